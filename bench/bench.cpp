@@ -0,0 +1,335 @@
+#include "bench.hpp"
+
+#include "alloc_guard.hpp"
+#include "client.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <utility>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+static uint64_t thread_cpu_ns() {
+	rusage usage = {};
+	getrusage(RUSAGE_THREAD, &usage);
+	const auto micros = [](const timeval& time) {
+		return static_cast<uint64_t>(time.tv_sec) * 1000000 + time.tv_usec;
+	};
+	return (micros(usage.ru_utime) + micros(usage.ru_stime)) * 1000;
+}
+
+void Samples::add(const uint64_t value) {
+	values.push_back(value);
+}
+
+void Samples::clear() {
+	values.clear();
+}
+
+size_t Samples::count() const {
+	return values.size();
+}
+
+void Samples::write_json(JsonWriter& json, const double unit_ns) const {
+	std::vector<uint64_t> sorted = values;
+	std::sort(sorted.begin(), sorted.end());
+
+	const auto percentile = [&sorted, unit_ns](const double rank) {
+		if (sorted.empty()) {
+			return 0.0;
+		}
+		const auto index = static_cast<size_t>(std::ceil(rank * static_cast<double>(sorted.size()))) - 1;
+		return std::round(static_cast<double>(sorted[std::min(index, sorted.size() - 1)]) / unit_ns * 100) / 100;
+	};
+
+	json.begin_object();
+	json.key("count").value(sorted.size());
+	json.key("p50").value(percentile(0.5));
+	json.key("p90").value(percentile(0.9));
+	json.key("p99").value(percentile(0.99));
+	json.key("max").value(percentile(1));
+	json.end_object();
+}
+
+/* Runs before the output's own frame handler, see the constructor */
+static void bench_output_frame_notify(wl_listener* listener, void* data) {
+	Bench& bench = magpie_container_of(listener, bench, output_frame);
+	(void) data;
+
+	bench.frame_started();
+}
+
+static void bench_output_commit_notify(wl_listener* listener, void* data) {
+	/* Runs inside the compositor's frame, but is the harness's bookkeeping */
+	MAGPIE_ALLOC_ALLOWED();
+	Bench& bench = magpie_container_of(listener, bench, output_commit);
+	(void) data;
+
+	bench.frame_committed();
+}
+
+Bench::Bench(Server& server, std::string socket, wlr_output& output) noexcept
+	: listeners(*this), server(server), socket(std::move(socket)), output(output) {
+	/* At the head of the list, so the frame is timed from before the scene
+	 * is rendered to after the output is committed */
+	listeners.output_frame.notify = bench_output_frame_notify;
+	wl_list_insert(&output.events.frame.listener_list, &listeners.output_frame.link);
+	listeners.output_commit.notify = bench_output_commit_notify;
+	wl_signal_add(&output.events.commit, &listeners.output_commit);
+}
+
+Bench::~Bench() noexcept {
+	for (const auto* client : clients) {
+		delete client;
+	}
+	wl_list_remove(&listeners.output_frame.link);
+	wl_list_remove(&listeners.output_commit.link);
+}
+
+void Bench::record(const std::string& operation, const uint64_t ns) {
+	const std::lock_guard lock(samples_mutex);
+	operations[operation].add(ns);
+}
+
+void Bench::window_created(const std::string& title, const uint64_t created_ns) {
+	const std::lock_guard lock(samples_mutex);
+	created_windows[title] = created_ns;
+}
+
+void Bench::frame_started() {
+	frame_start_ns = monotonic_ns();
+	frames_skipped++;
+}
+
+/* A frame with no damage never commits, so those stay counted as skipped */
+void Bench::frame_committed() {
+	if (frame_start_ns == 0) {
+		return;
+	}
+
+	const uint64_t now = monotonic_ns();
+	frame_times.add(now - frame_start_ns);
+	if (last_frame_ns != 0) {
+		frame_intervals.add(now - last_frame_ns);
+	}
+	last_frame_ns = now;
+	frame_start_ns = 0;
+	frames_skipped--;
+	frames_rendered++;
+}
+
+/* Views are matched to the windows that created them by title */
+void Bench::track_maps() {
+	const uint64_t now = monotonic_ns();
+	for (const auto* view : std::as_const(server.views)) {
+		if (!view->scene_node->enabled || mapped_views.contains(view->id)) {
+			continue;
+		}
+		mapped_views.insert(view->id);
+
+		const char* title = view->get_title();
+		const std::lock_guard lock(samples_mutex);
+		const auto created = created_windows.find(title != nullptr ? title : "");
+		if (created != created_windows.end()) {
+			operations["window_map"].add(now - created->second);
+		}
+	}
+}
+
+void Bench::dispatch(const int timeout_ms) {
+	wl_display_flush_clients(server.display);
+	wl_event_loop_dispatch(wl_display_get_event_loop(server.display), timeout_ms);
+	wl_display_flush_clients(server.display);
+
+	if (tracking_maps) {
+		track_maps();
+	}
+}
+
+bool Bench::run_until(const std::function<bool()>& done, const int timeout_ms) {
+	const uint64_t deadline = monotonic_ns() + static_cast<uint64_t>(timeout_ms) * 1000000;
+	while (!done()) {
+		if (monotonic_ns() >= deadline) {
+			return false;
+		}
+		dispatch(1);
+	}
+	return true;
+}
+
+void Bench::settle(const int ms) {
+	run_until(
+		[] {
+			return false;
+		},
+		ms);
+}
+
+void Bench::begin_scenario(const std::string& name, const bool maps) {
+	wlr_log(WLR_INFO, "Running scenario %s", name.c_str());
+	scenario = name;
+	tracking_maps = maps;
+	{
+		const std::lock_guard lock(samples_mutex);
+		operations.clear();
+	}
+	frame_times.clear();
+	frame_intervals.clear();
+	frame_start_ns = 0;
+	last_frame_ns = 0;
+	frames_rendered = 0;
+	frames_skipped = 0;
+
+	scenario_start_ns = monotonic_ns();
+	scenario_start_cpu_ns = thread_cpu_ns();
+}
+
+void Bench::end_scenario(const bool ok, const std::string& error) {
+	const uint64_t wall_ns = monotonic_ns() - scenario_start_ns;
+	const uint64_t cpu_ns = thread_cpu_ns() - scenario_start_cpu_ns;
+	tracking_maps = false;
+
+	report.begin_object();
+	report.key("name").value(scenario);
+	report.key("ok").value(ok);
+	if (!ok) {
+		report.key("error").value(error);
+	}
+	report.key("wall_ms").value(std::round(static_cast<double>(wall_ns) / 1e4) / 100);
+	/* The main thread only, the workers and clients are not the compositor's
+	 * critical path */
+	report.key("compositor_cpu_ms").value(std::round(static_cast<double>(cpu_ns) / 1e4) / 100);
+	report.key("frames_rendered").value(frames_rendered);
+	report.key("frames_skipped").value(frames_skipped);
+	report.key("frame_ms");
+	frame_times.write_json(report, 1e6);
+	/* Between committed frames, so the cadence clients see */
+	report.key("frame_interval_ms");
+	frame_intervals.write_json(report, 1e6);
+
+	report.key("operations_us").begin_object();
+	{
+		const std::lock_guard lock(samples_mutex);
+		for (const auto& [operation, samples] : operations) {
+			report.key(operation);
+			samples.write_json(report, 1e3);
+		}
+	}
+	report.end_object();
+	report.end_object();
+
+	wlr_log(WLR_INFO, "Scenario %s %s", scenario.c_str(), ok ? "finished" : error.c_str());
+}
+
+BenchOption BenchOption::counted(const char flag, uint32_t& count, const uint32_t max, const bool zero) {
+	return {flag, &count, max, zero, nullptr, nullptr};
+}
+
+BenchOption BenchOption::text(const char flag, std::string& string) {
+	return {flag, nullptr, 0, false, &string, nullptr};
+}
+
+BenchOption BenchOption::toggle(const char flag, bool& set) {
+	return {flag, nullptr, 0, false, nullptr, &set};
+}
+
+static bool parse_count(const char* arg, uint32_t& count, const uint32_t max, const bool zero) {
+	char* end = nullptr;
+	const unsigned long value = std::strtoul(arg, &end, 10);
+	if (end == arg || *end != '\0' || (value == 0 && !zero) || value > max) {
+		return false;
+	}
+	count = static_cast<uint32_t>(value);
+	return true;
+}
+
+bool bench_parse_options(const int argc, char** argv, const std::vector<BenchOption>& options, wlr_log_importance& level) {
+	std::string optstring;
+	for (const auto& option : options) {
+		optstring += option.flag;
+		if (option.set == nullptr) {
+			optstring += ':';
+		}
+	}
+	optstring += "vh";
+
+	level = WLR_ERROR;
+	int c;
+	while ((c = getopt(argc, argv, optstring.c_str())) != -1) {
+		if (c == 'v') {
+			level = level == WLR_ERROR ? WLR_INFO : WLR_DEBUG;
+			continue;
+		}
+
+		const auto option = std::find_if(options.begin(), options.end(), [c](const BenchOption& option) {
+			return option.flag == c;
+		});
+		if (option == options.end()) {
+			return false;
+		}
+		if (option->count != nullptr) {
+			if (!parse_count(optarg, *option->count, option->max, option->zero)) {
+				return false;
+			}
+		} else if (option->string != nullptr) {
+			*option->string = optarg;
+		} else {
+			*option->set = !*option->set;
+		}
+	}
+	return true;
+}
+
+bool bench_init(const wlr_log_importance level) {
+	if (getenv("XDG_RUNTIME_DIR") == nullptr) {
+		std::fprintf(stderr, "XDG_RUNTIME_DIR must be set\n");
+		return false;
+	}
+
+	/* Same as magpie-wm, see there */
+	sigset_t handled_signals;
+	sigemptyset(&handled_signals);
+	sigaddset(&handled_signals, SIGCHLD);
+	sigaddset(&handled_signals, SIGUSR1);
+	sigaddset(&handled_signals, SIGUSR2);
+	pthread_sigmask(SIG_BLOCK, &handled_signals, nullptr);
+
+	log_init(level);
+
+	/* Results must not depend on whoever runs it */
+	setenv("MAGPIE_CONFIG", "/dev/null", true);
+	return true;
+}
+
+Bench* bench_start(Server& server) {
+	const char* socket = wl_display_add_socket_auto(server.display);
+	if (socket == nullptr || !wlr_backend_start(server.backend)) {
+		wlr_log(WLR_ERROR, "Failed to start the headless backend");
+		log_finish();
+		return nullptr;
+	}
+
+	wlr_output* output = wlr_headless_add_output(server.backend, 1920, 1080);
+	return new Bench(server, socket, *output);
+}
+
+void bench_finish(Server& server, Bench* bench) {
+	delete bench;
+	wl_display_destroy_clients(server.display);
+	wl_display_destroy(server.display);
+	log_finish();
+}
@@ -0,0 +1,157 @@
+#ifndef MAGPIE_BENCH_HPP
+#define MAGPIE_BENCH_HPP
+
+#include "clock.hpp"
+#include "json.hpp"
+#include "types.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <wayland-server-core.h>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+class SyntheticClient;
+struct wlr_output;
+
+static constexpr int32_t BENCH_WINDOW_WIDTH = 320;
+static constexpr int32_t BENCH_WINDOW_HEIGHT = 240;
+/* For fixtures with hundreds of windows */
+static constexpr int32_t BENCH_SMALL_WINDOW_WIDTH = 160;
+static constexpr int32_t BENCH_SMALL_WINDOW_HEIGHT = 120;
+/* How long anything the clients are asked to do may take */
+static constexpr int BENCH_TIMEOUT_MS = 30000;
+/* Covers the deferred init after the first frame, which adds globals, and the
+ * keymap, which is compiled in the background */
+static constexpr int BENCH_SETTLE_MS = 500;
+
+/* Nanosecond samples, summarized as nearest-rank percentiles */
+class Samples {
+	std::vector<uint64_t> values;
+
+  public:
+	void add(uint64_t value);
+	void clear();
+	[[nodiscard]] size_t count() const;
+	void write_json(JsonWriter& json, double unit_ns) const;
+};
+
+/* Runs a headless Server on the calling thread and the scenarios against it.
+ * The event loop is only ever dispatched from here, so the compositor runs on
+ * the main thread as it does in magpie-wm, and the synthetic clients run on
+ * threads of their own. */
+class Bench {
+  public:
+	struct Listeners {
+		std::reference_wrapper<Bench> parent;
+		wl_listener output_frame = {};
+		wl_listener output_commit = {};
+		explicit Listeners(Bench& parent) noexcept : parent(parent) {}
+	};
+
+  private:
+	Listeners listeners;
+
+	std::mutex samples_mutex;
+	std::map<std::string, Samples> operations;
+	std::map<std::string, uint64_t> created_windows;
+	std::set<uint64_t> mapped_views;
+
+	Samples frame_times;
+	Samples frame_intervals;
+	uint64_t frame_start_ns = 0;
+	uint64_t last_frame_ns = 0;
+	uint64_t frames_rendered = 0;
+	uint64_t frames_skipped = 0;
+
+	std::string scenario;
+	uint64_t scenario_start_ns = 0;
+	uint64_t scenario_start_cpu_ns = 0;
+	bool tracking_maps = false;
+
+	void track_maps();
+
+  public:
+	Server& server;
+	const std::string socket;
+	wlr_output& output;
+	std::vector<SyntheticClient*> clients;
+	JsonWriter report;
+
+	Bench(Server& server, std::string socket, wlr_output& output) noexcept;
+	~Bench() noexcept;
+
+	/* Thread safe */
+	void record(const std::string& operation, uint64_t ns);
+	void window_created(const std::string& title, uint64_t created_ns);
+
+	void frame_started();
+	void frame_committed();
+
+	void dispatch(int timeout_ms);
+	bool run_until(const std::function<bool()>& done, int timeout_ms = BENCH_TIMEOUT_MS);
+	/* Runs the event loop for a while, for whatever the compositor does in
+	 * the background */
+	void settle(int ms = BENCH_SETTLE_MS);
+	void begin_scenario(const std::string& name, bool maps = false);
+	void end_scenario(bool ok, const std::string& error = {});
+};
+
+/* A command line option of a bench executable, a count from 1 (or 0) to max,
+ * a string, or a flag */
+struct BenchOption {
+	char flag;
+	uint32_t* count = nullptr;
+	uint32_t max = 0;
+	bool zero = false;
+	std::string* string = nullptr;
+	bool* set = nullptr;
+
+	static BenchOption counted(char flag, uint32_t& count, uint32_t max, bool zero = false);
+	static BenchOption text(char flag, std::string& string);
+	static BenchOption toggle(char flag, bool& set);
+};
+
+/* Parses options with getopt, along with -v, which raises the log level once
+ * per use. False on anything else, for the caller to print its usage. */
+bool bench_parse_options(int argc, char** argv, const std::vector<BenchOption>& options, wlr_log_importance& level);
+/* Checks the environment, blocks the signals magpie-wm blocks and starts
+ * logging, before the Server is created. False if the bench cannot run. */
+bool bench_init(wlr_log_importance level);
+/* Starts the Server's headless backend with a 1920x1080 output and the Bench
+ * on it. On failure logging is stopped and nullptr returned. */
+Bench* bench_start(Server& server);
+/* Destroys the Bench, the clients and the Server's display, and stops logging */
+void bench_finish(Server& server, Bench* bench);
+
+using Scenario = bool (*)(Bench& bench, std::string& error);
+
+struct BenchOptions {
+	uint32_t clients = 4;
+	uint32_t windows = 500;
+	uint32_t iterations = 500;
+	/* Virtual frames in the frames scenario */
+	uint32_t frames = 10000;
+	/* An input recording for the replay scenario */
+	std::string replay;
+};
+
+extern BenchOptions bench_options;
+
+bool scenario_windows(Bench& bench, std::string& error);
+bool scenario_focus(Bench& bench, std::string& error);
+bool scenario_move(Bench& bench, std::string& error);
+bool scenario_resize(Bench& bench, std::string& error);
+bool scenario_popups(Bench& bench, std::string& error);
+bool scenario_frames(Bench& bench, std::string& error);
+bool scenario_replay(Bench& bench, std::string& error);
+
+#endif
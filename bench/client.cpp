@@ -0,0 +1,640 @@
+#include "client.hpp"
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+#include <wayland-client.h>
+#include "pointer-constraints-unstable-v1-client-protocol.h"
+#include "wlr-layer-shell-unstable-v1-client-protocol.h"
+#include "xdg-shell-client-protocol.h"
+
+/* Opaque, so the compositor can skip everything below */
+static constexpr uint32_t SYNTHETIC_PIXEL = 0xff3366cc;
+/* Thickness of the panels along each edge, and the zone they reserve */
+static constexpr int32_t SYNTHETIC_LAYER_SIZE = 8;
+
+static void registry_global(void* data, wl_registry* registry, const uint32_t name, const char* interface,
+	const uint32_t version) {
+	auto& client = *static_cast<SyntheticClient*>(data);
+
+	if (strcmp(interface, wl_compositor_interface.name) == 0) {
+		client.compositor = static_cast<wl_compositor*>(
+			wl_registry_bind(registry, name, &wl_compositor_interface, std::min(version, 4U)));
+	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
+		client.shm = static_cast<wl_shm*>(wl_registry_bind(registry, name, &wl_shm_interface, 1));
+	} else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+		client.wm_base = static_cast<xdg_wm_base*>(
+			wl_registry_bind(registry, name, &xdg_wm_base_interface, std::min(version, 2U)));
+	} else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+		client.subcompositor =
+			static_cast<wl_subcompositor*>(wl_registry_bind(registry, name, &wl_subcompositor_interface, 1));
+	} else if (strcmp(interface, wl_seat_interface.name) == 0 && client.seat == nullptr) {
+		client.seat = static_cast<wl_seat*>(wl_registry_bind(registry, name, &wl_seat_interface, std::min(version, 5U)));
+	} else if (strcmp(interface, zwp_pointer_constraints_v1_interface.name) == 0) {
+		client.pointer_constraints = static_cast<zwp_pointer_constraints_v1*>(
+			wl_registry_bind(registry, name, &zwp_pointer_constraints_v1_interface, 1));
+	} else if (strcmp(interface, zwlr_layer_shell_v1_interface.name) == 0) {
+		client.layer_shell = static_cast<zwlr_layer_shell_v1*>(
+			wl_registry_bind(registry, name, &zwlr_layer_shell_v1_interface, std::min(version, 4U)));
+	}
+}
+
+static void registry_global_remove(void* data, wl_registry* registry, const uint32_t name) {
+	(void) data;
+	(void) registry;
+	(void) name;
+}
+
+static constexpr wl_registry_listener registry_listener = {registry_global, registry_global_remove};
+
+static void wm_base_ping(void* data, xdg_wm_base* wm_base, const uint32_t serial) {
+	(void) data;
+
+	xdg_wm_base_pong(wm_base, serial);
+}
+
+static constexpr xdg_wm_base_listener wm_base_listener = {wm_base_ping};
+
+static void buffer_release(void* data, wl_buffer* wl_buffer) {
+	auto& buffer = *static_cast<SyntheticBuffer*>(data);
+	(void) wl_buffer;
+
+	buffer.busy = false;
+	if (buffer.retired) {
+		wl_buffer_destroy(buffer.wlr);
+		delete &buffer;
+	}
+}
+
+static constexpr wl_buffer_listener buffer_listener = {buffer_release};
+
+static void window_xdg_surface_configure(void* data, xdg_surface* xdg_surface, const uint32_t serial) {
+	auto& window = *static_cast<SyntheticWindow*>(data);
+	(void) xdg_surface;
+
+	window.client.window_configured(window, serial);
+}
+
+static constexpr xdg_surface_listener window_xdg_surface_listener = {window_xdg_surface_configure};
+
+static void toplevel_configure(
+	void* data, xdg_toplevel* toplevel, const int32_t width, const int32_t height, wl_array* states) {
+	auto& window = *static_cast<SyntheticWindow*>(data);
+	(void) toplevel;
+	(void) states;
+
+	window.configure_width = width;
+	window.configure_height = height;
+}
+
+static void toplevel_close(void* data, xdg_toplevel* toplevel) {
+	(void) data;
+	(void) toplevel;
+}
+
+static constexpr xdg_toplevel_listener toplevel_listener = {toplevel_configure, toplevel_close};
+
+static void window_frame_done(void* data, wl_callback* callback, const uint32_t time_msec) {
+	auto& window = *static_cast<SyntheticWindow*>(data);
+
+	wl_callback_destroy(callback);
+	window.frame_callback = nullptr;
+	window.client.window_frame(window, time_msec);
+}
+
+static constexpr wl_callback_listener window_frame_listener = {window_frame_done};
+
+static void window_frame_sync_done(void* data, wl_callback* callback, const uint32_t serial) {
+	auto& window = *static_cast<SyntheticWindow*>(data);
+	(void) serial;
+
+	wl_callback_destroy(callback);
+	window.frame_sync = nullptr;
+	window.client.frames_answered++;
+}
+
+static constexpr wl_callback_listener window_frame_sync_listener = {window_frame_sync_done};
+
+static void popup_xdg_surface_configure(void* data, xdg_surface* xdg_surface, const uint32_t serial) {
+	auto& popup = *static_cast<SyntheticPopup*>(data);
+	(void) xdg_surface;
+
+	popup.client.popup_configured(popup, serial);
+}
+
+static constexpr xdg_surface_listener popup_xdg_surface_listener = {popup_xdg_surface_configure};
+
+static void popup_configure(void* data, xdg_popup* popup, const int32_t x, const int32_t y, const int32_t width,
+	const int32_t height) {
+	(void) data;
+	(void) popup;
+	(void) x;
+	(void) y;
+	(void) width;
+	(void) height;
+}
+
+static void popup_done(void* data, xdg_popup* popup) {
+	(void) data;
+	(void) popup;
+}
+
+static constexpr xdg_popup_listener popup_listener = {popup_configure, popup_done};
+
+static void layer_surface_configure(void* data, zwlr_layer_surface_v1* layer_surface, const uint32_t serial,
+	const uint32_t width, const uint32_t height) {
+	auto& layer = *static_cast<SyntheticLayer*>(data);
+	(void) layer_surface;
+
+	layer.client.layer_configured(layer, serial, static_cast<int32_t>(width), static_cast<int32_t>(height));
+}
+
+static void layer_surface_closed(void* data, zwlr_layer_surface_v1* layer_surface) {
+	(void) data;
+	(void) layer_surface;
+}
+
+static constexpr zwlr_layer_surface_v1_listener layer_surface_listener = {layer_surface_configure, layer_surface_closed};
+
+SyntheticClient::SyntheticClient(Bench& bench, std::string socket, const uint32_t index) noexcept
+	: bench(bench), socket(std::move(socket)), index(index) {
+	event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	thread = std::thread(&SyntheticClient::run, this);
+}
+
+SyntheticClient::~SyntheticClient() noexcept {
+	stopping = true;
+	const uint64_t one = 1;
+	(void) !write(event_fd, &one, sizeof(one));
+	thread.join();
+	close(event_fd);
+}
+
+void SyntheticClient::post(std::function<void()> work) {
+	{
+		const std::lock_guard lock(posted_mutex);
+		posted.push_back(std::move(work));
+	}
+	const uint64_t one = 1;
+	(void) !write(event_fd, &one, sizeof(one));
+}
+
+std::vector<uint32_t> SyntheticClient::take_frame_times() {
+	const std::lock_guard lock(frame_times_mutex);
+	return std::exchange(frame_times, {});
+}
+
+void SyntheticClient::run_posted() {
+	uint64_t count = 0;
+	(void) !read(event_fd, &count, sizeof(count));
+
+	std::vector<std::function<void()>> work;
+	{
+		const std::lock_guard lock(posted_mutex);
+		work.swap(posted);
+	}
+	for (auto& item : work) {
+		item();
+	}
+}
+
+void SyntheticClient::run() {
+	display = wl_display_connect(socket.c_str());
+	if (display == nullptr) {
+		failed = true;
+		ready = true;
+		return;
+	}
+
+	registry = wl_display_get_registry(display);
+	wl_registry_add_listener(registry, &registry_listener, this);
+	if (wl_display_roundtrip(display) < 0 || compositor == nullptr || shm == nullptr || wm_base == nullptr) {
+		failed = true;
+		ready = true;
+		wl_display_disconnect(display);
+		return;
+	}
+	xdg_wm_base_add_listener(wm_base, &wm_base_listener, this);
+	ready = true;
+
+	pollfd fds[2] = {{wl_display_get_fd(display), POLLIN, 0}, {event_fd, POLLIN, 0}};
+	while (!stopping) {
+		while (wl_display_prepare_read(display) != 0) {
+			wl_display_dispatch_pending(display);
+		}
+
+		/* A full socket is retried once the compositor has read some */
+		fds[0].events = POLLIN;
+		if (wl_display_flush(display) < 0) {
+			if (errno != EAGAIN) {
+				wl_display_cancel_read(display);
+				failed = true;
+				break;
+			}
+			fds[0].events |= POLLOUT;
+		}
+
+		if (poll(fds, 2, -1) < 0) {
+			wl_display_cancel_read(display);
+			if (errno == EINTR) {
+				continue;
+			}
+			failed = true;
+			break;
+		}
+
+		if ((fds[0].revents & POLLIN) != 0) {
+			if (wl_display_read_events(display) < 0) {
+				failed = true;
+				break;
+			}
+		} else {
+			wl_display_cancel_read(display);
+		}
+		if ((fds[0].revents & (POLLERR | POLLHUP)) != 0) {
+			failed = true;
+			break;
+		}
+
+		wl_display_dispatch_pending(display);
+		if ((fds[1].revents & POLLIN) != 0) {
+			run_posted();
+		}
+	}
+
+	destroy_all();
+	wl_display_disconnect(display);
+}
+
+void SyntheticClient::destroy_all() {
+	if (popup != nullptr) {
+		xdg_popup_destroy(popup->popup);
+		xdg_surface_destroy(popup->xdg);
+		wl_surface_destroy(popup->surface);
+		delete popup;
+		popup = nullptr;
+	}
+
+	for (auto* layer : layers) {
+		zwlr_layer_surface_v1_destroy(layer->layer_surface);
+		wl_surface_destroy(layer->surface);
+		if (layer->buffer != nullptr) {
+			wl_buffer_destroy(layer->buffer->wlr);
+			delete layer->buffer;
+		}
+		delete layer;
+	}
+	layers.clear();
+
+	for (auto* window : windows) {
+		if (window->confined_pointer != nullptr) {
+			zwp_confined_pointer_v1_destroy(window->confined_pointer);
+		}
+		if (window->frame_callback != nullptr) {
+			wl_callback_destroy(window->frame_callback);
+		}
+		if (window->frame_sync != nullptr) {
+			wl_callback_destroy(window->frame_sync);
+		}
+		/* Innermost first */
+		for (auto it = window->subsurfaces.rbegin(); it != window->subsurfaces.rend(); ++it) {
+			wl_subsurface_destroy(it->subsurface);
+			wl_surface_destroy(it->surface);
+			if (it->buffer != nullptr) {
+				wl_buffer_destroy(it->buffer->wlr);
+				delete it->buffer;
+			}
+		}
+		xdg_toplevel_destroy(window->toplevel);
+		xdg_surface_destroy(window->xdg);
+		wl_surface_destroy(window->surface);
+		if (window->buffer != nullptr) {
+			wl_buffer_destroy(window->buffer->wlr);
+			delete window->buffer;
+		}
+		delete window;
+	}
+	windows.clear();
+
+	if (pointer != nullptr) {
+		wl_pointer_destroy(pointer);
+		pointer = nullptr;
+	}
+}
+
+/* Each buffer gets its own memfd, a single pool would have to be resized
+ * under the compositor whenever a resize outgrew it. */
+SyntheticBuffer* SyntheticClient::create_buffer(const int32_t width, const int32_t height) {
+	const int32_t stride = width * 4;
+	const size_t size = static_cast<size_t>(stride) * height;
+
+	const int fd = memfd_create("magpie-bench", MFD_CLOEXEC);
+	if (fd < 0 || ftruncate(fd, static_cast<off_t>(size)) < 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return nullptr;
+	}
+
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data != MAP_FAILED) {
+		std::fill_n(static_cast<uint32_t*>(data), size / 4, SYNTHETIC_PIXEL);
+		munmap(data, size);
+	}
+
+	wl_shm_pool* pool = wl_shm_create_pool(shm, fd, static_cast<int32_t>(size));
+	auto* buffer = new SyntheticBuffer{
+		wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_ARGB8888), width, height};
+	wl_buffer_add_listener(buffer->wlr, &buffer_listener, buffer);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+
+	return buffer;
+}
+
+void SyntheticClient::release_buffer(SyntheticBuffer* buffer) {
+	if (buffer == nullptr) {
+		return;
+	}
+
+	if (buffer->busy) {
+		buffer->retired = true;
+	} else {
+		wl_buffer_destroy(buffer->wlr);
+		delete buffer;
+	}
+}
+
+void SyntheticClient::create_windows(const uint32_t count, const int32_t width, const int32_t height, const uint32_t depth) {
+	for (uint32_t i = 0; i < count; i++) {
+		auto* window = new SyntheticWindow{*this, "bench " + std::to_string(index) + " " + std::to_string(windows.size())};
+		window->depth = subcompositor != nullptr ? depth : 0;
+		window->width = width;
+		window->height = height;
+		window->created_ns = monotonic_ns();
+
+		window->surface = wl_compositor_create_surface(compositor);
+		window->xdg = xdg_wm_base_get_xdg_surface(wm_base, window->surface);
+		xdg_surface_add_listener(window->xdg, &window_xdg_surface_listener, window);
+		window->toplevel = xdg_surface_get_toplevel(window->xdg);
+		xdg_toplevel_add_listener(window->toplevel, &toplevel_listener, window);
+		xdg_toplevel_set_title(window->toplevel, window->title.c_str());
+		xdg_toplevel_set_app_id(window->toplevel, "magpie-bench");
+		bench.window_created(window->title, window->created_ns);
+
+		/* The initial commit asks for the first configure */
+		wl_surface_commit(window->surface);
+		windows.push_back(window);
+	}
+}
+
+/* Acks and answers with a buffer of the configured size, as a client that
+ * renders instantly would. */
+void SyntheticClient::window_configured(SyntheticWindow& window, const uint32_t serial) {
+	if (!window.configured) {
+		window.configured = true;
+		bench.record("window_configure", monotonic_ns() - window.created_ns);
+		windows_configured++;
+	}
+
+	if (window.configure_width > 0 && window.configure_height > 0) {
+		window.width = window.configure_width;
+		window.height = window.configure_height;
+	}
+
+	xdg_surface_ack_configure(window.xdg, serial);
+	if (window.buffer == nullptr || window.buffer->width != window.width || window.buffer->height != window.height) {
+		SyntheticBuffer* buffer = create_buffer(window.width, window.height);
+		if (buffer == nullptr) {
+			failed = true;
+			return;
+		}
+		release_buffer(window.buffer);
+		window.buffer = buffer;
+	}
+
+	wl_surface_attach(window.surface, window.buffer->wlr, 0, 0);
+	wl_surface_damage(window.surface, 0, 0, window.width, window.height);
+	window.buffer->busy = true;
+	if (window.subsurfaces.size() < window.depth) {
+		create_subsurfaces(window);
+	}
+	wl_surface_commit(window.surface);
+}
+
+/* Redraws the first window for each of the next frames, as an animating
+ * client would. Each frame is followed by a roundtrip, so once frames_answered
+ * counts it the compositor has seen the answer and the next frame can come. */
+void SyntheticClient::animate(const uint32_t frames) {
+	if (windows.empty() || windows.front()->buffer == nullptr) {
+		failed = true;
+		return;
+	}
+
+	frames_left = frames;
+	draw_frame(*windows.front());
+}
+
+void SyntheticClient::draw_frame(SyntheticWindow& window) {
+	if (frames_left > 0) {
+		wl_surface_attach(window.surface, window.buffer->wlr, 0, 0);
+		wl_surface_damage(window.surface, 0, 0, window.width, window.height);
+		window.buffer->busy = true;
+		window.frame_callback = wl_surface_frame(window.surface);
+		wl_callback_add_listener(window.frame_callback, &window_frame_listener, &window);
+		wl_surface_commit(window.surface);
+	}
+
+	window.frame_sync = wl_display_sync(display);
+	wl_callback_add_listener(window.frame_sync, &window_frame_sync_listener, &window);
+}
+
+void SyntheticClient::window_frame(SyntheticWindow& window, const uint32_t time_msec) {
+	{
+		const std::lock_guard lock(frame_times_mutex);
+		frame_times.push_back(time_msec);
+	}
+	frames_left--;
+	draw_frame(window);
+}
+
+/* A chain of synchronized subsurfaces, each inset from its parent. Their
+ * state is cached until the window itself commits, so they map with it. */
+void SyntheticClient::create_subsurfaces(SyntheticWindow& window) {
+	wl_surface* parent = window.surface;
+	for (uint32_t level = 1; level <= window.depth; level++) {
+		const auto inset = static_cast<int32_t>(level) * 4;
+		SyntheticSubsurface subsurface;
+		subsurface.surface = wl_compositor_create_surface(compositor);
+		subsurface.subsurface = wl_subcompositor_get_subsurface(subcompositor, subsurface.surface, parent);
+		wl_subsurface_set_position(subsurface.subsurface, 4, 4);
+
+		const int32_t width = std::max(window.width - 2 * inset, 8);
+		const int32_t height = std::max(window.height - 2 * inset, 8);
+		subsurface.buffer = create_buffer(width, height);
+		if (subsurface.buffer != nullptr) {
+			wl_surface_attach(subsurface.surface, subsurface.buffer->wlr, 0, 0);
+			wl_surface_damage(subsurface.surface, 0, 0, width, height);
+		}
+		wl_surface_commit(subsurface.surface);
+
+		parent = subsurface.surface;
+		window.subsurfaces.push_back(subsurface);
+	}
+}
+
+/* Panels along the edges of the output, going around it in turn, each one
+ * reserving an exclusive zone. */
+void SyntheticClient::create_layers(const uint32_t count) {
+	if (layer_shell == nullptr) {
+		failed = true;
+		return;
+	}
+
+	static constexpr uint32_t edges[] = {
+		ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP,
+		ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM,
+		ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT,
+		ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+	};
+
+	for (uint32_t i = 0; i < count; i++) {
+		auto* layer = new SyntheticLayer{*this};
+		layer->surface = wl_compositor_create_surface(compositor);
+		layer->layer_surface = zwlr_layer_shell_v1_get_layer_surface(
+			layer_shell, layer->surface, nullptr, ZWLR_LAYER_SHELL_V1_LAYER_TOP, "magpie-bench");
+		zwlr_layer_surface_v1_add_listener(layer->layer_surface, &layer_surface_listener, layer);
+
+		const uint32_t edge = edges[i % std::size(edges)];
+		const bool horizontal = edge == ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP || edge == ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM;
+		if (horizontal) {
+			zwlr_layer_surface_v1_set_anchor(layer->layer_surface,
+				edge | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+			zwlr_layer_surface_v1_set_size(layer->layer_surface, 0, SYNTHETIC_LAYER_SIZE);
+		} else {
+			zwlr_layer_surface_v1_set_anchor(layer->layer_surface,
+				edge | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM);
+			zwlr_layer_surface_v1_set_size(layer->layer_surface, SYNTHETIC_LAYER_SIZE, 0);
+		}
+		zwlr_layer_surface_v1_set_exclusive_zone(layer->layer_surface, SYNTHETIC_LAYER_SIZE);
+
+		wl_surface_commit(layer->surface);
+		layers.push_back(layer);
+	}
+}
+
+void SyntheticClient::layer_configured(SyntheticLayer& layer, const uint32_t serial, const int32_t width,
+	const int32_t height) {
+	zwlr_layer_surface_v1_ack_configure(layer.layer_surface, serial);
+
+	if (width > 0 && height > 0 &&
+		(layer.buffer == nullptr || layer.buffer->width != width || layer.buffer->height != height)) {
+		SyntheticBuffer* buffer = create_buffer(width, height);
+		if (buffer == nullptr) {
+			failed = true;
+			return;
+		}
+		release_buffer(layer.buffer);
+		layer.buffer = buffer;
+		wl_surface_attach(layer.surface, layer.buffer->wlr, 0, 0);
+		wl_surface_damage(layer.surface, 0, 0, width, height);
+		layer.buffer->busy = true;
+	}
+	wl_surface_commit(layer.surface);
+
+	if (!layer.configured) {
+		layer.configured = true;
+		layers_configured++;
+	}
+}
+
+/* Confines the pointer to a staircase of rectangles on the first window, so
+ * confining a motion has to go through all of them. */
+void SyntheticClient::confine_pointer(const uint32_t rects) {
+	if (windows.empty() || seat == nullptr || pointer_constraints == nullptr) {
+		failed = true;
+		return;
+	}
+
+	SyntheticWindow& window = *windows.front();
+	if (pointer == nullptr) {
+		pointer = wl_seat_get_pointer(seat);
+	}
+
+	const int32_t step = std::max(std::min(window.width, window.height) / static_cast<int32_t>(rects + 1), 1);
+	wl_region* region = wl_compositor_create_region(compositor);
+	for (uint32_t i = 0; i < rects; i++) {
+		const auto offset = static_cast<int32_t>(i) * step;
+		wl_region_add(region, offset, offset, step * 2, step * 2);
+	}
+
+	window.confined_pointer = zwp_pointer_constraints_v1_confine_pointer(
+		pointer_constraints, window.surface, pointer, region, ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT);
+	wl_region_destroy(region);
+	/* The region is double buffered */
+	wl_surface_commit(window.surface);
+	pointer_confined = true;
+}
+
+/* Opens popups one after the other on the first window, each one closed as
+ * soon as it is configured, so the next one can start. */
+void SyntheticClient::popup_storm(const uint32_t count) {
+	popups_left = count;
+	start_popup();
+}
+
+void SyntheticClient::start_popup() {
+	if (popups_left == 0 || windows.empty()) {
+		return;
+	}
+	popups_left--;
+
+	const SyntheticWindow& parent = *windows.front();
+	popup = new SyntheticPopup{*this};
+	popup->created_ns = monotonic_ns();
+
+	xdg_positioner* positioner = xdg_wm_base_create_positioner(wm_base);
+	xdg_positioner_set_size(positioner, 120, 160);
+	xdg_positioner_set_anchor_rect(positioner, parent.width / 4, parent.height / 4, 1, 1);
+	xdg_positioner_set_anchor(positioner, XDG_POSITIONER_ANCHOR_BOTTOM_RIGHT);
+	xdg_positioner_set_gravity(positioner, XDG_POSITIONER_GRAVITY_BOTTOM_RIGHT);
+
+	popup->surface = wl_compositor_create_surface(compositor);
+	popup->xdg = xdg_wm_base_get_xdg_surface(wm_base, popup->surface);
+	xdg_surface_add_listener(popup->xdg, &popup_xdg_surface_listener, popup);
+	popup->popup = xdg_surface_get_popup(popup->xdg, parent.xdg, positioner);
+	xdg_popup_add_listener(popup->popup, &popup_listener, popup);
+	xdg_positioner_destroy(positioner);
+
+	wl_surface_commit(popup->surface);
+}
+
+void SyntheticClient::popup_configured(SyntheticPopup& configured, const uint32_t serial) {
+	bench.record("popup_configure", monotonic_ns() - configured.created_ns);
+
+	xdg_surface_ack_configure(configured.xdg, serial);
+	configured.buffer = create_buffer(120, 160);
+	if (configured.buffer != nullptr) {
+		wl_surface_attach(configured.surface, configured.buffer->wlr, 0, 0);
+		configured.buffer->busy = true;
+	}
+	wl_surface_commit(configured.surface);
+
+	xdg_popup_destroy(configured.popup);
+	xdg_surface_destroy(configured.xdg);
+	wl_surface_destroy(configured.surface);
+	release_buffer(configured.buffer);
+	delete &configured;
+	popup = nullptr;
+
+	popups_done++;
+	start_popup();
+}
@@ -0,0 +1,161 @@
+#ifndef MAGPIE_BENCH_CLIENT_HPP
+#define MAGPIE_BENCH_CLIENT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Bench;
+class SyntheticClient;
+
+struct wl_buffer;
+struct wl_callback;
+struct wl_compositor;
+struct wl_display;
+struct wl_pointer;
+struct wl_registry;
+struct wl_seat;
+struct wl_shm;
+struct wl_subcompositor;
+struct wl_subsurface;
+struct wl_surface;
+struct xdg_popup;
+struct xdg_surface;
+struct xdg_toplevel;
+struct xdg_wm_base;
+struct zwlr_layer_shell_v1;
+struct zwlr_layer_surface_v1;
+struct zwp_confined_pointer_v1;
+struct zwp_pointer_constraints_v1;
+
+/* Buffers are only destroyed once the compositor has let go of them */
+struct SyntheticBuffer {
+	wl_buffer* wlr;
+	int32_t width = 0;
+	int32_t height = 0;
+	bool busy = false;
+	bool retired = false;
+};
+
+/* Nested below its parent, each one smaller than the one above */
+struct SyntheticSubsurface {
+	wl_surface* surface = nullptr;
+	wl_subsurface* subsurface = nullptr;
+	SyntheticBuffer* buffer = nullptr;
+};
+
+struct SyntheticWindow {
+	SyntheticClient& client;
+	std::string title;
+	uint32_t depth = 0;
+	wl_surface* surface = nullptr;
+	xdg_surface* xdg = nullptr;
+	xdg_toplevel* toplevel = nullptr;
+	SyntheticBuffer* buffer = nullptr;
+	int32_t width = 0;
+	int32_t height = 0;
+	/* Size from the last toplevel configure, 0 to pick our own */
+	int32_t configure_width = 0;
+	int32_t configure_height = 0;
+	bool configured = false;
+	uint64_t created_ns = 0;
+	std::vector<SyntheticSubsurface> subsurfaces = {};
+	zwp_confined_pointer_v1* confined_pointer = nullptr;
+	wl_callback* frame_callback = nullptr;
+	wl_callback* frame_sync = nullptr;
+};
+
+struct SyntheticPopup {
+	SyntheticClient& client;
+	wl_surface* surface = nullptr;
+	xdg_surface* xdg = nullptr;
+	xdg_popup* popup = nullptr;
+	SyntheticBuffer* buffer = nullptr;
+	uint64_t created_ns = 0;
+};
+
+struct SyntheticLayer {
+	SyntheticClient& client;
+	wl_surface* surface = nullptr;
+	zwlr_layer_surface_v1* layer_surface = nullptr;
+	SyntheticBuffer* buffer = nullptr;
+	bool configured = false;
+};
+
+/* An xdg-shell client with a connection and a thread of its own, so clients
+ * talk to the compositor concurrently like separate processes would, without
+ * needing any. Work is handed to the client thread with post(), and all
+ * Wayland objects are only touched there. The main thread only reads the
+ * counters. */
+class SyntheticClient {
+	std::thread thread;
+	int event_fd;
+	std::mutex posted_mutex;
+	std::vector<std::function<void()>> posted;
+	std::atomic<bool> stopping = false;
+
+	std::vector<SyntheticWindow*> windows;
+	std::vector<SyntheticLayer*> layers;
+	SyntheticPopup* popup = nullptr;
+	uint32_t popups_left = 0;
+	uint32_t frames_left = 0;
+	std::mutex frame_times_mutex;
+	std::vector<uint32_t> frame_times;
+
+	void run();
+	void run_posted();
+	void destroy_all();
+	void start_popup();
+	void create_subsurfaces(SyntheticWindow& window);
+	void draw_frame(SyntheticWindow& window);
+
+  public:
+	Bench& bench;
+	const std::string socket;
+	const uint32_t index;
+
+	wl_display* display = nullptr;
+	wl_registry* registry = nullptr;
+	wl_compositor* compositor = nullptr;
+	wl_shm* shm = nullptr;
+	xdg_wm_base* wm_base = nullptr;
+	/* Optional, only some benchmarks need these */
+	wl_subcompositor* subcompositor = nullptr;
+	wl_seat* seat = nullptr;
+	wl_pointer* pointer = nullptr;
+	zwp_pointer_constraints_v1* pointer_constraints = nullptr;
+	zwlr_layer_shell_v1* layer_shell = nullptr;
+
+	std::atomic<bool> ready = false;
+	std::atomic<bool> failed = false;
+	std::atomic<uint32_t> windows_configured = 0;
+	std::atomic<uint32_t> popups_done = 0;
+	std::atomic<uint32_t> layers_configured = 0;
+	std::atomic<bool> pointer_confined = false;
+	std::atomic<uint32_t> frames_answered = 0;
+
+	SyntheticClient(Bench& bench, std::string socket, uint32_t index) noexcept;
+	~SyntheticClient() noexcept;
+
+	void post(std::function<void()> work);
+	std::vector<uint32_t> take_frame_times();
+
+	/* Only on the client thread */
+	void create_windows(uint32_t count, int32_t width, int32_t height, uint32_t depth = 0);
+	void create_layers(uint32_t count);
+	void confine_pointer(uint32_t rects);
+	void popup_storm(uint32_t count);
+	void animate(uint32_t frames);
+	SyntheticBuffer* create_buffer(int32_t width, int32_t height);
+	void release_buffer(SyntheticBuffer* buffer);
+	void window_configured(SyntheticWindow& window, uint32_t serial);
+	void window_frame(SyntheticWindow& window, uint32_t time_msec);
+	void popup_configured(SyntheticPopup& popup, uint32_t serial);
+	void layer_configured(SyntheticLayer& layer, uint32_t serial, int32_t width, int32_t height);
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include "bench.hpp"
+
+#include "alloc_guard.hpp"
+#include "client.hpp"
+#include "input/seat.hpp"
+#include "output.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+
+#include <cstdio>
+#include <iterator>
+#include <linux/input-event-codes.h>
+#include <string>
+#include <unistd.h>
+#include <utility>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* Drives pointer motion, keys and frames through the headless backend, and
+ * fails if the compositor allocated inside any of the hot paths they run
+ * through. Each phase runs a few times first, uncounted, so the first enter,
+ * the cursor image and whatever else is set up once is out of the way. */
+
+static constexpr uint32_t HOT_PATHS_WARMUP = 64;
+/* Lets the clients read what they were sent, so their sockets never fill */
+static constexpr uint32_t HOT_PATHS_BATCH = 64;
+
+struct HotPathsOptions {
+	uint32_t windows = 16;
+	uint32_t events = 10000;
+	uint32_t frames = 10000;
+	bool trap = false;
+};
+
+static HotPathsOptions options;
+
+static constexpr wlr_pointer_impl hot_paths_pointer_impl = {"magpie-hot-paths"};
+static constexpr wlr_keyboard_impl hot_paths_keyboard_impl = {"magpie-hot-paths", nullptr};
+
+/* Keys without a binding, with shift now and then for the modifiers */
+static constexpr uint32_t hot_paths_keys[] = {KEY_Q, KEY_W, KEY_E, KEY_R, KEY_T, KEY_LEFTSHIFT, KEY_Y, KEY_U};
+
+struct HotPathsDevices {
+	wlr_pointer pointer = {};
+	wlr_keyboard keyboard = {};
+};
+
+static uint32_t now_msec() {
+	return static_cast<uint32_t>(monotonic_ns() / 1000000);
+}
+
+/* Back and forth across the output, over the windows and the gaps between
+ * them */
+static bool drive_pointer(Bench& bench, HotPathsDevices& devices, const uint32_t events, std::string& error) {
+	(void) error;
+	wlr_pointer* pointer = &devices.pointer;
+	for (uint32_t i = 0; i < events; i++) {
+		const double dx = (i / 256) % 2 == 0 ? 7 : -7;
+		const double dy = (i / 64) % 2 == 0 ? 3 : -3;
+		wlr_pointer_motion_event event = {pointer, now_msec(), dx, dy, dx, dy};
+		wl_signal_emit_mutable(&pointer->events.motion, &event);
+		wl_signal_emit_mutable(&pointer->events.frame, pointer);
+		if (i % HOT_PATHS_BATCH == 0) {
+			bench.dispatch(0);
+		}
+	}
+	return true;
+}
+
+static bool drive_keys(Bench& bench, HotPathsDevices& devices, const uint32_t events, std::string& error) {
+	(void) error;
+	for (uint32_t i = 0; i < events; i++) {
+		const uint32_t key = hot_paths_keys[(i / 2) % std::size(hot_paths_keys)];
+		const auto state = i % 2 == 0 ? WL_KEYBOARD_KEY_STATE_PRESSED : WL_KEYBOARD_KEY_STATE_RELEASED;
+		wlr_keyboard_key_event event = {now_msec(), key, true, state};
+		wlr_keyboard_notify_key(&devices.keyboard, &event);
+		if (i % HOT_PATHS_BATCH == 0) {
+			bench.dispatch(0);
+		}
+	}
+	return true;
+}
+
+/* On virtual time, with the topmost window drawing a new frame on every
+ * frame done, so each one renders */
+static bool drive_frames(Bench& bench, HotPathsDevices& devices, const uint32_t frames, std::string& error) {
+	(void) devices;
+	SyntheticClient& client = *bench.clients.front();
+	const uint64_t interval_ns = (*bench.server.outputs.begin())->frame_interval_ns();
+
+	bench.server.use_virtual_clock(monotonic_ns());
+	uint32_t answered = client.frames_answered.load() + 1;
+	client.post([&client, frames] {
+		client.animate(frames);
+	});
+	const auto frame_answered = [&client, &answered] {
+		return client.frames_answered.load() >= answered || client.failed.load();
+	};
+
+	bool ok = bench.run_until(frame_answered, BENCH_TIMEOUT_MS);
+	for (uint32_t i = 0; ok && i < frames; i++) {
+		bench.server.advance_clock(interval_ns);
+		answered++;
+		ok = bench.run_until(frame_answered, BENCH_TIMEOUT_MS);
+	}
+	bench.server.use_real_clock();
+	(void) client.take_frame_times();
+
+	if (!ok || client.failed) {
+		error = "timed out waiting for the window to answer a frame";
+		return false;
+	}
+	return true;
+}
+
+using HotPathsPhase = bool (*)(Bench& bench, HotPathsDevices& devices, uint32_t count, std::string& error);
+
+static bool run_phase(Bench& bench, HotPathsDevices& devices, const char* name, const HotPathsPhase phase,
+	const uint32_t count, std::string& error) {
+	wlr_log(WLR_INFO, "Running phase %s", name);
+	std::string phase_error;
+	bool ok = phase(bench, devices, HOT_PATHS_WARMUP, phase_error);
+	alloc_guard_reset();
+	ok = ok && phase(bench, devices, count, phase_error);
+	const uint64_t allocations = alloc_guard_count();
+	const char* last_scope = alloc_guard_last_scope();
+
+	bench.report.begin_object();
+	bench.report.key("name").value(name);
+	bench.report.key("events").value(count);
+	bench.report.key("allocations").value(allocations);
+	if (last_scope != nullptr) {
+		bench.report.key("last_scope").value(last_scope);
+	}
+	bench.report.end_object();
+
+	if (!ok) {
+		error = std::string(name) + ": " + phase_error;
+	} else if (allocations > 0) {
+		error = std::string(name) + ": " + std::to_string(allocations) + " allocations in hot paths, the last in " +
+				last_scope;
+	}
+	return error.empty();
+}
+
+/* A client with windows to move over and animate, the topmost one on top */
+static bool open_windows(Bench& bench, std::string& error) {
+	auto* client = new SyntheticClient(bench, bench.socket, 0);
+	bench.clients.push_back(client);
+	if (!bench.run_until([client] { return client->ready.load(); }, BENCH_TIMEOUT_MS) || client->failed) {
+		error = "the client failed to connect";
+		return false;
+	}
+
+	client->post([client] {
+		client->create_windows(options.windows, BENCH_WINDOW_WIDTH, BENCH_WINDOW_HEIGHT);
+	});
+	if (!bench.run_until([client] { return client->windows_configured.load() >= options.windows; },
+			BENCH_TIMEOUT_MS)) {
+		error = "timed out waiting for windows";
+		return false;
+	}
+
+	/* A window covered by others gets no frames */
+	for (auto* view : std::as_const(bench.server.views)) {
+		const char* title = view->get_title();
+		if (title != nullptr && std::string(title) == "bench 0 0") {
+			bench.server.focus_view(view);
+		}
+	}
+	bench.settle();
+	return true;
+}
+
+static void usage(const char* name) {
+	std::fprintf(stderr, "Usage: %s [-w windows] [-e events] [-f frames] [-t] [-v]\n", name);
+}
+
+int main(const int argc, char** argv) {
+	wlr_log_importance level = WLR_ERROR;
+	const std::vector<BenchOption> bench_options = {
+		BenchOption::counted('w', options.windows, 1000000),
+		BenchOption::counted('e', options.events, 1000000),
+		BenchOption::counted('f', options.frames, 1000000),
+		BenchOption::toggle('t', options.trap),
+	};
+	if (!bench_parse_options(argc, argv, bench_options, level)) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (optind != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!bench_init(level)) {
+		return 1;
+	}
+	/* Stops at the first allocation, where a debugger shows who made it */
+	if (options.trap) {
+		alloc_guard_set_trap(true);
+	}
+
+	Server server(MAGPIE_BACKEND_HEADLESS);
+	Bench* bench = bench_start(server);
+	if (bench == nullptr) {
+		return 1;
+	}
+
+	/* Plugged in before the windows, the keymap is compiled while they open */
+	auto* devices = new HotPathsDevices;
+	wlr_pointer_init(&devices->pointer, &hot_paths_pointer_impl, "magpie-hot-paths");
+	server.seat->new_input_device(&devices->pointer.base);
+	wlr_keyboard_init(&devices->keyboard, &hot_paths_keyboard_impl, "magpie-hot-paths");
+	server.seat->new_input_device(&devices->keyboard.base);
+
+	bench->report.begin_object();
+	bench->report.key("windows").value(options.windows);
+	bench->report.key("phases").begin_array();
+
+	std::string error;
+	if (open_windows(*bench, error)) {
+		(void) (run_phase(*bench, *devices, "pointer", drive_pointer, options.events, error) &&
+				run_phase(*bench, *devices, "keys", drive_keys, options.events, error) &&
+				run_phase(*bench, *devices, "frames", drive_frames, options.frames, error));
+	}
+
+	bench->report.end_array();
+	bench->report.key("ok").value(error.empty());
+	if (!error.empty()) {
+		bench->report.key("error").value(error);
+	}
+	bench->report.end_object();
+	std::printf("%s\n", bench->report.str().c_str());
+
+	wlr_keyboard_finish(&devices->keyboard);
+	wlr_pointer_finish(&devices->pointer);
+	delete devices;
+	bench_finish(server, bench);
+
+	return error.empty() ? 0 : 1;
+}
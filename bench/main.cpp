@@ -0,0 +1,113 @@
+#include "bench.hpp"
+
+#include "server.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+BenchOptions bench_options;
+
+/* In the order they run, the later ones work with the windows from the
+ * first */
+static constexpr std::pair<std::string_view, Scenario> scenarios[] = {
+	{"windows", scenario_windows},
+	{"focus", scenario_focus},
+	{"move", scenario_move},
+	{"resize", scenario_resize},
+	{"popups", scenario_popups},
+	{"frames", scenario_frames},
+	{"replay", scenario_replay},
+};
+
+static void usage(const char* name) {
+	std::fprintf(stderr, "Usage: %s [-c clients] [-w windows] [-i iterations] [-f frames] [-r recording] [-v] [scenario...]\n",
+		name);
+	std::fprintf(stderr, "Scenarios:");
+	for (const auto& [scenario, run] : scenarios) {
+		std::fprintf(stderr, " %.*s", static_cast<int>(scenario.size()), scenario.data());
+	}
+	std::fprintf(stderr, "\n");
+}
+
+int main(const int argc, char** argv) {
+	wlr_log_importance level = WLR_ERROR;
+	const std::vector<BenchOption> options = {
+		BenchOption::counted('c', bench_options.clients, 100000),
+		BenchOption::counted('w', bench_options.windows, 100000),
+		BenchOption::counted('i', bench_options.iterations, 100000),
+		BenchOption::counted('f', bench_options.frames, 100000),
+		BenchOption::text('r', bench_options.replay),
+	};
+	if (!bench_parse_options(argc, argv, options, level)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<bool> selected(std::size(scenarios), optind == argc);
+	for (int i = optind; i < argc; i++) {
+		const auto* scenario = std::find_if(std::begin(scenarios), std::end(scenarios), [&](const auto& entry) {
+			return entry.first == argv[i];
+		});
+		if (scenario == std::end(scenarios)) {
+			usage(argv[0]);
+			return 1;
+		}
+		selected[scenario - std::begin(scenarios)] = true;
+	}
+	/* Everything else needs the windows */
+	selected[0] = true;
+	/* Replaying needs a recording, and giving one asks for it */
+	const size_t replay = std::size(scenarios) - 1;
+	selected[replay] = (selected[replay] && optind < argc) || !bench_options.replay.empty();
+
+	if (!bench_init(level)) {
+		return 1;
+	}
+
+	Server server(MAGPIE_BACKEND_HEADLESS);
+	Bench* bench = bench_start(server);
+	if (bench == nullptr) {
+		return 1;
+	}
+	bench->report.begin_object();
+	bench->report.key("clients").value(bench_options.clients);
+	bench->report.key("windows").value(bench_options.windows);
+	bench->report.key("iterations").value(bench_options.iterations);
+	bench->report.key("frames").value(bench_options.frames);
+	bench->report.key("scenarios").begin_array();
+
+	bool all_ok = true;
+	for (size_t i = 0; i < std::size(scenarios); i++) {
+		if (!selected[i]) {
+			continue;
+		}
+
+		const auto& [name, run] = scenarios[i];
+		std::string error;
+		bench->begin_scenario(std::string(name), run == scenario_windows);
+		const bool ok = run(*bench, error);
+		bench->end_scenario(ok, error);
+		all_ok = all_ok && ok;
+
+		if (!ok && run == scenario_windows) {
+			break;
+		}
+	}
+
+	bench->report.end_array().end_object();
+	std::printf("%s\n", bench->report.str().c_str());
+
+	bench_finish(server, bench);
+
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,397 @@
+#include "bench.hpp"
+
+#include "client.hpp"
+#include "input/cursor.hpp"
+#include "input/seat.hpp"
+#include "output.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* Microbenchmarks of single compositor functions. The fixtures are built with
+ * the synthetic clients from magpie-bench, then the functions are called in
+ * tight loops on the main thread, with nothing else running in between. */
+
+/* Batches are sized to take about this long, so reading the clock doesn't
+ * show in the time per call */
+static constexpr uint64_t MICROBENCH_BATCH_NS = 2000000;
+/* Inputs are picked from a fixed set, the same on every run */
+static constexpr size_t MICROBENCH_INPUTS = 1024;
+
+struct MicrobenchOptions {
+	uint32_t windows = 200;
+	uint32_t depth = 8;
+	uint32_t outputs = 16;
+	uint32_t layers = 64;
+	uint32_t rects = 64;
+	uint32_t batches = 50;
+};
+
+static MicrobenchOptions options;
+
+using Microbench = bool (*)(Bench& bench, wlr_output& output, std::string& error);
+
+/* xorshift, seeded the same every time so runs can be compared */
+class MicrobenchRandom {
+	uint64_t state = 0x9e3779b97f4a7c15;
+
+  public:
+	int32_t next(const int32_t min, const int32_t max) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return min + static_cast<int32_t>(state % static_cast<uint64_t>(max - min + 1));
+	}
+};
+
+/* Calls op in batches and records the time per call of every batch. The
+ * event loop only runs between batches, outside the timing. Calls that make
+ * the compositor send events cap the batch size, so what they queue for the
+ * clients fits in the socket. */
+template <typename Op>
+static void measure(Bench& bench, const uint64_t max_batch, Op op) {
+	/* The first call warms up and sizes the batches */
+	const uint64_t start = monotonic_ns();
+	op(0);
+	const uint64_t once = std::max<uint64_t>(monotonic_ns() - start, 1);
+	const uint64_t batch = std::clamp<uint64_t>(MICROBENCH_BATCH_NS / once, 1, max_batch);
+	bench.dispatch(0);
+
+	Samples samples;
+	uint64_t calls = 1;
+	for (uint32_t i = 0; i < options.batches; i++) {
+		const uint64_t batch_start = monotonic_ns();
+		for (uint64_t j = 0; j < batch; j++) {
+			op(calls++);
+		}
+		samples.add((monotonic_ns() - batch_start) / batch);
+		bench.dispatch(0);
+	}
+
+	bench.report.key("batches").value(options.batches);
+	bench.report.key("calls_per_batch").value(batch);
+	bench.report.key("ns_per_call");
+	samples.write_json(bench.report, 1);
+}
+
+static uint32_t mapped_views(const Bench& bench) {
+	return static_cast<uint32_t>(std::count_if(bench.server.views.begin(), bench.server.views.end(), [](const View* view) {
+		return view->scene_node->enabled;
+	}));
+}
+
+static View* find_view(const Bench& bench, const std::string_view title) {
+	for (auto* view : std::as_const(bench.server.views)) {
+		const char* view_title = view->get_title();
+		if (view_title != nullptr && title == view_title) {
+			return view;
+		}
+	}
+	return nullptr;
+}
+
+/* Maps the windows every microbenchmark works with, each with a chain of
+ * subsurfaces, and scatters them over the output */
+static bool setup_windows(Bench& bench, wlr_output& output, std::string& error) {
+	auto* client = new SyntheticClient(bench, bench.socket, 0);
+	bench.clients.push_back(client);
+	if (!bench.run_until([client] { return client->ready.load(); }, BENCH_TIMEOUT_MS) || client->failed) {
+		error = "the client failed to connect";
+		return false;
+	}
+
+	client->post([client] {
+		client->create_windows(options.windows, BENCH_SMALL_WINDOW_WIDTH, BENCH_SMALL_WINDOW_HEIGHT, options.depth);
+	});
+	const bool mapped = bench.run_until(
+		[&bench] {
+			return mapped_views(bench) >= options.windows;
+		},
+		BENCH_TIMEOUT_MS);
+	if (!mapped) {
+		error = "timed out waiting for windows to map";
+		return false;
+	}
+
+	const auto& area = static_cast<Output*>(output.data)->usable_area;
+	MicrobenchRandom random;
+	for (auto* view : std::as_const(bench.server.views)) {
+		view->set_position(random.next(area.x, area.x + area.width - BENCH_SMALL_WINDOW_WIDTH),
+			random.next(area.y, area.y + area.height - BENCH_SMALL_WINDOW_HEIGHT));
+	}
+	bench.dispatch(0);
+	return true;
+}
+
+/* Hit tests points all over the output, most of them over one or more
+ * windows, the rest missing all of them after walking every window's tree */
+static bool microbench_surface_at(Bench& bench, wlr_output& output, std::string& error) {
+	(void) error;
+
+	const auto& area = static_cast<Output*>(output.data)->full_area;
+	MicrobenchRandom random;
+	std::vector<std::pair<double, double>> points(MICROBENCH_INPUTS);
+	for (auto& [x, y] : points) {
+		x = random.next(area.x, area.x + area.width - 1) + 0.5;
+		y = random.next(area.y, area.y + area.height - 1) + 0.5;
+	}
+
+	measure(bench, UINT64_MAX, [&bench, &points](const uint64_t call) {
+		const auto& [x, y] = points[call % points.size()];
+		wlr_surface* surface = nullptr;
+		double sx = 0;
+		double sy = 0;
+		(void) bench.server.surface_at(x, y, &surface, &sx, &sy);
+	});
+	return true;
+}
+
+/* Focuses the bottom view every time, so each call moves a view from one end
+ * of the list and the stack to the other */
+static bool microbench_focus_view(Bench& bench, wlr_output& output, std::string& error) {
+	(void) output;
+	(void) error;
+
+	Server& server = bench.server;
+	measure(bench, 64, [&server](const uint64_t call) {
+		(void) call;
+		server.focus_view(server.views.back());
+	});
+	return true;
+}
+
+/* Confines motions of every direction and length to a region of many
+ * rectangles on the focused view */
+static bool microbench_apply_constraint(Bench& bench, wlr_output& output, std::string& error) {
+	(void) output;
+
+	Seat& seat = *bench.server.seat;
+	SyntheticClient& client = *bench.clients.front();
+
+	/* The seat only has pointer capabilities, which the constraint needs, once
+	 * it has a pointer */
+	static constexpr wlr_pointer_impl pointer_impl = {"magpie-microbench"};
+	wlr_pointer pointer = {};
+	wlr_pointer_init(&pointer, &pointer_impl, "magpie-microbench");
+	seat.new_input_device(&pointer.base);
+
+	View* view = find_view(bench, "bench 0 0");
+	if (view == nullptr) {
+		wlr_pointer_finish(&pointer);
+		error = "no view";
+		return false;
+	}
+
+	client.post([&client] {
+		client.confine_pointer(options.rects);
+	});
+	const bool confined = bench.run_until(
+		[&bench, &client, view] {
+			if (!client.pointer_confined) {
+				return false;
+			}
+			bench.server.focus_view(view);
+			return bench.server.seat->current_constraint.has_value();
+		},
+		BENCH_TIMEOUT_MS);
+	if (!confined) {
+		wlr_pointer_finish(&pointer);
+		error = "the pointer was never confined";
+		return false;
+	}
+
+	const wlr_box geometry = view->get_geometry();
+	const int32_t step = std::max(std::min(geometry.width, geometry.height) / static_cast<int32_t>(options.rects + 1), 1);
+	wlr_cursor_warp_closest(&seat.cursor.wlr, nullptr, view->current.x + step, view->current.y + step);
+
+	MicrobenchRandom random;
+	std::vector<std::pair<double, double>> deltas(MICROBENCH_INPUTS);
+	for (auto& [dx, dy] : deltas) {
+		dx = random.next(-geometry.width, geometry.width) / 2.0;
+		dy = random.next(-geometry.height, geometry.height) / 2.0;
+	}
+
+	measure(bench, UINT64_MAX, [&seat, &pointer, &deltas](const uint64_t call) {
+		auto [dx, dy] = deltas[call % deltas.size()];
+		seat.apply_constraint(&pointer, &dx, &dy);
+	});
+
+	wlr_pointer_finish(&pointer);
+	return true;
+}
+
+/* Arranges an output with layer surfaces all around it. Every call sends each
+ * of them a configure, which caps the batches. */
+static bool microbench_update_layout(Bench& bench, wlr_output& output, std::string& error) {
+	SyntheticClient& client = *bench.clients.front();
+	client.post([&client] {
+		client.create_layers(options.layers);
+	});
+	const bool configured = bench.run_until(
+		[&client] {
+			return client.failed || client.layers_configured >= options.layers;
+		},
+		BENCH_TIMEOUT_MS);
+	if (!configured || client.failed) {
+		error = "layer surfaces were never configured";
+		return false;
+	}
+
+	Output& magpie_output = *static_cast<Output*>(output.data);
+	measure(bench, 16, [&magpie_output](const uint64_t call) {
+		(void) call;
+		magpie_output.update_layout();
+	});
+	return true;
+}
+
+/* Picks the output for boxes all over a layout of many outputs, which
+ * intersects the box with every one of them */
+static bool microbench_find_output_for_maximize(Bench& bench, wlr_output& output, std::string& error) {
+	(void) output;
+
+	for (uint32_t i = static_cast<uint32_t>(bench.server.outputs.size()); i < options.outputs; i++) {
+		wlr_headless_add_output(bench.server.backend, 1280, 720);
+	}
+	bench.dispatch(0);
+
+	View* view = find_view(bench, "bench 0 0");
+	if (view == nullptr) {
+		error = "no view";
+		return false;
+	}
+
+	wlr_box layout = {};
+	wlr_output_layout_get_box(bench.server.output_layout, nullptr, &layout);
+	MicrobenchRandom random;
+	std::vector<wlr_box> boxes(MICROBENCH_INPUTS);
+	for (auto& box : boxes) {
+		box.width = random.next(200, 1200);
+		box.height = random.next(150, 900);
+		box.x = random.next(layout.x - box.width / 2, layout.x + layout.width - box.width / 2);
+		box.y = random.next(layout.y - box.height / 2, layout.y + layout.height - box.height / 2);
+	}
+
+	const wlr_box previous = view->previous;
+	measure(bench, UINT64_MAX, [view, &boxes](const uint64_t call) {
+		view->previous = boxes[call % boxes.size()];
+		(void) view->find_output_for_maximize();
+	});
+	view->previous = previous;
+	return true;
+}
+
+/* In the order they run, find_output_for_maximize adds outputs so it goes
+ * last */
+static constexpr std::pair<std::string_view, Microbench> microbenches[] = {
+	{"surface_at", microbench_surface_at},
+	{"focus_view", microbench_focus_view},
+	{"apply_constraint", microbench_apply_constraint},
+	{"update_layout", microbench_update_layout},
+	{"find_output_for_maximize", microbench_find_output_for_maximize},
+};
+
+static void usage(const char* name) {
+	std::fprintf(stderr,
+		"Usage: %s [-w windows] [-d depth] [-o outputs] [-l layers] [-r rects] [-b batches] [-v] [microbenchmark...]\n",
+		name);
+	std::fprintf(stderr, "Microbenchmarks:");
+	for (const auto& [microbench, run] : microbenches) {
+		std::fprintf(stderr, " %.*s", static_cast<int>(microbench.size()), microbench.data());
+	}
+	std::fprintf(stderr, "\n");
+}
+
+int main(const int argc, char** argv) {
+	wlr_log_importance level = WLR_ERROR;
+	const std::vector<BenchOption> bench_options = {
+		BenchOption::counted('w', options.windows, 100000),
+		BenchOption::counted('d', options.depth, 100000),
+		BenchOption::counted('o', options.outputs, 100000),
+		BenchOption::counted('l', options.layers, 100000),
+		BenchOption::counted('r', options.rects, 100000),
+		BenchOption::counted('b', options.batches, 100000),
+	};
+	if (!bench_parse_options(argc, argv, bench_options, level)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<bool> selected(std::size(microbenches), optind == argc);
+	for (int i = optind; i < argc; i++) {
+		const auto* microbench = std::find_if(std::begin(microbenches), std::end(microbenches), [&](const auto& entry) {
+			return entry.first == argv[i];
+		});
+		if (microbench == std::end(microbenches)) {
+			usage(argv[0]);
+			return 1;
+		}
+		selected[microbench - std::begin(microbenches)] = true;
+	}
+
+	if (!bench_init(level)) {
+		return 1;
+	}
+
+	Server server(MAGPIE_BACKEND_HEADLESS);
+	Bench* bench = bench_start(server);
+	if (bench == nullptr) {
+		return 1;
+	}
+	bench->report.begin_object();
+	bench->report.key("windows").value(options.windows);
+	bench->report.key("depth").value(options.depth);
+	bench->report.key("outputs").value(options.outputs);
+	bench->report.key("layers").value(options.layers);
+	bench->report.key("rects").value(options.rects);
+	bench->report.key("microbenchmarks").begin_array();
+
+	std::string error;
+	const bool set_up = setup_windows(*bench, bench->output, error);
+	if (!set_up) {
+		wlr_log(WLR_ERROR, "Failed to set up the microbenchmarks: %s", error.c_str());
+	}
+
+	bool all_ok = set_up;
+	for (size_t i = 0; set_up && i < std::size(microbenches); i++) {
+		if (!selected[i]) {
+			continue;
+		}
+
+		const auto& [name, run] = microbenches[i];
+		wlr_log(WLR_INFO, "Running microbenchmark %.*s", static_cast<int>(name.size()), name.data());
+		bench->report.begin_object();
+		bench->report.key("name").value(name);
+		error.clear();
+		const bool ok = run(*bench, bench->output, error);
+		bench->report.key("ok").value(ok);
+		if (!ok) {
+			bench->report.key("error").value(error);
+		}
+		bench->report.end_object();
+		all_ok = all_ok && ok;
+	}
+
+	bench->report.end_array().end_object();
+	std::printf("%s\n", bench->report.str().c_str());
+
+	bench_finish(server, bench);
+
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,547 @@
+#include "protocol_client.hpp"
+
+#include "bench.hpp"
+#include "capture.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+
+/* Long enough for any configure or global the compositor owes us */
+static constexpr int REPLAY_WAIT_MS = 1000;
+static constexpr uint32_t REPLAY_DISPLAY_ID = 1;
+
+/* Reads a capture, bounds checked. Anything cut short makes it not ok. */
+class CaptureReader {
+	const char* position;
+	const char* end;
+
+  public:
+	bool ok = true;
+
+	explicit CaptureReader(const std::string_view data) : position(data.data()), end(data.data() + data.size()) {}
+
+	uint32_t u32() {
+		uint32_t value = 0;
+		if (end - position < static_cast<ptrdiff_t>(sizeof(value))) {
+			ok = false;
+			return 0;
+		}
+		std::memcpy(&value, position, sizeof(value));
+		position += sizeof(value);
+		return value;
+	}
+
+	std::string_view bytes() {
+		const uint32_t size = u32();
+		if (end - position < static_cast<ptrdiff_t>(size)) {
+			ok = false;
+			return {};
+		}
+		const std::string_view bytes(position, size);
+		position += size;
+		return bytes;
+	}
+
+	/* With its NUL, or null */
+	const char* string() {
+		const std::string_view string = bytes();
+		if (string.empty()) {
+			return nullptr;
+		}
+		if (string.back() != '\0') {
+			ok = false;
+			return nullptr;
+		}
+		return string.data();
+	}
+};
+
+static uint32_t signature_arguments(const char* signature) {
+	uint32_t arguments = 0;
+	for (const char* c = signature; *c != '\0'; c++) {
+		if (std::strchr("iufsonah", *c) != nullptr) {
+			arguments++;
+		}
+	}
+	return arguments;
+}
+
+/* Only the generic names, a request that destroys its object under any other
+ * name leaves a proxy behind */
+static bool is_destructor(const ReplayMessage& message) {
+	return message.name == "destroy" || message.name == "release";
+}
+
+static int replay_dispatch(const void* data, void* target, const uint32_t opcode, const wl_message* message,
+	wl_argument* arguments) {
+	(void) opcode;
+
+	auto& client = *const_cast<ProtocolReplayClient*>(static_cast<const ProtocolReplayClient*>(data));
+	client.event(static_cast<wl_proxy*>(target), *message, arguments);
+	return 0;
+}
+
+ReplayPool::~ReplayPool() noexcept {
+	if (data != nullptr) {
+		munmap(data, size);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+bool ReplayPool::resize(const size_t new_size) {
+	if (fd < 0) {
+		fd = memfd_create("magpie-protocol-replay", MFD_CLOEXEC);
+		if (fd < 0) {
+			return false;
+		}
+	}
+	if (data != nullptr) {
+		munmap(data, size);
+		data = nullptr;
+	}
+
+	size = new_size;
+	if (ftruncate(fd, static_cast<off_t>(size)) < 0) {
+		return false;
+	}
+	void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	data = static_cast<char*>(mapped);
+	return true;
+}
+
+ProtocolReplayClient::ProtocolReplayClient(const bool paced) noexcept : paced(paced) {}
+
+ProtocolReplayClient::~ProtocolReplayClient() noexcept {
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+bool ProtocolReplayClient::load(const std::string& path, std::string& load_error) {
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr) {
+		load_error = path + ": " + std::strerror(errno);
+		return false;
+	}
+	char chunk[65536];
+	for (size_t read = 0; (read = std::fread(chunk, 1, sizeof(chunk), file)) > 0;) {
+		contents.insert(contents.end(), chunk, chunk + read);
+	}
+	std::fclose(file);
+
+	ProtocolCaptureHeader header = {};
+	if (contents.size() >= sizeof(header)) {
+		std::memcpy(&header, contents.data(), sizeof(header));
+	}
+	if (header.magic != MAGPIE_PROTOCOL_CAPTURE_MAGIC || header.version != MAGPIE_PROTOCOL_CAPTURE_VERSION) {
+		load_error = path + " is not a protocol capture this version can replay";
+		return false;
+	}
+
+	size_t offset = sizeof(header);
+	while (contents.size() - offset >= sizeof(ProtocolCaptureRecord)) {
+		ProtocolCaptureRecord record = {};
+		std::memcpy(&record, contents.data() + offset, sizeof(record));
+		offset += sizeof(record);
+		if (contents.size() - offset < record.size) {
+			/* Cut short when the compositor went away, the rest still replays */
+			break;
+		}
+		const std::string_view payload(contents.data() + offset, record.size);
+		offset += record.size;
+
+		if (record.type != PROTOCOL_CAPTURE_INTERFACE) {
+			records.push_back({record.time_ns, record.type, payload});
+			continue;
+		}
+
+		CaptureReader reader(payload);
+		const uint32_t index = reader.u32();
+		auto interface = std::make_unique<ReplayInterface>();
+		const char* name = reader.string();
+		interface->name = name != nullptr ? name : "";
+		interface->version = reader.u32();
+		interface->methods.resize(std::min(reader.u32(), 1024U));
+		interface->events.resize(std::min(reader.u32(), 1024U));
+		for (auto* messages : {&interface->methods, &interface->events}) {
+			for (auto& message : *messages) {
+				const char* message_name = reader.string();
+				const char* signature = reader.string();
+				message.name = message_name != nullptr ? message_name : "";
+				message.signature = signature != nullptr ? signature : "";
+				message.types.resize(signature_arguments(message.signature.c_str()));
+				for (auto& type : message.types) {
+					type = reader.u32();
+				}
+			}
+		}
+		if (!reader.ok || index >= 4096) {
+			load_error = path + " has a broken interface description";
+			return false;
+		}
+
+		if (index >= interfaces.size()) {
+			interfaces.resize(index + 1);
+		}
+		interfaces[index] = std::move(interface);
+	}
+
+	return build_interfaces(load_error);
+}
+
+/* Once all are read, as they refer to each other */
+bool ProtocolReplayClient::build_interfaces(std::string& error) {
+	for (auto& interface : interfaces) {
+		if (interface == nullptr) {
+			error = "the capture is missing an interface description";
+			return false;
+		}
+	}
+
+	for (auto& interface : interfaces) {
+		size_t types = 0;
+		for (const auto* messages : {&interface->methods, &interface->events}) {
+			for (const auto& message : *messages) {
+				types += message.types.size();
+			}
+		}
+		/* Sized up front, the messages point into it */
+		interface->wl_types.reserve(types);
+
+		const auto build = [this, &interface](const std::vector<ReplayMessage>& messages, std::vector<wl_message>& built) {
+			for (const auto& message : messages) {
+				const wl_interface** types = interface->wl_types.data() + interface->wl_types.size();
+				for (const uint32_t type : message.types) {
+					interface->wl_types.push_back(type < interfaces.size() ? &interfaces[type]->wl : nullptr);
+				}
+				built.push_back({message.name.c_str(), message.signature.c_str(), types});
+			}
+		};
+		build(interface->methods, interface->wl_methods);
+		build(interface->events, interface->wl_events);
+
+		interface->wl = {interface->name.c_str(), static_cast<int>(interface->version),
+			static_cast<int>(interface->wl_methods.size()), interface->wl_methods.data(),
+			static_cast<int>(interface->wl_events.size()), interface->wl_events.data()};
+	}
+	return true;
+}
+
+size_t ProtocolReplayClient::request_count() const {
+	return static_cast<size_t>(std::count_if(records.begin(), records.end(), [](const ReplayRecord& record) {
+		return record.type == PROTOCOL_CAPTURE_REQUEST;
+	}));
+}
+
+void ProtocolReplayClient::start(const std::string& socket) {
+	thread = std::thread([this, socket] {
+		display = wl_display_connect(socket.c_str());
+		if (display == nullptr) {
+			error = "failed to connect to the compositor";
+		} else {
+			run();
+		}
+		finished = true;
+	});
+}
+
+void ProtocolReplayClient::run() {
+	const uint64_t start = monotonic_ns();
+	for (const auto& record : records) {
+		if (paced) {
+			const uint64_t due = start + record.time_ns;
+			for (uint64_t now = monotonic_ns(); now < due && error.empty(); now = monotonic_ns()) {
+				pump(static_cast<int>((due - now) / 1000000));
+			}
+		} else {
+			pump(0);
+		}
+		if (!error.empty()) {
+			break;
+		}
+
+		if (record.type == PROTOCOL_CAPTURE_BUFFER) {
+			fill_buffer(record);
+		} else if (record.type == PROTOCOL_CAPTURE_REQUEST) {
+			send(record);
+		}
+	}
+
+	/* Everything sent is dispatched before the compositor's side is done */
+	if (error.empty() && wl_display_roundtrip(display) < 0) {
+		pump(0);
+	}
+
+	for (const auto& [id, proxy] : proxies) {
+		wl_proxy_destroy(proxy);
+	}
+	proxies.clear();
+	wl_display_disconnect(display);
+	display = nullptr;
+}
+
+/* Flushes, then reads and dispatches whatever arrives within the timeout */
+bool ProtocolReplayClient::pump(const int timeout_ms) {
+	while (wl_display_prepare_read(display) != 0) {
+		wl_display_dispatch_pending(display);
+	}
+
+	pollfd fd = {wl_display_get_fd(display), POLLIN, 0};
+	if (wl_display_flush(display) < 0 && errno == EAGAIN) {
+		fd.events |= POLLOUT;
+	}
+	if (poll(&fd, 1, timeout_ms) > 0 && (fd.revents & POLLIN) != 0) {
+		wl_display_read_events(display);
+	} else {
+		wl_display_cancel_read(display);
+	}
+	wl_display_dispatch_pending(display);
+
+	if (wl_display_get_error(display) != 0) {
+		const wl_interface* interface = nullptr;
+		uint32_t id = 0;
+		const uint32_t code = wl_display_get_protocol_error(display, &interface, &id);
+		error = interface != nullptr ? "protocol error " + std::to_string(code) + " on " + interface->name + " " +
+											std::to_string(id)
+									 : std::string("lost the connection: ") + std::strerror(wl_display_get_error(display));
+		return false;
+	}
+	return true;
+}
+
+/* For what the compositor sends in its own time, like configures */
+bool ProtocolReplayClient::wait_for(const std::function<bool()>& done) {
+	const uint64_t deadline = monotonic_ns() + static_cast<uint64_t>(REPLAY_WAIT_MS) * 1000000;
+	while (!done()) {
+		if (monotonic_ns() >= deadline || !pump(1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void ProtocolReplayClient::fill_buffer(const ReplayRecord& record) {
+	CaptureReader reader(record.payload);
+	const uint32_t id = reader.u32();
+	(void) reader.u32();
+	(void) reader.u32();
+	(void) reader.u32();
+	const std::string_view data = reader.bytes();
+
+	const auto buffer = buffers.find(id);
+	if (!reader.ok || buffer == buffers.end()) {
+		return;
+	}
+	const ReplayPool& pool = *buffer->second.pool;
+	if (pool.data != nullptr && buffer->second.offset + data.size() <= pool.size) {
+		std::memcpy(pool.data + buffer->second.offset, data.data(), data.size());
+	}
+}
+
+void ProtocolReplayClient::send(const ReplayRecord& record) {
+	CaptureReader reader(record.payload);
+	const uint32_t id = reader.u32();
+	const uint32_t interface_index = reader.u32();
+	const uint32_t opcode = reader.u32();
+
+	wl_proxy* proxy = id == REPLAY_DISPLAY_ID ? reinterpret_cast<wl_proxy*>(display) : nullptr;
+	if (const auto found = proxies.find(id); found != proxies.end()) {
+		proxy = found->second;
+	}
+	if (!reader.ok || proxy == nullptr || interface_index >= interfaces.size() ||
+		opcode >= interfaces[interface_index]->methods.size()) {
+		requests_skipped++;
+		return;
+	}
+	const ReplayInterface& interface = *interfaces[interface_index];
+	const ReplayMessage& message = interface.methods[opcode];
+
+	std::vector<wl_argument> arguments;
+	/* Reserved, the arguments point into it */
+	std::vector<wl_array> arrays;
+	arrays.reserve(message.types.size());
+	uint32_t version = wl_proxy_get_version(proxy);
+	const wl_interface* created = nullptr;
+	uint32_t created_id = 0;
+	const char* last_string = nullptr;
+	int fd_argument = -1;
+	bool missing_object = false;
+
+	size_t index = 0;
+	for (const char c : message.signature) {
+		wl_argument argument = {};
+		switch (c) {
+			case 'i':
+			case 'u':
+			case 'f':
+				argument.u = reader.u32();
+				break;
+			case 's':
+				argument.s = reader.string();
+				last_string = argument.s;
+				break;
+			case 'o': {
+				const uint32_t object = reader.u32();
+				const auto found = proxies.find(object);
+				argument.o = found != proxies.end() ? reinterpret_cast<wl_object*>(found->second) : nullptr;
+				missing_object = missing_object || (object != 0 && argument.o == nullptr);
+				break;
+			}
+			case 'n': {
+				created_id = reader.u32();
+				const uint32_t type = message.types[index];
+				if (type < interfaces.size()) {
+					created = &interfaces[type]->wl;
+				} else if (last_string != nullptr) {
+					/* wl_registry.bind names the interface */
+					for (const auto& candidate : interfaces) {
+						if (candidate->name == last_string) {
+							created = &candidate->wl;
+						}
+					}
+				}
+				break;
+			}
+			case 'a': {
+				const std::string_view bytes = reader.bytes();
+				arrays.push_back({bytes.size(), bytes.size(), const_cast<char*>(bytes.data())});
+				argument.a = &arrays.back();
+				break;
+			}
+			case 'h':
+				fd_argument = static_cast<int>(arguments.size());
+				break;
+			default:
+				/* Versions and nullability */
+				continue;
+		}
+		arguments.push_back(argument);
+		index++;
+	}
+	if (!reader.ok || missing_object || (created_id != 0 && created == nullptr)) {
+		requests_skipped++;
+		return;
+	}
+
+	/* What the client got from the compositor is different this time */
+	if (interface.name == "wl_registry" && message.name == "bind") {
+		const std::string name = arguments[1].s != nullptr ? arguments[1].s : "";
+		if (!wait_for([this, &name] { return globals.contains(name); })) {
+			requests_skipped++;
+			return;
+		}
+		const auto& [global, global_version] = globals[name];
+		arguments[0].u = global;
+		arguments[2].u = std::min(arguments[2].u, global_version);
+		version = arguments[2].u;
+	} else if (message.name == "ack_configure") {
+		if (!wait_for([this, proxy] { return configure_serials.contains(proxy); })) {
+			requests_skipped++;
+			return;
+		}
+		arguments[0].u = configure_serials[proxy];
+		configure_serials.erase(proxy);
+	} else if (message.name == "pong") {
+		if (!ping_serials.contains(proxy)) {
+			requests_skipped++;
+			return;
+		}
+		arguments[0].u = ping_serials[proxy];
+		ping_serials.erase(proxy);
+	}
+
+	std::shared_ptr<ReplayPool> pool;
+	int fd = -1;
+	if (fd_argument >= 0) {
+		if (interface.name == "wl_shm" && message.name == "create_pool") {
+			pool = std::make_shared<ReplayPool>();
+			if (!pool->resize(static_cast<size_t>(std::max(arguments[2].i, 1)))) {
+				requests_skipped++;
+				return;
+			}
+			arguments[fd_argument].h = pool->fd;
+		} else {
+			/* Nothing a fake client could pass on, but the request still goes out */
+			fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+			arguments[fd_argument].h = fd;
+		}
+	}
+	if (interface.name == "wl_shm_pool") {
+		const auto found = pools.find(id);
+		if (found != pools.end() && message.name == "create_buffer") {
+			buffers[created_id] = {found->second, static_cast<size_t>(std::max(arguments[1].i, 0))};
+		} else if (found != pools.end() && message.name == "resize") {
+			found->second->resize(static_cast<size_t>(std::max(arguments[0].i, 1)));
+		}
+	}
+
+	const bool destroys = id != REPLAY_DISPLAY_ID && is_destructor(message);
+	if (destroys) {
+		forget(proxy);
+		proxies.erase(id);
+		pools.erase(id);
+		buffers.erase(id);
+	}
+	wl_proxy* result = wl_proxy_marshal_array_flags(
+		proxy, opcode, created, version, destroys ? WL_MARSHAL_FLAG_DESTROY : 0, arguments.data());
+	if (fd >= 0) {
+		close(fd);
+	}
+	requests_sent++;
+
+	if (created != nullptr && result != nullptr) {
+		if (const auto replaced = proxies.find(created_id); replaced != proxies.end()) {
+			forget(replaced->second);
+		}
+		proxies[created_id] = result;
+		proxy_ids[result] = created_id;
+		wl_proxy_add_dispatcher(result, replay_dispatch, this, nullptr);
+		if (pool != nullptr) {
+			pools[created_id] = pool;
+		}
+	}
+}
+
+void ProtocolReplayClient::forget(wl_proxy* proxy) {
+	proxy_ids.erase(proxy);
+	configure_serials.erase(proxy);
+	ping_serials.erase(proxy);
+}
+
+void ProtocolReplayClient::event(wl_proxy* proxy, const wl_message& message, const wl_argument* arguments) {
+	const std::string_view name = message.name;
+	const char* signature = message.signature;
+	while (*signature != '\0' && std::strchr("iufsonah", *signature) == nullptr) {
+		signature++;
+	}
+
+	if (name == "global" && std::strcmp(wl_proxy_get_class(proxy), "wl_registry") == 0) {
+		globals[arguments[1].s] = {arguments[0].u, arguments[2].u};
+	} else if (name == "configure" && *signature == 'u') {
+		/* xdg_surface and the layer shell, the serial comes first */
+		configure_serials[proxy] = arguments[0].u;
+	} else if (name == "ping" && *signature == 'u') {
+		ping_serials[proxy] = arguments[0].u;
+	} else if (name == "done" && std::strcmp(wl_proxy_get_class(proxy), "wl_callback") == 0) {
+		/* The compositor is done with these, nothing else would destroy them */
+		const auto id = proxy_ids.find(proxy);
+		if (id != proxy_ids.end()) {
+			proxies.erase(id->second);
+			forget(proxy);
+		}
+		wl_proxy_destroy(proxy);
+	}
+}
@@ -0,0 +1,117 @@
+#ifndef MAGPIE_BENCH_PROTOCOL_CLIENT_HPP
+#define MAGPIE_BENCH_PROTOCOL_CLIENT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <wayland-util.h>
+
+struct wl_display;
+struct wl_proxy;
+
+/* A message and the interface indices of its arguments, as described in the
+ * capture */
+struct ReplayMessage {
+	std::string name;
+	std::string signature;
+	std::vector<uint32_t> types;
+};
+
+/* An interface rebuilt from a capture, so libwayland can marshal its requests
+ * and demarshal its events without any protocol code built in */
+struct ReplayInterface {
+	std::string name;
+	uint32_t version = 0;
+	std::vector<ReplayMessage> methods;
+	std::vector<ReplayMessage> events;
+	std::vector<wl_message> wl_methods;
+	std::vector<wl_message> wl_events;
+	std::vector<const wl_interface*> wl_types;
+	wl_interface wl = {};
+};
+
+struct ReplayRecord {
+	uint64_t time_ns;
+	uint32_t type;
+	std::string_view payload;
+};
+
+/* A memfd standing in for a client's shm pool. Buffers hold on to it, as a
+ * pool is only gone once its buffers are. */
+struct ReplayPool {
+	int fd = -1;
+	char* data = nullptr;
+	size_t size = 0;
+
+	ReplayPool() noexcept = default;
+	ReplayPool(const ReplayPool&) = delete;
+	ReplayPool& operator=(const ReplayPool&) = delete;
+	~ReplayPool() noexcept;
+
+	bool resize(size_t new_size);
+};
+
+struct ReplayBuffer {
+	std::shared_ptr<ReplayPool> pool;
+	size_t offset = 0;
+};
+
+/* Sends the requests of a capture from a thread and connection of its own,
+ * the way the captured client did. Serials the client got from the
+ * compositor are swapped for the ones this run got, and shm buffers are
+ * filled with what they held when they were attached. */
+class ProtocolReplayClient {
+	std::vector<char> contents;
+	std::vector<std::unique_ptr<ReplayInterface>> interfaces;
+	std::vector<ReplayRecord> records;
+
+	std::thread thread;
+	wl_display* display = nullptr;
+	std::map<uint32_t, wl_proxy*> proxies;
+	std::map<wl_proxy*, uint32_t> proxy_ids;
+	std::map<uint32_t, std::shared_ptr<ReplayPool>> pools;
+	std::map<uint32_t, ReplayBuffer> buffers;
+	/* Name and version of each global by interface */
+	std::map<std::string, std::pair<uint32_t, uint32_t>> globals;
+	std::map<wl_proxy*, uint32_t> configure_serials;
+	std::map<wl_proxy*, uint32_t> ping_serials;
+
+	bool build_interfaces(std::string& error);
+	void run();
+	bool pump(int timeout_ms);
+	bool wait_for(const std::function<bool()>& done);
+	void fill_buffer(const ReplayRecord& record);
+	void send(const ReplayRecord& record);
+	void forget(wl_proxy* proxy);
+
+  public:
+	const bool paced;
+	std::atomic<bool> finished = false;
+	std::atomic<uint64_t> requests_sent = 0;
+	std::atomic<uint64_t> requests_skipped = 0;
+	/* Only read once finished */
+	std::string error;
+
+	explicit ProtocolReplayClient(bool paced) noexcept;
+	ProtocolReplayClient(const ProtocolReplayClient&) = delete;
+	ProtocolReplayClient& operator=(const ProtocolReplayClient&) = delete;
+	~ProtocolReplayClient() noexcept;
+
+	bool load(const std::string& path, std::string& load_error);
+	void start(const std::string& socket);
+	[[nodiscard]] size_t request_count() const;
+
+	/* Only on the client thread */
+	void event(wl_proxy* proxy, const wl_message& message, const wl_argument* arguments);
+};
+
+#endif
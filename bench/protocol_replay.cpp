@@ -0,0 +1,123 @@
+#include "bench.hpp"
+
+#include "protocol_client.hpp"
+#include "server.hpp"
+
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* Replays a capture made with start_protocol_capture against a headless
+ * compositor, and reports how long the compositor took to dispatch each type
+ * of request. */
+
+/* Times the requests of the replay as the compositor dispatches them. A
+ * request runs from when libwayland logs it to when it logs the next one; the
+ * last one of a read runs to the end of that event loop iteration, so it also
+ * counts whatever else ran then. */
+struct RequestTimer {
+	Bench& bench;
+	const pid_t pid = getpid();
+	const char* interface = nullptr;
+	const char* request = nullptr;
+	uint64_t start_ns = 0;
+
+	explicit RequestTimer(Bench& bench) noexcept : bench(bench) {}
+
+	void end(const uint64_t now) {
+		if (request != nullptr) {
+			bench.record(std::string(interface) + "." + request, now - start_ns);
+			request = nullptr;
+		}
+	}
+};
+
+/* Only the replay runs in this process, XWayland doesn't */
+static void request_timer_log(void* data, const wl_protocol_logger_type type, const wl_protocol_logger_message* message) {
+	const uint64_t now = monotonic_ns();
+	auto& timer = *static_cast<RequestTimer*>(data);
+	if (type != WL_PROTOCOL_LOGGER_REQUEST) {
+		return;
+	}
+
+	pid_t pid = 0;
+	wl_client_get_credentials(wl_resource_get_client(message->resource), &pid, nullptr, nullptr);
+	if (pid != timer.pid) {
+		return;
+	}
+
+	timer.end(now);
+	timer.interface = wl_resource_get_class(message->resource);
+	timer.request = message->message->name;
+	timer.start_ns = now;
+}
+
+static void usage(const char* name) {
+	std::fprintf(stderr, "Usage: %s [-f] [-v] capture\n", name);
+	std::fprintf(stderr, "  -f  send requests as fast as possible, rather than at the captured pace\n");
+}
+
+int main(const int argc, char** argv) {
+	wlr_log_importance level = WLR_ERROR;
+	bool fast = false;
+	if (!bench_parse_options(argc, argv, {BenchOption::toggle('f', fast)}, level) || optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	const bool paced = !fast;
+	const std::string path = argv[optind];
+
+	auto* client = new ProtocolReplayClient(paced);
+	std::string error;
+	if (!client->load(path, error)) {
+		std::fprintf(stderr, "%s\n", error.c_str());
+		delete client;
+		return 1;
+	}
+
+	if (!bench_init(level)) {
+		delete client;
+		return 1;
+	}
+
+	Server server(MAGPIE_BACKEND_HEADLESS);
+	Bench* bench = bench_start(server);
+	if (bench == nullptr) {
+		delete client;
+		return 1;
+	}
+	auto* timer = new RequestTimer(*bench);
+	wl_protocol_logger* logger = wl_display_add_protocol_logger(server.display, request_timer_log, timer);
+
+	bench->report.begin_object();
+	bench->report.key("capture").value(path);
+	bench->report.key("paced").value(paced);
+	bench->report.key("scenarios").begin_array();
+
+	bench->begin_scenario("protocol_replay");
+	client->start(bench->socket.c_str());
+	while (!client->finished) {
+		bench->dispatch(1);
+		timer->end(monotonic_ns());
+	}
+	const bool ok = client->error.empty();
+	bench->end_scenario(ok, client->error);
+
+	bench->report.end_array();
+	bench->report.key("requests").value(client->request_count());
+	bench->report.key("requests_sent").value(client->requests_sent.load());
+	bench->report.key("requests_skipped").value(client->requests_skipped.load());
+	bench->report.end_object();
+	std::printf("%s\n", bench->report.str().c_str());
+
+	delete client;
+	wl_protocol_logger_destroy(logger);
+	delete timer;
+	bench_finish(server, bench);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,237 @@
+#include "bench.hpp"
+
+#include "input/recorder.hpp"
+#include "input/seat.hpp"
+#include "server.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/types/wlr_input_device.h>
+#include "wlr-wrap-end.hpp"
+
+/* Names the per event latencies in the report */
+static constexpr const char* replay_operations[] = {
+	"device",
+	"motion",
+	"motion_absolute",
+	"button",
+	"axis",
+	"frame",
+	"swipe_begin",
+	"swipe_update",
+	"swipe_end",
+	"pinch_begin",
+	"pinch_update",
+	"pinch_end",
+	"hold_begin",
+	"hold_end",
+	"key",
+};
+
+static_assert(std::size(replay_operations) == INPUT_RECORD_KEY + 1);
+
+static constexpr wlr_pointer_impl replay_pointer_impl = {"magpie-replay"};
+static constexpr wlr_keyboard_impl replay_keyboard_impl = {"magpie-replay", nullptr};
+
+/* Stands in for a recorded device. It is added the way the backend adds new
+ * devices, so its events go through the same listeners. */
+struct ReplayDevice {
+	wlr_input_device_type type;
+	wlr_pointer pointer = {};
+	wlr_keyboard keyboard = {};
+
+	ReplayDevice(Seat& seat, const wlr_input_device_type type) noexcept : type(type) {
+		if (type == WLR_INPUT_DEVICE_KEYBOARD) {
+			wlr_keyboard_init(&keyboard, &replay_keyboard_impl, "magpie-replay");
+			seat.new_input_device(&keyboard.base);
+		} else {
+			wlr_pointer_init(&pointer, &replay_pointer_impl, "magpie-replay");
+			seat.new_input_device(&pointer.base);
+		}
+	}
+	ReplayDevice(const ReplayDevice&) = delete;
+	ReplayDevice& operator=(const ReplayDevice&) = delete;
+
+	~ReplayDevice() noexcept {
+		if (type == WLR_INPUT_DEVICE_KEYBOARD) {
+			wlr_keyboard_finish(&keyboard);
+		} else {
+			wlr_pointer_finish(&pointer);
+		}
+	}
+};
+
+static bool read_recording(const std::string& path, std::vector<InputRecord>& records, std::string& error) {
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr) {
+		error = path + ": " + std::strerror(errno);
+		return false;
+	}
+
+	InputRecordingHeader header = {};
+	if (std::fread(&header, sizeof(header), 1, file) != 1 || header.magic != MAGPIE_INPUT_RECORDING_MAGIC ||
+		header.version != MAGPIE_INPUT_RECORDING_VERSION) {
+		std::fclose(file);
+		error = path + " is not an input recording this version can replay";
+		return false;
+	}
+
+	InputRecord record = {};
+	while (std::fread(&record, sizeof(record), 1, file) == 1) {
+		records.push_back(record);
+	}
+	std::fclose(file);
+	return true;
+}
+
+/* Sends one recorded event through its device. Timestamps are the current
+ * time rather than the recorded ones, as clients compare them with their
+ * own clock. */
+static void replay_event(const InputRecord& record, ReplayDevice& device) {
+	const auto time_msec = static_cast<uint32_t>(monotonic_ns() / 1000000);
+	wlr_pointer* pointer = &device.pointer;
+
+	switch (record.type) {
+		case INPUT_RECORD_POINTER_MOTION: {
+			wlr_pointer_motion_event event = {pointer, time_msec, record.x, record.y, record.ux, record.uy};
+			wl_signal_emit_mutable(&pointer->events.motion, &event);
+			break;
+		}
+		case INPUT_RECORD_POINTER_MOTION_ABSOLUTE: {
+			wlr_pointer_motion_absolute_event event = {pointer, time_msec, record.x, record.y};
+			wl_signal_emit_mutable(&pointer->events.motion_absolute, &event);
+			break;
+		}
+		case INPUT_RECORD_POINTER_BUTTON: {
+			wlr_pointer_button_event event = {
+				pointer, time_msec, record.code, static_cast<wlr_button_state>(record.value)};
+			wl_signal_emit_mutable(&pointer->events.button, &event);
+			break;
+		}
+		case INPUT_RECORD_POINTER_AXIS: {
+			wlr_pointer_axis_event event = {pointer, time_msec, static_cast<wl_pointer_axis_source>(record.code >> 16),
+				static_cast<wl_pointer_axis>(record.code & 0xffff), record.x, record.value};
+			wl_signal_emit_mutable(&pointer->events.axis, &event);
+			break;
+		}
+		case INPUT_RECORD_POINTER_FRAME:
+			wl_signal_emit_mutable(&pointer->events.frame, pointer);
+			break;
+		case INPUT_RECORD_SWIPE_BEGIN: {
+			wlr_pointer_swipe_begin_event event = {pointer, time_msec, record.code};
+			wl_signal_emit_mutable(&pointer->events.swipe_begin, &event);
+			break;
+		}
+		case INPUT_RECORD_SWIPE_UPDATE: {
+			wlr_pointer_swipe_update_event event = {pointer, time_msec, record.code, record.x, record.y};
+			wl_signal_emit_mutable(&pointer->events.swipe_update, &event);
+			break;
+		}
+		case INPUT_RECORD_SWIPE_END: {
+			wlr_pointer_swipe_end_event event = {pointer, time_msec, record.value != 0};
+			wl_signal_emit_mutable(&pointer->events.swipe_end, &event);
+			break;
+		}
+		case INPUT_RECORD_PINCH_BEGIN: {
+			wlr_pointer_pinch_begin_event event = {pointer, time_msec, record.code};
+			wl_signal_emit_mutable(&pointer->events.pinch_begin, &event);
+			break;
+		}
+		case INPUT_RECORD_PINCH_UPDATE: {
+			wlr_pointer_pinch_update_event event = {
+				pointer, time_msec, record.code, record.x, record.y, record.ux, record.uy};
+			wl_signal_emit_mutable(&pointer->events.pinch_update, &event);
+			break;
+		}
+		case INPUT_RECORD_PINCH_END: {
+			wlr_pointer_pinch_end_event event = {pointer, time_msec, record.value != 0};
+			wl_signal_emit_mutable(&pointer->events.pinch_end, &event);
+			break;
+		}
+		case INPUT_RECORD_HOLD_BEGIN: {
+			wlr_pointer_hold_begin_event event = {pointer, time_msec, record.code};
+			wl_signal_emit_mutable(&pointer->events.hold_begin, &event);
+			break;
+		}
+		case INPUT_RECORD_HOLD_END: {
+			wlr_pointer_hold_end_event event = {pointer, time_msec, record.value != 0};
+			wl_signal_emit_mutable(&pointer->events.hold_end, &event);
+			break;
+		}
+		case INPUT_RECORD_KEY: {
+			wlr_keyboard_key_event event = {
+				time_msec, record.code, true, static_cast<wl_keyboard_key_state>(record.value)};
+			wlr_keyboard_notify_key(&device.keyboard, &event);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+/* Feeds a recording back at its original pace, recording how long each event
+ * took to process and how late it was sent. The frame times of the scenario
+ * show the cadence that resulted. */
+bool scenario_replay(Bench& bench, std::string& error) {
+	if (bench_options.replay.empty()) {
+		error = "no recording given, see -r";
+		return false;
+	}
+
+	std::vector<InputRecord> records;
+	if (!read_recording(bench_options.replay, records, error)) {
+		return false;
+	}
+
+	Seat& seat = *bench.server.seat;
+	std::map<uint16_t, std::unique_ptr<ReplayDevice>> devices;
+	uint32_t skipped = 0;
+
+	const uint64_t start = monotonic_ns();
+	for (const auto& record : records) {
+		const uint64_t due = start + record.time_ns;
+		for (uint64_t now = monotonic_ns(); now < due; now = monotonic_ns()) {
+			/* Sleeps in the event loop, then spins for the last millisecond */
+			bench.dispatch(static_cast<int>((due - now) / 1000000));
+		}
+
+		if (record.type == INPUT_RECORD_DEVICE) {
+			devices[record.device] =
+				std::make_unique<ReplayDevice>(seat, static_cast<wlr_input_device_type>(record.value));
+			continue;
+		}
+		bench.record("lag", monotonic_ns() - due);
+
+		const auto device = devices.find(record.device);
+		const bool is_key = record.type == INPUT_RECORD_KEY;
+		if (record.type > INPUT_RECORD_KEY || device == devices.end() ||
+			is_key != (device->second->type == WLR_INPUT_DEVICE_KEYBOARD)) {
+			skipped++;
+			continue;
+		}
+
+		const uint64_t event_start = monotonic_ns();
+		replay_event(record, *device->second);
+		bench.record(replay_operations[record.type], monotonic_ns() - event_start);
+	}
+
+	/* Lets the last frames and configures go out before the devices do */
+	bench.settle(100);
+	devices.clear();
+
+	if (skipped > 0) {
+		error = std::to_string(skipped) + " events had no device to replay them on";
+		return false;
+	}
+	return true;
+}
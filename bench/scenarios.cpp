@@ -0,0 +1,313 @@
+#include "bench.hpp"
+
+#include "client.hpp"
+#include "input/cursor.hpp"
+#include "input/seat.hpp"
+#include "output.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string_view>
+#include <utility>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/util/edges.h>
+#include "wlr-wrap-end.hpp"
+
+/* Lets a step share the loop with the frame timer, as real input would */
+static constexpr int SCENARIO_STEP_MS = 1;
+
+static uint32_t now_msec() {
+	return static_cast<uint32_t>(monotonic_ns() / 1000000);
+}
+
+static View* mapped_view(const Bench& bench) {
+	for (auto* view : std::as_const(bench.server.views)) {
+		if (view->scene_node->enabled) {
+			return view;
+		}
+	}
+	return nullptr;
+}
+
+/* Puts the pointer over the middle of a view, which gives it pointer focus
+ * the same way moving a real pointer there would */
+static void point_at(Bench& bench, const View& view) {
+	Cursor& cursor = bench.server.seat->cursor;
+	const wlr_box geometry = view.get_geometry();
+	wlr_cursor_warp_closest(
+		&cursor.wlr, nullptr, view.current.x + geometry.width / 2.0, view.current.y + geometry.height / 2.0);
+	cursor.process_motion(now_msec());
+}
+
+/* Maps the windows the other scenarios work with, spread over all clients */
+bool scenario_windows(Bench& bench, std::string& error) {
+	const uint32_t count = bench_options.clients;
+	for (uint32_t i = 0; i < count; i++) {
+		bench.clients.push_back(new SyntheticClient(bench, bench.socket, i));
+	}
+
+	const bool connected = bench.run_until(
+		[&bench] {
+			return std::all_of(bench.clients.begin(), bench.clients.end(), [](const SyntheticClient* client) {
+				return client->ready.load();
+			});
+		},
+		BENCH_TIMEOUT_MS);
+	if (!connected || std::any_of(bench.clients.begin(), bench.clients.end(), [](const SyntheticClient* client) {
+			return client->failed.load();
+		})) {
+		error = "clients failed to connect";
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		SyntheticClient& client = *bench.clients[i];
+		const uint32_t windows = bench_options.windows / count + (i < bench_options.windows % count ? 1 : 0);
+		client.post([&client, windows] {
+			client.create_windows(windows, BENCH_WINDOW_WIDTH, BENCH_WINDOW_HEIGHT);
+		});
+	}
+
+	const bool mapped = bench.run_until(
+		[&bench] {
+			const auto views = std::count_if(bench.server.views.begin(), bench.server.views.end(), [](const View* view) {
+				return view->scene_node->enabled;
+			});
+			return static_cast<uint32_t>(views) >= bench_options.windows;
+		},
+		BENCH_TIMEOUT_MS);
+	if (!mapped) {
+		error = "timed out waiting for windows to map";
+		return false;
+	}
+	return true;
+}
+
+/* Focuses every view in turn, each focus change restacks and sends configures
+ * to the old and the new view */
+bool scenario_focus(Bench& bench, std::string& error) {
+	if (bench.server.views.empty()) {
+		error = "no views";
+		return false;
+	}
+
+	for (uint32_t i = 0; i < bench_options.iterations; i++) {
+		/* The focused view moves to the front, so taking the last one each
+		 * time goes through all of them */
+		View* view = bench.server.views.back();
+
+		const uint64_t start = monotonic_ns();
+		bench.server.focus_view(view);
+		wl_display_flush_clients(bench.server.display);
+		bench.record("focus", monotonic_ns() - start);
+
+		bench.dispatch(SCENARIO_STEP_MS);
+	}
+	return true;
+}
+
+/* Drags a view around in a circle, as an interactive move */
+bool scenario_move(Bench& bench, std::string& error) {
+	View* view = mapped_view(bench);
+	if (view == nullptr) {
+		error = "no mapped views";
+		return false;
+	}
+
+	Cursor& cursor = bench.server.seat->cursor;
+	bench.server.focus_view(view);
+	point_at(bench, *view);
+	view->begin_interactive(MAGPIE_CURSOR_MOVE, 0);
+	if (bench.server.grabbed_view != view) {
+		error = "the view did not get pointer focus";
+		return false;
+	}
+
+	const double origin_x = cursor.wlr.x;
+	const double origin_y = cursor.wlr.y;
+	for (uint32_t i = 0; i < bench_options.iterations; i++) {
+		const double angle = static_cast<double>(i) * 0.05;
+		wlr_cursor_warp_closest(&cursor.wlr, nullptr, origin_x + 200 * std::cos(angle), origin_y + 200 * std::sin(angle));
+
+		const uint64_t start = monotonic_ns();
+		cursor.process_motion(now_msec());
+		bench.record("move", monotonic_ns() - start);
+		bench.dispatch(SCENARIO_STEP_MS);
+	}
+
+	cursor.reset_mode();
+	return true;
+}
+
+/* Resizes a view from its bottom right corner, back and forth. Each step
+ * waits for the client to answer with a buffer of the new size. */
+bool scenario_resize(Bench& bench, std::string& error) {
+	View* view = mapped_view(bench);
+	if (view == nullptr) {
+		error = "no mapped views";
+		return false;
+	}
+
+	Cursor& cursor = bench.server.seat->cursor;
+	bench.server.focus_view(view);
+	point_at(bench, *view);
+	const wlr_box geometry = view->get_geometry();
+	wlr_cursor_warp_closest(
+		&cursor.wlr, nullptr, view->current.x + geometry.width - 1, view->current.y + geometry.height - 1);
+	view->begin_interactive(MAGPIE_CURSOR_RESIZE, WLR_EDGE_RIGHT | WLR_EDGE_BOTTOM);
+	if (bench.server.grabbed_view != view) {
+		error = "the view did not get pointer focus";
+		return false;
+	}
+
+	const double origin_x = cursor.wlr.x;
+	const double origin_y = cursor.wlr.y;
+	uint32_t timeouts = 0;
+	for (uint32_t i = 0; i < bench_options.iterations; i++) {
+		const double offset = std::abs(static_cast<int32_t>(i % 100) - 50) * 4.0;
+		wlr_cursor_warp_closest(&cursor.wlr, nullptr, origin_x + offset, origin_y + offset);
+
+		const wlr_box before = view->get_geometry();
+		const uint64_t start = monotonic_ns();
+		cursor.process_motion(now_msec());
+		bench.record("resize_request", monotonic_ns() - start);
+
+		const bool answered = bench.run_until(
+			[view, &before] {
+				const wlr_box after = view->get_geometry();
+				return after.width != before.width || after.height != before.height;
+			},
+			1000);
+		if (answered) {
+			bench.record("resize_roundtrip", monotonic_ns() - start);
+		} else {
+			timeouts++;
+		}
+	}
+
+	cursor.reset_mode();
+	if (timeouts > 0) {
+		error = std::to_string(timeouts) + " resizes were never answered";
+		return false;
+	}
+	return true;
+}
+
+/* Every client opens and closes popups as fast as the compositor configures
+ * them */
+bool scenario_popups(Bench& bench, std::string& error) {
+	if (bench.clients.empty()) {
+		error = "no clients";
+		return false;
+	}
+
+	uint32_t expected = 0;
+	for (auto* client : bench.clients) {
+		const uint32_t start = client->popups_done.load();
+		expected += start + bench_options.iterations;
+		client->post([client] {
+			client->popup_storm(bench_options.iterations);
+		});
+	}
+
+	const bool done = bench.run_until(
+		[&bench, expected] {
+			uint32_t popups = 0;
+			for (const auto* client : bench.clients) {
+				popups += client->popups_done.load();
+			}
+			return popups >= expected;
+		},
+		BENCH_TIMEOUT_MS);
+	if (!done) {
+		error = "timed out waiting for popups";
+		return false;
+	}
+	return true;
+}
+
+static View* view_titled(const Bench& bench, const std::string_view title) {
+	for (auto* view : std::as_const(bench.server.views)) {
+		const char* view_title = view->get_title();
+		if (view_title != nullptr && view_title == title) {
+			return view;
+		}
+	}
+	return nullptr;
+}
+
+/* Runs the frame loop on virtual time. The first window of the first client
+ * animates while the clock moves one frame at a time, as fast as the
+ * compositor and the client keep up. Every frame must reach the window,
+ * stamped with exactly the time it was due. */
+bool scenario_frames(Bench& bench, std::string& error) {
+	if (bench.clients.empty() || bench.server.outputs.empty()) {
+		error = "no clients";
+		return false;
+	}
+
+	/* On top, a window covered by others gets no frames */
+	View* view = view_titled(bench, "bench 0 0");
+	if (view == nullptr) {
+		error = "the first window is gone";
+		return false;
+	}
+	bench.server.focus_view(view);
+	bench.settle(100);
+
+	SyntheticClient& client = *bench.clients.front();
+	const uint64_t interval_ns = (*bench.server.outputs.begin())->frame_interval_ns();
+	const uint32_t frames = bench_options.frames;
+	const uint64_t start_ns = monotonic_ns();
+	bench.server.use_virtual_clock(start_ns);
+
+	uint32_t answered = client.frames_answered.load() + 1;
+	client.post([&client, frames] {
+		client.animate(frames);
+	});
+	const auto frame_answered = [&client, &answered] {
+		return client.frames_answered.load() >= answered || client.failed.load();
+	};
+
+	bool ok = bench.run_until(frame_answered, BENCH_TIMEOUT_MS);
+	uint32_t extra_frames = 0;
+	for (uint32_t i = 0; ok && i < frames; i++) {
+		const uint64_t step_start = monotonic_ns();
+		extra_frames += bench.server.advance_clock(interval_ns) - 1;
+		answered++;
+		ok = bench.run_until(frame_answered, BENCH_TIMEOUT_MS);
+		bench.record("virtual_frame", monotonic_ns() - step_start);
+	}
+	bench.server.use_real_clock();
+
+	if (!ok || client.failed) {
+		error = "timed out waiting for the window to answer a frame";
+		return false;
+	}
+	if (extra_frames > 0) {
+		error = std::to_string(extra_frames) + " frames came off the pace";
+		return false;
+	}
+
+	const std::vector<uint32_t> times = client.take_frame_times();
+	if (times.size() != frames) {
+		error = std::to_string(times.size()) + " of " + std::to_string(frames) + " frames reached the window";
+		return false;
+	}
+	uint32_t off = 0;
+	for (uint32_t i = 0; i < frames; i++) {
+		/* Frame done times are in milliseconds, truncated */
+		const auto due_msec = static_cast<uint32_t>((start_ns + (i + 1) * interval_ns) / 1000000);
+		off += times[i] != due_msec ? 1 : 0;
+	}
+	if (off > 0) {
+		error = std::to_string(off) + " frames were stamped with the wrong time";
+		return false;
+	}
+	return true;
+}
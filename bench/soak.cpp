@@ -0,0 +1,260 @@
+#include "bench.hpp"
+
+#include "client.hpp"
+#include "input/seat.hpp"
+#include "live_objects.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <malloc.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* Opens and closes the same set of windows, popups, layer surfaces and
+ * keyboards over and over, and checks that the compositor is back where it
+ * started after each round: the same objects alive, and no more memory than
+ * after the first round, which fills the caches. */
+
+
+struct SoakOptions {
+	uint32_t cycles = 20;
+	uint32_t clients = 4;
+	uint32_t windows = 200;
+	uint32_t popups = 200;
+	uint32_t layers = 32;
+	uint32_t keyboards = 32;
+	/* How much the resident set may grow after the first cycle */
+	uint32_t max_growth_kib = 4096;
+};
+
+static SoakOptions options;
+
+static constexpr wlr_keyboard_impl soak_keyboard_impl = {"magpie-soak", nullptr};
+
+using LiveCounts = std::vector<uint64_t>;
+
+static LiveCounts live_counts() {
+	return {std::begin(live_object_counts), std::end(live_object_counts)};
+}
+
+/* Spread over the clients, the first ones taking the remainder */
+static uint32_t share(const uint32_t total, const uint32_t index) {
+	return total / options.clients + (index < total % options.clients ? 1 : 0);
+}
+
+template <typename Counter>
+static uint32_t sum(const Bench& bench, Counter counter) {
+	uint32_t total = 0;
+	for (const auto* client : bench.clients) {
+		total += counter(*client);
+	}
+	return total;
+}
+
+/* Plugged in and pulled out again, each one going through the seat the way
+ * a virtual keyboard does */
+static void churn_keyboards(Seat& seat) {
+	std::vector<std::unique_ptr<wlr_keyboard>> keyboards;
+	for (uint32_t i = 0; i < options.keyboards; i++) {
+		auto& keyboard = *keyboards.emplace_back(std::make_unique<wlr_keyboard>());
+		wlr_keyboard_init(&keyboard, &soak_keyboard_impl, "magpie-soak");
+		seat.new_input_device(&keyboard.base);
+	}
+	for (auto& keyboard : keyboards) {
+		wlr_keyboard_finish(keyboard.get());
+	}
+}
+
+static bool run_cycle(Bench& bench, std::string& error) {
+	for (uint32_t i = 0; i < options.clients; i++) {
+		bench.clients.push_back(new SyntheticClient(bench, bench.socket, i));
+	}
+	const bool connected = bench.run_until(
+		[&bench] {
+			return sum(bench, [](const SyntheticClient& client) { return client.ready ? 1U : 0U; }) == options.clients;
+		},
+		BENCH_TIMEOUT_MS);
+	if (!connected || sum(bench, [](const SyntheticClient& client) { return client.failed ? 1U : 0U; }) > 0) {
+		error = "clients failed to connect";
+		return false;
+	}
+
+	for (uint32_t i = 0; i < options.clients; i++) {
+		SyntheticClient& client = *bench.clients[i];
+		const uint32_t windows = std::max(share(options.windows, i), 1U);
+		const uint32_t layers = share(options.layers, i);
+		client.post([&client, windows, layers] {
+			client.create_windows(windows, BENCH_SMALL_WINDOW_WIDTH, BENCH_SMALL_WINDOW_HEIGHT, 1);
+			if (layers > 0) {
+				client.create_layers(layers);
+			}
+		});
+	}
+	const bool mapped = bench.run_until(
+		[&bench] {
+			return sum(bench, [](const SyntheticClient& client) { return client.windows_configured.load(); }) >=
+					   std::max(options.windows, options.clients) &&
+				   sum(bench, [](const SyntheticClient& client) { return client.layers_configured.load(); }) >=
+					   options.layers;
+		},
+		BENCH_TIMEOUT_MS);
+	if (!mapped) {
+		error = "timed out waiting for windows and layers";
+		return false;
+	}
+
+	for (uint32_t i = 0; i < options.clients; i++) {
+		SyntheticClient& client = *bench.clients[i];
+		const uint32_t popups = share(options.popups, i);
+		client.post([&client, popups] {
+			client.popup_storm(popups);
+		});
+	}
+	SyntheticClient& first = *bench.clients.front();
+	first.post([&first] {
+		first.confine_pointer(4);
+	});
+	const bool done = bench.run_until(
+		[&bench, &first] {
+			return sum(bench, [](const SyntheticClient& client) { return client.popups_done.load(); }) >= options.popups &&
+				   first.pointer_confined;
+		},
+		BENCH_TIMEOUT_MS);
+	if (!done) {
+		error = "timed out waiting for popups and the pointer constraint";
+		return false;
+	}
+
+	/* Every focus change lands on the constrained window at some point */
+	for (uint32_t i = 0; i < 2 * options.windows && !bench.server.views.empty(); i++) {
+		bench.server.focus_view(bench.server.views.back());
+		bench.dispatch(0);
+	}
+	churn_keyboards(*bench.server.seat);
+
+	for (const auto* client : bench.clients) {
+		delete client;
+	}
+	bench.clients.clear();
+	return true;
+}
+
+static void usage(const char* name) {
+	std::fprintf(stderr,
+		"Usage: %s [-n cycles] [-c clients] [-w windows] [-p popups] [-l layers] [-k keyboards] [-g max growth KiB] [-v]\n",
+		name);
+}
+
+int main(const int argc, char** argv) {
+	wlr_log_importance level = WLR_ERROR;
+	const std::vector<BenchOption> bench_options = {
+		BenchOption::counted('n', options.cycles, 1000000),
+		BenchOption::counted('c', options.clients, 1000000),
+		BenchOption::counted('w', options.windows, 1000000),
+		BenchOption::counted('p', options.popups, 1000000, true),
+		BenchOption::counted('l', options.layers, 1000000, true),
+		BenchOption::counted('k', options.keyboards, 1000000, true),
+		BenchOption::counted('g', options.max_growth_kib, 1000000, true),
+	};
+	if (!bench_parse_options(argc, argv, bench_options, level)) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (optind != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!bench_init(level)) {
+		return 1;
+	}
+
+	Server server(MAGPIE_BACKEND_HEADLESS);
+	Bench* bench = bench_start(server);
+	if (bench == nullptr) {
+		return 1;
+	}
+	bench->settle();
+
+	bench->report.begin_object();
+	bench->report.key("cycles").value(options.cycles);
+	bench->report.key("clients").value(options.clients);
+	bench->report.key("windows").value(options.windows);
+	bench->report.key("popups").value(options.popups);
+	bench->report.key("layers").value(options.layers);
+	bench->report.key("keyboards").value(options.keyboards);
+	bench->report.key("baseline");
+	live_objects_write_json(bench->report);
+	bench->report.key("results").begin_array();
+
+	const LiveCounts baseline = live_counts();
+	uint64_t first_rss_kib = 0;
+	uint64_t last_rss_kib = 0;
+	std::string error;
+	for (uint32_t cycle = 0; cycle < options.cycles && error.empty(); cycle++) {
+		wlr_log(WLR_INFO, "Soak cycle %u", cycle);
+		const uint64_t start = monotonic_ns();
+		if (!run_cycle(*bench, error)) {
+			error = "cycle " + std::to_string(cycle) + ": " + error;
+			break;
+		}
+
+		/* The last destroys come in with the clients' disconnects */
+		const bool settled = bench->run_until(
+			[&baseline] {
+				return live_counts() == baseline;
+			},
+			BENCH_TIMEOUT_MS);
+		/* Gives back what the allocator keeps around, so it isn't taken for a leak */
+		malloc_trim(0);
+		last_rss_kib = resident_set_kib();
+		if (cycle == 0) {
+			first_rss_kib = last_rss_kib;
+		}
+
+		bench->report.begin_object();
+		bench->report.key("cycle").value(cycle);
+		bench->report.key("wall_ms").value(static_cast<double>((monotonic_ns() - start) / 10000) / 100);
+		bench->report.key("live");
+		live_objects_write_json(bench->report);
+		bench->report.end_object();
+
+		if (!settled) {
+			const LiveCounts counts = live_counts();
+			for (int type = 0; type < LIVE_OBJECT_TYPE_COUNT; type++) {
+				if (counts[type] != baseline[type]) {
+					error = "cycle " + std::to_string(cycle) + " left " + std::to_string(counts[type]) + " " +
+							live_object_name(static_cast<LiveObjectType>(type)) + " alive, " +
+							std::to_string(baseline[type]) + " before";
+					break;
+				}
+			}
+		}
+	}
+	if (error.empty() && last_rss_kib > first_rss_kib + options.max_growth_kib) {
+		error = "the resident set grew by " + std::to_string(last_rss_kib - first_rss_kib) + " KiB after the first cycle";
+	}
+
+	bench->report.end_array();
+	bench->report.key("rss_growth_kib").value(static_cast<int64_t>(last_rss_kib) - static_cast<int64_t>(first_rss_kib));
+	bench->report.key("ok").value(error.empty());
+	if (!error.empty()) {
+		bench->report.key("error").value(error);
+	}
+	bench->report.end_object();
+	std::printf("%s\n", bench->report.str().c_str());
+
+	bench_finish(server, bench);
+
+	return error.empty() ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+#include "alloc_guard.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+
+enum AllocGuardMode {
+	ALLOC_GUARD_UNSET,
+	ALLOC_GUARD_COUNT,
+	ALLOC_GUARD_TRAP,
+};
+
+constinit thread_local const char* alloc_guard_scope = nullptr;
+
+/* All constant initialized, operator new runs before any dynamic initializer
+ * does */
+static constinit std::atomic<uint64_t> allocations = 0;
+static constinit std::atomic<const char*> last_scope = nullptr;
+static constinit std::atomic<int> mode = ALLOC_GUARD_UNSET;
+
+static bool trapping() {
+	int current = mode.load(std::memory_order_relaxed);
+	if (current == ALLOC_GUARD_UNSET) {
+		const char* env = std::getenv("MAGPIE_ALLOC_GUARD");
+		const int from_env = env != nullptr && std::strcmp(env, "trap") == 0 ? ALLOC_GUARD_TRAP : ALLOC_GUARD_COUNT;
+		if (mode.compare_exchange_strong(current, from_env, std::memory_order_relaxed)) {
+			current = from_env;
+		}
+	}
+	return current == ALLOC_GUARD_TRAP;
+}
+
+static void check_allocation(const std::size_t size) {
+	const char* scope = alloc_guard_scope;
+	if (scope == nullptr) {
+		return;
+	}
+
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	last_scope.store(scope, std::memory_order_relaxed);
+	if (trapping()) {
+		/* Nothing here may allocate again */
+		char message[128];
+		const int len = std::snprintf(message, sizeof(message), "magpie: %zu byte allocation in hot path %s\n", size, scope);
+		(void) !write(STDERR_FILENO, message, len > 0 ? static_cast<size_t>(len) : 0);
+		std::abort();
+	}
+}
+
+static void* allocate(const std::size_t size, const std::align_val_t align = std::align_val_t(0)) noexcept {
+	check_allocation(size);
+
+	const auto alignment = static_cast<std::size_t>(align);
+	if (alignment <= alignof(std::max_align_t)) {
+		return std::malloc(size != 0 ? size : 1);
+	}
+	void* ptr = nullptr;
+	return posix_memalign(&ptr, alignment, size != 0 ? size : 1) == 0 ? ptr : nullptr;
+}
+
+static void* allocate_or_throw(const std::size_t size, const std::align_val_t align = std::align_val_t(0)) {
+	void* ptr = allocate(size, align);
+	if (ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+uint64_t alloc_guard_count() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+const char* alloc_guard_last_scope() {
+	return last_scope.load(std::memory_order_relaxed);
+}
+
+void alloc_guard_reset() {
+	allocations.store(0, std::memory_order_relaxed);
+	last_scope.store(nullptr, std::memory_order_relaxed);
+}
+
+void alloc_guard_set_trap(const bool trap) {
+	mode.store(trap ? ALLOC_GUARD_TRAP : ALLOC_GUARD_COUNT, std::memory_order_relaxed);
+}
+
+/* Every replaceable form, so none of them reaches the default allocator that
+ * the hooks would not see. All memory comes from malloc, and goes back with
+ * free. */
+void* operator new(const std::size_t size) {
+	return allocate_or_throw(size);
+}
+
+void* operator new[](const std::size_t size) {
+	return allocate_or_throw(size);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t align) {
+	return allocate_or_throw(size, align);
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t align) {
+	return allocate_or_throw(size, align);
+}
+
+void* operator new(const std::size_t size, const std::nothrow_t& tag) noexcept {
+	(void) tag;
+	return allocate(size);
+}
+
+void* operator new[](const std::size_t size, const std::nothrow_t& tag) noexcept {
+	(void) tag;
+	return allocate(size);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t align, const std::nothrow_t& tag) noexcept {
+	(void) tag;
+	return allocate(size, align);
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t align, const std::nothrow_t& tag) noexcept {
+	(void) tag;
+	return allocate(size, align);
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::size_t size) noexcept {
+	(void) size;
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::size_t size) noexcept {
+	(void) size;
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::align_val_t align) noexcept {
+	(void) align;
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::align_val_t align) noexcept {
+	(void) align;
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::size_t size, const std::align_val_t align) noexcept {
+	(void) size;
+	(void) align;
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::size_t size, const std::align_val_t align) noexcept {
+	(void) size;
+	(void) align;
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t& tag) noexcept {
+	(void) tag;
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t& tag) noexcept {
+	(void) tag;
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::align_val_t align, const std::nothrow_t& tag) noexcept {
+	(void) align;
+	(void) tag;
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::align_val_t align, const std::nothrow_t& tag) noexcept {
+	(void) align;
+	(void) tag;
+	std::free(ptr);
+}
@@ -0,0 +1,57 @@
+#ifndef MAGPIE_ALLOC_GUARD_HPP
+#define MAGPIE_ALLOC_GUARD_HPP
+
+/* Checks that the paths run for every input event and every frame stay off
+ * the heap. Built only with the alloc_guard meson option, which replaces the
+ * global operator new, otherwise every macro below expands to nothing.
+ *
+ * Allocations through operator new made on a thread while it is inside a
+ * MAGPIE_HOT_PATH scope are counted, and abort with the scope's name when
+ * trapping is on, either from alloc_guard_set_trap or by starting with
+ * MAGPIE_ALLOC_GUARD=trap. MAGPIE_ALLOC_ALLOWED lifts that for the rest of
+ * its own scope, for work that is rare or opt-in, like key binding actions
+ * and recordings. malloc from C code, wlroots included, is not seen. Scope
+ * names must be string literals. */
+
+#ifdef MAGPIE_ALLOC_GUARD
+
+#include <cstdint>
+
+#define MAGPIE_ALLOC_GUARD_CONCAT_INNER(a, b) a##b
+#define MAGPIE_ALLOC_GUARD_CONCAT(a, b) MAGPIE_ALLOC_GUARD_CONCAT_INNER(a, b)
+
+#define MAGPIE_HOT_PATH(name) const AllocGuardScope MAGPIE_ALLOC_GUARD_CONCAT(magpie_hot_path_, __LINE__)(name)
+#define MAGPIE_ALLOC_ALLOWED() const AllocGuardScope MAGPIE_ALLOC_GUARD_CONCAT(magpie_alloc_allowed_, __LINE__)(nullptr)
+
+/* The innermost scope of the calling thread, nullptr outside of hot paths */
+extern constinit thread_local const char* alloc_guard_scope;
+
+[[nodiscard]] uint64_t alloc_guard_count();
+/* The scope of the last allocation counted, nullptr if there was none */
+[[nodiscard]] const char* alloc_guard_last_scope();
+void alloc_guard_reset();
+void alloc_guard_set_trap(bool trap);
+
+class AllocGuardScope {
+	const char* previous;
+
+  public:
+	explicit AllocGuardScope(const char* name) noexcept : previous(alloc_guard_scope) {
+		alloc_guard_scope = name;
+	}
+	AllocGuardScope(const AllocGuardScope&) = delete;
+	AllocGuardScope& operator=(const AllocGuardScope&) = delete;
+
+	~AllocGuardScope() noexcept {
+		alloc_guard_scope = previous;
+	}
+};
+
+#else
+
+#define MAGPIE_HOT_PATH(name) ((void) 0)
+#define MAGPIE_ALLOC_ALLOWED() ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,331 @@
+#include "capture.hpp"
+
+#include "clock.hpp"
+#include "server.hpp"
+
+#include <cinttypes>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+#include "wlr-wrap-start.hpp"
+#include <wayland-server-protocol.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* A few frames of requests, or part of a buffer */
+static constexpr size_t PROTOCOL_CAPTURE_CHUNK = 64 * 1024;
+static constexpr uint32_t PROTOCOL_CAPTURE_DISPLAY_ID = 1;
+
+static void put_u32(std::vector<char>& payload, const uint32_t value) {
+	const auto* bytes = reinterpret_cast<const char*>(&value);
+	payload.insert(payload.end(), bytes, bytes + sizeof(value));
+}
+
+static void put_bytes(std::vector<char>& payload, const void* data, const size_t size) {
+	put_u32(payload, static_cast<uint32_t>(size));
+	const auto* bytes = static_cast<const char*>(data);
+	payload.insert(payload.end(), bytes, bytes + size);
+}
+
+static void put_string(std::vector<char>& payload, const char* string) {
+	put_bytes(payload, string, string != nullptr ? std::strlen(string) + 1 : 0);
+}
+
+static void client_capture_client_destroy_notify(wl_listener* listener, void* data) {
+	ClientCapture& capture = magpie_container_of(listener, capture, client_destroy);
+	(void) data;
+
+	capture.capture.client_destroyed(capture);
+}
+
+ClientCapture::ClientCapture(ProtocolCapture& capture, wl_client* client, const pid_t pid) noexcept
+	: listeners(*this), start_ns(clock_now_ns()), capture(capture), client(client), pid(pid),
+	  writer(*capture.server.workers, PROTOCOL_CAPTURE_CHUNK) {
+	listeners.client_destroy.notify = client_capture_client_destroy_notify;
+	wl_client_add_destroy_listener(client, &listeners.client_destroy);
+
+	/* The one object every client starts with */
+	objects[PROTOCOL_CAPTURE_DISPLAY_ID] = &wl_display_interface;
+
+	const ProtocolCaptureHeader header = {MAGPIE_PROTOCOL_CAPTURE_MAGIC, MAGPIE_PROTOCOL_CAPTURE_VERSION, start_ns};
+	if (writer.open(default_recording_path("protocol", "mgpc"), &header, sizeof(header))) {
+		wlr_log(WLR_INFO, "Capturing the requests of client %d to %s", pid, writer.path.c_str());
+	}
+}
+
+ClientCapture::~ClientCapture() noexcept {
+	wl_list_remove(&listeners.client_destroy.link);
+	writer.close();
+}
+
+/* Interfaces are described the first time they are referred to, along with
+ * every interface their messages refer to */
+uint32_t ClientCapture::interface_index(const wl_interface* interface) {
+	if (interface == nullptr) {
+		return PROTOCOL_CAPTURE_NO_INTERFACE;
+	}
+
+	const auto known = interfaces.find(interface);
+	if (known != interfaces.end()) {
+		return known->second;
+	}
+
+	const auto index = static_cast<uint32_t>(interfaces.size());
+	interfaces.emplace(interface, index);
+
+	std::vector<char> payload;
+	put_u32(payload, index);
+	put_string(payload, interface->name);
+	put_u32(payload, static_cast<uint32_t>(interface->version));
+	put_u32(payload, static_cast<uint32_t>(interface->method_count));
+	put_u32(payload, static_cast<uint32_t>(interface->event_count));
+
+	const auto put_messages = [this, &payload](const wl_message* messages, const int count) {
+		for (int i = 0; i < count; i++) {
+			const wl_message& message = messages[i];
+			put_string(payload, message.name);
+			put_string(payload, message.signature);
+
+			uint32_t arguments = 0;
+			for (const char* c = message.signature; *c != '\0'; c++) {
+				if (std::strchr("iufsonah", *c) != nullptr) {
+					arguments++;
+				}
+			}
+			for (uint32_t argument = 0; argument < arguments; argument++) {
+				put_u32(payload, interface_index(message.types != nullptr ? message.types[argument] : nullptr));
+			}
+		}
+	};
+	put_messages(interface->methods, interface->method_count);
+	put_messages(interface->events, interface->event_count);
+
+	write_record(PROTOCOL_CAPTURE_INTERFACE, payload);
+	return index;
+}
+
+void ClientCapture::write_record(const ProtocolCaptureRecordType type, const std::vector<char>& payload) {
+	const ProtocolCaptureRecord record = {clock_now_ns() - start_ns, type, static_cast<uint32_t>(payload.size())};
+	writer.append(&record, sizeof(record));
+	writer.append(payload.data(), payload.size());
+}
+
+/* Only buffers the compositor can read back, which are the shm ones. A
+ * buffer attached again with the same contents isn't written again. */
+void ClientCapture::buffer(wl_resource* resource) {
+	wlr_buffer* buffer = wlr_buffer_try_from_resource(resource);
+	if (buffer == nullptr) {
+		return;
+	}
+
+	void* data = nullptr;
+	uint32_t format = 0;
+	size_t stride = 0;
+	if (wlr_buffer_begin_data_ptr_access(buffer, WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		const size_t size = stride * static_cast<size_t>(buffer->height);
+		const std::string_view contents(static_cast<const char*>(data), size);
+		const size_t hash = std::hash<std::string_view>{}(contents);
+
+		const uint32_t id = wl_resource_get_id(resource);
+		const auto last = buffer_hashes.find(id);
+		if (last == buffer_hashes.end() || last->second != hash) {
+			buffer_hashes[id] = hash;
+
+			std::vector<char> payload;
+			payload.reserve(5 * sizeof(uint32_t) + size);
+			put_u32(payload, id);
+			put_u32(payload, static_cast<uint32_t>(buffer->width));
+			put_u32(payload, static_cast<uint32_t>(buffer->height));
+			put_u32(payload, static_cast<uint32_t>(stride));
+			put_bytes(payload, data, size);
+			write_record(PROTOCOL_CAPTURE_BUFFER, payload);
+		}
+		wlr_buffer_end_data_ptr_access(buffer);
+	}
+	wlr_buffer_unlock(buffer);
+}
+
+void ClientCapture::request(const wl_protocol_logger_message& message) {
+	if (!writer.is_open()) {
+		return;
+	}
+
+	const uint32_t id = wl_resource_get_id(message.resource);
+	const auto object = objects.find(id);
+	if (object == objects.end()) {
+		/* Made by the compositor, or by a global that wasn't advertised */
+		wlr_log(WLR_DEBUG, "Not capturing %s.%s on unknown object %u", wl_resource_get_class(message.resource),
+			message.message->name, id);
+		return;
+	}
+	const wl_interface* interface = object->second;
+
+	std::vector<char> payload;
+	put_u32(payload, id);
+	put_u32(payload, interface_index(interface));
+	put_u32(payload, static_cast<uint32_t>(message.message_opcode));
+
+	const char* last_string = nullptr;
+	int index = 0;
+	for (const char* c = message.message->signature; *c != '\0' && index < message.arguments_count; c++) {
+		const wl_argument& argument = message.arguments[index];
+		switch (*c) {
+			case 'i':
+			case 'u':
+			case 'f':
+				put_u32(payload, argument.u);
+				break;
+			case 's':
+				put_string(payload, argument.s);
+				last_string = argument.s;
+				break;
+			case 'o':
+				put_u32(payload, argument.o != nullptr ? wl_resource_get_id(reinterpret_cast<wl_resource*>(argument.o)) : 0);
+				break;
+			case 'n': {
+				put_u32(payload, argument.n);
+				/* Untyped only in wl_registry.bind, named by the string before */
+				const wl_interface* created = message.message->types != nullptr ? message.message->types[index] : nullptr;
+				if (created == nullptr && last_string != nullptr) {
+					created = capture.global_interface(last_string);
+				}
+				if (created != nullptr) {
+					objects[argument.n] = created;
+					interface_index(created);
+				} else {
+					objects.erase(argument.n);
+				}
+				buffer_hashes.erase(argument.n);
+				break;
+			}
+			case 'a':
+				if (argument.a != nullptr) {
+					put_bytes(payload, argument.a->data, argument.a->size);
+				} else {
+					put_u32(payload, 0);
+				}
+				break;
+			case 'h':
+				break;
+			default:
+				/* Versions and nullability */
+				continue;
+		}
+		index++;
+	}
+
+	if (interface == &wl_surface_interface && std::strcmp(message.message->name, "attach") == 0 &&
+		message.arguments[0].o != nullptr) {
+		buffer(reinterpret_cast<wl_resource*>(message.arguments[0].o));
+	}
+	write_record(PROTOCOL_CAPTURE_REQUEST, payload);
+	requests++;
+}
+
+static void protocol_capture_client_created_notify(wl_listener* listener, void* data) {
+	ProtocolCapture& capture = magpie_container_of(listener, capture, client_created);
+
+	capture.client_created(static_cast<wl_client*>(data));
+}
+
+static void protocol_capture_log(void* data, const wl_protocol_logger_type type, const wl_protocol_logger_message* message) {
+	static_cast<ProtocolCapture*>(data)->log(type, *message);
+}
+
+static bool protocol_capture_global_filter(const wl_client* client, const wl_global* global, void* data) {
+	return static_cast<ProtocolCapture*>(data)->filter_global(*client, *global);
+}
+
+ProtocolCapture::ProtocolCapture(Server& server) noexcept : listeners(*this), server(server) {
+	listeners.client_created.notify = protocol_capture_client_created_notify;
+}
+
+ProtocolCapture::~ProtocolCapture() noexcept {
+	stop();
+}
+
+/* Captures the clients that connect from now on. The command is matched
+ * against the first 15 characters of the client's executable name. */
+void ProtocolCapture::start(const std::string& new_command) {
+	if (capturing()) {
+		return;
+	}
+
+	command = new_command.substr(0, 15);
+	captured.clear();
+	/* Bound globals are only named, their interface comes from here */
+	previous_filter = server.global_filter;
+	previous_filter_data = server.global_filter_data;
+	server.set_global_filter(protocol_capture_global_filter, this);
+	wl_display_add_client_created_listener(server.display, &listeners.client_created);
+	logger = wl_display_add_protocol_logger(server.display, protocol_capture_log, this);
+	wlr_log(WLR_INFO, "Capturing the protocol of %s", command.empty() ? "new clients" : command.c_str());
+}
+
+/* Returns the captures made since starting, the ones of clients still
+ * connected end here */
+std::vector<CapturedClient> ProtocolCapture::stop() {
+	if (!capturing()) {
+		return {};
+	}
+
+	wl_protocol_logger_destroy(logger);
+	logger = nullptr;
+	wl_list_remove(&listeners.client_created.link);
+	server.set_global_filter(previous_filter, previous_filter_data);
+
+	while (!clients.empty()) {
+		client_destroyed(*clients.begin()->second);
+	}
+	return std::exchange(captured, {});
+}
+
+void ProtocolCapture::client_created(wl_client* client) {
+	pid_t pid = 0;
+	wl_client_get_credentials(client, &pid, nullptr, nullptr);
+	if (!command.empty() && process_command(pid) != command) {
+		return;
+	}
+
+	clients.emplace(client, new ClientCapture(*this, client, pid));
+}
+
+void ProtocolCapture::client_destroyed(ClientCapture& capture) {
+	if (capture.writer.is_open()) {
+		wlr_log(WLR_INFO, "Captured %" PRIu64 " requests of client %d to %s", capture.requests, capture.pid,
+			capture.writer.path.c_str());
+		captured.push_back({capture.writer.path, capture.pid, capture.requests});
+	}
+	clients.erase(capture.client);
+	delete &capture;
+}
+
+void ProtocolCapture::log(const wl_protocol_logger_type type, const wl_protocol_logger_message& message) {
+	if (type != WL_PROTOCOL_LOGGER_REQUEST) {
+		return;
+	}
+
+	const auto client = clients.find(wl_resource_get_client(message.resource));
+	if (client != clients.end()) {
+		client->second->request(message);
+	}
+}
+
+/* Leaves the decision to the filter that was there before, and only notes
+ * the interface of the globals clients are shown */
+bool ProtocolCapture::filter_global(const wl_client& client, const wl_global& global) {
+	if (previous_filter != nullptr && !previous_filter(&client, &global, previous_filter_data)) {
+		return false;
+	}
+
+	const wl_interface* interface = wl_global_get_interface(&global);
+	globals.emplace(interface->name, interface);
+	return true;
+}
+
+const wl_interface* ProtocolCapture::global_interface(const char* name) const {
+	const auto global = globals.find(name);
+	return global != globals.end() ? global->second : nullptr;
+}
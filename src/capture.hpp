@@ -0,0 +1,132 @@
+#ifndef MAGPIE_CAPTURE_HPP
+#define MAGPIE_CAPTURE_HPP
+
+#include "recording.hpp"
+#include "types.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include <wayland-server-core.h>
+
+static constexpr uint32_t MAGPIE_PROTOCOL_CAPTURE_MAGIC = 0x4350474d; /* "MGPC" */
+static constexpr uint32_t MAGPIE_PROTOCOL_CAPTURE_VERSION = 1;
+/* An argument that is not an object, or one of any interface */
+static constexpr uint32_t PROTOCOL_CAPTURE_NO_INTERFACE = UINT32_MAX;
+
+/* What follows the record header for each type. Numbers are 32 bits, strings
+ * and arrays a 32 bit length followed by their bytes. */
+enum ProtocolCaptureRecordType : uint32_t {
+	/* index, name, version, method count, event count, then for each message
+	 * its name, signature and the interface index of each argument. The
+	 * indices may point at interfaces described later, as they form cycles. */
+	PROTOCOL_CAPTURE_INTERFACE,
+	/* object id, interface index, opcode, then each argument: numbers as they
+	 * are, objects and new ids as ids, 0 for null, strings with their NUL and
+	 * a length of 0 for null. File descriptors are left out. */
+	PROTOCOL_CAPTURE_REQUEST,
+	/* wl_buffer id, width, height, stride, then the stride * height bytes the
+	 * buffer held when it was attached. Comes before the attach. */
+	PROTOCOL_CAPTURE_BUFFER,
+};
+
+/* A capture is this header followed by records of any size, in the machine's
+ * byte order. Times are clock_now_ns nanoseconds. */
+struct ProtocolCaptureHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t start_ns;
+};
+
+struct ProtocolCaptureRecord {
+	/* Since the client connected */
+	uint64_t time_ns;
+	uint32_t type;
+	uint32_t size;
+};
+
+/* The requests of one client, from its very first one, for replaying with
+ * magpie-protocol-replay */
+class ClientCapture {
+  public:
+	struct Listeners {
+		std::reference_wrapper<ClientCapture> parent;
+		wl_listener client_destroy = {};
+		explicit Listeners(ClientCapture& parent) noexcept : parent(parent) {}
+	};
+
+  private:
+	Listeners listeners;
+	uint64_t start_ns;
+	std::map<uint32_t, const wl_interface*> objects;
+	std::map<const wl_interface*, uint32_t> interfaces;
+	std::map<uint32_t, size_t> buffer_hashes;
+
+	uint32_t interface_index(const wl_interface* interface);
+	void write_record(ProtocolCaptureRecordType type, const std::vector<char>& payload);
+	void buffer(wl_resource* resource);
+
+  public:
+	ProtocolCapture& capture;
+	wl_client* client;
+	pid_t pid;
+	RecordingWriter writer;
+	uint64_t requests = 0;
+
+	ClientCapture(ProtocolCapture& capture, wl_client* client, pid_t pid) noexcept;
+	~ClientCapture() noexcept;
+
+	void request(const wl_protocol_logger_message& message);
+};
+
+struct CapturedClient {
+	std::string path;
+	pid_t pid;
+	uint64_t requests;
+};
+
+/* Captures the clients that connect while it runs, all of them or the ones
+ * whose command matches. Clients that were already connected are left out,
+ * as a replay has to start from the first request. */
+class ProtocolCapture {
+  public:
+	struct Listeners {
+		std::reference_wrapper<ProtocolCapture> parent;
+		wl_listener client_created = {};
+		explicit Listeners(ProtocolCapture& parent) noexcept : parent(parent) {}
+	};
+
+  private:
+	Listeners listeners;
+	wl_protocol_logger* logger = nullptr;
+	wl_display_global_filter_func_t previous_filter = nullptr;
+	void* previous_filter_data = nullptr;
+	std::string command;
+	std::map<wl_client*, ClientCapture*> clients;
+	std::map<std::string, const wl_interface*> globals;
+	std::vector<CapturedClient> captured;
+
+  public:
+	Server& server;
+
+	explicit ProtocolCapture(Server& server) noexcept;
+	~ProtocolCapture() noexcept;
+
+	[[nodiscard]] bool capturing() const {
+		return logger != nullptr;
+	}
+	void start(const std::string& new_command = {});
+	std::vector<CapturedClient> stop();
+
+	void client_created(wl_client* client);
+	void client_destroyed(ClientCapture& capture);
+	void log(wl_protocol_logger_type type, const wl_protocol_logger_message& message);
+	bool filter_global(const wl_client& client, const wl_global& global);
+	[[nodiscard]] const wl_interface* global_interface(const char* name) const;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "clock.hpp"
+
+#include <atomic>
+
+/* 0 while following the real clock */
+static std::atomic<uint64_t> virtual_now_ns = 0;
+
+uint64_t monotonic_ns() {
+	timespec now = {};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+uint64_t clock_now_ns() {
+	const uint64_t now = virtual_now_ns.load(std::memory_order_acquire);
+	return now != 0 ? now : monotonic_ns();
+}
+
+timespec clock_now_timespec() {
+	const uint64_t now = clock_now_ns();
+	return {static_cast<time_t>(now / 1000000000), static_cast<long>(now % 1000000000)};
+}
+
+bool clock_is_virtual() {
+	return virtual_now_ns.load(std::memory_order_acquire) != 0;
+}
+
+void clock_set_virtual(const uint64_t now_ns) {
+	virtual_now_ns.store(now_ns != 0 ? now_ns : 1, std::memory_order_release);
+}
+
+void clock_set_real() {
+	virtual_now_ns.store(0, std::memory_order_release);
+}
+
+uint64_t clock_from_monotonic(const timespec& when) {
+	const uint64_t when_ns = static_cast<uint64_t>(when.tv_sec) * 1000000000 + when.tv_nsec;
+	const uint64_t virtual_now = virtual_now_ns.load(std::memory_order_acquire);
+	if (virtual_now == 0) {
+		return when_ns;
+	}
+
+	/* As long ago in virtual time as it was in real time */
+	const uint64_t real_now = monotonic_ns();
+	const uint64_t ago = real_now > when_ns ? real_now - when_ns : 0;
+	return virtual_now > ago ? virtual_now - ago : 0;
+}
+
+void clock_advance_to(const uint64_t now_ns) {
+	uint64_t current = virtual_now_ns.load(std::memory_order_acquire);
+	while (current != 0 && current < now_ns &&
+		   !virtual_now_ns.compare_exchange_weak(current, now_ns, std::memory_order_acq_rel)) {
+	}
+}
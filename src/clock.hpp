@@ -0,0 +1,29 @@
+#ifndef MAGPIE_CLOCK_HPP
+#define MAGPIE_CLOCK_HPP
+
+#include <cstdint>
+#include <ctime>
+
+/* Where the compositor's time comes from: frame done timestamps, telemetry,
+ * launch times and the timestamps of recordings. It follows CLOCK_MONOTONIC
+ * unless switched to virtual time, which only moves when told to, so frame
+ * pacing can be checked exactly without waiting for it. See
+ * Server::use_virtual_clock for how outputs get their frames then.
+ *
+ * Code measuring how long something took on this machine (trace spans, the
+ * startup timeline, benchmarks) wants monotonic_ns instead. Safe to call from
+ * any thread. */
+[[nodiscard]] uint64_t clock_now_ns();
+[[nodiscard]] timespec clock_now_timespec();
+[[nodiscard]] bool clock_is_virtual();
+void clock_set_virtual(uint64_t now_ns);
+void clock_set_real();
+/* Only moves virtual time, never backwards */
+void clock_advance_to(uint64_t now_ns);
+/* A CLOCK_MONOTONIC timestamp from elsewhere, such as a presentation time, on
+ * the compositor's clock */
+[[nodiscard]] uint64_t clock_from_monotonic(const timespec& when);
+
+[[nodiscard]] uint64_t monotonic_ns();
+
+#endif
@@ -0,0 +1,668 @@
+#include "config.hpp"
+
+#include "capture.hpp"
+#include "input/cursor.hpp"
+#include "input/keyboard.hpp"
+#include "input/recorder.hpp"
+#include "input/seat.hpp"
+#include "output.hpp"
+#include "server.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+#include "watchdog.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <utility>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* Editors tend to write a file in several steps, wait for them to settle */
+static constexpr int CONFIG_RELOAD_DELAY_MS = 100;
+
+struct IniEntry {
+	std::string key;
+	std::string value;
+	int line;
+};
+
+struct IniSection {
+	std::string name;
+	int line;
+	std::vector<IniEntry> entries;
+};
+
+struct ConfigParse {
+	Config config;
+	std::vector<std::string> errors;
+};
+
+static constexpr std::pair<std::string_view, KeybindingAction> keybinding_actions[] = {
+	{"quit", KEYBINDING_QUIT},
+	{"cycle_views", KEYBINDING_CYCLE_VIEWS},
+	{"close", KEYBINDING_CLOSE},
+	{"toggle_maximize", KEYBINDING_TOGGLE_MAXIMIZE},
+	{"toggle_keep_above", KEYBINDING_TOGGLE_KEEP_ABOVE},
+	{"toggle_keep_below", KEYBINDING_TOGGLE_KEEP_BELOW},
+	{"workspace_prev", KEYBINDING_WORKSPACE_PREV},
+	{"workspace_next", KEYBINDING_WORKSPACE_NEXT},
+	{"move_to_workspace_prev", KEYBINDING_MOVE_TO_WORKSPACE_PREV},
+	{"move_to_workspace_next", KEYBINDING_MOVE_TO_WORKSPACE_NEXT},
+};
+
+static constexpr std::pair<std::string_view, uint32_t> keybinding_modifiers[] = {
+	{"shift", WLR_MODIFIER_SHIFT},
+	{"ctrl", WLR_MODIFIER_CTRL},
+	{"control", WLR_MODIFIER_CTRL},
+	{"alt", WLR_MODIFIER_ALT},
+	{"mod1", WLR_MODIFIER_ALT},
+	{"logo", WLR_MODIFIER_LOGO},
+	{"super", WLR_MODIFIER_LOGO},
+	{"mod4", WLR_MODIFIER_LOGO},
+};
+
+Config::Config() {
+	constexpr uint32_t ctrl_alt = WLR_MODIFIER_CTRL | WLR_MODIFIER_ALT;
+	keybindings = {
+		{WLR_MODIFIER_ALT, XKB_KEY_Escape, KEYBINDING_QUIT, {}},
+		{WLR_MODIFIER_ALT, XKB_KEY_Tab, KEYBINDING_CYCLE_VIEWS, {}},
+		{ctrl_alt, XKB_KEY_Left, KEYBINDING_WORKSPACE_PREV, {}},
+		{ctrl_alt, XKB_KEY_Right, KEYBINDING_WORKSPACE_NEXT, {}},
+		{ctrl_alt | WLR_MODIFIER_SHIFT, XKB_KEY_Left, KEYBINDING_MOVE_TO_WORKSPACE_PREV, {}},
+		{ctrl_alt | WLR_MODIFIER_SHIFT, XKB_KEY_Right, KEYBINDING_MOVE_TO_WORKSPACE_NEXT, {}},
+	};
+}
+
+const KeyboardConfig& Config::keyboard_for(const std::string& device) const {
+	const auto it = device_keyboards.find(device);
+	return it != device_keyboards.end() ? it->second : keyboard;
+}
+
+OutputConfig Config::output_for(const std::string& name) const {
+	const auto it = outputs.find(name);
+	return it != outputs.end() ? it->second : OutputConfig();
+}
+
+static std::string config_path() {
+	if (const char* path = getenv("MAGPIE_CONFIG"); path != nullptr && *path != '\0') {
+		return path;
+	}
+	if (const char* config_home = getenv("XDG_CONFIG_HOME"); config_home != nullptr && *config_home == '/') {
+		return std::string(config_home) + "/magpie/magpie.ini";
+	}
+	if (const char* home = getenv("HOME"); home != nullptr && *home != '\0') {
+		return std::string(home) + "/.config/magpie/magpie.ini";
+	}
+	return {};
+}
+
+static std::string_view trim(std::string_view str) {
+	const auto start = str.find_first_not_of(" \t\r");
+	if (start == std::string_view::npos) {
+		return {};
+	}
+	return str.substr(start, str.find_last_not_of(" \t\r") - start + 1);
+}
+
+static std::string lowercase(std::string_view str) {
+	std::string result(str);
+	std::transform(result.begin(), result.end(), result.begin(), [](const unsigned char c) {
+		return std::tolower(c);
+	});
+	return result;
+}
+
+static std::optional<int64_t> parse_integer(const std::string_view str, const int64_t min, const int64_t max) {
+	int64_t value = 0;
+	const auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+	if (error != std::errc() || end != str.data() + str.size() || value < min || value > max) {
+		return {};
+	}
+	return value;
+}
+
+static std::optional<double> parse_number(const std::string_view str) {
+	double value = 0;
+	const auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), value);
+	if (error != std::errc() || end != str.data() + str.size() || !std::isfinite(value)) {
+		return {};
+	}
+	return value;
+}
+
+static std::optional<bool> parse_bool(const std::string_view str) {
+	const std::string value = lowercase(str);
+	if (value == "true" || value == "yes" || value == "on" || value == "1") {
+		return true;
+	}
+	if (value == "false" || value == "no" || value == "off" || value == "0") {
+		return false;
+	}
+	return {};
+}
+
+static std::vector<IniSection> parse_ini(std::istream& stream, std::vector<std::string>& errors) {
+	std::vector<IniSection> sections;
+	std::string text;
+	for (int line = 1; std::getline(stream, text); line++) {
+		const std::string_view str = trim(text);
+		if (str.empty() || str.front() == '#' || str.front() == ';') {
+			continue;
+		}
+
+		if (str.front() == '[') {
+			if (str.back() != ']') {
+				errors.push_back("line " + std::to_string(line) + ": unterminated section header");
+				continue;
+			}
+			sections.push_back({std::string(trim(str.substr(1, str.size() - 2))), line, {}});
+			continue;
+		}
+
+		const auto equals = str.find('=');
+		if (equals == std::string_view::npos) {
+			errors.push_back("line " + std::to_string(line) + ": expected key = value");
+			continue;
+		}
+		if (sections.empty()) {
+			errors.push_back("line " + std::to_string(line) + ": key outside of a section");
+			continue;
+		}
+		sections.back().entries.push_back(
+			{std::string(trim(str.substr(0, equals))), std::string(trim(str.substr(equals + 1))), line});
+	}
+
+	return sections;
+}
+
+static std::string entry_error(const IniEntry& entry, const std::string_view message) {
+	return "line " + std::to_string(entry.line) + ": " + std::string(message) + " for '" + entry.key + "'";
+}
+
+static void parse_keyboard(const IniSection& section, KeyboardConfig& keyboard, std::vector<std::string>& errors) {
+	for (const auto& entry : section.entries) {
+		if (entry.key == "rules") {
+			keyboard.keymap.rules = entry.value;
+		} else if (entry.key == "model") {
+			keyboard.keymap.model = entry.value;
+		} else if (entry.key == "layout") {
+			keyboard.keymap.layout = entry.value;
+		} else if (entry.key == "variant") {
+			keyboard.keymap.variant = entry.value;
+		} else if (entry.key == "options") {
+			keyboard.keymap.options = entry.value;
+		} else if (entry.key == "repeat_rate" || entry.key == "repeat_delay") {
+			const auto value = parse_integer(entry.value, 0, entry.key == "repeat_rate" ? 1000 : 10000);
+			if (!value.has_value()) {
+				errors.push_back(entry_error(entry, "expected an integer in range"));
+			} else if (entry.key == "repeat_rate") {
+				keyboard.repeat_rate = static_cast<int32_t>(*value);
+			} else {
+				keyboard.repeat_delay = static_cast<int32_t>(*value);
+			}
+		} else {
+			errors.push_back(entry_error(entry, "unknown key"));
+		}
+	}
+}
+
+static void parse_cursor(const IniSection& section, CursorConfig& cursor, std::vector<std::string>& errors) {
+	for (const auto& entry : section.entries) {
+		if (entry.key == "theme") {
+			cursor.theme = entry.value;
+		} else if (entry.key == "size") {
+			const auto value = parse_integer(entry.value, 8, 256);
+			if (value.has_value()) {
+				cursor.size = static_cast<uint32_t>(*value);
+			} else {
+				errors.push_back(entry_error(entry, "expected an integer from 8 to 256"));
+			}
+		} else {
+			errors.push_back(entry_error(entry, "unknown key"));
+		}
+	}
+}
+
+static void parse_watchdog(const IniSection& section, WatchdogConfig& watchdog, std::vector<std::string>& errors) {
+	for (const auto& entry : section.entries) {
+		if (entry.key == "threshold_ms") {
+			const auto value = parse_integer(entry.value, 0, 60000);
+			if (value.has_value()) {
+				watchdog.threshold_ms = static_cast<uint32_t>(*value);
+			} else {
+				errors.push_back(entry_error(entry, "expected an integer from 0 to 60000"));
+			}
+		} else {
+			errors.push_back(entry_error(entry, "unknown key"));
+		}
+	}
+}
+
+static void parse_debug(const IniSection& section, DebugConfig& debug, std::vector<std::string>& errors) {
+	for (const auto& entry : section.entries) {
+		if (entry.key == "recording") {
+			const auto value = parse_bool(entry.value);
+			if (value.has_value()) {
+				debug.recording = *value;
+			} else {
+				errors.push_back(entry_error(entry, "expected true or false"));
+			}
+		} else {
+			errors.push_back(entry_error(entry, "unknown key"));
+		}
+	}
+}
+
+/* Keys look like Ctrl+Alt+Left, actions like workspace_next or exec foot */
+static std::optional<Keybinding> parse_keybinding(const IniEntry& entry, std::vector<std::string>& errors) {
+	Keybinding binding = {0, XKB_KEY_NoSymbol, KEYBINDING_EXEC, {}};
+
+	std::string_view keys = entry.key;
+	for (auto plus = keys.find('+'); plus != std::string_view::npos && plus + 1 < keys.size(); plus = keys.find('+')) {
+		const std::string name = lowercase(trim(keys.substr(0, plus)));
+		const auto* modifier =
+			std::find_if(std::begin(keybinding_modifiers), std::end(keybinding_modifiers), [&name](const auto& candidate) {
+				return candidate.first == name;
+			});
+		if (modifier == std::end(keybinding_modifiers)) {
+			errors.push_back(entry_error(entry, "unknown modifier '" + name + "'"));
+			return {};
+		}
+		binding.modifiers |= modifier->second;
+		keys.remove_prefix(plus + 1);
+	}
+
+	const std::string key(trim(keys));
+	binding.sym = xkb_keysym_to_lower(xkb_keysym_from_name(key.c_str(), XKB_KEYSYM_CASE_INSENSITIVE));
+	if (binding.sym == XKB_KEY_NoSymbol) {
+		errors.push_back(entry_error(entry, "unknown key '" + key + "'"));
+		return {};
+	}
+
+	const std::string_view action = entry.value;
+	if (action.starts_with("exec ") && !trim(action.substr(5)).empty()) {
+		binding.command = trim(action.substr(5));
+		return binding;
+	}
+
+	const auto* known =
+		std::find_if(std::begin(keybinding_actions), std::end(keybinding_actions), [&action](const auto& candidate) {
+			return candidate.first == action;
+		});
+	if (known == std::end(keybinding_actions)) {
+		errors.push_back(entry_error(entry, "unknown action '" + entry.value + "'"));
+		return {};
+	}
+	binding.action = known->second;
+	return binding;
+}
+
+static void parse_keybindings(const IniSection& section, std::vector<Keybinding>& bindings, std::vector<std::string>& errors) {
+	/* A [keybindings] section replaces the defaults rather than adding to them */
+	bindings.clear();
+	for (const auto& entry : section.entries) {
+		auto binding = parse_keybinding(entry, errors);
+		if (!binding.has_value()) {
+			continue;
+		}
+
+		const bool duplicate = std::any_of(bindings.begin(), bindings.end(), [&binding](const Keybinding& existing) {
+			return existing.modifiers == binding->modifiers && existing.sym == binding->sym;
+		});
+		if (duplicate) {
+			errors.push_back(entry_error(entry, "duplicate binding"));
+			continue;
+		}
+		bindings.push_back(std::move(*binding));
+	}
+}
+
+/* Modes are written as preferred, 2560x1440 or 2560x1440@59.951 */
+static bool parse_mode(const std::string_view str, OutputConfig& output) {
+	if (str == "preferred") {
+		output.width = output.height = output.refresh = 0;
+		return true;
+	}
+
+	const auto x = str.find('x');
+	const auto at = str.find('@');
+	if (x == std::string_view::npos) {
+		return false;
+	}
+
+	const auto width = parse_integer(str.substr(0, x), 1, 32768);
+	const auto height = parse_integer(str.substr(x + 1, at == std::string_view::npos ? at : at - x - 1), 1, 32768);
+	if (!width.has_value() || !height.has_value()) {
+		return false;
+	}
+
+	int32_t refresh = 0;
+	if (at != std::string_view::npos) {
+		std::string_view rate = str.substr(at + 1);
+		if (rate.ends_with("Hz")) {
+			rate.remove_suffix(2);
+		}
+		const auto hz = parse_number(rate);
+		if (!hz.has_value() || *hz <= 0 || *hz > 1000) {
+			return false;
+		}
+		refresh = static_cast<int32_t>(std::lround(*hz * 1000));
+	}
+
+	output.width = static_cast<int32_t>(*width);
+	output.height = static_cast<int32_t>(*height);
+	output.refresh = refresh;
+	return true;
+}
+
+static void parse_output(const IniSection& section, OutputConfig& output, std::vector<std::string>& errors) {
+	for (const auto& entry : section.entries) {
+		if (entry.key == "enabled") {
+			const auto value = parse_bool(entry.value);
+			if (value.has_value()) {
+				output.enabled = *value;
+			} else {
+				errors.push_back(entry_error(entry, "expected true or false"));
+			}
+		} else if (entry.key == "mode") {
+			if (!parse_mode(entry.value, output)) {
+				errors.push_back(entry_error(entry, "expected preferred or WIDTHxHEIGHT[@HZ]"));
+			}
+		} else if (entry.key == "scale") {
+			const auto value = parse_number(entry.value);
+			if (value.has_value() && *value >= 0.25 && *value <= 8) {
+				output.scale = static_cast<float>(*value);
+			} else {
+				errors.push_back(entry_error(entry, "expected a number from 0.25 to 8"));
+			}
+		} else {
+			errors.push_back(entry_error(entry, "unknown key"));
+		}
+	}
+}
+
+/* Runs on a worker thread, see WorkerPool for what it may touch. A missing
+ * file is not an error, it just means the defaults. */
+static ConfigParse parse_config(const std::string& path) {
+	MAGPIE_TRACE_SCOPE("config_parse");
+	ConfigParse result;
+
+	std::ifstream stream(path);
+	if (path.empty() || !stream.is_open()) {
+		return result;
+	}
+
+	const auto sections = parse_ini(stream, result.errors);
+	std::set<std::string> seen;
+	for (const auto& section : sections) {
+		if (!seen.insert(section.name).second) {
+			result.errors.push_back("line " + std::to_string(section.line) + ": duplicate section [" + section.name + "]");
+		}
+	}
+
+	Config& config = result.config;
+	for (const auto& section : sections) {
+		if (section.name == "keyboard") {
+			parse_keyboard(section, config.keyboard, result.errors);
+		} else if (section.name == "cursor") {
+			parse_cursor(section, config.cursor, result.errors);
+		} else if (section.name == "keybindings") {
+			parse_keybindings(section, config.keybindings, result.errors);
+		} else if (section.name == "watchdog") {
+			parse_watchdog(section, config.watchdog, result.errors);
+		} else if (section.name == "debug") {
+			parse_debug(section, config.debug, result.errors);
+		} else if (section.name.starts_with("output:") && section.name.size() > 7) {
+			parse_output(section, config.outputs[section.name.substr(7)], result.errors);
+		} else if (!section.name.starts_with("keyboard:") || section.name.size() <= 9) {
+			result.errors.push_back("line " + std::to_string(section.line) + ": unknown section [" + section.name + "]");
+		}
+	}
+
+	/* Device sections only override what they set, so they are resolved once
+	 * [keyboard] is known, wherever it is in the file */
+	for (const auto& section : sections) {
+		if (section.name.starts_with("keyboard:") && section.name.size() > 9) {
+			KeyboardConfig& device = config.device_keyboards[section.name.substr(9)];
+			device = config.keyboard;
+			parse_keyboard(section, device, result.errors);
+		}
+	}
+
+	return result;
+}
+
+/* Whether a keyboard device needs a keymap other than the shared one */
+static bool has_own_keymap(const Config& config, const std::string& device) {
+	return config.device_keyboards.contains(device) && config.keyboard_for(device).keymap != config.keyboard.keymap;
+}
+
+static int config_inotify_notify(int fd, uint32_t mask, void* data) {
+	auto& manager = *static_cast<ConfigManager*>(data);
+	(void) fd;
+	(void) mask;
+
+	manager.handle_inotify();
+	return 0;
+}
+
+static int config_reload_timer_notify(void* data) {
+	auto& manager = *static_cast<ConfigManager*>(data);
+
+	manager.reload();
+	return 0;
+}
+
+static void log_errors(const std::string& path, const std::vector<std::string>& errors) {
+	for (const auto& error : errors) {
+		wlr_log(WLR_ERROR, "%s: %s", path.c_str(), error.c_str());
+	}
+	wlr_log(WLR_ERROR, "Ignoring %s, it has %zu errors", path.c_str(), errors.size());
+}
+
+/* The first load blocks, so outputs and input devices are set up from the
+ * file the first time rather than reconfigured once it has been read */
+ConfigManager::ConfigManager(Server& server) noexcept : path(config_path()), server(server) {
+	ConfigParse result = parse_config(path);
+	if (!result.errors.empty()) {
+		log_errors(path, result.errors);
+	} else {
+		current = std::move(result.config);
+	}
+
+	reload_timer = wl_event_loop_add_timer(wl_display_get_event_loop(server.display), config_reload_timer_notify, this);
+	watch();
+}
+
+ConfigManager::~ConfigManager() noexcept {
+	if (inotify_source != nullptr) {
+		wl_event_source_remove(inotify_source);
+	}
+	if (inotify_fd >= 0) {
+		close(inotify_fd);
+	}
+	wl_event_source_remove(reload_timer);
+}
+
+void ConfigManager::watch() {
+	const auto slash = path.find_last_of('/');
+	if (slash == std::string::npos) {
+		return;
+	}
+
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to set up inotify, the config will not be reloaded");
+		return;
+	}
+
+	const std::string directory = path.substr(0, slash);
+	constexpr uint32_t events = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+	if (inotify_add_watch(inotify_fd, directory.c_str(), events) < 0) {
+		wlr_log_errno(WLR_INFO, "Not watching %s for config changes", directory.c_str());
+		close(inotify_fd);
+		inotify_fd = -1;
+		return;
+	}
+
+	inotify_source = wl_event_loop_add_fd(
+		wl_display_get_event_loop(server.display), inotify_fd, WL_EVENT_READABLE, config_inotify_notify, this);
+}
+
+void ConfigManager::handle_inotify() {
+	const std::string_view name = std::string_view(path).substr(path.find_last_of('/') + 1);
+
+	alignas(inotify_event) char buffer[4096];
+	ssize_t len;
+	while ((len = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+		for (ssize_t offset = 0; offset < len;) {
+			const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			if (event->len > 0 && name == event->name) {
+				schedule_reload();
+			}
+			offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+		}
+	}
+}
+
+void ConfigManager::schedule_reload() {
+	wl_event_source_timer_update(reload_timer, CONFIG_RELOAD_DELAY_MS);
+}
+
+/* Parses the file on a worker. A change that comes in while a parse is
+ * running is picked up by another one right after. */
+void ConfigManager::reload() {
+	if (loading) {
+		reload_pending = true;
+		return;
+	}
+	loading = true;
+
+	server.workers->submit<ConfigParse>(
+		[path = path]() {
+			return parse_config(path);
+		},
+		[this](ConfigParse result) {
+			loading = false;
+
+			if (!result.errors.empty()) {
+				log_errors(path, result.errors);
+			} else {
+				apply(std::move(result.config));
+			}
+
+			if (reload_pending) {
+				reload_pending = false;
+				reload();
+			}
+		});
+}
+
+/* Compiles the keymaps of the first load, once there is a seat for them */
+void ConfigManager::load_keymaps(Seat& seat) {
+	seat.load_keymap();
+	for (const auto& [device, keyboard] : current.device_keyboards) {
+		if (has_own_keymap(current, device)) {
+			seat.load_keymap(device);
+		}
+	}
+}
+
+/* Applies what differs between the live configuration and the new one */
+void ConfigManager::apply(Config&& next) {
+	MAGPIE_TRACE_SCOPE("config_apply");
+	const Config previous = std::exchange(current, std::move(next));
+
+	std::vector<std::string> changed;
+	Seat& seat = *server.seat;
+
+	if (previous.keyboard.keymap != current.keyboard.keymap) {
+		seat.load_keymap();
+		changed.emplace_back("keymap");
+	}
+
+	std::set<std::string> devices;
+	for (const auto& [device, keyboard] : previous.device_keyboards) {
+		devices.insert(device);
+	}
+	for (const auto& [device, keyboard] : current.device_keyboards) {
+		devices.insert(device);
+	}
+	for (const auto& device : devices) {
+		const bool had_own = has_own_keymap(previous, device);
+		if (has_own_keymap(current, device)) {
+			if (!had_own || previous.keyboard_for(device).keymap != current.keyboard_for(device).keymap) {
+				seat.load_keymap(device);
+				changed.push_back("keymap of " + device);
+			}
+		} else if (had_own) {
+			seat.remove_device_keymap(device);
+			changed.push_back("keymap of " + device);
+		}
+	}
+
+	bool repeat_changed = false;
+	for (auto* keyboard : seat.keyboards) {
+		const KeyboardConfig& before = previous.keyboard_for(keyboard->name());
+		const KeyboardConfig& after = current.keyboard_for(keyboard->name());
+		if (before.repeat_rate != after.repeat_rate || before.repeat_delay != after.repeat_delay) {
+			wlr_keyboard_set_repeat_info(&keyboard->wlr, after.repeat_rate, after.repeat_delay);
+			repeat_changed = true;
+		}
+	}
+	if (repeat_changed) {
+		changed.emplace_back("key repeat");
+	}
+
+	if (previous.cursor != current.cursor) {
+		seat.cursor.set_theme(current.cursor.theme, current.cursor.size);
+		changed.emplace_back("cursor");
+	}
+
+	if (previous.keybindings != current.keybindings) {
+		changed.emplace_back("keybindings");
+	}
+
+	if (previous.watchdog != current.watchdog) {
+		server.watchdog->set_threshold(current.watchdog.threshold_ms);
+		changed.emplace_back("watchdog");
+	}
+
+	if (previous.debug != current.debug) {
+		if (!current.debug.recording && server.input_recorder->recording()) {
+			server.input_recorder->stop();
+		}
+		if (!current.debug.recording && server.protocol_capture->capturing()) {
+			(void) server.protocol_capture->stop();
+		}
+		changed.emplace_back("debug");
+	}
+
+	for (auto* output : std::as_const(server.outputs)) {
+		const OutputConfig config = current.output_for(output->wlr.name);
+		if (previous.output_for(output->wlr.name) != config) {
+			output->apply_config(config);
+			changed.push_back(std::string("output ") + output->wlr.name);
+		}
+	}
+
+	std::string summary;
+	for (const auto& part : changed) {
+		summary += (summary.empty() ? "" : ", ") + part;
+	}
+	wlr_log(WLR_INFO, "Loaded %s: %s", path.empty() ? "the default config" : path.c_str(),
+		summary.empty() ? "no changes" : summary.c_str());
+}
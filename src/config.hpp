@@ -0,0 +1,150 @@
+#ifndef MAGPIE_CONFIG_HPP
+#define MAGPIE_CONFIG_HPP
+
+#include "types.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <xkbcommon/xkbcommon.h>
+
+#include <wayland-server-core.h>
+
+/* Passed to xkb_keymap_new_from_names, empty fields take the xkbcommon
+ * defaults (or XKB_DEFAULT_*) */
+struct KeymapNames {
+	std::string rules;
+	std::string model;
+	std::string layout;
+	std::string variant;
+	std::string options;
+
+	bool operator==(const KeymapNames&) const = default;
+};
+
+struct KeyboardConfig {
+	KeymapNames keymap;
+	int32_t repeat_rate = 25;
+	int32_t repeat_delay = 600;
+
+	bool operator==(const KeyboardConfig&) const = default;
+};
+
+struct CursorConfig {
+	/* Empty for the default theme */
+	std::string theme;
+	uint32_t size = 24;
+
+	bool operator==(const CursorConfig&) const = default;
+};
+
+enum KeybindingAction {
+	KEYBINDING_QUIT,
+	KEYBINDING_CYCLE_VIEWS,
+	KEYBINDING_CLOSE,
+	KEYBINDING_TOGGLE_MAXIMIZE,
+	KEYBINDING_TOGGLE_KEEP_ABOVE,
+	KEYBINDING_TOGGLE_KEEP_BELOW,
+	KEYBINDING_WORKSPACE_PREV,
+	KEYBINDING_WORKSPACE_NEXT,
+	KEYBINDING_MOVE_TO_WORKSPACE_PREV,
+	KEYBINDING_MOVE_TO_WORKSPACE_NEXT,
+	KEYBINDING_EXEC,
+};
+
+struct Keybinding {
+	/* WLR_MODIFIER_* */
+	uint32_t modifiers;
+	/* Lower case */
+	xkb_keysym_t sym;
+	KeybindingAction action;
+	/* For KEYBINDING_EXEC */
+	std::string command;
+
+	bool operator==(const Keybinding&) const = default;
+};
+
+struct OutputConfig {
+	bool enabled = true;
+	/* 0 for the preferred mode */
+	int32_t width = 0;
+	int32_t height = 0;
+	/* mHz, 0 for the highest available at the size */
+	int32_t refresh = 0;
+	/* 0 to leave it to the backend */
+	float scale = 0;
+
+	bool operator==(const OutputConfig&) const = default;
+};
+
+struct WatchdogConfig {
+	/* How long one event loop iteration may take before it is reported, 0 to
+	 * turn the watchdog off */
+	uint32_t threshold_ms = 300;
+
+	bool operator==(const WatchdogConfig&) const = default;
+};
+
+struct DebugConfig {
+	/* Whether IPC clients may record input, which includes every key press,
+	 * and capture the protocol of other clients, buffer contents included */
+	bool recording = false;
+
+	bool operator==(const DebugConfig&) const = default;
+};
+
+struct Config {
+	KeyboardConfig keyboard;
+	/* [keyboard:<device name>] sections, resolved on top of [keyboard] */
+	std::map<std::string, KeyboardConfig> device_keyboards;
+	CursorConfig cursor;
+	std::vector<Keybinding> keybindings;
+	/* [output:<connector name>] sections */
+	std::map<std::string, OutputConfig> outputs;
+	WatchdogConfig watchdog;
+	DebugConfig debug;
+
+	Config();
+
+	[[nodiscard]] const KeyboardConfig& keyboard_for(const std::string& device) const;
+	[[nodiscard]] OutputConfig output_for(const std::string& name) const;
+};
+
+/* Owns the live configuration and keeps it in sync with the config file.
+ *
+ * The file is read right away at startup, so the first outputs and keyboards
+ * are set up from it. Reloads read and validate it on a worker thread. A file
+ * with any error in it is rejected as a whole and the live configuration
+ * stays. A valid one is compared against the live configuration section by
+ * section, and only what differs is applied: a new keybinding only replaces
+ * the table, a keymap change only recompiles the keymap of the keyboards it
+ * applies to, and only outputs whose settings changed are committed again.
+ *
+ * The directory holding the file is watched with inotify, since editors
+ * usually replace the file rather than write to it. */
+class ConfigManager {
+	std::string path;
+	int inotify_fd = -1;
+	wl_event_source* inotify_source = nullptr;
+	wl_event_source* reload_timer = nullptr;
+	bool loading = false;
+	bool reload_pending = false;
+
+	void watch();
+	void apply(Config&& next);
+
+  public:
+	Server& server;
+	Config current;
+
+	explicit ConfigManager(Server& server) noexcept;
+	~ConfigManager() noexcept;
+
+	void load_keymaps(Seat& seat);
+	void reload();
+	void handle_inotify();
+	void schedule_reload();
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "flight_recorder.hpp"
+
+#include "clock.hpp"
+#include "recording.hpp"
+#include "server.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string_view>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* How often a dump tries to copy a ring before leaving it out */
+static constexpr int FLIGHT_RECORDER_READ_ATTEMPTS = 64;
+
+static void flight_recorder_ring_client_destroy_notify(wl_listener* listener, void* data) {
+	FlightRecorderRing& ring = magpie_container_of(listener, ring, client_destroy);
+	(void) data;
+
+	ring.client = nullptr;
+	ring.begin_write();
+	ring.connected = false;
+	ring.end_write();
+	wl_list_remove(&listener->link);
+	wl_list_init(&listener->link);
+}
+
+static void flight_recorder_client_created_notify(wl_listener* listener, void* data) {
+	FlightRecorder& recorder = magpie_container_of(listener, recorder, client_created);
+
+	recorder.client_created(static_cast<wl_client*>(data));
+}
+
+static void flight_recorder_log(void* data, const wl_protocol_logger_type type, const wl_protocol_logger_message* message) {
+	static_cast<FlightRecorder*>(data)->log(type, *message);
+}
+
+FlightRecorder::FlightRecorder(Server& server) noexcept
+	: listeners(*this), rings(new FlightRecorderRing[MAGPIE_FLIGHT_RECORDER_CLIENTS]), server(server) {
+	for (size_t i = 0; i < MAGPIE_FLIGHT_RECORDER_CLIENTS; i++) {
+		wl_list_init(&rings[i].listeners.client_destroy.link);
+	}
+
+	listeners.client_created.notify = flight_recorder_client_created_notify;
+	wl_display_add_client_created_listener(server.display, &listeners.client_created);
+	logger = wl_display_add_protocol_logger(server.display, flight_recorder_log, this);
+}
+
+FlightRecorder::~FlightRecorder() noexcept {
+	wl_protocol_logger_destroy(logger);
+	wl_list_remove(&listeners.client_created.link);
+	for (size_t i = 0; i < MAGPIE_FLIGHT_RECORDER_CLIENTS; i++) {
+		wl_list_remove(&rings[i].listeners.client_destroy.link);
+	}
+}
+
+/* Takes the free ring that has been free the longest. Clients beyond the
+ * number of rings are not recorded. */
+void FlightRecorder::client_created(wl_client* client) {
+	const int fd = wl_client_get_fd(client);
+	if (fd < 0) {
+		return;
+	}
+	if (static_cast<size_t>(fd) >= rings_by_fd.size()) {
+		rings_by_fd.resize(fd + 1, nullptr);
+	}
+	rings_by_fd[fd] = nullptr;
+
+	for (size_t i = 0; i < MAGPIE_FLIGHT_RECORDER_CLIENTS; i++) {
+		FlightRecorderRing& ring = rings[(next_ring + i) % MAGPIE_FLIGHT_RECORDER_CLIENTS];
+		if (ring.client != nullptr) {
+			continue;
+		}
+		next_ring = (next_ring + i + 1) % MAGPIE_FLIGHT_RECORDER_CLIENTS;
+
+		pid_t pid = 0;
+		wl_client_get_credentials(client, &pid, nullptr, nullptr);
+		const std::string command = process_command(pid);
+
+		ring.client = client;
+		ring.begin_write();
+		ring.id = next_id++;
+		ring.pid = pid;
+		ring.connect_ns = clock_now_ns();
+		std::memset(ring.command, 0, sizeof(ring.command));
+		std::strncpy(ring.command, command.c_str(), sizeof(ring.command) - 1);
+		ring.total = 0;
+		ring.connected = true;
+		ring.end_write();
+
+		ring.listeners.client_destroy.notify = flight_recorder_ring_client_destroy_notify;
+		wl_client_add_destroy_listener(client, &ring.listeners.client_destroy);
+		rings_by_fd[fd] = &ring;
+		return;
+	}
+}
+
+/* Called for every message, so only stores what it is handed */
+void FlightRecorder::log(const wl_protocol_logger_type type, const wl_protocol_logger_message& message) {
+	wl_client* client = wl_resource_get_client(message.resource);
+	const int fd = wl_client_get_fd(client);
+	if (fd < 0 || static_cast<size_t>(fd) >= rings_by_fd.size()) {
+		return;
+	}
+	FlightRecorderRing* ring = rings_by_fd[fd];
+	if (ring == nullptr || ring->client != client) {
+		return;
+	}
+
+	const FlightRecorderEntry entry = {clock_now_ns(), wl_resource_get_class(message.resource), message.message,
+		wl_resource_get_id(message.resource), static_cast<uint16_t>(message.message_opcode), static_cast<uint16_t>(type)};
+	ring->begin_write();
+	ring->entries[ring->total % MAGPIE_FLIGHT_RECORDER_MESSAGES] = entry;
+	ring->total++;
+	ring->end_write();
+}
+
+/* Copies what the dump needs from a ring, false if the main thread kept
+ * writing to it */
+static bool read_ring(const FlightRecorderRing& ring, FlightRecordingClient& header,
+	std::vector<FlightRecorderEntry>& entries) {
+	for (int attempt = 0; attempt < FLIGHT_RECORDER_READ_ATTEMPTS; attempt++) {
+		const uint32_t sequence = ring.sequence.load(std::memory_order_acquire);
+		if (sequence % 2 != 0) {
+			continue;
+		}
+
+		/* Read once, a torn copy is thrown away but must not run off */
+		const uint64_t total = ring.total;
+		const uint64_t kept = std::min<uint64_t>(total, MAGPIE_FLIGHT_RECORDER_MESSAGES);
+		header = {total, ring.connect_ns, ring.id, ring.pid, ring.connected, static_cast<uint32_t>(kept), {}};
+		std::memcpy(header.command, ring.command, sizeof(header.command));
+		entries.clear();
+		for (uint64_t n = total - kept; n < total; n++) {
+			entries.push_back(ring.entries[n % MAGPIE_FLIGHT_RECORDER_MESSAGES]);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (ring.sequence.load(std::memory_order_relaxed) == sequence) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Writes every ring that was ever used to $XDG_RUNTIME_DIR/
+ * magpie-flight-<pid>-<n>.mgpf */
+std::string FlightRecorder::dump() {
+	const std::lock_guard lock(dump_mutex);
+	const uint64_t dump_ns = clock_now_ns();
+
+	std::vector<const char*> names;
+	std::map<std::string_view, uint32_t> name_indices;
+	const auto name_index = [&names, &name_indices](const char* name) {
+		const auto [it, inserted] = name_indices.emplace(name, static_cast<uint32_t>(names.size()));
+		if (inserted) {
+			names.push_back(name);
+		}
+		return it->second;
+	};
+
+	std::vector<char> body;
+	const auto append = [&body](const void* data, const size_t size) {
+		const auto* bytes = static_cast<const char*>(data);
+		body.insert(body.end(), bytes, bytes + size);
+	};
+
+	uint32_t clients = 0;
+	FlightRecordingClient client = {};
+	std::vector<FlightRecorderEntry> entries;
+	entries.reserve(MAGPIE_FLIGHT_RECORDER_MESSAGES);
+	for (size_t i = 0; i < MAGPIE_FLIGHT_RECORDER_CLIENTS; i++) {
+		if (!read_ring(rings[i], client, entries)) {
+			wlr_log(WLR_INFO, "Left a flight recorder ring out of the dump, it kept changing");
+			continue;
+		}
+		if (client.id == 0) {
+			continue;
+		}
+		append(&client, sizeof(client));
+
+		for (const FlightRecorderEntry& entry : entries) {
+			const FlightRecordingMessage message = {entry.time_ns, entry.object_id,
+				name_index(entry.interface != nullptr ? entry.interface : "?"),
+				name_index(entry.message != nullptr ? entry.message->name : "?"), entry.opcode, entry.type};
+			append(&message, sizeof(message));
+		}
+		clients++;
+	}
+
+	const std::string path = default_recording_path("flight", "mgpf");
+	FILE* file = std::fopen(path.c_str(), "we");
+	if (file == nullptr) {
+		wlr_log_errno(WLR_ERROR, "Failed to open %s", path.c_str());
+		return {};
+	}
+
+	const FlightRecordingHeader header = {MAGPIE_FLIGHT_RECORDING_MAGIC, MAGPIE_FLIGHT_RECORDING_VERSION, dump_ns,
+		static_cast<uint32_t>(names.size()), clients};
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+	for (const char* name : names) {
+		const auto length = static_cast<uint32_t>(std::strlen(name));
+		ok = ok && std::fwrite(&length, sizeof(length), 1, file) == 1 && std::fwrite(name, 1, length, file) == length;
+	}
+	ok = ok && std::fwrite(body.data(), 1, body.size(), file) == body.size();
+	ok = std::fclose(file) == 0 && ok;
+
+	if (!ok) {
+		wlr_log(WLR_ERROR, "Failed to write %s", path.c_str());
+		return {};
+	}
+	wlr_log(WLR_INFO, "Dumped the flight recorder of %u clients to %s", clients, path.c_str());
+	return path;
+}
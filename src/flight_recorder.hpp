@@ -0,0 +1,149 @@
+#ifndef MAGPIE_FLIGHT_RECORDER_HPP
+#define MAGPIE_FLIGHT_RECORDER_HPP
+
+#include "types.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <type_traits>
+#include <vector>
+
+#include <wayland-server-core.h>
+
+static constexpr uint32_t MAGPIE_FLIGHT_RECORDING_MAGIC = 0x4650474d; /* "MGPF" */
+static constexpr uint32_t MAGPIE_FLIGHT_RECORDING_VERSION = 1;
+static constexpr size_t MAGPIE_FLIGHT_RECORDER_CLIENTS = 64;
+/* Per client, a power of two */
+static constexpr size_t MAGPIE_FLIGHT_RECORDER_MESSAGES = 512;
+
+/* A dump is this header, then the names its messages refer to, each a 32 bit
+ * length followed by the name, then for each client a FlightRecordingClient
+ * followed by its last messages, oldest first. In the machine's byte order,
+ * times are clock_now_ns nanoseconds. magpie-flight-decode prints it. */
+struct FlightRecordingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t dump_ns;
+	uint32_t names;
+	uint32_t clients;
+};
+
+struct FlightRecordingClient {
+	/* Messages since the client connected, of which the last are kept */
+	uint64_t total;
+	uint64_t connect_ns;
+	/* Numbered in the order they connected */
+	uint32_t id;
+	int32_t pid;
+	uint32_t connected;
+	uint32_t messages;
+	char command[16];
+};
+
+struct FlightRecordingMessage {
+	uint64_t time_ns;
+	uint32_t object_id;
+	/* Indices into the names */
+	uint32_t interface;
+	uint32_t message;
+	uint16_t opcode;
+	/* wl_protocol_logger_type */
+	uint16_t type;
+};
+
+static_assert(std::is_trivially_copyable_v<FlightRecordingClient> && sizeof(FlightRecordingClient) == 48);
+static_assert(std::is_trivially_copyable_v<FlightRecordingMessage> && sizeof(FlightRecordingMessage) == 24);
+
+/* What the protocol logger stores, turned into names only when dumped */
+struct FlightRecorderEntry {
+	uint64_t time_ns;
+	const char* interface;
+	const wl_message* message;
+	uint32_t object_id;
+	uint16_t opcode;
+	uint16_t type;
+};
+
+struct FlightRecorderRing {
+	struct Listeners {
+		std::reference_wrapper<FlightRecorderRing> parent;
+		wl_listener client_destroy = {};
+		explicit Listeners(FlightRecorderRing& parent) noexcept : parent(parent) {}
+	};
+
+	Listeners listeners;
+	/* nullptr once the client is gone, so a new client on the same socket
+	 * is not mistaken for it */
+	wl_client* client = nullptr;
+	/* A seqlock over everything below, odd while the main thread writes.
+	 * Dumps from other threads retry until they copied the ring between two
+	 * writes. */
+	std::atomic<uint32_t> sequence = 0;
+	bool connected = false;
+	uint32_t id = 0;
+	pid_t pid = 0;
+	uint64_t connect_ns = 0;
+	char command[16] = {};
+	uint64_t total = 0;
+	FlightRecorderEntry entries[MAGPIE_FLIGHT_RECORDER_MESSAGES] = {};
+
+	FlightRecorderRing() noexcept : listeners(*this) {}
+	FlightRecorderRing(const FlightRecorderRing&) = delete;
+	FlightRecorderRing& operator=(const FlightRecorderRing&) = delete;
+
+	void begin_write() noexcept {
+		sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+	void end_write() noexcept {
+		sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+};
+
+/* Keeps the last requests and events of every client in memory, so there is
+ * something to look at after a hang without running with WAYLAND_DEBUG. The
+ * protocol logger stores the message's object, interface, opcode and time in
+ * the client's ring, with no formatting and no allocation; names are only
+ * looked up when dumping.
+ *
+ * Rings are never freed, and one that disconnected stays around until a new
+ * client needs its slot, so a dump shows the clients that just left too. A
+ * dump may be taken from the watchdog thread while the main thread is stuck,
+ * which the ring's seqlock makes safe. A ring the main thread keeps writing
+ * to is left out rather than waited for. */
+class FlightRecorder {
+  public:
+	struct Listeners {
+		std::reference_wrapper<FlightRecorder> parent;
+		wl_listener client_created = {};
+		explicit Listeners(FlightRecorder& parent) noexcept : parent(parent) {}
+	};
+
+  private:
+	Listeners listeners;
+	wl_protocol_logger* logger = nullptr;
+	std::unique_ptr<FlightRecorderRing[]> rings;
+	/* Indexed by the client's socket */
+	std::vector<FlightRecorderRing*> rings_by_fd;
+	size_t next_ring = 0;
+	uint32_t next_id = 1;
+	std::mutex dump_mutex;
+
+  public:
+	Server& server;
+
+	explicit FlightRecorder(Server& server) noexcept;
+	~FlightRecorder() noexcept;
+
+	void client_created(wl_client* client);
+	void log(wl_protocol_logger_type type, const wl_protocol_logger_message& message);
+	/* Returns the path written to, empty on failure. Safe from any thread. */
+	std::string dump();
+};
+
+#endif
@@ -91,7 +91,7 @@ void ForeignToplevelHandle::set_app_id(const std::string& app_id) const {
 }
 
 void ForeignToplevelHandle::set_parent(const std::optional<std::reference_wrapper<const ForeignToplevelHandle>> parent) const {
-	wlr_foreign_toplevel_handle_v1_set_parent(&handle, parent.has_value() ? nullptr : &parent->get().handle);
+	wlr_foreign_toplevel_handle_v1_set_parent(&handle, parent.has_value() ? &parent->get().handle : nullptr);
 }
 
 void ForeignToplevelHandle::set_placement(const ViewPlacement placement) const {
@@ -1,6 +1,7 @@
 #ifndef FOREIGN_TOPLEVEL_HPP
 #define FOREIGN_TOPLEVEL_HPP
 
+#include "live_objects.hpp"
 #include "types.hpp"
 
 #include <functional>
@@ -26,6 +27,7 @@ class ForeignToplevelHandle {
 
   private:
 	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_FOREIGN_TOPLEVEL_HANDLE> live;
 
   public:
 	View& view;
@@ -41,9 +41,12 @@ PointerConstraint::PointerConstraint(Seat& seat, wlr_pointer_constraint_v1& wlr)
 	wl_signal_add(&wlr.surface->events.commit, &listeners.surface_commit);
 	listeners.destroy.notify = constraint_destroy_notify;
 	wl_signal_add(&wlr.events.destroy, &listeners.destroy);
+
+	wlr.data = this;
 }
 
 PointerConstraint::~PointerConstraint() noexcept {
+	wlr.data = nullptr;
 	wl_list_remove(&listeners.set_region.link);
 	wl_list_remove(&listeners.surface_commit.link);
 	wl_list_remove(&listeners.destroy.link);
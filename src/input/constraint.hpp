@@ -1,6 +1,7 @@
 #ifndef MAGPIE_CONSTRAINT_HPP
 #define MAGPIE_CONSTRAINT_HPP
 
+#include "live_objects.hpp"
 #include "types.hpp"
 
 #include <functional>
@@ -22,6 +23,7 @@ class PointerConstraint {
 
   private:
 	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_POINTER_CONSTRAINT> live;
 
   public:
 	Seat& seat;
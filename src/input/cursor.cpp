@@ -1,13 +1,23 @@
 #include "cursor.hpp"
 
+#include "alloc_guard.hpp"
+#include "config.hpp"
 #include "input/constraint.hpp"
+#include "output.hpp"
+#include "recorder.hpp"
 #include "seat.hpp"
 #include "server.hpp"
 #include "surface/surface.hpp"
 #include "surface/view.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+#include "worker_pool.hpp"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <utility>
 
 #include "wlr-wrap-start.hpp"
 #include <wlr/types/wlr_idle_notify_v1.h>
@@ -15,9 +25,12 @@
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/util/edges.h>
+#include <wlr/util/log.h>
+#include <wlr/xcursor.h>
 #include "wlr-wrap-end.hpp"
 
 void Cursor::process_resize(const uint32_t time) const {
+	MAGPIE_TRACE_SCOPE("cursor_process_resize");
 	(void) time;
 
 	/*
@@ -70,6 +83,7 @@ void Cursor::process_resize(const uint32_t time) const {
 }
 
 void Cursor::process_move(const uint32_t time) {
+	MAGPIE_TRACE_SCOPE("cursor_process_move");
 	(void) time;
 
 	/* Move the grabbed view to the new position. */
@@ -84,9 +98,14 @@ void Cursor::process_move(const uint32_t time) {
 /* This event is forwarded by the cursor when a pointer emits an axis event,
  * for example when you move the scroll wheel. */
 static void cursor_axis_notify(wl_listener* listener, void* data) {
+	MAGPIE_HOT_PATH("cursor_axis");
+	MAGPIE_TRACE_SCOPE("cursor_axis");
 	Cursor& cursor = magpie_container_of(listener, cursor, axis);
 	const auto* event = static_cast<wlr_pointer_axis_event*>(data);
 
+	cursor.seat.server.telemetry->pointer_event();
+	cursor.seat.server.input_recorder->axis(*event);
+
 	/* Notify the client with pointer focus of the axis event. */
 	wlr_seat_pointer_notify_axis(
 		cursor.seat.wlr, event->time_msec, event->orientation, event->delta, event->delta_discrete, event->source);
@@ -97,9 +116,13 @@ static void cursor_axis_notify(wl_listener* listener, void* data) {
  * multiple events together. For instance, two axis events may happen at the
  * same time, in which case a frame event won't be sent in between. */
 static void cursor_frame_notify(wl_listener* listener, void* data) {
+	MAGPIE_HOT_PATH("cursor_frame");
+	MAGPIE_TRACE_SCOPE("cursor_frame");
 	Cursor& cursor = magpie_container_of(listener, cursor, frame);
 	(void) data;
 
+	cursor.seat.server.input_recorder->frame();
+
 	/* Notify the client with pointer focus of the frame event. */
 	wlr_seat_pointer_notify_frame(cursor.seat.wlr);
 }
@@ -111,9 +134,14 @@ static void cursor_frame_notify(wl_listener* listener, void* data) {
  * so we have to warp the mouse there. There is also some hardware which
  * emits these events. */
 static void cursor_motion_absolute_notify(wl_listener* listener, void* data) {
+	MAGPIE_HOT_PATH("cursor_motion_absolute");
+	MAGPIE_TRACE_SCOPE("cursor_motion_absolute");
 	Cursor& cursor = magpie_container_of(listener, cursor, motion_absolute);
 	const auto* event = static_cast<wlr_pointer_motion_absolute_event*>(data);
 
+	cursor.seat.server.telemetry->pointer_event();
+	cursor.seat.server.input_recorder->motion_absolute(*event);
+
 	double lx, ly;
 	wlr_cursor_absolute_to_layout_coords(&cursor.wlr, &event->pointer->base, event->x, event->y, &lx, &ly);
 
@@ -134,10 +162,13 @@ static void cursor_motion_absolute_notify(wl_listener* listener, void* data) {
 
 /* This event is forwarded by the cursor when a pointer emits a button event. */
 static void cursor_button_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("cursor_button");
 	Cursor& cursor = magpie_container_of(listener, cursor, button);
 	const auto* event = static_cast<wlr_pointer_button_event*>(data);
 
 	Server& server = cursor.seat.server;
+	server.telemetry->pointer_event();
+	server.input_recorder->button(*event);
 
 	/* Notify the client with pointer focus that a button press has occurred */
 	wlr_seat_pointer_notify_button(server.seat->wlr, event->time_msec, event->button, event->state);
@@ -162,9 +193,14 @@ static void cursor_button_notify(wl_listener* listener, void* data) {
 /* This event is forwarded by the cursor when a pointer emits a _relative_
  * pointer motion event (i.e. a delta) */
 static void cursor_motion_notify(wl_listener* listener, void* data) {
+	MAGPIE_HOT_PATH("cursor_motion");
+	MAGPIE_TRACE_SCOPE("cursor_motion");
 	Cursor& cursor = magpie_container_of(listener, cursor, motion);
 	const auto* event = static_cast<wlr_pointer_motion_event*>(data);
 
+	cursor.seat.server.telemetry->pointer_event();
+	cursor.seat.server.input_recorder->motion(*event);
+
 	wlr_relative_pointer_manager_v1_send_relative_motion(cursor.relative_pointer_mgr, cursor.seat.wlr,
 		static_cast<uint64_t>(event->time_msec) * 1000, event->delta_x, event->delta_y, event->unaccel_dx, event->unaccel_dy);
 
@@ -184,6 +220,7 @@ static void gesture_pinch_begin_notify(wl_listener* listener, void* data) {
 	Cursor& cursor = magpie_container_of(listener, cursor, gesture_pinch_begin);
 	const auto* event = static_cast<wlr_pointer_pinch_begin_event*>(data);
 
+	cursor.seat.server.input_recorder->pinch_begin(*event);
 	wlr_pointer_gestures_v1_send_pinch_begin(cursor.pointer_gestures, cursor.seat.wlr, event->time_msec, event->fingers);
 }
 
@@ -191,6 +228,7 @@ static void gesture_pinch_update_notify(wl_listener* listener, void* data) {
 	Cursor& cursor = magpie_container_of(listener, cursor, gesture_pinch_update);
 	const auto* event = static_cast<wlr_pointer_pinch_update_event*>(data);
 
+	cursor.seat.server.input_recorder->pinch_update(*event);
 	wlr_pointer_gestures_v1_send_pinch_update(
 		cursor.pointer_gestures, cursor.seat.wlr, event->time_msec, event->dx, event->dy, event->scale, event->rotation);
 }
@@ -199,6 +237,7 @@ static void gesture_pinch_end_notify(wl_listener* listener, void* data) {
 	Cursor& cursor = magpie_container_of(listener, cursor, gesture_pinch_end);
 	const auto* event = static_cast<wlr_pointer_pinch_end_event*>(data);
 
+	cursor.seat.server.input_recorder->pinch_end(*event);
 	wlr_pointer_gestures_v1_send_pinch_end(cursor.pointer_gestures, cursor.seat.wlr, event->time_msec, event->cancelled);
 }
 
@@ -206,6 +245,7 @@ static void gesture_swipe_begin_notify(wl_listener* listener, void* data) {
 	Cursor& cursor = magpie_container_of(listener, cursor, gesture_swipe_begin);
 	const auto* event = static_cast<wlr_pointer_swipe_begin_event*>(data);
 
+	cursor.seat.server.input_recorder->swipe_begin(*event);
 	wlr_pointer_gestures_v1_send_swipe_begin(cursor.pointer_gestures, cursor.seat.wlr, event->time_msec, event->fingers);
 }
 
@@ -213,6 +253,7 @@ static void gesture_swipe_update_notify(wl_listener* listener, void* data) {
 	Cursor& cursor = magpie_container_of(listener, cursor, gesture_swipe_update);
 	const auto* event = static_cast<wlr_pointer_swipe_update_event*>(data);
 
+	cursor.seat.server.input_recorder->swipe_update(*event);
 	wlr_pointer_gestures_v1_send_swipe_update(cursor.pointer_gestures, cursor.seat.wlr, event->time_msec, event->dx, event->dy);
 }
 
@@ -220,6 +261,7 @@ static void gesture_swipe_end_notify(wl_listener* listener, void* data) {
 	Cursor& cursor = magpie_container_of(listener, cursor, gesture_swipe_end);
 	const auto* event = static_cast<wlr_pointer_swipe_end_event*>(data);
 
+	cursor.seat.server.input_recorder->swipe_end(*event);
 	wlr_pointer_gestures_v1_send_swipe_end(cursor.pointer_gestures, cursor.seat.wlr, event->time_msec, event->cancelled);
 }
 
@@ -227,6 +269,7 @@ static void gesture_hold_begin_notify(wl_listener* listener, void* data) {
 	Cursor& cursor = magpie_container_of(listener, cursor, gesture_hold_begin);
 	const auto* event = static_cast<wlr_pointer_hold_begin_event*>(data);
 
+	cursor.seat.server.input_recorder->hold_begin(*event);
 	wlr_pointer_gestures_v1_send_hold_begin(cursor.pointer_gestures, cursor.seat.wlr, event->time_msec, event->fingers);
 }
 
@@ -234,6 +277,7 @@ static void gesture_hold_end_notify(wl_listener* listener, void* data) {
 	Cursor& cursor = magpie_container_of(listener, cursor, gesture_hold_end);
 	const auto* event = static_cast<wlr_pointer_hold_end_event*>(data);
 
+	cursor.seat.server.input_recorder->hold_end(*event);
 	wlr_pointer_gestures_v1_send_hold_end(cursor.pointer_gestures, cursor.seat.wlr, event->time_msec, event->cancelled);
 }
 
@@ -247,9 +291,11 @@ Cursor::Cursor(Seat& seat) noexcept : listeners(*this), seat(seat), wlr(*wlr_cur
 	/* Creates an xcursor manager, another wlroots utility which loads up
 	 * Xcursor themes to source cursor images from and makes sure that cursor
 	 * images are available at all scale factors on the screen (necessary for
-	 * HiDPI support). We add a cursor theme at scale factor 1 to begin with. */
-	cursor_mgr = wlr_xcursor_manager_create(nullptr, 24);
-	wlr_xcursor_manager_load(cursor_mgr, 1);
+	 * HiDPI support). We add a cursor theme at scale factor 1 to begin with,
+	 * loading it in the background since it means reading many files. */
+	const CursorConfig& config = seat.server.config->current.cursor;
+	cursor_mgr = wlr_xcursor_manager_create(config.theme.empty() ? nullptr : config.theme.c_str(), config.size);
+	load_theme(1);
 
 	relative_pointer_mgr = wlr_relative_pointer_manager_v1_create(seat.server.display);
 	pointer_gestures = wlr_pointer_gestures_v1_create(seat.server.display);
@@ -301,7 +347,10 @@ void Cursor::attach_input_device(wlr_input_device* device) const {
 }
 
 void Cursor::process_motion(const uint32_t time) {
-	wlr_idle_notifier_v1_notify_activity(seat.server.idle_notifier, seat.wlr);
+	MAGPIE_TRACE_SCOPE("cursor_process_motion");
+	if (seat.server.idle_notifier != nullptr) {
+		wlr_idle_notifier_v1_notify_activity(seat.server.idle_notifier, seat.wlr);
+	}
 
 	/* If the mode is non-passthrough, delegate to those functions. */
 	if (mode == MAGPIE_CURSOR_MOVE) {
@@ -374,13 +423,117 @@ void Cursor::warp_to_constraint(PointerConstraint& constraint) const {
 	}
 }
 
-void Cursor::set_image(const std::string& name) {
-	if (current_image != name) {
+void Cursor::set_image(const char* name) {
+	if (std::strcmp(current_image, name) != 0) {
 		current_image = name;
 		reload_image();
 	}
 }
 
-void Cursor::reload_image() const {
-	wlr_cursor_set_xcursor(&wlr, cursor_mgr, current_image.c_str());
+void Cursor::reload_image() {
+	/* wlr_cursor loads missing themes synchronously, so hold off on the image
+	 * until the background loads are done. */
+	if (!themes_ready()) {
+		return;
+	}
+
+	wlr_cursor_set_xcursor(&wlr, cursor_mgr, current_image);
+	if (retired_cursor_mgr != nullptr) {
+		wlr_xcursor_manager_destroy(retired_cursor_mgr);
+		retired_cursor_mgr = nullptr;
+	}
+}
+
+bool Cursor::has_theme(const float scale) const {
+	wlr_xcursor_manager_theme* theme;
+	wl_list_for_each(theme, &cursor_mgr->scaled_themes, link) {
+		if (theme->scale == scale) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool Cursor::themes_ready() const {
+	const auto settled = [this](const float scale) {
+		return has_theme(scale) ||
+			   std::find(failed_theme_scales.begin(), failed_theme_scales.end(), scale) != failed_theme_scales.end();
+	};
+	if (!settled(1)) {
+		return false;
+	}
+
+	return std::all_of(seat.server.outputs.begin(), seat.server.outputs.end(), [&settled](const Output* output) {
+		return settled(output->wlr.scale);
+	});
+}
+
+/* Loads the cursor theme for a scale factor on a worker thread, falling back
+ * to the default theme. The theme is only handed to the xcursor manager once
+ * it is fully loaded. If neither loads, the scale is given up on so the image
+ * is still set at the other scales. */
+void Cursor::load_theme(const float scale) {
+	if (has_theme(scale) || std::find(pending_theme_scales.begin(), pending_theme_scales.end(), scale) !=
+								pending_theme_scales.end()) {
+		return;
+	}
+	pending_theme_scales.push_back(scale);
+
+	std::string name = cursor_mgr->name != nullptr ? cursor_mgr->name : "";
+	const auto size = static_cast<int>(static_cast<float>(cursor_mgr->size) * scale);
+
+	seat.server.workers->submit<wlr_xcursor_theme*>(
+		[name = std::move(name), size]() {
+			wlr_xcursor_theme* theme = wlr_xcursor_theme_load(name.empty() ? nullptr : name.c_str(), size);
+			if (theme == nullptr && !name.empty()) {
+				theme = wlr_xcursor_theme_load(nullptr, size);
+			}
+			return theme;
+		},
+		[this, scale, generation = theme_generation](wlr_xcursor_theme* theme) {
+			if (generation != theme_generation) {
+				if (theme != nullptr) {
+					wlr_xcursor_theme_destroy(theme);
+				}
+				return;
+			}
+
+			std::erase(pending_theme_scales, scale);
+			if (theme == nullptr) {
+				wlr_log(WLR_ERROR, "Failed to load cursor theme at scale %.2f", scale);
+				failed_theme_scales.push_back(scale);
+				reload_image();
+				return;
+			}
+
+			/* Ownership moves to the manager, which frees both on destroy */
+			auto* entry = static_cast<wlr_xcursor_manager_theme*>(calloc(1, sizeof(wlr_xcursor_manager_theme)));
+			entry->scale = scale;
+			entry->theme = theme;
+			wl_list_insert(&cursor_mgr->scaled_themes, &entry->link);
+
+			reload_image();
+		});
+}
+
+/* Switches to another theme or size. The current images stay up until the
+ * new theme is loaded at every scale in use. */
+void Cursor::set_theme(const std::string& name, const uint32_t size) {
+	if (retired_cursor_mgr == nullptr) {
+		retired_cursor_mgr = cursor_mgr;
+	} else {
+		/* Never shown, the one before it still is */
+		wlr_xcursor_manager_destroy(cursor_mgr);
+	}
+
+	cursor_mgr = wlr_xcursor_manager_create(name.empty() ? nullptr : name.c_str(), size);
+	theme_generation++;
+	pending_theme_scales.clear();
+	failed_theme_scales.clear();
+
+	load_theme(1);
+	for (const auto* output : std::as_const(seat.server.outputs)) {
+		load_theme(output->wlr.scale);
+	}
 }
@@ -6,6 +6,7 @@
 
 #include <functional>
 #include <string>
+#include <vector>
 
 #include "wlr-wrap-start.hpp"
 #include <wlr/types/wlr_cursor.h>
@@ -40,8 +41,18 @@ class Cursor {
   private:
 	Listeners listeners;
 
+	std::vector<float> pending_theme_scales;
+	/* Scales no theme could be loaded at, not waited for */
+	std::vector<float> failed_theme_scales;
+	/* Bumped when the theme changes, so loads for the old one are dropped */
+	uint32_t theme_generation = 0;
+	/* Still shown until the new theme is loaded */
+	wlr_xcursor_manager* retired_cursor_mgr = nullptr;
+
 	void process_move(uint32_t time);
 	void process_resize(uint32_t time) const;
+	[[nodiscard]] bool has_theme(float scale) const;
+	[[nodiscard]] bool themes_ready() const;
 
   public:
 	const Seat& seat;
@@ -51,7 +62,8 @@ class Cursor {
 	wlr_xcursor_manager* cursor_mgr;
 	wlr_relative_pointer_manager_v1* relative_pointer_mgr;
 	wlr_pointer_gestures_v1* pointer_gestures;
-	std::string current_image;
+	/* Not owned, string literals in practice */
+	const char* current_image = "";
 
 	explicit Cursor(Seat& seat) noexcept;
 
@@ -59,8 +71,10 @@ class Cursor {
 	void process_motion(uint32_t time);
 	void reset_mode();
 	void warp_to_constraint(PointerConstraint& constraint) const;
-	void set_image(const std::string& name);
-	void reload_image() const;
+	void set_image(const char* name);
+	void reload_image();
+	void load_theme(float scale);
+	void set_theme(const std::string& name, uint32_t size);
 };
 
 #endif
@@ -1,10 +1,18 @@
 #include "keyboard.hpp"
 
+#include "alloc_guard.hpp"
+#include "config.hpp"
+#include "launcher.hpp"
+#include "recorder.hpp"
 #include "seat.hpp"
 #include "server.hpp"
 #include "surface/view.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+#include "workspace.hpp"
 
 #include <algorithm>
+#include <iterator>
 #include <xkbcommon/xkbcommon.h>
 
 #include "wlr-wrap-start.hpp"
@@ -22,67 +30,144 @@ static void keyboard_handle_destroy(wl_listener* listener, void* data) {
 	(void) data;
 
 	std::vector<Keyboard*>& keyboards = keyboard.seat.keyboards;
-	(void) std::ranges::remove(keyboards, &keyboard).begin();
+	std::erase(keyboards, &keyboard);
 
 	delete &keyboard;
 }
 
-static bool handle_compositor_keybinding(const Keyboard& keyboard, const uint32_t modifiers, const xkb_keysym_t sym) {
-	Server& server = keyboard.seat.server;
+/* Moves to the next or previous workspace, wrapping around, and takes the
+ * focused view along if asked to. */
+static void switch_workspace(Server& server, const int32_t direction, const bool take_view) {
+	const auto count = static_cast<int32_t>(server.workspaces.size());
+	const auto index = (static_cast<int32_t>(server.active_workspace->index) + direction + count) % count;
+	Workspace& workspace = *server.workspaces[index];
+
+	View* view = server.focused_view;
+	if (take_view && view != nullptr) {
+		view->set_workspace(workspace);
+		server.focus_view(view);
+	} else {
+		server.set_active_workspace(workspace);
+	}
+}
 
-	if (modifiers == WLR_MODIFIER_ALT) {
-		switch (sym) {
-			case XKB_KEY_Escape: {
-				wl_display_terminate(server.display);
-				return true;
+static void run_keybinding(Server& server, const Keybinding& binding) {
+	MAGPIE_ALLOC_ALLOWED();
+	switch (binding.action) {
+		case KEYBINDING_QUIT: {
+			server.terminate();
+			break;
+		}
+		case KEYBINDING_CYCLE_VIEWS: {
+			/* Cycle to the next view on this workspace. The focused view
+			 * is always at the front of the list. */
+			if (server.views.size() < 2) {
+				break;
 			}
-			case XKB_KEY_Tab: {
-				/* Cycle to the next view */
-				if (server.views.size() < 2) {
-					return true;
-				}
-				View* next_view = *server.views.begin()++;
-				server.focus_view(next_view);
-				return true;
+			const auto next_view =
+				std::find_if(std::next(server.views.begin()), server.views.end(), [&server](const View* view) {
+					return view->workspace == server.active_workspace && !view->is_minimized;
+				});
+			if (next_view != server.views.end()) {
+				server.focus_view(*next_view);
 			}
-			default: {
-				break;
+			break;
+		}
+		case KEYBINDING_CLOSE: {
+			if (server.focused_view != nullptr) {
+				server.focused_view->close();
 			}
+			break;
+		}
+		case KEYBINDING_TOGGLE_MAXIMIZE: {
+			if (server.focused_view != nullptr) {
+				server.focused_view->toggle_maximize();
+			}
+			break;
+		}
+		case KEYBINDING_TOGGLE_KEEP_ABOVE:
+		case KEYBINDING_TOGGLE_KEEP_BELOW: {
+			View* view = server.focused_view;
+			if (view != nullptr && view->workspace != nullptr) {
+				const ViewBand band = binding.action == KEYBINDING_TOGGLE_KEEP_ABOVE ? VIEW_BAND_ABOVE : VIEW_BAND_BELOW;
+				view->workspace->stack.set_band(*view, view->band == band ? VIEW_BAND_NORMAL : band);
+			}
+			break;
+		}
+		case KEYBINDING_WORKSPACE_PREV:
+		case KEYBINDING_WORKSPACE_NEXT: {
+			switch_workspace(server, binding.action == KEYBINDING_WORKSPACE_NEXT ? 1 : -1, false);
+			break;
+		}
+		case KEYBINDING_MOVE_TO_WORKSPACE_PREV:
+		case KEYBINDING_MOVE_TO_WORKSPACE_NEXT: {
+			switch_workspace(server, binding.action == KEYBINDING_MOVE_TO_WORKSPACE_NEXT ? 1 : -1, true);
+			break;
+		}
+		case KEYBINDING_EXEC: {
+			server.launcher->launch(binding.command);
+			break;
 		}
-	} else if (sym >= XKB_KEY_XF86Switch_VT_1 && sym <= XKB_KEY_XF86Switch_VT_12) {
-		if (wlr_backend_is_multi(keyboard.seat.server.backend)) {
+	}
+}
+
+static bool handle_compositor_keybinding(const Keyboard& keyboard, const uint32_t modifiers, const xkb_keysym_t sym) {
+	Server& server = keyboard.seat.server;
+
+	/* VT switching is not configurable, so there is always a way out */
+	if (sym >= XKB_KEY_XF86Switch_VT_1 && sym <= XKB_KEY_XF86Switch_VT_12) {
+		if (wlr_backend_is_multi(server.backend)) {
 			const unsigned vt = sym - XKB_KEY_XF86Switch_VT_1 + 1;
-			wlr_session_change_vt(keyboard.seat.server.session, vt);
+			wlr_session_change_vt(server.session, vt);
 		}
 		return true;
 	}
 
+	/* Caps and num lock are ignored, so bindings work with either on */
+	const uint32_t held = modifiers & ~(WLR_MODIFIER_CAPS | WLR_MODIFIER_MOD2);
+	const xkb_keysym_t lower = xkb_keysym_to_lower(sym);
+	for (const auto& binding : server.config->current.keybindings) {
+		if (binding.modifiers == held && binding.sym == lower) {
+			run_keybinding(server, binding);
+			return true;
+		}
+	}
+
 	return false;
 }
 
 /* This event is raised when a key is pressed or released. */
 static void keyboard_handle_key(wl_listener* listener, void* data) {
+	MAGPIE_HOT_PATH("keyboard_key");
+	MAGPIE_TRACE_SCOPE("keyboard_key");
 	const Keyboard& keyboard = magpie_container_of(listener, keyboard, key);
 
 	const auto* event = static_cast<wlr_keyboard_key_event*>(data);
 	wlr_seat* seat = keyboard.seat.wlr;
 
-	wlr_idle_notifier_v1_notify_activity(keyboard.seat.server.idle_notifier, seat);
+	if (keyboard.seat.server.idle_notifier != nullptr) {
+		wlr_idle_notifier_v1_notify_activity(keyboard.seat.server.idle_notifier, seat);
+	}
+	keyboard.seat.server.telemetry->keyboard_event();
+	keyboard.seat.server.input_recorder->key(keyboard.wlr, *event);
 
 	/* Translate libinput keycode -> xkbcommon */
 	const uint32_t keycode = event->keycode + 8;
 	/* Get a list of keysyms based on the keymap for this keyboard */
-	const xkb_keysym_t* syms;
-	const int nsyms = xkb_state_key_get_syms(keyboard.wlr.xkb_state, keycode, &syms);
+	const xkb_keysym_t* syms = nullptr;
+	int nsyms = 0;
+	if (keyboard.wlr.xkb_state != nullptr) {
+		nsyms = xkb_state_key_get_syms(keyboard.wlr.xkb_state, keycode, &syms);
+	}
 
 	bool handled = false;
 	const uint32_t modifiers = wlr_keyboard_get_modifiers(&keyboard.wlr);
 	if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-		if (modifiers & WLR_MODIFIER_ALT) {
-			/* If alt is held down and this button was _pressed_, we attempt to
-			 * process it as a compositor keybinding. */
-			for (int i = 0; i < nsyms; i++) {
-				handled = handle_compositor_keybinding(keyboard, modifiers, syms[i]);
+		/* If this button was _pressed_, we attempt to process it as a
+		 * compositor keybinding. */
+		for (int i = 0; i < nsyms; i++) {
+			if (handle_compositor_keybinding(keyboard, modifiers, syms[i])) {
+				handled = true;
 			}
 		}
 	}
@@ -97,6 +182,8 @@ static void keyboard_handle_key(wl_listener* listener, void* data) {
 /* This event is raised when a modifier key, such as shift or alt, is
  * pressed. We simply communicate this to the client. */
 static void keyboard_handle_modifiers(wl_listener* listener, void* data) {
+	MAGPIE_HOT_PATH("keyboard_modifiers");
+	MAGPIE_TRACE_SCOPE("keyboard_modifiers");
 	Keyboard& keyboard = magpie_container_of(listener, keyboard, modifiers);
 	(void) data;
 
@@ -111,16 +198,17 @@ static void keyboard_handle_modifiers(wl_listener* listener, void* data) {
 	wlr_seat_keyboard_notify_modifiers(keyboard.seat.wlr, &keyboard.wlr.modifiers);
 }
 
-Keyboard::Keyboard(Seat& seat, wlr_keyboard& keyboard) noexcept : listeners(*this), seat(seat), wlr(keyboard) {
-	/* We need to prepare an XKB keymap and assign it to the keyboard. This
-	 * assumes the defaults (e.g. layout = "us"). */
-	xkb_context* context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-	xkb_keymap* keymap = xkb_keymap_new_from_names(context, nullptr, XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-	wlr_keyboard_set_keymap(&keyboard, keymap);
-	xkb_keymap_unref(keymap);
-	xkb_context_unref(context);
-	wlr_keyboard_set_repeat_info(&keyboard, 25, 600);
+Keyboard::Keyboard(Seat& seat, wlr_keyboard& keyboard, const bool is_virtual) noexcept
+	: listeners(*this), seat(seat), wlr(keyboard), is_virtual(is_virtual) {
+	/* Keyboards share the seat's keymap unless the config gives them their
+	 * own. It is compiled in the background, so it may not be there yet, in
+	 * which case the seat sets it later. Virtual keyboards keep the keymap
+	 * their client sends. */
+	if (xkb_keymap* keymap = seat.keymap_for(*this); keymap != nullptr && !is_virtual) {
+		wlr_keyboard_set_keymap(&keyboard, keymap);
+	}
+	const KeyboardConfig& config = seat.server.config->current.keyboard_for(name());
+	wlr_keyboard_set_repeat_info(&keyboard, config.repeat_rate, config.repeat_delay);
 
 	/* Here we set up listeners for keyboard events. */
 	listeners.modifiers.notify = keyboard_handle_modifiers;
@@ -138,3 +226,7 @@ Keyboard::~Keyboard() noexcept {
 	wl_list_remove(&listeners.key.link);
 	wl_list_remove(&listeners.destroy.link);
 }
+
+std::string Keyboard::name() const {
+	return wlr.base.name != nullptr ? wlr.base.name : "";
+}
@@ -1,9 +1,11 @@
 #ifndef MAGPIE_KEYBOARD_HPP
 #define MAGPIE_KEYBOARD_HPP
 
+#include "live_objects.hpp"
 #include "types.hpp"
 
 #include <functional>
+#include <string>
 
 #include "wlr-wrap-start.hpp"
 #include <wlr/types/wlr_keyboard.h>
@@ -21,13 +23,19 @@ class Keyboard {
 
   private:
 	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_KEYBOARD> live;
 
   public:
 	Seat& seat;
 	wlr_keyboard& wlr;
+	/* From zwp_virtual_keyboard_v1, whose client brings its own keymap */
+	const bool is_virtual;
 
-	Keyboard(Seat& seat, wlr_keyboard& keyboard) noexcept;
+	Keyboard(Seat& seat, wlr_keyboard& keyboard, bool is_virtual = false) noexcept;
 	~Keyboard() noexcept;
+
+	/* The input device name, which config sections refer to */
+	[[nodiscard]] std::string name() const;
 };
 
 #endif
@@ -0,0 +1,159 @@
+#include "recorder.hpp"
+
+#include "alloc_guard.hpp"
+#include "clock.hpp"
+#include "server.hpp"
+
+#include <cinttypes>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* About 10 KiB, a few seconds of fast pointer motion */
+static constexpr size_t INPUT_RECORDER_CHUNK = 256 * sizeof(InputRecord);
+/* Not a device, frames come from the cursor */
+static constexpr uint16_t INPUT_RECORDER_NO_DEVICE = UINT16_MAX;
+
+InputRecorder::InputRecorder(Server& server) noexcept : server(server), writer(*server.workers, INPUT_RECORDER_CHUNK) {}
+
+InputRecorder::~InputRecorder() noexcept {
+	stop();
+}
+
+/* Records to the given path, or to $XDG_RUNTIME_DIR/magpie-input-<pid>-<n>.mgpi */
+bool InputRecorder::start() {
+	if (recording()) {
+		return false;
+	}
+
+	start_ns = clock_now_ns();
+	const InputRecordingHeader header = {MAGPIE_INPUT_RECORDING_MAGIC, MAGPIE_INPUT_RECORDING_VERSION, start_ns};
+	if (!writer.open(default_recording_path("input", "mgpi"), &header, sizeof(header))) {
+		return false;
+	}
+
+	events = 0;
+	devices.clear();
+	wlr_log(WLR_INFO, "Recording input to %s", writer.path.c_str());
+	return true;
+}
+
+/* Returns the number of events recorded. The file is complete once the
+ * workers have written out what is still pending. */
+uint64_t InputRecorder::stop() {
+	if (!recording()) {
+		return 0;
+	}
+
+	writer.close();
+	wlr_log(WLR_INFO, "Recorded %" PRIu64 " input events to %s", events, writer.path.c_str());
+	return events;
+}
+
+void InputRecorder::append(const InputRecordType type, const uint16_t device, const uint32_t time_msec, const uint32_t code,
+	const int32_t value, const float x, const float y, const float ux, const float uy) {
+	/* Recording is opt-in, and the buffer grows a chunk at a time */
+	MAGPIE_ALLOC_ALLOWED();
+	const InputRecord record = {clock_now_ns() - start_ns, time_msec, type, device, code, value, x, y, ux, uy};
+	writer.append(&record, sizeof(record));
+	if (type != INPUT_RECORD_DEVICE) {
+		events++;
+	}
+}
+
+/* Devices are numbered in the order they first send an event */
+uint16_t InputRecorder::device_index(const wlr_input_device& device, const uint32_t time_msec) {
+	const auto it = devices.find(&device);
+	if (it != devices.end()) {
+		return it->second;
+	}
+
+	const auto index = static_cast<uint16_t>(devices.size());
+	devices.emplace(&device, index);
+	append(INPUT_RECORD_DEVICE, index, time_msec, 0, device.type);
+	return index;
+}
+
+void InputRecorder::pointer_event(const InputRecordType type, const wlr_pointer& pointer, const uint32_t time_msec,
+	const uint32_t code, const int32_t value, const float x, const float y, const float ux, const float uy) {
+	if (!recording()) {
+		return;
+	}
+
+	last_pointer = device_index(pointer.base, time_msec);
+	append(type, last_pointer, time_msec, code, value, x, y, ux, uy);
+}
+
+void InputRecorder::motion(const wlr_pointer_motion_event& event) {
+	pointer_event(INPUT_RECORD_POINTER_MOTION, *event.pointer, event.time_msec, 0, 0, static_cast<float>(event.delta_x),
+		static_cast<float>(event.delta_y), static_cast<float>(event.unaccel_dx), static_cast<float>(event.unaccel_dy));
+}
+
+void InputRecorder::motion_absolute(const wlr_pointer_motion_absolute_event& event) {
+	pointer_event(INPUT_RECORD_POINTER_MOTION_ABSOLUTE, *event.pointer, event.time_msec, 0, 0, static_cast<float>(event.x),
+		static_cast<float>(event.y));
+}
+
+void InputRecorder::button(const wlr_pointer_button_event& event) {
+	pointer_event(INPUT_RECORD_POINTER_BUTTON, *event.pointer, event.time_msec, event.button, event.state);
+}
+
+void InputRecorder::axis(const wlr_pointer_axis_event& event) {
+	pointer_event(INPUT_RECORD_POINTER_AXIS, *event.pointer, event.time_msec, event.orientation | event.source << 16,
+		event.delta_discrete, static_cast<float>(event.delta));
+}
+
+/* Frames come from the cursor as a whole, and belong to the pointer that
+ * sent the events before them */
+void InputRecorder::frame() {
+	if (!recording()) {
+		return;
+	}
+
+	append(INPUT_RECORD_POINTER_FRAME, devices.empty() ? INPUT_RECORDER_NO_DEVICE : last_pointer, 0);
+}
+
+void InputRecorder::swipe_begin(const wlr_pointer_swipe_begin_event& event) {
+	pointer_event(INPUT_RECORD_SWIPE_BEGIN, *event.pointer, event.time_msec, event.fingers);
+}
+
+void InputRecorder::swipe_update(const wlr_pointer_swipe_update_event& event) {
+	pointer_event(INPUT_RECORD_SWIPE_UPDATE, *event.pointer, event.time_msec, event.fingers, 0,
+		static_cast<float>(event.dx), static_cast<float>(event.dy));
+}
+
+void InputRecorder::swipe_end(const wlr_pointer_swipe_end_event& event) {
+	pointer_event(INPUT_RECORD_SWIPE_END, *event.pointer, event.time_msec, 0, event.cancelled);
+}
+
+void InputRecorder::pinch_begin(const wlr_pointer_pinch_begin_event& event) {
+	pointer_event(INPUT_RECORD_PINCH_BEGIN, *event.pointer, event.time_msec, event.fingers);
+}
+
+void InputRecorder::pinch_update(const wlr_pointer_pinch_update_event& event) {
+	pointer_event(INPUT_RECORD_PINCH_UPDATE, *event.pointer, event.time_msec, event.fingers, 0,
+		static_cast<float>(event.dx), static_cast<float>(event.dy), static_cast<float>(event.scale),
+		static_cast<float>(event.rotation));
+}
+
+void InputRecorder::pinch_end(const wlr_pointer_pinch_end_event& event) {
+	pointer_event(INPUT_RECORD_PINCH_END, *event.pointer, event.time_msec, 0, event.cancelled);
+}
+
+void InputRecorder::hold_begin(const wlr_pointer_hold_begin_event& event) {
+	pointer_event(INPUT_RECORD_HOLD_BEGIN, *event.pointer, event.time_msec, event.fingers);
+}
+
+void InputRecorder::hold_end(const wlr_pointer_hold_end_event& event) {
+	pointer_event(INPUT_RECORD_HOLD_END, *event.pointer, event.time_msec, 0, event.cancelled);
+}
+
+void InputRecorder::key(const wlr_keyboard& keyboard, const wlr_keyboard_key_event& event) {
+	if (!recording()) {
+		return;
+	}
+
+	const uint16_t device = device_index(keyboard.base, event.time_msec);
+	append(INPUT_RECORD_KEY, device, event.time_msec, event.keycode, event.state);
+}
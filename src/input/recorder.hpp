@@ -0,0 +1,122 @@
+#ifndef MAGPIE_RECORDER_HPP
+#define MAGPIE_RECORDER_HPP
+
+#include "recording.hpp"
+#include "types.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <type_traits>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_pointer.h>
+#include "wlr-wrap-end.hpp"
+
+static constexpr uint32_t MAGPIE_INPUT_RECORDING_MAGIC = 0x4950474d; /* "MGPI" */
+static constexpr uint32_t MAGPIE_INPUT_RECORDING_VERSION = 1;
+
+/* What the generic fields of an InputRecord hold for each type */
+enum InputRecordType : uint16_t {
+	/* value: the wlr_input_device_type, first seen before its events */
+	INPUT_RECORD_DEVICE,
+	/* x, y: delta, ux, uy: unaccelerated delta */
+	INPUT_RECORD_POINTER_MOTION,
+	/* x, y: position, from 0 to 1 */
+	INPUT_RECORD_POINTER_MOTION_ABSOLUTE,
+	/* code: button, value: wlr_button_state */
+	INPUT_RECORD_POINTER_BUTTON,
+	/* code: orientation | source << 16, value: discrete delta, x: delta */
+	INPUT_RECORD_POINTER_AXIS,
+	INPUT_RECORD_POINTER_FRAME,
+	/* code: fingers */
+	INPUT_RECORD_SWIPE_BEGIN,
+	/* code: fingers, x, y: delta */
+	INPUT_RECORD_SWIPE_UPDATE,
+	/* value: cancelled */
+	INPUT_RECORD_SWIPE_END,
+	/* code: fingers */
+	INPUT_RECORD_PINCH_BEGIN,
+	/* code: fingers, x, y: delta, ux: scale, uy: rotation */
+	INPUT_RECORD_PINCH_UPDATE,
+	/* value: cancelled */
+	INPUT_RECORD_PINCH_END,
+	/* code: fingers */
+	INPUT_RECORD_HOLD_BEGIN,
+	/* value: cancelled */
+	INPUT_RECORD_HOLD_END,
+	/* code: keycode, value: wl_keyboard_key_state */
+	INPUT_RECORD_KEY,
+};
+
+/* A recording is this header followed by fixed size records, in the
+ * machine's byte order. Times are clock_now_ns nanoseconds. */
+struct InputRecordingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t start_ns;
+};
+
+struct InputRecord {
+	/* Since the recording started */
+	uint64_t time_ns;
+	/* The timestamp the device gave the event */
+	uint32_t time_msec;
+	uint16_t type;
+	uint16_t device;
+	uint32_t code;
+	int32_t value;
+	float x;
+	float y;
+	float ux;
+	float uy;
+};
+
+static_assert(std::is_trivially_copyable_v<InputRecord> && sizeof(InputRecord) == 40);
+
+/* Records the raw events of every pointer and keyboard as they reach the
+ * cursor and keyboard listeners, for replaying with magpie-bench. The input
+ * path only appends to the writer's buffer. */
+class InputRecorder {
+	uint64_t start_ns = 0;
+	uint64_t events = 0;
+	std::map<const wlr_input_device*, uint16_t> devices;
+	uint16_t last_pointer = 0;
+
+	uint16_t device_index(const wlr_input_device& device, uint32_t time_msec);
+	void append(InputRecordType type, uint16_t device, uint32_t time_msec, uint32_t code = 0, int32_t value = 0,
+		float x = 0, float y = 0, float ux = 0, float uy = 0);
+	void pointer_event(InputRecordType type, const wlr_pointer& pointer, uint32_t time_msec, uint32_t code = 0,
+		int32_t value = 0, float x = 0, float y = 0, float ux = 0, float uy = 0);
+
+  public:
+	Server& server;
+	RecordingWriter writer;
+
+	explicit InputRecorder(Server& server) noexcept;
+	~InputRecorder() noexcept;
+
+	[[nodiscard]] bool recording() const {
+		return writer.is_open();
+	}
+	bool start();
+	uint64_t stop();
+
+	void motion(const wlr_pointer_motion_event& event);
+	void motion_absolute(const wlr_pointer_motion_absolute_event& event);
+	void button(const wlr_pointer_button_event& event);
+	void axis(const wlr_pointer_axis_event& event);
+	void frame();
+	void swipe_begin(const wlr_pointer_swipe_begin_event& event);
+	void swipe_update(const wlr_pointer_swipe_update_event& event);
+	void swipe_end(const wlr_pointer_swipe_end_event& event);
+	void pinch_begin(const wlr_pointer_pinch_begin_event& event);
+	void pinch_update(const wlr_pointer_pinch_update_event& event);
+	void pinch_end(const wlr_pointer_pinch_end_event& event);
+	void hold_begin(const wlr_pointer_hold_begin_event& event);
+	void hold_end(const wlr_pointer_hold_end_event& event);
+	void key(const wlr_keyboard& keyboard, const wlr_keyboard_key_event& event);
+};
+
+#endif
@@ -1,10 +1,12 @@
 #include "seat.hpp"
 
+#include "config.hpp"
 #include "cursor.hpp"
 #include "keyboard.hpp"
 #include "server.hpp"
 #include "surface/view.hpp"
 #include "types.hpp"
+#include "worker_pool.hpp"
 
 #include <wayland-util.h>
 
@@ -36,7 +38,7 @@ static void new_virtual_keyboard_notify(wl_listener* listener, void* data) {
 	Seat& seat = magpie_container_of(listener, seat, new_virtual_keyboard);
 	auto* keyboard = static_cast<wlr_virtual_keyboard_v1*>(data);
 
-	seat.new_input_device(&keyboard->keyboard.base);
+	seat.new_input_device(&keyboard->keyboard.base, true);
 }
 
 static void new_pointer_constraint_notify(wl_listener* listener, void* data) {
@@ -103,12 +105,114 @@ Seat::Seat(Server& server) noexcept : listeners(*this), server(server), cursor(*
 	pointer_constraints = wlr_pointer_constraints_v1_create(server.display);
 	listeners.new_pointer_constraint.notify = new_pointer_constraint_notify;
 	wl_signal_add(&pointer_constraints->events.new_constraint, &listeners.new_pointer_constraint);
+
+	server.config->load_keymaps(*this);
+}
+
+Seat::~Seat() noexcept {
+	wl_list_remove(&listeners.new_input.link);
+	wl_list_remove(&listeners.request_cursor.link);
+	wl_list_remove(&listeners.request_set_selection.link);
+	wl_list_remove(&listeners.new_virtual_pointer.link);
+	wl_list_remove(&listeners.new_virtual_keyboard.link);
+	wl_list_remove(&listeners.new_pointer_constraint.link);
+
+	if (keymap != nullptr) {
+		xkb_keymap_unref(keymap);
+	}
+	for (const auto& [device, device_keymap] : device_keymaps) {
+		xkb_keymap_unref(device_keymap);
+	}
+}
+
+/* Compiles the keymap shared by all keyboards, or the one configured for a
+ * keyboard device, on a worker thread, compiling takes long enough to drop
+ * frames. Keyboards that show up before it is ready get it as soon as it is. */
+void Seat::load_keymap(const std::string& device) {
+	const KeymapNames& names = server.config->current.keyboard_for(device).keymap;
+
+	server.workers->submit<xkb_keymap*>(
+		[names]() {
+			xkb_context* context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+			if (context == nullptr) {
+				return static_cast<xkb_keymap*>(nullptr);
+			}
+
+			/* Empty names fall back to the defaults (e.g. layout = "us") */
+			const xkb_rule_names rule_names = {
+				names.rules.empty() ? nullptr : names.rules.c_str(),
+				names.model.empty() ? nullptr : names.model.c_str(),
+				names.layout.empty() ? nullptr : names.layout.c_str(),
+				names.variant.empty() ? nullptr : names.variant.c_str(),
+				names.options.empty() ? nullptr : names.options.c_str(),
+			};
+			xkb_keymap* new_keymap = xkb_keymap_new_from_names(context, &rule_names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+			xkb_context_unref(context);
+			return new_keymap;
+		},
+		[this, device, names](xkb_keymap* new_keymap) {
+			/* A later reload changed it again, its own compile will follow */
+			const Config& config = server.config->current;
+			if (config.keyboard_for(device).keymap != names ||
+				(!device.empty() && !config.device_keyboards.contains(device))) {
+				if (new_keymap != nullptr) {
+					xkb_keymap_unref(new_keymap);
+				}
+				return;
+			}
+
+			if (new_keymap == nullptr) {
+				wlr_log(WLR_ERROR, "Failed to compile the keymap (layout '%s', variant '%s', options '%s')",
+					names.layout.c_str(), names.variant.c_str(), names.options.c_str());
+				return;
+			}
+
+			set_keymap(device, new_keymap);
+			xkb_keymap_unref(new_keymap);
+		});
+}
+
+/* Only the keyboards the keymap is for are updated. The shared keymap is for
+ * every keyboard without one of its own, virtual keyboards have theirs from
+ * their client. */
+void Seat::set_keymap(const std::string& device, xkb_keymap* new_keymap) {
+	xkb_keymap*& slot = device.empty() ? keymap : device_keymaps[device];
+	if (slot != nullptr) {
+		xkb_keymap_unref(slot);
+	}
+	slot = xkb_keymap_ref(new_keymap);
+
+	for (auto* keyboard : keyboards) {
+		if (!keyboard->is_virtual && keymap_for(*keyboard) == slot) {
+			wlr_keyboard_set_keymap(&keyboard->wlr, slot);
+		}
+	}
+}
+
+void Seat::remove_device_keymap(const std::string& device) {
+	const auto it = device_keymaps.find(device);
+	if (it == device_keymaps.end()) {
+		return;
+	}
+	xkb_keymap_unref(it->second);
+	device_keymaps.erase(it);
+
+	for (auto* keyboard : keyboards) {
+		if (!keyboard->is_virtual && keyboard->name() == device && keymap != nullptr) {
+			wlr_keyboard_set_keymap(&keyboard->wlr, keymap);
+		}
+	}
 }
 
-void Seat::new_input_device(wlr_input_device* device) {
+xkb_keymap* Seat::keymap_for(const Keyboard& keyboard) const {
+	const auto it = device_keymaps.find(keyboard.name());
+	return it != device_keymaps.end() ? it->second : keymap;
+}
+
+void Seat::new_input_device(wlr_input_device* device, const bool is_virtual) {
 	switch (device->type) {
 		case WLR_INPUT_DEVICE_KEYBOARD:
-			keyboards.push_back(new Keyboard(*this, *wlr_keyboard_from_input_device(device)));
+			keyboards.push_back(new Keyboard(*this, *wlr_keyboard_from_input_device(device), is_virtual));
 			break;
 		case WLR_INPUT_DEVICE_POINTER:
 		case WLR_INPUT_DEVICE_TABLET_TOOL:
@@ -138,8 +242,13 @@ void Seat::set_constraint(wlr_pointer_constraint_v1* wlr_constraint) {
 	}
 
 	if (wlr_constraint != nullptr) {
-		current_constraint = *new PointerConstraint(*this, *wlr_constraint);
-		current_constraint.value().get().activate();
+		/* Made once per constraint, it comes back here on every focus change */
+		auto* constraint = static_cast<PointerConstraint*>(wlr_constraint->data);
+		if (constraint == nullptr) {
+			constraint = new PointerConstraint(*this, *wlr_constraint);
+		}
+		current_constraint = *constraint;
+		constraint->activate();
 	}
 }
 
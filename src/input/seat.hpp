@@ -5,8 +5,11 @@
 #include "constraint.hpp"
 #include "types.hpp"
 
+#include <map>
 #include <optional>
+#include <string>
 #include <vector>
+#include <xkbcommon/xkbcommon.h>
 
 #include "wlr-wrap-start.hpp"
 #include <wlr/types/wlr_pointer_constraints_v1.h>
@@ -36,6 +39,9 @@ class Seat {
 	wlr_seat* wlr;
 	Cursor cursor;
 	std::vector<Keyboard*> keyboards;
+	xkb_keymap* keymap = nullptr;
+	/* For keyboards configured with a keymap of their own, by device name */
+	std::map<std::string, xkb_keymap*> device_keymaps;
 	wlr_virtual_pointer_manager_v1* virtual_pointer_mgr;
 	wlr_virtual_keyboard_manager_v1* virtual_keyboard_mgr;
 	wlr_pointer_constraints_v1* pointer_constraints;
@@ -44,7 +50,11 @@ class Seat {
 	explicit Seat(Server& server) noexcept;
 	~Seat() noexcept;
 
-	void new_input_device(wlr_input_device* device);
+	void new_input_device(wlr_input_device* device, bool is_virtual = false);
+	void load_keymap(const std::string& device = {});
+	void set_keymap(const std::string& device, xkb_keymap* new_keymap);
+	void remove_device_keymap(const std::string& device);
+	[[nodiscard]] xkb_keymap* keymap_for(const Keyboard& keyboard) const;
 	void set_constraint(wlr_pointer_constraint_v1* wlr_constraint);
 	void apply_constraint(const wlr_pointer* pointer, double* dx, double* dy) const;
 	bool is_pointer_locked(const wlr_pointer* pointer) const;
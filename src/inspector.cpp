@@ -0,0 +1,333 @@
+#include "inspector.hpp"
+
+#include "output.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/box.h>
+#include "wlr-wrap-end.hpp"
+
+/* Keeps the report bounded when something misbehaves on a large desktop */
+static constexpr size_t INSPECTOR_MAX_MISMATCHES = 256;
+
+static constexpr const char* layer_names[MAGPIE_SCENE_LAYER_LOCK + 1] = {
+	"background", "bottom", "normal", "top", "overlay", "lock"};
+
+struct LayerStats {
+	uint32_t trees = 0;
+	uint32_t rects = 0;
+	uint32_t buffers = 0;
+	uint32_t disabled = 0;
+	uint32_t max_depth = 0;
+};
+
+struct ClientStats {
+	uint32_t surfaces = 0;
+	uint32_t max_depth = 0;
+};
+
+struct OutputStats {
+	Output* output;
+	wlr_box box;
+	int64_t covered = 0;
+	int64_t painted = 0;
+	std::vector<std::pair<wlr_scene_node*, wlr_box>> visible;
+};
+
+struct Mismatch {
+	const char* output;
+	pid_t pid;
+	const View* view;
+	int32_t buffer_scale;
+	float output_scale;
+	int32_t buffer_transform;
+	int32_t output_transform;
+};
+
+struct Inspection {
+	LayerStats* layer = nullptr;
+	std::map<pid_t, ClientStats> clients;
+	std::vector<OutputStats> outputs;
+	std::vector<Mismatch> mismatches;
+};
+
+static int64_t region_area_in(pixman_region32_t& region, const wlr_box& box) {
+	pixman_region32_t clipped;
+	pixman_region32_init(&clipped);
+	pixman_region32_intersect_rect(&clipped, &region, box.x, box.y, box.width, box.height);
+
+	int count = 0;
+	const pixman_box32_t* rects = pixman_region32_rectangles(&clipped, &count);
+	int64_t area = 0;
+	for (int i = 0; i < count; i++) {
+		area += static_cast<int64_t>(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+	}
+
+	pixman_region32_fini(&clipped);
+	return area;
+}
+
+static wlr_box buffer_box(const wlr_scene_buffer& buffer, const int x, const int y) {
+	wlr_box box = {x, y, buffer.dst_width, buffer.dst_height};
+	if ((box.width <= 0 || box.height <= 0) && buffer.buffer != nullptr) {
+		box.width = buffer.buffer->width;
+		box.height = buffer.buffer->height;
+		if (buffer.transform & WL_OUTPUT_TRANSFORM_90) {
+			std::swap(box.width, box.height);
+		}
+	}
+
+	return box;
+}
+
+/* The view a node belongs to, found the same way as in Server::surface_at. */
+static const View* owning_view(const wlr_scene_node& node) {
+	const wlr_scene_tree* tree = node.parent;
+	while (tree != nullptr && tree->node.data == nullptr) {
+		tree = tree->node.parent;
+	}
+
+	if (tree == nullptr) {
+		return nullptr;
+	}
+	return dynamic_cast<const View*>(static_cast<const Surface*>(tree->node.data));
+}
+
+static void inspect_buffer(Inspection& state, wlr_scene_buffer& buffer, const wlr_box& box, const uint32_t depth) {
+	const wlr_scene_surface* scene_surface = wlr_scene_surface_try_from_buffer(&buffer);
+	if (scene_surface == nullptr) {
+		return;
+	}
+
+	const wlr_surface& surface = *scene_surface->surface;
+	pid_t pid = 0;
+	wl_client_get_credentials(wl_resource_get_client(surface.resource), &pid, nullptr, nullptr);
+
+	ClientStats& client = state.clients[pid];
+	client.surfaces++;
+	client.max_depth = std::max(client.max_depth, depth);
+
+	for (const auto& output : state.outputs) {
+		wlr_box intersection = {};
+		if (!wlr_box_intersection(&intersection, &box, &output.box)) {
+			continue;
+		}
+
+		const wlr_output& wlr = output.output->wlr;
+		const bool scale_differs = static_cast<float>(surface.current.scale) != wlr.scale;
+		const bool transform_differs = surface.current.transform != wlr.transform;
+		if ((scale_differs || transform_differs) && state.mismatches.size() < INSPECTOR_MAX_MISMATCHES) {
+			state.mismatches.push_back({wlr.name, pid, owning_view(buffer.node), surface.current.scale, wlr.scale,
+				surface.current.transform, wlr.transform});
+		}
+	}
+}
+
+static void inspect_node(Inspection& state, wlr_scene_node& node, const int x, const int y, const uint32_t depth,
+	const bool ancestors_enabled) {
+	LayerStats& layer = *state.layer;
+	layer.max_depth = std::max(layer.max_depth, depth);
+	if (!node.enabled) {
+		layer.disabled++;
+	}
+	const bool enabled = ancestors_enabled && node.enabled;
+
+	wlr_box box = {};
+	switch (node.type) {
+		case WLR_SCENE_NODE_TREE: {
+			layer.trees++;
+			wlr_scene_tree* tree = wlr_scene_tree_from_node(&node);
+			wlr_scene_node* child;
+			wl_list_for_each(child, &tree->children, link) {
+				inspect_node(state, *child, x + child->x, y + child->y, depth + 1, enabled);
+			}
+			return;
+		}
+		case WLR_SCENE_NODE_RECT: {
+			layer.rects++;
+			const auto* rect = reinterpret_cast<const wlr_scene_rect*>(&node);
+			box = {x, y, rect->width, rect->height};
+			break;
+		}
+		case WLR_SCENE_NODE_BUFFER: {
+			layer.buffers++;
+			wlr_scene_buffer* buffer = wlr_scene_buffer_from_node(&node);
+			box = buffer_box(*buffer, x, y);
+			/* Hidden surfaces (other workspaces, unmapped views) are only counted as disabled */
+			if (enabled) {
+				inspect_buffer(state, *buffer, box, depth);
+			}
+			break;
+		}
+	}
+
+	if (!enabled) {
+		return;
+	}
+
+	/* The scene has already culled the visible region of each node against the
+	 * opaque nodes above it, so painted is what actually gets drawn and covered
+	 * is what would be drawn without culling. */
+	for (auto& output : state.outputs) {
+		wlr_box intersection = {};
+		if (!wlr_box_intersection(&intersection, &box, &output.box)) {
+			continue;
+		}
+		output.covered += static_cast<int64_t>(intersection.width) * intersection.height;
+
+		const int64_t painted = region_area_in(node.visible, output.box);
+		if (painted > 0) {
+			output.painted += painted;
+			output.visible.emplace_back(&node, box);
+		}
+	}
+}
+
+/* Mirrors the checks the scene makes before handing a buffer straight to the
+ * output. A passing result can still be refused by the backend. */
+static const char* scanout_blocker(const OutputStats& stats) {
+	const Output& output = *stats.output;
+	if (!output.wlr.enabled) {
+		return "output is disabled";
+	}
+	if (output.is_leased) {
+		return "output is leased";
+	}
+	if (stats.visible.empty()) {
+		return "nothing is visible";
+	}
+	if (stats.visible.size() > 1) {
+		return "more than one node is visible";
+	}
+
+	const auto& [node, box] = stats.visible.front();
+	if (node->type != WLR_SCENE_NODE_BUFFER) {
+		return "the visible node is a solid color";
+	}
+
+	const wlr_scene_buffer* buffer = wlr_scene_buffer_from_node(node);
+	if (buffer->buffer == nullptr) {
+		return "the visible node has no buffer";
+	}
+	if (!wlr_box_equal(&box, &stats.box)) {
+		return "the buffer does not cover the whole output";
+	}
+	if (buffer->transform != output.wlr.transform) {
+		return "the buffer transform differs from the output";
+	}
+	if (!wlr_fbox_empty(&buffer->src_box)) {
+		return "the buffer is cropped";
+	}
+	if (buffer->buffer->width != output.wlr.width || buffer->buffer->height != output.wlr.height) {
+		return "the buffer needs scaling";
+	}
+
+	return nullptr;
+}
+
+static void write_ratio(JsonWriter& json, const int64_t area, const wlr_box& box) {
+	const int64_t output_area = static_cast<int64_t>(box.width) * box.height;
+	json.value(output_area > 0 ? std::round(100.0 * area / output_area) / 100.0 : 0.0);
+}
+
+void inspect_scene(Server& server, JsonWriter& json) {
+	MAGPIE_TRACE_SCOPE("inspect_scene");
+	Inspection state;
+	for (auto* output : server.outputs) {
+		if (wlr_scene_get_scene_output(server.scene, &output->wlr) != nullptr) {
+			state.outputs.push_back({output, output->full_area_in_layout_coords(), 0, 0, {}});
+		}
+	}
+
+	LayerStats layers[MAGPIE_SCENE_LAYER_LOCK + 1] = {};
+	for (int idx = 0; idx <= MAGPIE_SCENE_LAYER_LOCK; idx++) {
+		state.layer = &layers[idx];
+		wlr_scene_node& node = server.scene_layers[idx]->node;
+		inspect_node(state, node, node.x, node.y, 0, server.scene->tree.node.enabled);
+	}
+
+	json.begin_object();
+
+	json.key("layers").begin_array();
+	for (int idx = 0; idx <= MAGPIE_SCENE_LAYER_LOCK; idx++) {
+		const LayerStats& layer = layers[idx];
+		json.begin_object();
+		json.key("name").value(layer_names[idx]);
+		json.key("trees").value(layer.trees);
+		json.key("rects").value(layer.rects);
+		json.key("buffers").value(layer.buffers);
+		json.key("disabled").value(layer.disabled);
+		json.key("max_depth").value(layer.max_depth);
+		json.end_object();
+	}
+	json.end_array();
+
+	json.key("clients").begin_array();
+	for (const auto& [pid, client] : state.clients) {
+		json.begin_object();
+		json.key("pid").value(pid);
+		json.key("surfaces").value(client.surfaces);
+		json.key("max_depth").value(client.max_depth);
+		json.end_object();
+	}
+	json.end_array();
+
+	json.key("outputs").begin_array();
+	for (const auto& output : state.outputs) {
+		const wlr_scene_output* scene_output = wlr_scene_get_scene_output(server.scene, &output.output->wlr);
+		const char* blocker = scanout_blocker(output);
+
+		json.begin_object();
+		json.key("name").value(output.output->wlr.name);
+		json.key("visible_nodes").value(output.visible.size());
+		json.key("overdraw");
+		write_ratio(json, output.painted, output.box);
+		json.key("overdraw_without_culling");
+		write_ratio(json, output.covered, output.box);
+		json.key("last_frame_scanout").value(scene_output->prev_scanout);
+		json.key("scanout_possible").value(blocker == nullptr);
+		json.key("scanout_blocker");
+		if (blocker != nullptr) {
+			json.value(blocker);
+		} else {
+			json.null();
+		}
+		json.end_object();
+	}
+	json.end_array();
+
+	json.key("scale_mismatches").begin_array();
+	for (const auto& mismatch : state.mismatches) {
+		json.begin_object();
+		json.key("output").value(mismatch.output);
+		json.key("pid").value(mismatch.pid);
+		json.key("view");
+		if (mismatch.view != nullptr) {
+			json.value(mismatch.view->id);
+		} else {
+			json.null();
+		}
+		json.key("buffer_scale").value(mismatch.buffer_scale);
+		json.key("output_scale").value(static_cast<double>(mismatch.output_scale));
+		json.key("buffer_transform").value(mismatch.buffer_transform);
+		json.key("output_transform").value(mismatch.output_transform);
+		json.end_object();
+	}
+	json.end_array();
+
+	json.end_object();
+}
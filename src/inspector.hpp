@@ -0,0 +1,14 @@
+#ifndef MAGPIE_INSPECTOR_HPP
+#define MAGPIE_INSPECTOR_HPP
+
+#include "json.hpp"
+#include "types.hpp"
+
+/* Walks the scene graph and every scene output once and writes a report of
+ * what makes frames expensive: node counts per layer and per client, how much
+ * of each output is painted more than once, surfaces that need scaling or
+ * rotating for the output they are on, and whether each output could have
+ * scanned out a single buffer directly. Only meant to be run on demand. */
+void inspect_scene(Server& server, JsonWriter& json);
+
+#endif
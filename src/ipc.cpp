@@ -0,0 +1,1027 @@
+#include "ipc.hpp"
+
+#include "capture.hpp"
+#include "config.hpp"
+#include "flight_recorder.hpp"
+#include "input/recorder.hpp"
+#include "inspector.hpp"
+#include "json.hpp"
+#include "launcher.hpp"
+#include "live_objects.hpp"
+#include "output.hpp"
+#include "server.hpp"
+#include "startup.hpp"
+#include "surface/view.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+#include "workspace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* A client that stops reading its subscription gets disconnected rather than
+ * buffered forever. */
+static constexpr size_t IPC_MAX_BACKLOG = 16 << 20;
+
+static const char* event_name(const IpcEvent type) {
+	switch (type) {
+		case IPC_EVENT_VIEW_MAPPED:
+			return "view_mapped";
+		case IPC_EVENT_VIEW_UNMAPPED:
+			return "view_unmapped";
+		case IPC_EVENT_VIEW_DESTROYED:
+			return "view_destroyed";
+		case IPC_EVENT_VIEW_CHANGED:
+			return "view_changed";
+		case IPC_EVENT_FOCUS_CHANGED:
+			return "focus_changed";
+		case IPC_EVENT_WORKSPACE_CHANGED:
+			return "workspace_changed";
+		default:
+			return "outputs_changed";
+	}
+}
+
+static const char* placement_name(const ViewPlacement placement) {
+	switch (placement) {
+		case VIEW_PLACEMENT_MAXIMIZED:
+			return "maximized";
+		case VIEW_PLACEMENT_FULLSCREEN:
+			return "fullscreen";
+		default:
+			return "stacking";
+	}
+}
+
+static std::optional<ViewPlacement> placement_from_name(const std::string_view name) {
+	if (name == "stacking") {
+		return VIEW_PLACEMENT_STACKING;
+	}
+	if (name == "maximized") {
+		return VIEW_PLACEMENT_MAXIMIZED;
+	}
+	if (name == "fullscreen") {
+		return VIEW_PLACEMENT_FULLSCREEN;
+	}
+	return {};
+}
+
+static const char* band_name(const ViewBand band) {
+	switch (band) {
+		case VIEW_BAND_BELOW:
+			return "below";
+		case VIEW_BAND_ABOVE:
+			return "above";
+		default:
+			return "normal";
+	}
+}
+
+static std::optional<ViewBand> band_from_name(const std::string_view name) {
+	if (name == "below") {
+		return VIEW_BAND_BELOW;
+	}
+	if (name == "normal") {
+		return VIEW_BAND_NORMAL;
+	}
+	if (name == "above") {
+		return VIEW_BAND_ABOVE;
+	}
+	return {};
+}
+
+static void write_box(JsonWriter& json, const wlr_box& box) {
+	json.begin_object();
+	json.key("x").value(box.x);
+	json.key("y").value(box.y);
+	json.key("width").value(box.width);
+	json.key("height").value(box.height);
+	json.end_object();
+}
+
+static void write_view(JsonWriter& json, const Server& server, const View& view) {
+	const wlr_surface* surface = view.get_wlr_surface();
+	const View* parent = view.get_transient_parent();
+
+	json.begin_object();
+	json.key("id").value(view.id);
+	json.key("type").value(dynamic_cast<const XWaylandView*>(&view) != nullptr ? "xwayland" : "xdg");
+	json.key("title").value(view.get_title());
+	json.key("app_id").value(view.get_app_id());
+	json.key("geometry");
+	write_box(json, view.current);
+	json.key("placement").value(placement_name(view.curr_placement));
+	json.key("band").value(band_name(view.band));
+	json.key("mapped").value(surface != nullptr && surface->mapped);
+	json.key("minimized").value(view.is_minimized);
+	json.key("focused").value(&view == server.focused_view);
+	json.key("workspace");
+	if (view.workspace != nullptr) {
+		json.value(view.workspace->index);
+	} else {
+		json.null();
+	}
+	json.key("parent");
+	if (parent != nullptr) {
+		json.value(parent->id);
+	} else {
+		json.null();
+	}
+	json.end_object();
+}
+
+static void write_views(JsonWriter& json, const Server& server) {
+	json.begin_array();
+	for (const auto* view : std::as_const(server.views)) {
+		write_view(json, server, *view);
+	}
+	json.end_array();
+}
+
+static void write_outputs(JsonWriter& json, const Server& server) {
+	json.begin_array();
+	for (const auto* output : std::as_const(server.outputs)) {
+		json.begin_object();
+		json.key("name").value(output->wlr.name);
+		json.key("description").value(output->wlr.description);
+		json.key("enabled").value(output->wlr.enabled);
+		json.key("leased").value(output->is_leased);
+		json.key("scale").value(static_cast<double>(output->wlr.scale));
+		json.key("refresh_mhz").value(output->wlr.refresh);
+		json.key("full_area");
+		write_box(json, output->full_area_in_layout_coords());
+		json.key("usable_area");
+		write_box(json, output->usable_area_in_layout_coords());
+		json.end_object();
+	}
+	json.end_array();
+}
+
+static void write_workspaces(JsonWriter& json, const Server& server) {
+	json.begin_object();
+	json.key("active").value(server.active_workspace->index);
+	json.key("count").value(server.workspaces.size());
+	json.end_object();
+}
+
+static View* find_view(const Server& server, const uint64_t id) {
+	const auto it = std::find_if(server.views.begin(), server.views.end(), [id](const View* view) {
+		return view->id == id;
+	});
+
+	return it != server.views.end() ? *it : nullptr;
+}
+
+/* Each handler writes its result and returns an empty string, or returns an
+ * error message for the client. */
+using IpcHandler = std::string (*)(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result);
+
+static std::string ipc_get_state(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	result.begin_object();
+	result.key("focused");
+	if (server.focused_view != nullptr) {
+		result.value(server.focused_view->id);
+	} else {
+		result.null();
+	}
+	result.key("workspaces");
+	write_workspaces(result, server);
+	result.key("outputs");
+	write_outputs(result, server);
+	result.key("views");
+	write_views(result, server);
+	result.end_object();
+	return {};
+}
+
+static std::string ipc_get_views(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	write_views(result, server);
+	return {};
+}
+
+static std::string ipc_get_outputs(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	write_outputs(result, server);
+	return {};
+}
+
+static std::string ipc_inspect_scene(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	inspect_scene(server, result);
+	return {};
+}
+
+static std::string ipc_get_startup(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) server;
+	(void) client;
+	(void) request;
+
+	startup_write_json(result);
+	return {};
+}
+
+static std::string ipc_get_live_objects(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) server;
+	(void) client;
+	(void) request;
+
+	live_objects_write_json(result);
+	return {};
+}
+
+static void write_launch(JsonWriter& json, const LaunchedProcess& process) {
+	json.begin_object();
+	json.key("id").value(process.id);
+	json.key("pid").value(process.pid);
+	json.key("command").value(process.command);
+	json.key("activation_token").value(process.activation_token);
+	json.key("cgroup");
+	if (!process.cgroup.empty()) {
+		json.value(process.cgroup);
+	} else {
+		json.null();
+	}
+	json.key("running").value(process.running);
+	json.key("exit_status");
+	if (!process.running) {
+		json.value(process.exit_status);
+	} else {
+		json.null();
+	}
+	json.key("view");
+	if (process.view_id != 0) {
+		json.value(process.view_id);
+	} else {
+		json.null();
+	}
+	json.end_object();
+}
+
+static std::string ipc_launch(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+
+	const auto command = request.get_string("command");
+	if (!command.has_value() || command->empty()) {
+		return "missing command";
+	}
+
+	const LaunchedProcess* process = server.launcher->launch(*command);
+	if (process == nullptr) {
+		return "failed to launch";
+	}
+
+	write_launch(result, *process);
+	return {};
+}
+
+static std::string ipc_get_launches(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	result.begin_array();
+	for (const auto& process : std::as_const(server.launcher->processes)) {
+		write_launch(result, process);
+	}
+	result.end_array();
+	return {};
+}
+
+/* Minimum, median and maximum in milliseconds of one step over the latest
+ * launches */
+static void write_launch_step(JsonWriter& json, const std::vector<LaunchSample>& samples, uint64_t LaunchSample::*step) {
+	std::vector<uint64_t> values;
+	values.reserve(samples.size());
+	for (const auto& sample : samples) {
+		values.push_back(sample.*step);
+	}
+	std::sort(values.begin(), values.end());
+
+	json.begin_object();
+	json.key("min_ms").value(static_cast<double>(values.front()) / 1000000);
+	json.key("median_ms").value(static_cast<double>(values[values.size() / 2]) / 1000000);
+	json.key("max_ms").value(static_cast<double>(values.back()) / 1000000);
+	json.end_object();
+}
+
+static std::string ipc_get_launch_stats(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	result.begin_object();
+	for (const auto& [app_id, stats] : std::as_const(server.launcher->launch_stats)) {
+		result.key(app_id).begin_object();
+		result.key("launches").value(stats.launches);
+		result.key("samples").value(static_cast<uint64_t>(stats.samples.size()));
+		result.key("created");
+		write_launch_step(result, stats.samples, &LaunchSample::created);
+		result.key("first_commit");
+		write_launch_step(result, stats.samples, &LaunchSample::first_commit);
+		result.key("mapped");
+		write_launch_step(result, stats.samples, &LaunchSample::mapped);
+		result.key("presented");
+		write_launch_step(result, stats.samples, &LaunchSample::presented);
+		result.key("total");
+		write_launch_step(result, stats.samples, &LaunchSample::total);
+		result.end_object();
+	}
+	result.end_object();
+	return {};
+}
+
+static std::string ipc_reload_config(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	/* Parsing is asynchronous, the outcome goes to the log */
+	server.config->reload();
+	result.null();
+	return {};
+}
+
+static std::string ipc_start_input_recording(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	if (!server.config->current.debug.recording) {
+		return "recording is disabled, set recording in the [debug] section of the config";
+	}
+	InputRecorder& recorder = *server.input_recorder;
+	if (recorder.recording()) {
+		return "already recording";
+	}
+	if (!recorder.start()) {
+		return "failed to start recording";
+	}
+
+	result.begin_object();
+	result.key("path").value(recorder.writer.path);
+	result.end_object();
+	return {};
+}
+
+static std::string ipc_stop_input_recording(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	InputRecorder& recorder = *server.input_recorder;
+	if (!recorder.recording()) {
+		return "not recording";
+	}
+
+	const uint64_t events = recorder.stop();
+	result.begin_object();
+	result.key("path").value(recorder.writer.path);
+	result.key("events").value(events);
+	result.end_object();
+	return {};
+}
+
+static std::string ipc_start_protocol_capture(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	if (!server.config->current.debug.recording) {
+		return "recording is disabled, set recording in the [debug] section of the config";
+	}
+	ProtocolCapture& capture = *server.protocol_capture;
+	if (capture.capturing()) {
+		return "already capturing";
+	}
+
+	capture.start(request.get_string("command").value_or(""));
+	return {};
+}
+
+static std::string ipc_stop_protocol_capture(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	ProtocolCapture& capture = *server.protocol_capture;
+	if (!capture.capturing()) {
+		return "not capturing";
+	}
+
+	result.begin_object();
+	result.key("captures").begin_array();
+	for (const auto& captured : capture.stop()) {
+		result.begin_object();
+		result.key("path").value(captured.path);
+		result.key("pid").value(captured.pid);
+		result.key("requests").value(captured.requests);
+		result.end_object();
+	}
+	result.end_array();
+	result.end_object();
+	return {};
+}
+
+static std::string ipc_dump_flight_recorder(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) request;
+
+	const std::string path = server.flight_recorder->dump();
+	if (path.empty()) {
+		return "failed to write the dump";
+	}
+
+	result.begin_object();
+	result.key("path").value(path);
+	result.end_object();
+	return {};
+}
+
+static std::string ipc_subscribe(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) server;
+	(void) request;
+	(void) result;
+
+	client.subscribed = true;
+	return {};
+}
+
+static std::string ipc_set_workspace(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	const auto index = request.get_integer("workspace");
+	if (!index.has_value() || *index < 0 || *index >= static_cast<int64_t>(server.workspaces.size())) {
+		return "invalid workspace";
+	}
+
+	server.set_active_workspace(*server.workspaces[*index]);
+	return {};
+}
+
+/* The remaining commands all act on one view, given by its "view" id. */
+static std::string with_view(Server& server, const JsonValue& request, View*& view) {
+	const auto id = request.get_integer("view");
+	if (!id.has_value()) {
+		return "missing view";
+	}
+
+	view = find_view(server, *id);
+	if (view == nullptr) {
+		return "no such view";
+	}
+
+	return {};
+}
+
+static std::string ipc_focus(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	View* view = nullptr;
+	if (auto error = with_view(server, request, view); !error.empty()) {
+		return error;
+	}
+
+	view->set_minimized(false);
+	server.focus_view(view);
+	return {};
+}
+
+static std::string ipc_close(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	View* view = nullptr;
+	if (auto error = with_view(server, request, view); !error.empty()) {
+		return error;
+	}
+
+	view->close();
+	return {};
+}
+
+static std::string ipc_move(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	View* view = nullptr;
+	if (auto error = with_view(server, request, view); !error.empty()) {
+		return error;
+	}
+
+	const auto x = request.get_integer("x");
+	const auto y = request.get_integer("y");
+	if (!x.has_value() || !y.has_value()) {
+		return "missing x or y";
+	}
+
+	if (view->curr_placement != VIEW_PLACEMENT_STACKING) {
+		view->set_placement(VIEW_PLACEMENT_STACKING, true);
+	}
+	view->set_position(static_cast<int>(*x), static_cast<int>(*y));
+	return {};
+}
+
+static std::string ipc_resize(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	View* view = nullptr;
+	if (auto error = with_view(server, request, view); !error.empty()) {
+		return error;
+	}
+
+	const auto width = request.get_integer("width");
+	const auto height = request.get_integer("height");
+	if (!width.has_value() || !height.has_value() || *width <= 0 || *height <= 0) {
+		return "invalid width or height";
+	}
+
+	if (view->curr_placement != VIEW_PLACEMENT_STACKING) {
+		view->set_placement(VIEW_PLACEMENT_STACKING, true);
+	}
+	view->set_size(static_cast<int>(*width), static_cast<int>(*height));
+	return {};
+}
+
+static std::string ipc_set_placement(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	View* view = nullptr;
+	if (auto error = with_view(server, request, view); !error.empty()) {
+		return error;
+	}
+
+	const auto placement = placement_from_name(request.get_string("placement").value_or(""));
+	if (!placement.has_value()) {
+		return "invalid placement";
+	}
+
+	view->set_placement(*placement, true);
+	return {};
+}
+
+static std::string ipc_set_band(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	View* view = nullptr;
+	if (auto error = with_view(server, request, view); !error.empty()) {
+		return error;
+	}
+
+	const auto band = band_from_name(request.get_string("band").value_or(""));
+	if (!band.has_value()) {
+		return "invalid band";
+	}
+
+	if (view->workspace != nullptr) {
+		view->workspace->stack.set_band(*view, *band);
+	} else {
+		view->band = *band;
+	}
+	return {};
+}
+
+static std::string ipc_set_minimized(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	View* view = nullptr;
+	if (auto error = with_view(server, request, view); !error.empty()) {
+		return error;
+	}
+
+	const auto minimized = request.get_bool("minimized");
+	if (!minimized.has_value()) {
+		return "missing minimized";
+	}
+
+	view->set_minimized(*minimized);
+	return {};
+}
+
+static std::string ipc_move_to_workspace(Server& server, IpcClient& client, const JsonValue& request, JsonWriter& result) {
+	(void) client;
+	(void) result;
+
+	View* view = nullptr;
+	if (auto error = with_view(server, request, view); !error.empty()) {
+		return error;
+	}
+
+	const auto index = request.get_integer("workspace");
+	if (!index.has_value() || *index < 0 || *index >= static_cast<int64_t>(server.workspaces.size())) {
+		return "invalid workspace";
+	}
+
+	view->set_workspace(*server.workspaces[*index]);
+	return {};
+}
+
+static constexpr std::pair<std::string_view, IpcHandler> ipc_handlers[] = {
+	{"get_state", ipc_get_state},
+	{"get_views", ipc_get_views},
+	{"get_outputs", ipc_get_outputs},
+	{"inspect_scene", ipc_inspect_scene},
+	{"get_startup", ipc_get_startup},
+	{"get_live_objects", ipc_get_live_objects},
+	{"get_launches", ipc_get_launches},
+	{"get_launch_stats", ipc_get_launch_stats},
+	{"launch", ipc_launch},
+	{"reload_config", ipc_reload_config},
+	{"start_input_recording", ipc_start_input_recording},
+	{"stop_input_recording", ipc_stop_input_recording},
+	{"start_protocol_capture", ipc_start_protocol_capture},
+	{"stop_protocol_capture", ipc_stop_protocol_capture},
+	{"dump_flight_recorder", ipc_dump_flight_recorder},
+	{"subscribe", ipc_subscribe},
+	{"set_workspace", ipc_set_workspace},
+	{"focus", ipc_focus},
+	{"close", ipc_close},
+	{"move", ipc_move},
+	{"resize", ipc_resize},
+	{"set_placement", ipc_set_placement},
+	{"set_band", ipc_set_band},
+	{"set_minimized", ipc_set_minimized},
+	{"move_to_workspace", ipc_move_to_workspace},
+};
+
+static int ipc_client_notify(int fd, uint32_t mask, void* data) {
+	auto& client = *static_cast<IpcClient*>(data);
+	(void) fd;
+
+	if (!client.dispatch(mask)) {
+		client.ipc.remove_client(client);
+	}
+	return 0;
+}
+
+IpcClient::IpcClient(IpcServer& ipc, const int fd) noexcept : ipc(ipc), fd(fd) {
+	source = wl_event_loop_add_fd(
+		wl_display_get_event_loop(ipc.server.display), fd, WL_EVENT_READABLE, ipc_client_notify, this);
+}
+
+IpcClient::~IpcClient() noexcept {
+	wl_event_source_remove(source);
+	close(fd);
+}
+
+/* Reads whatever arrived and answers every complete request in it. Returns
+ * false once the client should be dropped. */
+bool IpcClient::dispatch(const uint32_t mask) {
+	MAGPIE_TRACE_SCOPE("ipc_dispatch");
+	if (mask & WL_EVENT_WRITABLE && !flush()) {
+		return false;
+	}
+
+	if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+		return false;
+	}
+
+	if (!(mask & WL_EVENT_READABLE)) {
+		return true;
+	}
+
+	char buffer[4096];
+	while (true) {
+		const ssize_t len = read(fd, buffer, sizeof(buffer));
+		if (len > 0) {
+			in.append(buffer, len);
+		} else if (len == 0) {
+			return false;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			break;
+		} else if (errno != EINTR) {
+			return false;
+		}
+	}
+
+	size_t offset = 0;
+	while (in.size() - offset >= sizeof(uint32_t)) {
+		const auto* header = reinterpret_cast<const uint8_t*>(in.data() + offset);
+		const uint32_t length = header[0] | header[1] << 8 | header[2] << 16 | static_cast<uint32_t>(header[3]) << 24;
+		if (length > MAGPIE_IPC_MAX_MESSAGE) {
+			wlr_log(WLR_ERROR, "IPC client sent an oversized message, disconnecting");
+			return false;
+		}
+		if (in.size() - offset - sizeof(uint32_t) < length) {
+			break;
+		}
+
+		const std::string_view payload(in.data() + offset + sizeof(uint32_t), length);
+		offset += sizeof(uint32_t) + length;
+
+		const auto request = json_parse(payload);
+		std::string reply;
+		if (request.has_value()) {
+			reply = ipc.handle_request(*this, *request);
+		} else {
+			JsonWriter json;
+			json.begin_object().key("id").null().key("ok").value(false).key("error").value("invalid JSON").end_object();
+			reply = json.take();
+		}
+
+		if (!send(reply)) {
+			return false;
+		}
+	}
+	in.erase(0, offset);
+
+	return true;
+}
+
+bool IpcClient::send(const std::string_view message) {
+	if (out.size() + message.size() > IPC_MAX_BACKLOG) {
+		wlr_log(WLR_ERROR, "IPC client is not reading its messages, disconnecting");
+		return false;
+	}
+
+	const auto length = static_cast<uint32_t>(message.size());
+	const char header[] = {static_cast<char>(length), static_cast<char>(length >> 8), static_cast<char>(length >> 16),
+		static_cast<char>(length >> 24)};
+	out.append(header, sizeof(header));
+	out.append(message);
+
+	return flush();
+}
+
+/* Writes as much of the backlog as the socket takes, and only polls for
+ * writability while something is left over. */
+bool IpcClient::flush() {
+	size_t written = 0;
+	while (written < out.size()) {
+		const ssize_t len = ::send(fd, out.data() + written, out.size() - written, MSG_NOSIGNAL);
+		if (len >= 0) {
+			written += len;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			break;
+		} else if (errno != EINTR) {
+			return false;
+		}
+	}
+	out.erase(0, written);
+
+	wl_event_source_fd_update(source, out.empty() ? WL_EVENT_READABLE : WL_EVENT_READABLE | WL_EVENT_WRITABLE);
+	return true;
+}
+
+static int ipc_listen_notify(int fd, uint32_t mask, void* data) {
+	auto& ipc = *static_cast<IpcServer*>(data);
+	(void) fd;
+	(void) mask;
+
+	ipc.accept_client();
+	return 0;
+}
+
+static void ipc_flush_idle(void* data) {
+	auto& ipc = *static_cast<IpcServer*>(data);
+
+	ipc.flush_events();
+}
+
+IpcServer::IpcServer(Server& server) noexcept : server(server) {}
+
+IpcServer::~IpcServer() noexcept {
+	for (const auto* client : std::as_const(clients)) {
+		delete client;
+	}
+
+	if (flush_idle != nullptr) {
+		wl_event_source_remove(flush_idle);
+	}
+	if (listen_source != nullptr) {
+		wl_event_source_remove(listen_source);
+	}
+	if (listen_fd >= 0) {
+		close(listen_fd);
+	}
+	if (!path.empty()) {
+		unlink(path.c_str());
+	}
+}
+
+/* The socket is named after the Wayland display so several sessions of the
+ * same user don't collide, and its path is exported as MAGPIE_IPC_SOCKET to
+ * our children. */
+void IpcServer::listen(const char* wayland_display) {
+	const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+	if (runtime_dir == nullptr) {
+		wlr_log(WLR_ERROR, "XDG_RUNTIME_DIR is not set, IPC is disabled");
+		return;
+	}
+
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	path = std::string(runtime_dir) + "/magpie-ipc." + wayland_display + ".sock";
+	if (path.size() >= sizeof(addr.sun_path)) {
+		wlr_log(WLR_ERROR, "IPC socket path %s is too long", path.c_str());
+		path.clear();
+		return;
+	}
+	std::strcpy(addr.sun_path, path.c_str());
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to create the IPC socket");
+		path.clear();
+		return;
+	}
+
+	/* Left behind by a compositor that crashed on the same display */
+	unlink(path.c_str());
+	if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(listen_fd, 16) < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to listen on %s", path.c_str());
+		close(listen_fd);
+		listen_fd = -1;
+		path.clear();
+		return;
+	}
+
+	listen_source = wl_event_loop_add_fd(
+		wl_display_get_event_loop(server.display), listen_fd, WL_EVENT_READABLE, ipc_listen_notify, this);
+	setenv("MAGPIE_IPC_SOCKET", path.c_str(), true);
+	wlr_log(WLR_INFO, "Listening for IPC clients on %s", path.c_str());
+}
+
+void IpcServer::accept_client() {
+	const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to accept an IPC client");
+		return;
+	}
+
+	/* The runtime dir should already keep other users out, but don't rely on it */
+	ucred credentials = {};
+	socklen_t credentials_len = sizeof(credentials);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_len) < 0 || credentials.uid != getuid()) {
+		wlr_log(WLR_ERROR, "Rejecting IPC client from another user");
+		close(fd);
+		return;
+	}
+
+	clients.push_back(new IpcClient(*this, fd));
+}
+
+void IpcServer::remove_client(IpcClient& client) {
+	clients.remove(&client);
+	delete &client;
+}
+
+std::string IpcServer::handle_request(IpcClient& client, const JsonValue& request) {
+	MAGPIE_TRACE_SCOPE("ipc_request");
+	const auto method = request.get_string("method");
+
+	const auto* handler = std::find_if(std::begin(ipc_handlers), std::end(ipc_handlers), [&method](const auto& entry) {
+		return method.has_value() && entry.first == *method;
+	});
+
+	JsonWriter result;
+	std::string error = "unknown method";
+	if (handler != std::end(ipc_handlers)) {
+		error = handler->second(server, client, request, result);
+	}
+
+	JsonWriter json;
+	json.begin_object();
+	json.key("id");
+	if (const auto id = request.get_number("id"); id.has_value()) {
+		json.value(*id);
+	} else {
+		json.null();
+	}
+	json.key("ok").value(error.empty());
+	if (error.empty()) {
+		json.key("result");
+		if (result.str().empty()) {
+			json.null();
+		} else {
+			json.raw(result.str());
+		}
+	} else {
+		json.key("error").value(error);
+	}
+	json.end_object();
+
+	return json.take();
+}
+
+/* Events are coalesced until the event loop is idle, so an interactive move
+ * sends one view_changed per frame at most rather than one per pointer
+ * motion. The state in each event is read when the batch is sent. */
+void IpcServer::queue(const IpcEvent type, const uint64_t view_id) {
+	if (listen_source == nullptr) {
+		return;
+	}
+
+	/* Nothing about a destroyed view can be reported any more */
+	if (type == IPC_EVENT_VIEW_DESTROYED) {
+		std::erase_if(pending, [view_id](const PendingEvent& event) {
+			return event.view_id == view_id;
+		});
+	}
+
+	const bool queued = std::any_of(pending.begin(), pending.end(), [type, view_id](const PendingEvent& event) {
+		return event.type == type && event.view_id == view_id;
+	});
+	if (!queued) {
+		pending.push_back({type, view_id});
+	}
+
+	if (flush_idle == nullptr) {
+		flush_idle = wl_event_loop_add_idle(wl_display_get_event_loop(server.display), ipc_flush_idle, this);
+	}
+}
+
+void IpcServer::view_event(const IpcEvent type, const View& view) {
+	queue(type, view.id);
+}
+
+void IpcServer::event(const IpcEvent type) {
+	queue(type, 0);
+}
+
+void IpcServer::flush_events() {
+	MAGPIE_TRACE_SCOPE("ipc_flush_events");
+	flush_idle = nullptr;
+
+	const std::vector<PendingEvent> events = std::move(pending);
+	pending.clear();
+
+	const bool any_subscribed = std::any_of(clients.begin(), clients.end(), [](const IpcClient* client) {
+		return client->subscribed;
+	});
+	if (events.empty() || !any_subscribed) {
+		return;
+	}
+
+	JsonWriter json;
+	json.begin_object();
+	json.key("event").value("batch");
+	json.key("events").begin_array();
+	for (const auto& event : events) {
+		json.begin_object();
+		json.key("type").value(event_name(event.type));
+		switch (event.type) {
+			case IPC_EVENT_FOCUS_CHANGED:
+				json.key("focused");
+				if (server.focused_view != nullptr) {
+					json.value(server.focused_view->id);
+				} else {
+					json.null();
+				}
+				break;
+			case IPC_EVENT_WORKSPACE_CHANGED:
+				json.key("workspaces");
+				write_workspaces(json, server);
+				break;
+			case IPC_EVENT_OUTPUTS_CHANGED:
+				json.key("outputs");
+				write_outputs(json, server);
+				break;
+			default: {
+				json.key("id").value(event.view_id);
+				/* Unmapped X11 views are no longer tracked, so only the id is left */
+				const View* view = find_view(server, event.view_id);
+				if (view != nullptr && event.type != IPC_EVENT_VIEW_DESTROYED) {
+					json.key("view");
+					write_view(json, server, *view);
+				}
+				break;
+			}
+		}
+		json.end_object();
+	}
+	json.end_array();
+	json.end_object();
+
+	std::vector<IpcClient*> dropped;
+	for (auto* client : std::as_const(clients)) {
+		if (client->subscribed && !client->send(json.str())) {
+			dropped.push_back(client);
+		}
+	}
+	for (auto* client : dropped) {
+		remove_client(*client);
+	}
+}
@@ -0,0 +1,85 @@
+#ifndef MAGPIE_IPC_HPP
+#define MAGPIE_IPC_HPP
+
+#include "json.hpp"
+#include "types.hpp"
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <wayland-server-core.h>
+
+/* Each message on the socket is a 32-bit little-endian length followed by that
+ * many bytes of JSON. Requests look like {"id": 1, "method": "...", ...} and
+ * get exactly one reply, {"id": 1, "ok": true, "result": ...} or
+ * {"id": 1, "ok": false, "error": "..."}, in the order they were sent. After
+ * a "subscribe" request the client also receives {"event": "batch", "events":
+ * [...]} messages, sent at most once per event loop iteration. */
+static constexpr uint32_t MAGPIE_IPC_MAX_MESSAGE = 1 << 20;
+
+enum IpcEvent {
+	IPC_EVENT_VIEW_MAPPED,
+	IPC_EVENT_VIEW_UNMAPPED,
+	IPC_EVENT_VIEW_DESTROYED,
+	IPC_EVENT_VIEW_CHANGED,
+	IPC_EVENT_FOCUS_CHANGED,
+	IPC_EVENT_WORKSPACE_CHANGED,
+	IPC_EVENT_OUTPUTS_CHANGED,
+};
+
+class IpcClient {
+	std::string in;
+	std::string out;
+
+	bool flush();
+
+  public:
+	IpcServer& ipc;
+	int fd;
+	wl_event_source* source;
+	bool subscribed = false;
+
+	IpcClient(IpcServer& ipc, int fd) noexcept;
+	~IpcClient() noexcept;
+
+	bool dispatch(uint32_t mask);
+	bool send(std::string_view message);
+};
+
+/* Serves window management queries and commands on a Unix socket at
+ * $XDG_RUNTIME_DIR/magpie-ipc.<display>.sock, so panels, docks and test
+ * harnesses can drive the compositor without a Wayland connection. */
+class IpcServer {
+	struct PendingEvent {
+		IpcEvent type;
+		uint64_t view_id;
+	};
+
+	int listen_fd = -1;
+	wl_event_source* listen_source = nullptr;
+	wl_event_source* flush_idle = nullptr;
+	std::string path;
+	std::list<IpcClient*> clients;
+	std::vector<PendingEvent> pending;
+
+	void queue(IpcEvent type, uint64_t view_id);
+
+  public:
+	Server& server;
+
+	explicit IpcServer(Server& server) noexcept;
+	~IpcServer() noexcept;
+
+	void listen(const char* wayland_display);
+	void accept_client();
+	void remove_client(IpcClient& client);
+	[[nodiscard]] std::string handle_request(IpcClient& client, const JsonValue& request);
+	void view_event(IpcEvent type, const View& view);
+	void event(IpcEvent type);
+	void flush_events();
+};
+
+#endif
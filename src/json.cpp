@@ -0,0 +1,431 @@
+#include "json.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+void JsonWriter::separate() {
+	if (after_key) {
+		after_key = false;
+		return;
+	}
+
+	if (!scope_has_items.empty()) {
+		if (scope_has_items.back()) {
+			out += ',';
+		}
+		scope_has_items.back() = true;
+	}
+}
+
+void JsonWriter::append_string(const std::string_view string) {
+	out += '"';
+	for (const char c : string) {
+		switch (c) {
+			case '"':
+				out += "\\\"";
+				break;
+			case '\\':
+				out += "\\\\";
+				break;
+			case '\n':
+				out += "\\n";
+				break;
+			case '\r':
+				out += "\\r";
+				break;
+			case '\t':
+				out += "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					out += escaped;
+				} else {
+					out += c;
+				}
+				break;
+		}
+	}
+	out += '"';
+}
+
+JsonWriter& JsonWriter::begin_object() {
+	separate();
+	out += '{';
+	scope_has_items.push_back(false);
+	return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+	out += '}';
+	scope_has_items.pop_back();
+	return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+	separate();
+	out += '[';
+	scope_has_items.push_back(false);
+	return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+	out += ']';
+	scope_has_items.pop_back();
+	return *this;
+}
+
+JsonWriter& JsonWriter::key(const std::string_view name) {
+	separate();
+	append_string(name);
+	out += ':';
+	after_key = true;
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(const std::string_view string) {
+	separate();
+	append_string(string);
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* string) {
+	if (string == nullptr) {
+		return null();
+	}
+
+	return value(std::string_view(string));
+}
+
+JsonWriter& JsonWriter::value(const double number) {
+	separate();
+	if (!std::isfinite(number)) {
+		out += "null";
+		return *this;
+	}
+
+	char formatted[32];
+	std::snprintf(formatted, sizeof(formatted), "%.17g", number);
+	out += formatted;
+	return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+	separate();
+	out += "null";
+	return *this;
+}
+
+/* Inserts an already serialized value. */
+JsonWriter& JsonWriter::raw(const std::string_view json) {
+	separate();
+	out += json;
+	return *this;
+}
+
+std::string JsonWriter::take() {
+	scope_has_items.clear();
+	after_key = false;
+	return std::exchange(out, {});
+}
+
+const JsonValue* JsonValue::get(const std::string_view key) const {
+	if (type != JSON_OBJECT) {
+		return nullptr;
+	}
+
+	for (const auto& [name, member] : object) {
+		if (name == key) {
+			return &member;
+		}
+	}
+
+	return nullptr;
+}
+
+std::optional<std::string> JsonValue::get_string(const std::string_view key) const {
+	const JsonValue* member = get(key);
+	if (member == nullptr || member->type != JSON_STRING) {
+		return {};
+	}
+
+	return member->string;
+}
+
+std::optional<double> JsonValue::get_number(const std::string_view key) const {
+	const JsonValue* member = get(key);
+	if (member == nullptr || member->type != JSON_NUMBER) {
+		return {};
+	}
+
+	return member->number;
+}
+
+std::optional<int64_t> JsonValue::get_integer(const std::string_view key) const {
+	const auto number = get_number(key);
+	if (!number.has_value() || std::trunc(*number) != *number) {
+		return {};
+	}
+
+	return static_cast<int64_t>(*number);
+}
+
+std::optional<bool> JsonValue::get_bool(const std::string_view key) const {
+	const JsonValue* member = get(key);
+	if (member == nullptr || member->type != JSON_BOOL) {
+		return {};
+	}
+
+	return member->boolean;
+}
+
+/* Deep enough for anything we exchange, shallow enough to not blow the stack
+ * on hostile input. */
+static constexpr int JSON_MAX_DEPTH = 64;
+
+class JsonParser {
+	std::string_view text;
+	size_t pos = 0;
+
+	void skip_whitespace() {
+		while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+			pos++;
+		}
+	}
+
+	bool consume(const std::string_view literal) {
+		if (text.substr(pos, literal.size()) != literal) {
+			return false;
+		}
+		pos += literal.size();
+		return true;
+	}
+
+	static void append_utf8(std::string& out, const uint32_t codepoint) {
+		if (codepoint < 0x80) {
+			out += static_cast<char>(codepoint);
+		} else if (codepoint < 0x800) {
+			out += static_cast<char>(0xc0 | (codepoint >> 6));
+			out += static_cast<char>(0x80 | (codepoint & 0x3f));
+		} else if (codepoint < 0x10000) {
+			out += static_cast<char>(0xe0 | (codepoint >> 12));
+			out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+			out += static_cast<char>(0x80 | (codepoint & 0x3f));
+		} else {
+			out += static_cast<char>(0xf0 | (codepoint >> 18));
+			out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3f));
+			out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+			out += static_cast<char>(0x80 | (codepoint & 0x3f));
+		}
+	}
+
+	std::optional<uint32_t> parse_hex4() {
+		if (pos + 4 > text.size()) {
+			return {};
+		}
+
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++) {
+			const char c = text[pos++];
+			value <<= 4;
+			if (c >= '0' && c <= '9') {
+				value |= c - '0';
+			} else if (c >= 'a' && c <= 'f') {
+				value |= c - 'a' + 10;
+			} else if (c >= 'A' && c <= 'F') {
+				value |= c - 'A' + 10;
+			} else {
+				return {};
+			}
+		}
+
+		return value;
+	}
+
+	bool parse_string(std::string& out) {
+		if (!consume("\"")) {
+			return false;
+		}
+
+		while (pos < text.size()) {
+			const char c = text[pos++];
+			if (c == '"') {
+				return true;
+			}
+			if (static_cast<unsigned char>(c) < 0x20) {
+				return false;
+			}
+			if (c != '\\') {
+				out += c;
+				continue;
+			}
+
+			if (pos >= text.size()) {
+				return false;
+			}
+			switch (text[pos++]) {
+				case '"':
+					out += '"';
+					break;
+				case '\\':
+					out += '\\';
+					break;
+				case '/':
+					out += '/';
+					break;
+				case 'b':
+					out += '\b';
+					break;
+				case 'f':
+					out += '\f';
+					break;
+				case 'n':
+					out += '\n';
+					break;
+				case 'r':
+					out += '\r';
+					break;
+				case 't':
+					out += '\t';
+					break;
+				case 'u': {
+					auto codepoint = parse_hex4();
+					if (!codepoint.has_value()) {
+						return false;
+					}
+					if (*codepoint >= 0xd800 && *codepoint < 0xdc00) {
+						if (!consume("\\u")) {
+							return false;
+						}
+						const auto low = parse_hex4();
+						if (!low.has_value() || *low < 0xdc00 || *low >= 0xe000) {
+							return false;
+						}
+						codepoint = 0x10000 + ((*codepoint - 0xd800) << 10) + (*low - 0xdc00);
+					}
+					append_utf8(out, *codepoint);
+					break;
+				}
+				default:
+					return false;
+			}
+		}
+
+		return false;
+	}
+
+	bool parse_number(JsonValue& value) {
+		const size_t start = pos;
+		if (pos < text.size() && text[pos] == '-') {
+			pos++;
+		}
+		while (pos < text.size() && ((text[pos] >= '0' && text[pos] <= '9') || text[pos] == '.' || text[pos] == 'e' ||
+										text[pos] == 'E' || text[pos] == '+' || text[pos] == '-')) {
+			pos++;
+		}
+
+		const std::string number(text.substr(start, pos - start));
+		char* end = nullptr;
+		value.type = JsonValue::JSON_NUMBER;
+		value.number = std::strtod(number.c_str(), &end);
+		return !number.empty() && end == number.c_str() + number.size();
+	}
+
+	bool parse_value(JsonValue& value, const int depth) {
+		if (depth > JSON_MAX_DEPTH) {
+			return false;
+		}
+
+		skip_whitespace();
+		if (pos >= text.size()) {
+			return false;
+		}
+
+		switch (text[pos]) {
+			case 'n':
+				value.type = JsonValue::JSON_NULL;
+				return consume("null");
+			case 't':
+				value.type = JsonValue::JSON_BOOL;
+				value.boolean = true;
+				return consume("true");
+			case 'f':
+				value.type = JsonValue::JSON_BOOL;
+				value.boolean = false;
+				return consume("false");
+			case '"':
+				value.type = JsonValue::JSON_STRING;
+				return parse_string(value.string);
+			case '[':
+				pos++;
+				value.type = JsonValue::JSON_ARRAY;
+				skip_whitespace();
+				if (consume("]")) {
+					return true;
+				}
+				while (true) {
+					if (!parse_value(value.array.emplace_back(), depth + 1)) {
+						return false;
+					}
+					skip_whitespace();
+					if (consume("]")) {
+						return true;
+					}
+					if (!consume(",")) {
+						return false;
+					}
+				}
+			case '{':
+				pos++;
+				value.type = JsonValue::JSON_OBJECT;
+				skip_whitespace();
+				if (consume("}")) {
+					return true;
+				}
+				while (true) {
+					skip_whitespace();
+					auto& [name, member] = value.object.emplace_back();
+					if (!parse_string(name)) {
+						return false;
+					}
+					skip_whitespace();
+					if (!consume(":") || !parse_value(member, depth + 1)) {
+						return false;
+					}
+					skip_whitespace();
+					if (consume("}")) {
+						return true;
+					}
+					if (!consume(",")) {
+						return false;
+					}
+				}
+			default:
+				return parse_number(value);
+		}
+	}
+
+  public:
+	explicit JsonParser(const std::string_view text) : text(text) {}
+
+	std::optional<JsonValue> parse() {
+		JsonValue value;
+		if (!parse_value(value, 0)) {
+			return {};
+		}
+
+		skip_whitespace();
+		if (pos != text.size()) {
+			return {};
+		}
+
+		return value;
+	}
+};
+
+std::optional<JsonValue> json_parse(const std::string_view text) {
+	return JsonParser(text).parse();
+}
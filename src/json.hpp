@@ -0,0 +1,74 @@
+#ifndef MAGPIE_JSON_HPP
+#define MAGPIE_JSON_HPP
+
+#include <concepts>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* Streaming JSON writer. Commas and escaping are handled here, nesting is up
+ * to the caller. */
+class JsonWriter {
+	std::string out;
+	std::vector<bool> scope_has_items;
+	bool after_key = false;
+
+	void separate();
+	void append_string(std::string_view string);
+
+  public:
+	JsonWriter& begin_object();
+	JsonWriter& end_object();
+	JsonWriter& begin_array();
+	JsonWriter& end_array();
+	JsonWriter& key(std::string_view name);
+	JsonWriter& value(std::string_view string);
+	JsonWriter& value(const char* string);
+	JsonWriter& value(double number);
+	JsonWriter& null();
+	JsonWriter& raw(std::string_view json);
+
+	template <typename T>
+		requires std::integral<T>
+	JsonWriter& value(const T number) {
+		separate();
+		if constexpr (std::is_same_v<T, bool>) {
+			out += number ? "true" : "false";
+		} else {
+			out += std::to_string(number);
+		}
+		return *this;
+	}
+
+	[[nodiscard]] const std::string& str() const {
+		return out;
+	}
+	std::string take();
+};
+
+/* A parsed JSON document. Objects keep their members in document order. */
+class JsonValue {
+  public:
+	enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+	Type type = JSON_NULL;
+	bool boolean = false;
+	double number = 0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::vector<std::pair<std::string, JsonValue>> object;
+
+	[[nodiscard]] const JsonValue* get(std::string_view key) const;
+	[[nodiscard]] std::optional<std::string> get_string(std::string_view key) const;
+	[[nodiscard]] std::optional<double> get_number(std::string_view key) const;
+	[[nodiscard]] std::optional<int64_t> get_integer(std::string_view key) const;
+	[[nodiscard]] std::optional<bool> get_bool(std::string_view key) const;
+};
+
+std::optional<JsonValue> json_parse(std::string_view text);
+
+#endif
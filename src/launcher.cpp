@@ -0,0 +1,403 @@
+#include "launcher.hpp"
+
+#include "alloc_guard.hpp"
+#include "clock.hpp"
+#include "output.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xdg_activation_v1.h>
+#include <wlr/util/box.h>
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+extern char** environ;
+
+/* Exited processes are kept around for IPC queries, up to this many */
+static constexpr size_t LAUNCHER_MAX_EXITED = 64;
+/* Tokens expire after 30 seconds unless wlroots is told otherwise, this only
+ * bounds the list when clients ask for many */
+static constexpr size_t LAUNCHER_MAX_ISSUED_TOKENS = 64;
+/* Per app_id */
+static constexpr size_t LAUNCHER_MAX_LAUNCH_SAMPLES = 32;
+
+static int launcher_sigchld_notify(int signal, void* data) {
+	auto& launcher = *static_cast<Launcher*>(data);
+	(void) signal;
+
+	launcher.reap_children();
+	return 0;
+}
+
+/* The cgroup v2 directory of a process, "self" for our own */
+static std::string process_cgroup(const std::string& pid) {
+	FILE* file = fopen(("/proc/" + pid + "/cgroup").c_str(), "re");
+	if (file == nullptr) {
+		return {};
+	}
+
+	std::string cgroup;
+	char line[4096];
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		const std::string_view entry(line);
+		if (entry.starts_with("0::/")) {
+			cgroup = "/sys/fs/cgroup" + std::string(entry.substr(3, entry.find_last_not_of('\n') - 2));
+			break;
+		}
+	}
+	fclose(file);
+	return cgroup;
+}
+
+/* Our own cgroup, if it is a cgroup v2 directory we may create children in
+ * and move processes out of, such as one delegated to a user service. */
+static std::string find_cgroup_root() {
+	std::string root = process_cgroup("self");
+	if (root.empty() || access(root.c_str(), W_OK) < 0 || access((root + "/cgroup.procs").c_str(), W_OK) < 0) {
+		return {};
+	}
+	return root;
+}
+
+static std::string cgroup_name(const LaunchedProcess& process) {
+	const std::string_view command(process.command);
+	std::string_view program = command.substr(0, command.find(' '));
+	program = program.substr(program.find_last_of('/') + 1);
+
+	std::string name = "app-";
+	for (const char c : program) {
+		name += std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' ? c : '_';
+	}
+	return name + "-" + std::to_string(process.id);
+}
+
+Launcher::Launcher(Server& server) noexcept : server(server) {
+	sigchld_source =
+		wl_event_loop_add_signal(wl_display_get_event_loop(server.display), SIGCHLD, launcher_sigchld_notify, this);
+
+	cgroup_root = find_cgroup_root();
+	if (cgroup_root.empty()) {
+		wlr_log(WLR_INFO, "Our cgroup is not delegated, launched applications share it");
+	}
+}
+
+Launcher::~Launcher() noexcept {
+	wl_event_source_remove(sigchld_source);
+}
+
+const LaunchedProcess* Launcher::launch(const std::string& command) {
+	MAGPIE_TRACE_SCOPE("launch");
+	LaunchedProcess process = {};
+	process.id = next_id++;
+	process.command = command;
+
+	wlr_xdg_activation_token_v1* token = wlr_xdg_activation_token_v1_create(server.xdg_activation);
+	if (token != nullptr) {
+		process.activation_token = wlr_xdg_activation_token_v1_get_name(token);
+		process.token_ns = clock_now_ns();
+	}
+
+	/* Our environment, with the activation token in both the Wayland and the
+	 * startup-notification spelling */
+	const std::string token_vars[] = {
+		"XDG_ACTIVATION_TOKEN=" + process.activation_token, "DESKTOP_STARTUP_ID=" + process.activation_token};
+	std::vector<char*> envp;
+	for (char** var = environ; *var != nullptr; var++) {
+		const std::string_view entry(*var);
+		if (!entry.starts_with("XDG_ACTIVATION_TOKEN=") && !entry.starts_with("DESKTOP_STARTUP_ID=")) {
+			envp.push_back(*var);
+		}
+	}
+	if (!process.activation_token.empty()) {
+		for (const auto& var : token_vars) {
+			envp.push_back(const_cast<char*>(var.c_str()));
+		}
+	}
+	envp.push_back(nullptr);
+
+	/* Children start with no blocked signals and default handlers for the
+	 * ones we route through the event loop, in a session of their own. */
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t mask;
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGPIPE);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
+	posix_spawnattr_setsigdefault(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSID);
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+	/* Our descriptors should all be close-on-exec already, this catches the
+	 * ones libraries forgot */
+	posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+#endif
+
+	const char* argv[] = {"/bin/sh", "-c", command.c_str(), nullptr};
+	const int error = posix_spawn(&process.pid, "/bin/sh", &actions, &attr, const_cast<char* const*>(argv), envp.data());
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+
+	if (error != 0) {
+		wlr_log(WLR_ERROR, "Failed to launch '%s': %s", command.c_str(), strerror(error));
+		if (token != nullptr) {
+			wlr_xdg_activation_token_v1_destroy(token);
+		}
+		return nullptr;
+	}
+
+	process.start_ns = clock_now_ns();
+	place_in_cgroup(process);
+	wlr_log(WLR_INFO, "Launched '%s' as pid %d", command.c_str(), process.pid);
+
+	processes.push_back(std::move(process));
+	return &processes.back();
+}
+
+/* posix_spawn cannot start the child in another cgroup, so it is moved right
+ * after. Whatever it forked before that stays in ours. */
+void Launcher::place_in_cgroup(LaunchedProcess& process) {
+	if (cgroup_root.empty()) {
+		return;
+	}
+
+	const std::string path = cgroup_root + "/" + cgroup_name(process);
+	if (mkdir(path.c_str(), 0755) < 0) {
+		wlr_log_errno(WLR_DEBUG, "Failed to create cgroup %s", path.c_str());
+		return;
+	}
+
+	const int fd = open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+	const std::string pid = std::to_string(process.pid);
+	const bool moved = fd >= 0 && write(fd, pid.c_str(), pid.size()) == static_cast<ssize_t>(pid.size());
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	if (!moved) {
+		wlr_log_errno(WLR_DEBUG, "Failed to move pid %d into %s", process.pid, path.c_str());
+		rmdir(path.c_str());
+		return;
+	}
+
+	process.cgroup = path;
+}
+
+/* Only our own children are waited for. wlroots waits for the processes it
+ * starts itself, and must not find them already reaped. */
+void Launcher::reap_children() {
+	for (auto& process : processes) {
+		if (!process.running) {
+			continue;
+		}
+
+		int status = 0;
+		if (waitpid(process.pid, &status, WNOHANG) != process.pid) {
+			continue;
+		}
+
+		process.running = false;
+		process.exit_ns = clock_now_ns();
+		process.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		wlr_log(WLR_DEBUG, "'%s' (pid %d) exited with status %d", process.command.c_str(), process.pid,
+			process.exit_status);
+
+		/* Fails while processes it left behind are still running, in which
+		 * case the cgroup is left to whoever cleans up the parent */
+		if (!process.cgroup.empty()) {
+			rmdir(process.cgroup.c_str());
+		}
+	}
+
+	auto exited = std::count_if(processes.begin(), processes.end(), [](const LaunchedProcess& process) {
+		return !process.running;
+	});
+	for (auto it = processes.begin(); it != processes.end() && exited > static_cast<ptrdiff_t>(LAUNCHER_MAX_EXITED);) {
+		if (!it->running) {
+			it = processes.erase(it);
+			exited--;
+		} else {
+			++it;
+		}
+	}
+}
+
+/* A token a client asked for, to start an application with */
+void Launcher::token_issued(const char* token) {
+	issued_tokens.emplace_back(token, clock_now_ns());
+	if (issued_tokens.size() > LAUNCHER_MAX_ISSUED_TOKENS) {
+		issued_tokens.pop_front();
+	}
+}
+
+uint64_t Launcher::token_issued_at(const char* token) const {
+	for (const auto& process : processes) {
+		if (process.activation_token == token) {
+			return process.token_ns;
+		}
+	}
+	for (const auto& [name, issued_ns] : issued_tokens) {
+		if (name == token) {
+			return issued_ns;
+		}
+	}
+	return 0;
+}
+
+/* Views that were already around when the token was issued are being
+ * raised, not launched */
+void Launcher::token_activated(const char* token, View& view) {
+	if (token == nullptr) {
+		return;
+	}
+
+	for (auto& process : processes) {
+		if (process.view_id == 0 && process.activation_token == token) {
+			process.view_id = view.id;
+			break;
+		}
+	}
+
+	const uint64_t token_ns = token_issued_at(token);
+	if (view.launch.token_ns == 0 && token_ns != 0 && token_ns <= view.launch.created_ns) {
+		view.launch.token_ns = token_ns;
+		report_launch(view);
+	}
+}
+
+/* Our own launches are recognized by their pid, or by their cgroup when the
+ * shell forked rather than exec'd the command */
+void Launcher::view_created(View& view, const pid_t pid) {
+	view.launch.created_ns = clock_now_ns();
+	if (pid <= 0) {
+		return;
+	}
+
+	std::string cgroup;
+	for (auto& process : processes) {
+		if (!process.running || process.view_id != 0 || process.token_ns == 0) {
+			continue;
+		}
+		if (process.pid != pid) {
+			if (process.cgroup.empty()) {
+				continue;
+			}
+			if (cgroup.empty()) {
+				cgroup = process_cgroup(std::to_string(pid));
+			}
+			if (cgroup != process.cgroup) {
+				continue;
+			}
+		}
+
+		process.view_id = view.id;
+		view.launch.token_ns = process.token_ns;
+		return;
+	}
+}
+
+void Launcher::view_mapped(View& view) {
+	if (view.launch.mapped_ns != 0) {
+		return;
+	}
+
+	view.launch.mapped_ns = clock_now_ns();
+	/* XWayland surfaces already have their buffer when they map */
+	if (view.launch.first_commit_ns == 0) {
+		view.launch.first_commit_ns = view.launch.mapped_ns;
+	}
+	awaiting_present.push_back(&view);
+}
+
+/* Views are unmapped before they are destroyed, and XWayland views lose their
+ * scene node */
+void Launcher::view_unmapped(View& view) {
+	std::erase(awaiting_present, &view);
+}
+
+/* Marks the views a frame just committed on the output shows for the first
+ * time. Runs for every frame that was committed, and does nothing unless a
+ * view just mapped. */
+void Launcher::output_committed(const Output& output) {
+	for (auto* view : awaiting_present) {
+		int lx = 0;
+		int ly = 0;
+		if (view->launch.rendered_on != nullptr || view->scene_node == nullptr ||
+			!wlr_scene_node_coords(view->scene_node, &lx, &ly)) {
+			continue;
+		}
+
+		const wlr_box box = {lx, ly, view->current.width, view->current.height};
+		wlr_box intersection = {};
+		const wlr_box area = output.full_area_in_layout_coords();
+		if (wlr_box_intersection(&intersection, &box, &area)) {
+			view->launch.rendered_on = &output;
+		}
+	}
+}
+
+void Launcher::output_presented(const Output& output, const uint64_t presented_ns) {
+	if (awaiting_present.empty()) {
+		return;
+	}
+
+	std::erase_if(awaiting_present, [this, &output, presented_ns](View* view) {
+		if (view->launch.rendered_on != &output) {
+			return false;
+		}
+		/* The frame was committed after the map, a skewed timestamp must not make that negative */
+		view->launch.presented_ns = std::max(presented_ns, view->launch.mapped_ns);
+		report_launch(*view);
+		return true;
+	});
+}
+
+/* Once a view is both on screen and tied to a token */
+void Launcher::report_launch(View& view) {
+	LaunchTimes& times = view.launch;
+	if (times.reported || times.token_ns == 0 || times.presented_ns == 0) {
+		return;
+	}
+	/* Rare, and may run in the frame path */
+	MAGPIE_ALLOC_ALLOWED();
+	times.reported = true;
+
+	const LaunchSample sample = {times.created_ns - times.token_ns, times.first_commit_ns - times.created_ns,
+		times.mapped_ns - times.first_commit_ns, times.presented_ns - times.mapped_ns, times.presented_ns - times.token_ns};
+	const char* app_id = view.get_app_id();
+	LaunchStats& stats = launch_stats[app_id != nullptr ? app_id : ""];
+	if (stats.samples.size() < LAUNCHER_MAX_LAUNCH_SAMPLES) {
+		stats.samples.push_back(sample);
+	} else {
+		stats.samples[stats.launches % LAUNCHER_MAX_LAUNCH_SAMPLES] = sample;
+	}
+	stats.launches++;
+
+	wlr_log(WLR_INFO, "Launched %s in %lu ms: created after %lu ms, first commit %lu ms, mapped %lu ms, presented %lu ms",
+		app_id != nullptr ? app_id : "an app without app_id", static_cast<unsigned long>(sample.total / 1000000),
+		static_cast<unsigned long>(sample.created / 1000000), static_cast<unsigned long>(sample.first_commit / 1000000),
+		static_cast<unsigned long>(sample.mapped / 1000000), static_cast<unsigned long>(sample.presented / 1000000));
+}
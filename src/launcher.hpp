@@ -0,0 +1,107 @@
+#ifndef MAGPIE_LAUNCHER_HPP
+#define MAGPIE_LAUNCHER_HPP
+
+#include "types.hpp"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+#include <wayland-server-core.h>
+
+struct LaunchedProcess {
+	uint64_t id;
+	pid_t pid;
+	std::string command;
+	std::string activation_token;
+	uint64_t token_ns = 0;
+	/* Empty when the process could not be given its own cgroup */
+	std::string cgroup;
+	uint64_t start_ns;
+	uint64_t exit_ns = 0;
+	bool running = true;
+	int exit_status = 0;
+	/* The first view it opened or activated with our token, 0 until then */
+	uint64_t view_id = 0;
+};
+
+/* The steps of a view on its way to the screen, clock_now_ns, 0 until they
+ * happen. The token is the activation token the view was started with, as
+ * far as we know. */
+struct LaunchTimes {
+	uint64_t token_ns = 0;
+	uint64_t created_ns = 0;
+	uint64_t first_commit_ns = 0;
+	uint64_t mapped_ns = 0;
+	uint64_t presented_ns = 0;
+	/* The output whose next present is the first to show the view */
+	const Output* rendered_on = nullptr;
+	bool reported = false;
+};
+
+/* How long each step of one launch took after the one before, and all of
+ * them together, in nanoseconds */
+struct LaunchSample {
+	uint64_t created;
+	uint64_t first_commit;
+	uint64_t mapped;
+	uint64_t presented;
+	uint64_t total;
+};
+
+/* The latest launches of one app_id */
+struct LaunchStats {
+	uint64_t launches = 0;
+	std::vector<LaunchSample> samples;
+};
+
+/* Starts applications with posix_spawn, which never duplicates the page
+ * tables of the compositor, and reaps them from a SIGCHLD signalfd on the
+ * event loop. Each launch gets an activation token, so the application can
+ * raise its first window, and when our cgroup is delegated to us, its own
+ * child cgroup for accounting.
+ *
+ * Launches are also timed from the activation token to the first frame
+ * that shows their view, whether we started them or a client that asked for
+ * the token did. Views are tied to a launch by its token or, for our own
+ * launches, by their pid or cgroup. Views no token is known for, such as
+ * applications started from a terminal, are not counted.
+ *
+ * SIGCHLD has to be blocked in every thread before any thread starts. */
+class Launcher {
+	wl_event_source* sigchld_source = nullptr;
+	std::string cgroup_root;
+	uint64_t next_id = 1;
+	/* Tokens clients asked for, newest last */
+	std::list<std::pair<std::string, uint64_t>> issued_tokens;
+	std::vector<View*> awaiting_present;
+
+	void place_in_cgroup(LaunchedProcess& process);
+	[[nodiscard]] uint64_t token_issued_at(const char* token) const;
+	void report_launch(View& view);
+
+  public:
+	Server& server;
+	std::list<LaunchedProcess> processes;
+	std::map<std::string, LaunchStats> launch_stats;
+
+	explicit Launcher(Server& server) noexcept;
+	~Launcher() noexcept;
+
+	const LaunchedProcess* launch(const std::string& command);
+	void reap_children();
+	void token_issued(const char* token);
+	void token_activated(const char* token, View& view);
+
+	void view_created(View& view, pid_t pid);
+	void view_mapped(View& view);
+	void view_unmapped(View& view);
+	void output_committed(const Output& output);
+	void output_presented(const Output& output, uint64_t presented_ns);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "live_objects.hpp"
+
+#include <cstdio>
+#include <iterator>
+#include <unistd.h>
+
+uint64_t live_object_counts[LIVE_OBJECT_TYPE_COUNT] = {};
+
+static constexpr const char* live_object_names[] = {
+	"xdg_view",
+	"xwayland_view",
+	"popup",
+	"layer",
+	"layer_subsurface",
+	"foreign_toplevel_handle",
+	"output",
+	"keyboard",
+	"pointer_constraint",
+	"signal_awaiter",
+};
+
+static_assert(std::size(live_object_names) == LIVE_OBJECT_TYPE_COUNT);
+
+const char* live_object_name(const LiveObjectType type) {
+	return live_object_names[type];
+}
+
+uint64_t resident_set_kib() {
+	FILE* file = std::fopen("/proc/self/statm", "re");
+	if (file == nullptr) {
+		return 0;
+	}
+
+	unsigned long size = 0;
+	unsigned long resident = 0;
+	const bool read = std::fscanf(file, "%lu %lu", &size, &resident) == 2;
+	std::fclose(file);
+	if (!read) {
+		return 0;
+	}
+	return static_cast<uint64_t>(resident) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) / 1024;
+}
+
+void live_objects_write_json(JsonWriter& json) {
+	json.begin_object();
+	json.key("rss_kib").value(resident_set_kib());
+	json.key("objects").begin_object();
+	for (int type = 0; type < LIVE_OBJECT_TYPE_COUNT; type++) {
+		json.key(live_object_names[type]).value(live_object_counts[type]);
+	}
+	json.end_object();
+	json.end_object();
+}
@@ -0,0 +1,49 @@
+#ifndef MAGPIE_LIVE_OBJECTS_HPP
+#define MAGPIE_LIVE_OBJECTS_HPP
+
+#include "json.hpp"
+
+#include <cstdint>
+
+/* The types counted, the ones that own listeners and free themselves from one
+ * of them. One that outlives its wlroots object shows as a count that only
+ * grows. */
+enum LiveObjectType {
+	LIVE_OBJECT_XDG_VIEW,
+	LIVE_OBJECT_XWAYLAND_VIEW,
+	LIVE_OBJECT_POPUP,
+	LIVE_OBJECT_LAYER,
+	LIVE_OBJECT_LAYER_SUBSURFACE,
+	LIVE_OBJECT_FOREIGN_TOPLEVEL_HANDLE,
+	LIVE_OBJECT_OUTPUT,
+	LIVE_OBJECT_KEYBOARD,
+	LIVE_OBJECT_POINTER_CONSTRAINT,
+	LIVE_OBJECT_SIGNAL_AWAITER,
+	LIVE_OBJECT_TYPE_COUNT,
+};
+
+/* Main thread only, like the objects themselves */
+extern uint64_t live_object_counts[LIVE_OBJECT_TYPE_COUNT];
+
+const char* live_object_name(LiveObjectType type);
+/* From /proc/self/statm, 0 if it can't be read */
+uint64_t resident_set_kib();
+void live_objects_write_json(JsonWriter& json);
+
+/* Counts the instances of the type it is a member of. Declared
+ * [[no_unique_address]], it takes no space. */
+template <LiveObjectType type>
+struct LiveObject {
+	LiveObject() noexcept {
+		live_object_counts[type]++;
+	}
+	LiveObject(const LiveObject&) noexcept {
+		live_object_counts[type]++;
+	}
+	LiveObject& operator=(const LiveObject&) noexcept = default;
+	~LiveObject() noexcept {
+		live_object_counts[type]--;
+	}
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include "log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/* Per thread, so one chatty thread can't starve the others. */
+static constexpr size_t LOG_RING_SIZE = 64 * 1024;
+static constexpr size_t LOG_MESSAGE_MAX = 1024;
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "ring size must be a power of two");
+
+/* Single producer (the owning thread), single consumer (the drain thread).
+ * Records are a uint32_t length followed by the message bytes. */
+struct LogRing {
+	std::array<char, LOG_RING_SIZE> buffer = {};
+	std::atomic<size_t> head = 0;
+	std::atomic<size_t> tail = 0;
+	std::atomic<uint64_t> dropped = 0;
+
+	void copy_in(size_t pos, const void* data, size_t len) {
+		const size_t offset = pos & (LOG_RING_SIZE - 1);
+		const size_t first = std::min(len, LOG_RING_SIZE - offset);
+		std::memcpy(&buffer[offset], data, first);
+		std::memcpy(&buffer[0], static_cast<const char*>(data) + first, len - first);
+	}
+
+	void copy_out(size_t pos, void* data, size_t len) const {
+		const size_t offset = pos & (LOG_RING_SIZE - 1);
+		const size_t first = std::min(len, LOG_RING_SIZE - offset);
+		std::memcpy(data, &buffer[offset], first);
+		std::memcpy(static_cast<char*>(data) + first, &buffer[0], len - first);
+	}
+
+	bool push(const char* message, const uint32_t len) {
+		const size_t current_head = head.load(std::memory_order_relaxed);
+		const size_t current_tail = tail.load(std::memory_order_acquire);
+		if (LOG_RING_SIZE - (current_head - current_tail) < sizeof(len) + len) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		copy_in(current_head, &len, sizeof(len));
+		copy_in(current_head + sizeof(len), message, len);
+		head.store(current_head + sizeof(len) + len, std::memory_order_release);
+		return true;
+	}
+
+	/* Appends every complete record to out, returns whether anything was read. */
+	bool drain(std::string& out) {
+		const size_t current_head = head.load(std::memory_order_acquire);
+		size_t current_tail = tail.load(std::memory_order_relaxed);
+		if (current_tail == current_head) {
+			return false;
+		}
+
+		while (current_tail != current_head) {
+			uint32_t len = 0;
+			copy_out(current_tail, &len, sizeof(len));
+			const size_t start = out.size();
+			out.resize(start + len);
+			copy_out(current_tail + sizeof(len), &out[start], len);
+			current_tail += sizeof(len) + len;
+		}
+
+		tail.store(current_tail, std::memory_order_release);
+		return true;
+	}
+
+	/* Writes every complete record straight to fd, without allocating */
+	void drain_to(const int fd) {
+		const size_t current_head = head.load(std::memory_order_acquire);
+		size_t current_tail = tail.load(std::memory_order_relaxed);
+
+		char message[LOG_MESSAGE_MAX];
+		while (current_tail != current_head) {
+			uint32_t len = 0;
+			copy_out(current_tail, &len, sizeof(len));
+			copy_out(current_tail + sizeof(len), message, std::min<size_t>(len, sizeof(message)));
+			(void) !write(fd, message, std::min<size_t>(len, sizeof(message)));
+			current_tail += sizeof(len) + len;
+		}
+
+		tail.store(current_tail, std::memory_order_release);
+	}
+};
+
+static struct {
+	std::atomic<int> level = WLR_INFO;
+	std::atomic<bool> running = false;
+	std::atomic<uint32_t> wakeups = 0;
+	std::atomic<bool> drain_waiting = false;
+	std::mutex rings_mutex;
+	std::vector<std::shared_ptr<LogRing>> rings;
+	std::thread drain_thread;
+	timespec start_time = {};
+} log_state;
+
+static const char* const level_names[] = {"SILENT", "ERROR", "INFO", "DEBUG"};
+
+/* Registering takes the lock, but only once per thread. */
+static LogRing& thread_ring() {
+	thread_local std::shared_ptr<LogRing> ring = [] {
+		auto new_ring = std::make_shared<LogRing>();
+		const std::lock_guard lock(log_state.rings_mutex);
+		log_state.rings.push_back(new_ring);
+		return new_ring;
+	}();
+
+	return *ring;
+}
+
+static void wake_drain_thread() {
+	/* Pairs with the fence in drain_main. Without both, the push and the
+	 * flag could each miss the other's store and the message would sit in
+	 * the ring until the next one. */
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (log_state.drain_waiting.load(std::memory_order_relaxed)) {
+		log_state.wakeups.fetch_add(1, std::memory_order_release);
+		log_state.wakeups.notify_one();
+	}
+}
+
+static void log_callback(const wlr_log_importance importance, const char* fmt, va_list args) {
+	if (static_cast<int>(importance) > log_state.level.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	timespec now = {};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t elapsed_ms = (now.tv_sec - log_state.start_time.tv_sec) * 1000 +
+						 (now.tv_nsec - log_state.start_time.tv_nsec) / 1000000;
+
+	char message[LOG_MESSAGE_MAX];
+	const int64_t hours = elapsed_ms / 3600000;
+	elapsed_ms %= 3600000;
+	int len = std::snprintf(message, sizeof(message), "%02ld:%02ld:%02ld.%03ld [%s] ", static_cast<long>(hours),
+		static_cast<long>(elapsed_ms / 60000), static_cast<long>((elapsed_ms / 1000) % 60),
+		static_cast<long>(elapsed_ms % 1000), level_names[importance < WLR_LOG_IMPORTANCE_LAST ? importance : 0]);
+	if (len < 0) {
+		return;
+	}
+
+	const int body = std::vsnprintf(message + len, sizeof(message) - len - 1, fmt, args);
+	if (body > 0) {
+		len = std::min(len + body, static_cast<int>(sizeof(message)) - 2);
+	}
+	message[len++] = '\n';
+
+	if (!log_state.running.load(std::memory_order_acquire)) {
+		if (write(STDERR_FILENO, message, len) < 0) {
+			/* Nowhere left to report this */
+		}
+		return;
+	}
+
+	thread_ring().push(message, static_cast<uint32_t>(len));
+	wake_drain_thread();
+}
+
+static bool drain_rings(std::string& out) {
+	bool any = false;
+
+	const std::lock_guard lock(log_state.rings_mutex);
+	for (const auto& ring : log_state.rings) {
+		any |= ring->drain(out);
+
+		const uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped > 0) {
+			out += "[log] dropped " + std::to_string(dropped) + " messages\n";
+			any = true;
+		}
+	}
+
+	return any;
+}
+
+static void write_all(const std::string& out) {
+	size_t written = 0;
+	while (written < out.size()) {
+		const ssize_t ret = write(STDERR_FILENO, out.data() + written, out.size() - written);
+		if (ret <= 0) {
+			return;
+		}
+		written += ret;
+	}
+}
+
+static void drain_main() {
+	std::string out;
+
+	while (true) {
+		const uint32_t seen = log_state.wakeups.load(std::memory_order_acquire);
+
+		out.clear();
+		if (drain_rings(out)) {
+			write_all(out);
+			continue;
+		}
+
+		if (!log_state.running.load(std::memory_order_acquire)) {
+			return;
+		}
+
+		log_state.drain_waiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		/* Re-check after announcing ourselves, a producer may have pushed
+		 * before it could see the flag. */
+		out.clear();
+		if (drain_rings(out)) {
+			log_state.drain_waiting.store(false, std::memory_order_relaxed);
+			write_all(out);
+			continue;
+		}
+		log_state.wakeups.wait(seen, std::memory_order_acquire);
+		log_state.drain_waiting.store(false, std::memory_order_relaxed);
+	}
+}
+
+/* Best effort from a crashing thread: the drain thread may be the one that
+ * crashed, or hold the lock, in which case nothing is written. */
+static void log_flush() {
+	std::unique_lock lock(log_state.rings_mutex, std::try_to_lock);
+	if (!lock.owns_lock()) {
+		return;
+	}
+
+	for (const auto& ring : log_state.rings) {
+		ring->drain_to(STDERR_FILENO);
+	}
+}
+
+static void log_fatal_signal_handler(const int signal) {
+	log_flush();
+	/* The handler was reset, so this ends the process as it would have */
+	raise(signal);
+}
+
+void log_init(const wlr_log_importance level) {
+	clock_gettime(CLOCK_MONOTONIC, &log_state.start_time);
+	log_state.level.store(level, std::memory_order_relaxed);
+
+	/* wlroots filters before calling us, so let everything through and do the
+	 * filtering here where the level can change. */
+	wlr_log_init(WLR_DEBUG, log_callback);
+
+	log_state.running.store(true, std::memory_order_release);
+	log_state.drain_thread = std::thread(drain_main);
+
+	/* The last messages before an abort or crash are the ones most worth
+	 * having, and would otherwise die in the rings */
+	struct sigaction action = {};
+	action.sa_handler = log_fatal_signal_handler;
+	action.sa_flags = SA_RESETHAND;
+	sigemptyset(&action.sa_mask);
+	for (const int signal : {SIGABRT, SIGSEGV, SIGBUS, SIGILL, SIGFPE}) {
+		sigaction(signal, &action, nullptr);
+	}
+}
+
+/* Drains whatever is left and stops the drain thread. */
+void log_finish() {
+	if (!log_state.running.exchange(false, std::memory_order_acq_rel)) {
+		return;
+	}
+
+	log_state.wakeups.fetch_add(1, std::memory_order_release);
+	log_state.wakeups.notify_one();
+	log_state.drain_thread.join();
+}
+
+void log_set_level(const wlr_log_importance level) {
+	log_state.level.store(level, std::memory_order_relaxed);
+}
+
+wlr_log_importance log_get_level() {
+	return static_cast<wlr_log_importance>(log_state.level.load(std::memory_order_relaxed));
+}
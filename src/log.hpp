@@ -0,0 +1,22 @@
+#ifndef MAGPIE_LOG_HPP
+#define MAGPIE_LOG_HPP
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* Asynchronous logging backend for wlr_log. Messages are formatted on the
+ * calling thread into a lock-free ring owned by that thread, and a background
+ * thread drains all rings to stderr, so logging never blocks on the sink. If
+ * a ring fills up, messages are dropped and the drop is reported instead.
+ * On a fatal signal, the crashing thread writes out what is left first.
+ *
+ * The level is checked before formatting and can be changed at any time from
+ * any thread. */
+void log_init(wlr_log_importance level);
+void log_finish();
+
+void log_set_level(wlr_log_importance level);
+wlr_log_importance log_get_level();
+
+#endif
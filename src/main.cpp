@@ -1,5 +1,13 @@
+#include "ipc.hpp"
+#include "launcher.hpp"
+#include "log.hpp"
 #include "server.hpp"
+#include "startup.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+#include "watchdog.hpp"
 
+#include <csignal>
 #include <cstdio>
 #include <string>
 #include <unistd.h>
@@ -10,7 +18,32 @@
 #include <wlr/util/log.h>
 #include "wlr-wrap-end.hpp"
 
+/* SIGUSR1 flips between the default level and debug, so a misbehaving session
+ * can be investigated without restarting it. */
+static int log_toggle_debug_notify(int signal, void* data) {
+	(void) signal;
+	(void) data;
+
+	const wlr_log_importance level = log_get_level() == WLR_DEBUG ? WLR_INFO : WLR_DEBUG;
+	log_set_level(level);
+	wlr_log(WLR_INFO, "Log level set to %s", level == WLR_DEBUG ? "debug" : "info");
+	return 0;
+}
+
+#ifdef MAGPIE_TRACING
+/* SIGUSR2 starts and stops recording a trace. */
+static int trace_toggle_notify(int signal, void* data) {
+	(void) signal;
+	(void) data;
+
+	trace_toggle();
+	return 0;
+}
+#endif
+
 int main(const int argc, char** argv) {
+	startup_mark("main");
+
 	std::vector<std::string> startup_cmds;
 	int c;
 	while ((c = getopt(argc, argv, "s:h")) != -1) {
@@ -29,41 +62,65 @@ int main(const int argc, char** argv) {
 		return 0;
 	}
 
-	wlr_log_init(WLR_INFO, nullptr);
+	/* Signals handled through the event loop must be blocked before any
+	 * thread starts, or they may be delivered to a thread that doesn't
+	 * expect them. Children get the default mask back before exec. */
+	sigset_t handled_signals;
+	sigemptyset(&handled_signals);
+	sigaddset(&handled_signals, SIGCHLD);
+	sigaddset(&handled_signals, SIGUSR1);
+	sigaddset(&handled_signals, SIGUSR2);
+	pthread_sigmask(SIG_BLOCK, &handled_signals, nullptr);
 
-	const Server server = Server();
+	log_init(WLR_INFO);
+
+	Server server = Server();
+	wl_event_loop_add_signal(wl_display_get_event_loop(server.display), SIGUSR1, log_toggle_debug_notify, nullptr);
+#ifdef MAGPIE_TRACING
+	wl_event_loop_add_signal(wl_display_get_event_loop(server.display), SIGUSR2, trace_toggle_notify, nullptr);
+#endif
 
 	/* Add a Unix socket to the Wayland display. */
 	const char* socket = wl_display_add_socket_auto(server.display);
 	if (socket == nullptr) {
-		std::printf("Unix socket for display failed to initialize\n");
+		wlr_log(WLR_ERROR, "Unix socket for display failed to initialize");
+		log_finish();
 		return 1;
 	}
+	startup_mark("socket");
 
 	/* Start the backend. This will enumerate outputs and inputs, become the DRM master, etc */
 	if (!wlr_backend_start(server.backend)) {
 		wlr_backend_destroy(server.backend);
 		wl_display_destroy(server.display);
+		log_finish();
 		return 1;
 	}
 
-	std::printf("Running compositor on wayland display '%s'\n", socket);
+	startup_mark("backend_start");
+
 	setenv("WAYLAND_DISPLAY", socket, true);
+	server.telemetry->set_wayland_display(socket);
+	server.ipc->listen(socket);
 
-	for (const auto& cmd : std::as_const(startup_cmds)) {
-		if (fork() == 0) {
-			execl("/bin/sh", "/bin/sh", "-c", cmd.c_str(), nullptr);
+	/* Startup commands may well be X11 clients, so wait for XWayland */
+	server.on_startup_complete = [&server, &startup_cmds] {
+		for (const auto& cmd : std::as_const(startup_cmds)) {
+			server.launcher->launch(cmd);
 		}
-	}
+	};
 
 	/* Run the Wayland event loop. This does not return until you exit the
-	 * compositor. Starting the backend rigged up all of the necessary event
+	 * compositor, see Server::run. Starting the backend rigged up all of the necessary event
 	 * loop configuration to listen to libinput events, DRM events, generate
 	 * frame events at the refresh rate, and so on. */
 	wlr_log(WLR_INFO, "Running Wayland compositor on WAYLAND_DISPLAY=%s", socket);
-	wl_display_run(server.display);
+	server.run();
+	delete server.watchdog;
+	delete server.ipc;
 	wl_display_destroy_clients(server.display);
 	wl_display_destroy(server.display);
+	log_finish();
 
 	return 0;
 }
@@ -1,20 +1,36 @@
 #include "output.hpp"
 
+#include "alloc_guard.hpp"
+#include "clock.hpp"
+#include "config.hpp"
+#include "input/seat.hpp"
+#include "ipc.hpp"
+#include "launcher.hpp"
 #include "server.hpp"
+#include "startup.hpp"
 #include "surface/layer.hpp"
+#include "surface/view.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+#include "transaction.hpp"
 #include "types.hpp"
+#include "watchdog.hpp"
 
+#include <algorithm>
+#include <cstdlib>
 #include <set>
 #include <utility>
 
 #include <wlr-wrap-start.hpp>
 #include <wlr/types/wlr_layer_shell_v1.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/log.h>
 #include <wlr-wrap-end.hpp>
 
 /* This function is called every time an output is ready to display a frame,
  * generally at the output's refresh rate (e.g. 60Hz). */
 static void output_request_state_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("output_request_state");
 	Output& output = magpie_container_of(listener, output, request_state);
 	const auto* event = static_cast<wlr_output_event_request_state*>(data);
 
@@ -25,28 +41,61 @@ static void output_request_state_notify(wl_listener* listener, void* data) {
 /* This function is called every time an output is ready to display a frame,
  * generally at the output's refresh rate (e.g. 60Hz). */
 static void output_frame_notify(wl_listener* listener, void* data) {
+	MAGPIE_HOT_PATH("output_frame");
 	Output& output = magpie_container_of(listener, output, frame);
 	(void) data;
 
+	/* On virtual time only Server::advance_clock hands out frames. The
+	 * backend's own timer stops once these are left without a commit. */
+	if (clock_is_virtual() && !output.frame_from_clock) {
+		return;
+	}
+
+	/* Marks the vblank, so spans can be lined up with each output's frames */
+	MAGPIE_TRACE_INSTANT("frame", output.wlr.name);
+	MAGPIE_TRACE_SCOPE("output_frame");
+
 	wlr_scene_output* scene_output = wlr_scene_get_scene_output(output.server.scene, &output.wlr);
 
 	if (scene_output == nullptr || output.is_leased || !output.wlr.enabled) {
 		return;
 	}
 
-	/* Render the scene if needed and commit the output */
-	wlr_scene_output_commit(scene_output, nullptr);
+	/* Render the scene if needed and commit the output. Without damage the
+	 * commit is skipped, yet still reported as a success. */
+	const bool needs_commit =
+		output.wlr.needs_frame || pixman_region32_not_empty(&scene_output->damage_ring.current) != 0;
+	if (wlr_scene_output_commit(scene_output, nullptr) && needs_commit) {
+		output.server.launcher->output_committed(output);
+	}
+	output.server.telemetry->output_frame(output.telemetry_slot, output.wlr.refresh);
+	output.server.watchdog->output_frame(output.telemetry_slot);
+	output.server.schedule_deferred_init();
 
-	timespec now = {};
-	timespec_get(&now, TIME_UTC);
+	timespec now = clock_now_timespec();
 	wlr_scene_output_send_frame_done(scene_output, &now);
 }
 
+static void output_present_notify(wl_listener* listener, void* data) {
+	Output& output = magpie_container_of(listener, output, present);
+	const auto* event = static_cast<wlr_output_event_present*>(data);
+
+	if (event->presented) {
+		startup_frame_presented(output.wlr.name);
+		/* wlroots fills in when for every presented frame */
+		output.server.launcher->output_presented(output, clock_from_monotonic(*event->when));
+	}
+}
+
 static void output_destroy_notify(wl_listener* listener, void* data) {
 	Output& output = magpie_container_of(listener, output, destroy);
 	(void) data;
 
 	output.server.outputs.erase(&output);
+	output.server.telemetry->remove_output(output.telemetry_slot);
+	output.server.watchdog->remove_output(output.telemetry_slot);
+	output.server.ipc->event(IPC_EVENT_OUTPUTS_CHANGED);
+	output.evacuate_views();
 	for (const auto* layer : std::as_const(output.layers)) {
 		wlr_layer_surface_v1_destroy(&layer->layer_surface);
 	}
@@ -54,19 +103,63 @@ static void output_destroy_notify(wl_listener* listener, void* data) {
 	delete &output;
 }
 
+/* The mode closest to the configured one, or the preferred mode when none is
+ * configured or none matches. */
+static wlr_output_mode* output_config_mode(wlr_output& wlr, const OutputConfig& config) {
+	if (config.width <= 0 || config.height <= 0) {
+		return wlr_output_preferred_mode(&wlr);
+	}
+
+	wlr_output_mode* best = nullptr;
+	wlr_output_mode* mode;
+	wl_list_for_each(mode, &wlr.modes, link) {
+		if (mode->width != config.width || mode->height != config.height) {
+			continue;
+		}
+		if (best == nullptr || (config.refresh > 0 ? std::abs(mode->refresh - config.refresh) <
+														 std::abs(best->refresh - config.refresh)
+												   : mode->refresh > best->refresh)) {
+			best = mode;
+		}
+	}
+
+	if (best == nullptr && !wl_list_empty(&wlr.modes)) {
+		wlr_log(WLR_ERROR, "%s has no %dx%d mode, using the preferred one", wlr.name, config.width, config.height);
+		return wlr_output_preferred_mode(&wlr);
+	}
+	return best;
+}
+
+static void output_config_state(wlr_output& wlr, const OutputConfig& config, wlr_output_state& state) {
+	wlr_output_state_set_enabled(&state, config.enabled);
+	if (!config.enabled) {
+		return;
+	}
+
+	wlr_output_mode* mode = output_config_mode(wlr, config);
+	if (mode != nullptr) {
+		wlr_output_state_set_mode(&state, mode);
+	} else if (config.width > 0 && config.height > 0) {
+		/* Backends without modes, such as nested ones, take any size */
+		wlr_output_state_set_custom_mode(&state, config.width, config.height, config.refresh);
+	}
+
+	if (config.scale > 0) {
+		wlr_output_state_set_scale(&state, config.scale);
+	}
+}
+
 Output::Output(Server& server, wlr_output& wlr) noexcept : listeners(*this), server(server), wlr(wlr) {
 	wlr.data = this;
 
 	wlr_output_init_render(&wlr, server.allocator, server.renderer);
 
+	/* Some backends don't have modes. DRM+KMS does, and we need to set a mode
+	 * before we can use the output. Each monitor supports only a specific set
+	 * of modes, we take the configured one or the monitor's preferred mode. */
 	wlr_output_state state = {};
 	wlr_output_state_init(&state);
-	wlr_output_state_set_enabled(&state, true);
-
-	wlr_output_mode* mode = wlr_output_preferred_mode(&wlr);
-	if (mode != nullptr) {
-		wlr_output_state_set_mode(&state, mode);
-	}
+	output_config_state(wlr, server.config->current.output_for(wlr.name), state);
 
 	wlr_output_commit_state(&wlr, &state);
 	wlr_output_state_finish(&state);
@@ -75,28 +168,84 @@ Output::Output(Server& server, wlr_output& wlr) noexcept : listeners(*this), ser
 	wl_signal_add(&wlr.events.request_state, &listeners.request_state);
 	listeners.frame.notify = output_frame_notify;
 	wl_signal_add(&wlr.events.frame, &listeners.frame);
+	listeners.present.notify = output_present_notify;
+	wl_signal_add(&wlr.events.present, &listeners.present);
 	listeners.destroy.notify = output_destroy_notify;
 	wl_signal_add(&wlr.events.destroy, &listeners.destroy);
 
 	wlr_output_layout_output* layout_output = wlr_output_layout_add_auto(server.output_layout, &wlr);
 	wlr_scene_output* scene_output = wlr_scene_output_create(server.scene, &wlr);
 	wlr_scene_output_layout_add_output(server.scene_layout, layout_output, scene_output);
+
+	telemetry_slot = server.telemetry->add_output(wlr.name);
+	server.watchdog->add_output(telemetry_slot, wlr.name);
+	server.ipc->event(IPC_EVENT_OUTPUTS_CHANGED);
 }
 
 Output::~Output() noexcept {
 	wl_list_remove(&listeners.request_state.link);
 	wl_list_remove(&listeners.frame.link);
+	wl_list_remove(&listeners.present.link);
 	wl_list_remove(&listeners.destroy.link);
 }
 
+/* Only called for outputs whose config section changed, so a reload never
+ * modesets the others. */
+void Output::apply_config(const OutputConfig& config) {
+	MAGPIE_TRACE_SCOPE("output_apply_config");
+	/* The lessee owns it until the lease ends */
+	if (is_leased) {
+		return;
+	}
+
+	const bool adding = config.enabled && !wlr.enabled;
+	const bool removing = !config.enabled && wlr.enabled;
+
+	if (removing) {
+		evacuate_views();
+	}
+
+	wlr_output_state state = {};
+	wlr_output_state_init(&state);
+	output_config_state(wlr, config, state);
+	const bool committed = wlr_output_commit_state(&wlr, &state);
+	wlr_output_state_finish(&state);
+
+	if (!committed) {
+		wlr_log(WLR_ERROR, "Failed to apply the config for %s", wlr.name);
+		return;
+	}
+
+	if (adding) {
+		wlr_output_layout_add_auto(server.output_layout, &wlr);
+		scene_output = wlr_scene_get_scene_output(server.scene, &wlr);
+	} else if (removing) {
+		wlr_output_layout_remove(server.output_layout, &wlr);
+		scene_output = nullptr;
+	}
+
+	if (config.enabled) {
+		update_layout();
+		server.seat->cursor.load_theme(wlr.scale);
+	}
+}
+
 void Output::update_layout() {
+	MAGPIE_TRACE_SCOPE("output_arrange_layers");
 	const wlr_scene_output* scene_output = wlr_scene_get_scene_output(server.scene, &wlr);
 	if (scene_output == nullptr) {
 		return;
 	}
 
-	full_area.x = scene_output->x;
-	full_area.y = scene_output->y;
+	const wlr_box prev_full_area = full_area;
+	const wlr_box prev_usable_area = usable_area;
+
+	/* Read the position from the layout itself, the scene output may not have
+	 * caught up with a layout change yet. */
+	wlr_box layout_box = {};
+	wlr_output_layout_get_box(server.output_layout, &wlr, &layout_box);
+	full_area.x = layout_box.x;
+	full_area.y = layout_box.y;
 	wlr_output_effective_resolution(&wlr, &full_area.width, &full_area.height);
 
 	usable_area = full_area;
@@ -104,24 +253,93 @@ void Output::update_layout() {
 	for (const auto* layer : std::as_const(layers)) {
 		wlr_scene_layer_surface_v1_configure(layer->scene_layer_surface, &full_area, &usable_area);
 	}
+
+	if (!wlr_box_equal(&prev_full_area, &full_area) || !wlr_box_equal(&prev_usable_area, &usable_area)) {
+		reflow_views(prev_full_area);
+		server.ipc->event(IPC_EVENT_OUTPUTS_CHANGED);
+	}
 }
 
-wlr_box Output::full_area_in_layout_coords() const {
-	double layout_x = 0, layout_y = 0;
-	wlr_output_layout_output_coords(server.output_layout, &wlr, &layout_x, &layout_y);
+/* Resizes every maximized and fullscreen view that was on this output to its
+ * new area, as a single transaction so they all change in the same frame. */
+void Output::reflow_views(const wlr_box& prev_full_area) {
+	MAGPIE_TRACE_SCOPE("output_reflow_views");
+	for (auto* view : std::as_const(server.views)) {
+		if (view->curr_placement == VIEW_PLACEMENT_STACKING) {
+			continue;
+		}
+
+		wlr_box intersection = {};
+		if (!wlr_box_intersection(&intersection, &view->current, &prev_full_area)) {
+			continue;
+		}
 
-	wlr_box box = full_area;
-	box.x += static_cast<int>(std::round(layout_x));
-	box.y += static_cast<int>(std::round(layout_y));
-	return box;
+		server.transactions->add(*view, view->curr_placement == VIEW_PLACEMENT_FULLSCREEN ? full_area : usable_area);
+	}
+
+	server.transactions->commit();
+}
+
+/* Moves the views on this output to another one before it goes away, keeping
+ * stacking views at the same offset and resizing the others to fit. */
+void Output::evacuate_views() {
+	Output* target = nullptr;
+	for (auto* output : std::as_const(server.outputs)) {
+		if (output != this && output->wlr.enabled && !output->is_leased) {
+			target = output;
+			break;
+		}
+	}
+
+	if (target == nullptr) {
+		return;
+	}
+
+	const wlr_box& area = target->usable_area;
+	const auto relocate = [this, &area](wlr_box box) {
+		box.x = area.x + (box.x - full_area.x);
+		box.y = area.y + (box.y - full_area.y);
+		box.x = std::clamp(box.x, area.x, std::max(area.x, area.x + area.width - box.width));
+		box.y = std::clamp(box.y, area.y, std::max(area.y, area.y + area.height - box.height));
+		return box;
+	};
+
+	for (auto* view : std::as_const(server.views)) {
+		wlr_box intersection = {};
+		if (!wlr_box_intersection(&intersection, &view->current, &full_area)) {
+			continue;
+		}
+
+		switch (view->curr_placement) {
+			case VIEW_PLACEMENT_STACKING:
+				server.transactions->add(*view, relocate(view->current));
+				break;
+			case VIEW_PLACEMENT_MAXIMIZED:
+				view->previous = relocate(view->previous);
+				server.transactions->add(*view, target->usable_area);
+				break;
+			case VIEW_PLACEMENT_FULLSCREEN:
+				view->previous = relocate(view->previous);
+				server.transactions->add(*view, target->full_area);
+				break;
+		}
+	}
+
+	server.transactions->commit();
+}
+
+/* full_area and usable_area are already in layout coordinates, since they are
+ * taken from the scene output and handed to the layer shell as such. */
+wlr_box Output::full_area_in_layout_coords() const {
+	return full_area;
 }
 
 wlr_box Output::usable_area_in_layout_coords() const {
-	double layout_x = 0, layout_y = 0;
-	wlr_output_layout_output_coords(server.output_layout, &wlr, &layout_x, &layout_y);
+	return usable_area;
+}
 
-	wlr_box box = usable_area;
-	box.x += static_cast<int>(std::round(layout_x));
-	box.y += static_cast<int>(std::round(layout_y));
-	return box;
+/* From the current mode, outputs that do not report one are paced at 60Hz */
+uint64_t Output::frame_interval_ns() const {
+	const int32_t refresh_mhz = wlr.refresh > 0 ? wlr.refresh : 60000;
+	return 1000000000000 / static_cast<uint64_t>(refresh_mhz);
 }
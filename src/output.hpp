@@ -1,6 +1,7 @@
 #ifndef MAGPIE_OUTPUT_HPP
 #define MAGPIE_OUTPUT_HPP
 
+#include "live_objects.hpp"
 #include "types.hpp"
 
 #include <functional>
@@ -19,12 +20,16 @@ class Output {
 		wl_listener enable = {};
 		wl_listener request_state = {};
 		wl_listener frame = {};
+		wl_listener present = {};
 		wl_listener destroy = {};
 		explicit Listeners(Output& parent) noexcept : parent(parent) {}
 	};
 
   private:
 	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_OUTPUT> live;
+
+	void reflow_views(const wlr_box& prev_full_area);
 
   public:
 	Server& server;
@@ -34,13 +39,21 @@ class Output {
 	wlr_box usable_area = {};
 	std::set<Layer*> layers;
 	bool is_leased = false;
+	int32_t telemetry_slot = -1;
+	/* When the next frame is due on virtual time, and whether it is being
+	 * handed out */
+	uint64_t next_frame_ns = 0;
+	bool frame_from_clock = false;
 
 	Output(Server& server, wlr_output& wlr) noexcept;
 	~Output() noexcept;
 
+	void apply_config(const OutputConfig& config);
 	void update_layout();
+	void evacuate_views();
 	[[nodiscard]] wlr_box full_area_in_layout_coords() const;
 	[[nodiscard]] wlr_box usable_area_in_layout_coords() const;
+	[[nodiscard]] uint64_t frame_interval_ns() const;
 };
 
 #endif
@@ -0,0 +1,147 @@
+#include "recording.hpp"
+
+#include "worker_pool.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utility>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+/* Closed once the last chunk written to it is done with it */
+struct RecordingFile {
+	int fd;
+
+	explicit RecordingFile(const int fd) noexcept : fd(fd) {}
+	RecordingFile(const RecordingFile&) = delete;
+	RecordingFile& operator=(const RecordingFile&) = delete;
+
+	~RecordingFile() noexcept {
+		::close(fd);
+	}
+};
+
+static bool write_at(const int fd, const void* data, const size_t size, const uint64_t offset) {
+	const auto* bytes = static_cast<const char*>(data);
+	size_t written = 0;
+	while (written < size) {
+		const ssize_t result = pwrite(fd, bytes + written, size - written, static_cast<off_t>(offset + written));
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			return false;
+		}
+		written += static_cast<size_t>(result);
+	}
+	return true;
+}
+
+std::string default_recording_path(const std::string& kind, const std::string& extension) {
+	/* The flight recorder may dump from the watchdog thread */
+	static std::atomic<uint32_t> recording_count = 0;
+
+	const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+	return std::string(runtime_dir != nullptr ? runtime_dir : "/tmp") + "/magpie-" + kind + "-" +
+		   std::to_string(getpid()) + "-" + std::to_string(recording_count++) + "." + extension;
+}
+
+std::string process_command(const pid_t pid) {
+	char path[64];
+	std::snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+
+	/* procfs, so this doesn't block like a real file might */
+	FILE* file = std::fopen(path, "re");
+	if (file == nullptr) {
+		return {};
+	}
+	char command[64] = {};
+	const bool read = std::fgets(command, sizeof(command), file) != nullptr;
+	std::fclose(file);
+	if (!read) {
+		return {};
+	}
+	command[std::strcspn(command, "\n")] = '\0';
+	return command;
+}
+
+RecordingWriter::RecordingWriter(WorkerPool& workers, const size_t chunk_size) noexcept
+	: chunk_size(chunk_size), workers(workers) {}
+
+RecordingWriter::~RecordingWriter() noexcept {
+	close();
+}
+
+/* The header is written right away, so a file that opened is never empty.
+ * Never opens a file that already exists, as the names are predictable. */
+bool RecordingWriter::open(const std::string& new_path, const void* header, const size_t size) {
+	if (is_open()) {
+		return false;
+	}
+
+	path = new_path;
+	const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		wlr_log(WLR_ERROR, "Failed to open %s for recording: %s", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	if (!write_at(fd, header, size, 0)) {
+		wlr_log(WLR_ERROR, "Failed to write to %s: %s", path.c_str(), strerror(errno));
+		::close(fd);
+		return false;
+	}
+
+	file = std::make_shared<RecordingFile>(fd);
+	offset = size;
+	pending.reserve(chunk_size);
+	return true;
+}
+
+void RecordingWriter::append(const void* data, const size_t size) {
+	if (!is_open()) {
+		return;
+	}
+
+	const auto* bytes = static_cast<const char*>(data);
+	pending.insert(pending.end(), bytes, bytes + size);
+	if (pending.size() >= chunk_size) {
+		flush();
+	}
+}
+
+void RecordingWriter::flush() {
+	if (pending.empty()) {
+		return;
+	}
+
+	const size_t size = pending.size();
+	workers.submit<bool>(
+		[file = file, chunk = std::exchange(pending, {}), chunk_offset = offset, size] {
+			return write_at(file->fd, chunk.data(), size, chunk_offset);
+		},
+		[chunk_path = path](const bool written) {
+			if (!written) {
+				wlr_log(WLR_ERROR, "Failed to write a recording to %s", chunk_path.c_str());
+			}
+		});
+	offset += size;
+	pending.reserve(chunk_size);
+}
+
+/* The file is complete once the workers have written out what is pending */
+void RecordingWriter::close() {
+	if (!is_open()) {
+		return;
+	}
+
+	flush();
+	file.reset();
+}
@@ -0,0 +1,48 @@
+#ifndef MAGPIE_RECORDING_HPP
+#define MAGPIE_RECORDING_HPP
+
+#include "types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+struct RecordingFile;
+
+/* $XDG_RUNTIME_DIR/magpie-<kind>-<pid>-<n>.<extension>, numbered across all
+ * kinds so no two recordings of one run share a name */
+std::string default_recording_path(const std::string& kind, const std::string& extension);
+/* The command name of a process, as it shows in ps, empty if it is gone */
+std::string process_command(pid_t pid);
+
+/* An append only file for the recorders. Appends only copy into a buffer;
+ * full buffers are written by the workers, each at an offset of its own so
+ * they can finish in any order. */
+class RecordingWriter {
+	std::shared_ptr<RecordingFile> file;
+	std::vector<char> pending;
+	uint64_t offset = 0;
+	size_t chunk_size;
+
+  public:
+	WorkerPool& workers;
+	std::string path;
+
+	RecordingWriter(WorkerPool& workers, size_t chunk_size) noexcept;
+	RecordingWriter(const RecordingWriter&) = delete;
+	RecordingWriter& operator=(const RecordingWriter&) = delete;
+	~RecordingWriter() noexcept;
+
+	[[nodiscard]] bool is_open() const {
+		return file != nullptr;
+	}
+	bool open(const std::string& new_path, const void* header, size_t size);
+	void append(const void* data, size_t size);
+	void flush();
+	void close();
+};
+
+#endif
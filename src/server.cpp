@@ -1,19 +1,40 @@
 #include "server.hpp"
 
+#include "capture.hpp"
+#include "clock.hpp"
+#include "config.hpp"
+#include "flight_recorder.hpp"
+#include "input/recorder.hpp"
 #include "input/seat.hpp"
+#include "ipc.hpp"
+#include "launcher.hpp"
 #include "output.hpp"
+#include "startup.hpp"
 #include "surface/layer.hpp"
 #include "surface/popup.hpp"
 #include "surface/surface.hpp"
 #include "surface/view.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+#include "transaction.hpp"
 #include "types.hpp"
+#include "watchdog.hpp"
+#include "worker_pool.hpp"
+#include "workspace.hpp"
 #include "xwayland.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <poll.h>
+#include <thread>
 #include <utility>
 
 #include "wlr-wrap-start.hpp"
+#include <wlr/backend/headless.h>
 #include <wlr/backend/session.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_data_control_v1.h>
 #include <wlr/types/wlr_data_device.h>
@@ -33,6 +54,7 @@
 #include "wlr-wrap-end.hpp"
 
 void Server::focus_view(View* view, wlr_surface* surface) {
+	MAGPIE_TRACE_SCOPE("focus_view");
 	const wlr_surface* prev_surface = seat->wlr->keyboard_state.focused_surface;
 	if (prev_surface == surface && surface != nullptr) {
 		/* Don't re-focus an already focused surface. */
@@ -58,17 +80,24 @@ void Server::focus_view(View* view, wlr_surface* surface) {
 		surface = view->get_wlr_surface();
 	}
 
-	/* Move the view to the front */
-	wlr_scene_node_raise_to_top(view->scene_node);
-	(void) std::remove(views.begin(), views.end(), view);
-	for (auto* it : std::as_const(views)) {
-		it->set_activated(false);
+	if (view->workspace != nullptr && view->workspace != active_workspace) {
+		show_workspace(*view->workspace);
+	}
+
+	/* Move the view and its transients to the front */
+	if (view->workspace != nullptr) {
+		view->workspace->stack.raise(*view);
+	}
+	views.remove(view);
+	if (focused_view != nullptr && focused_view != view) {
+		focused_view->set_activated(false);
 	}
 
 	/* Activate the new surface */
 	views.insert(views.begin(), view);
 	view->set_activated(true);
 	focused_view = view;
+	ipc->event(IPC_EVENT_FOCUS_CHANGED);
 
 	/*
 	 * Tell the seat to have the keyboard enter this surface. wlroots will keep
@@ -86,7 +115,54 @@ void Server::focus_view(View* view, wlr_surface* surface) {
 	seat->set_constraint(constraint);
 }
 
+/* Focuses the topmost view of the active workspace, or nothing at all if the
+ * workspace is empty. */
+void Server::refocus() {
+	View* view = active_workspace->top_view();
+	if (view != nullptr) {
+		focus_view(view);
+		return;
+	}
+
+	if (focused_view != nullptr) {
+		focused_view->set_activated(false);
+		focused_view = nullptr;
+		ipc->event(IPC_EVENT_FOCUS_CHANGED);
+	}
+	wlr_seat_keyboard_notify_clear_focus(seat->wlr);
+}
+
+/* Switching only toggles two scene trees and leaves foreign toplevel state
+ * alone, since the protocol has no notion of workspaces. The focus change
+ * that follows updates at most the two handles losing and gaining focus,
+ * each of which wlroots flushes to clients with its own done event. */
+void Server::show_workspace(Workspace& workspace) {
+	if (&workspace == active_workspace) {
+		return;
+	}
+
+	active_workspace->set_active(false);
+	workspace.set_active(true);
+	active_workspace = &workspace;
+	ipc->event(IPC_EVENT_WORKSPACE_CHANGED);
+}
+
+void Server::set_active_workspace(Workspace& workspace) {
+	MAGPIE_TRACE_SCOPE("set_active_workspace");
+	if (&workspace == active_workspace) {
+		return;
+	}
+
+	if (grabbed_view != nullptr) {
+		seat->cursor.reset_mode();
+	}
+
+	show_workspace(workspace);
+	refocus();
+}
+
 Surface* Server::surface_at(const double lx, const double ly, wlr_surface** wlr, double* sx, double* sy) const {
+	MAGPIE_TRACE_SCOPE("surface_at");
 	/* This returns the topmost node in the scene at the given layout coords.
 	 * we only care about surface nodes as we are specifically looking for a
 	 * surface in the surface tree of a magpie_view. */
@@ -118,6 +194,7 @@ Surface* Server::surface_at(const double lx, const double ly, wlr_surface** wlr,
 /* This event is raised by the backend when a new output (aka a display or
  * monitor) becomes available. */
 static void new_output_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("new_output");
 	Server& server = magpie_container_of(listener, server, backend_new_output);
 	auto* new_output = static_cast<wlr_output*>(data);
 
@@ -129,21 +206,7 @@ static void new_output_notify(wl_listener* listener, void* data) {
 	 * and our renderer. Must be done once, before commiting the output */
 	wlr_output_init_render(new_output, server.allocator, server.renderer);
 
-	/* Some backends don't have modes. DRM+KMS does, and we need to set a mode
-	 * before we can use the output. The mode is a tuple of (width, height,
-	 * refresh rate), and each monitor supports only a specific set of modes. We
-	 * just pick the monitor's preferred mode, a more sophisticated compositor
-	 * would let the user configure it. */
-	if (!wl_list_empty(&new_output->modes)) {
-		wlr_output_mode* mode = wlr_output_preferred_mode(new_output);
-		wlr_output_set_mode(new_output, mode);
-		wlr_output_enable(new_output, true);
-		if (!wlr_output_commit(new_output)) {
-			return;
-		}
-	}
-
-	/* Allocates and configures our state for this output */
+	/* Allocates and configures our state for this output, including its mode */
 	auto* output = new Output(server, *new_output);
 	server.outputs.emplace(output);
 
@@ -159,6 +222,7 @@ static void new_output_notify(wl_listener* listener, void* data) {
 	wlr_output_layout_add_auto(server.output_layout, new_output);
 
 	output->update_layout();
+	server.seat->cursor.load_theme(new_output->scale);
 }
 
 static void output_power_manager_set_mode_notify(wl_listener* listener, void* data) {
@@ -218,10 +282,20 @@ static void request_activation_notify(wl_listener* listener, void* data) {
 
 	auto* view = dynamic_cast<View*>(static_cast<Surface*>(xdg_surface->surface->data));
 	if (view != nullptr && xdg_surface->surface->mapped) {
+		server.launcher->token_activated(wlr_xdg_activation_token_v1_get_name(event->token), *view);
 		server.focus_view(view, xdg_surface->surface);
 	}
 }
 
+/* Tokens a client asked for, usually a launcher or shell about to start an
+ * application with it */
+static void activation_new_token_notify(wl_listener* listener, void* data) {
+	Server& server = magpie_container_of(listener, server, activation_new_token);
+	auto* token = static_cast<wlr_xdg_activation_token_v1*>(data);
+
+	server.launcher->token_issued(wlr_xdg_activation_token_v1_get_name(token));
+}
+
 static void drm_lease_notify(wl_listener* listener, void* data) {
 	Server& server = magpie_container_of(listener, server, drm_lease_request);
 	auto* request = static_cast<wlr_drm_lease_request_v1*>(data);
@@ -237,6 +311,7 @@ static void drm_lease_notify(wl_listener* listener, void* data) {
 		if (output == nullptr)
 			continue;
 
+		output->evacuate_views();
 		wlr_output_enable(&output->wlr, false);
 		wlr_output_commit(&output->wlr);
 		wlr_output_layout_remove(server.output_layout, &output->wlr);
@@ -246,9 +321,14 @@ static void drm_lease_notify(wl_listener* listener, void* data) {
 }
 
 void output_layout_change_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("output_layout_change");
 	Server& server = magpie_container_of(listener, server, output_layout_change);
 	(void) data;
 
+	for (auto* output : std::as_const(server.outputs)) {
+		output->update_layout();
+	}
+
 	if (server.num_pending_output_layout_changes > 0) {
 		return;
 	}
@@ -270,6 +350,7 @@ void output_layout_change_notify(wl_listener* listener, void* data) {
 }
 
 void output_manager_apply_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("output_manager_apply");
 	Server& server = magpie_container_of(listener, server, output_manager_apply);
 	auto& config = *static_cast<wlr_output_configuration_v1*>(data);
 
@@ -282,6 +363,10 @@ void output_manager_apply_notify(wl_listener* listener, void* data) {
 		const bool adding = enabled && !output.wlr.enabled;
 		const bool removing = !enabled && output.wlr.enabled;
 
+		if (removing) {
+			output.evacuate_views();
+		}
+
 		wlr_output_enable(&output.wlr, enabled);
 		if (enabled) {
 			if (head->state.mode) {
@@ -316,6 +401,10 @@ void output_manager_apply_notify(wl_listener* listener, void* data) {
 			}
 		}
 
+		if (enabled) {
+			output.update_layout();
+		}
+
 		if (removing) {
 			wlr_output_layout_remove(server.output_layout, &output.wlr);
 			output.scene_output = nullptr;
@@ -326,33 +415,83 @@ void output_manager_apply_notify(wl_listener* listener, void* data) {
 	wlr_output_configuration_v1_destroy(&config);
 
 	for (auto* output : server.outputs) {
-		wlr_xcursor_manager_load(server.seat->cursor.cursor_mgr, output->wlr.scale);
+		server.seat->cursor.load_theme(output->wlr.scale);
 	}
 
 	server.seat->cursor.reload_image();
 }
 
-Server::Server() : listeners(*this) {
+/* How long to wait for a first frame before setting up the rest anyway */
+static constexpr int DEFERRED_INIT_TIMEOUT_MS = 1000;
+
+static void deferred_xwayland_idle(void* data) {
+	auto& server = *static_cast<Server*>(data);
+
+	server.init_deferred_xwayland();
+}
+
+static void deferred_globals_idle(void* data) {
+	auto& server = *static_cast<Server*>(data);
+
+	server.init_deferred_globals();
+	/* A separate iteration, so input and frames queued meanwhile go first */
+	wl_event_loop_add_idle(wl_display_get_event_loop(server.display), deferred_xwayland_idle, &server);
+}
+
+static int deferred_init_timeout_notify(void* data) {
+	auto& server = *static_cast<Server*>(data);
+
+	wlr_log(WLR_INFO, "No frame presented yet, setting up the remaining globals anyway");
+	server.schedule_deferred_init();
+	return 0;
+}
+
+Server::Server(const ServerBackend backend_type) : listeners(*this), backend_type(backend_type) {
 	/* The Wayland display is managed by libwayland. It handles accepting
 	 * clients from the Unix socket, manging Wayland globals, and so on. */
 	display = wl_display_create();
 	assert(display);
 
-	session = wlr_session_create(display);
-	assert(session);
-
-	/* The backend is a wlroots feature which abstracts the underlying input and
-	 * output hardware. The autocreate option will choose the most suitable
-	 * backend based on the current environment, such as opening an X11 window
-	 * if an X11 server is running. */
-	backend = wlr_backend_autocreate(display, &session);
-	assert(backend);
+	/* Blocking setup work is handed to a few worker threads, see worker_pool.hpp
+	 * for what they are allowed to touch. */
+	workers = new WorkerPool(*this, std::clamp(std::thread::hardware_concurrency() / 2, 1U, 4U));
+	telemetry = new Telemetry(*this);
+	ipc = new IpcServer(*this);
+	launcher = new Launcher(*this);
+	config = new ConfigManager(*this);
+	input_recorder = new InputRecorder(*this);
+	protocol_capture = new ProtocolCapture(*this);
+	flight_recorder = new FlightRecorder(*this);
+	watchdog = new Watchdog(*this, config->current.watchdog.threshold_ms);
+	startup_mark("display");
+
+	if (backend_type == MAGPIE_BACKEND_HEADLESS) {
+		/* Outputs are added by whoever asked for a headless server, and
+		 * everything is rendered on the CPU so it runs without a GPU. */
+		backend = wlr_headless_backend_create(display);
+		assert(backend);
+		startup_mark("backend_create");
+
+		renderer = wlr_pixman_renderer_create();
+	} else {
+		session = wlr_session_create(display);
+		assert(session);
+
+		/* The backend is a wlroots feature which abstracts the underlying
+		 * input and output hardware. The autocreate option will choose the
+		 * most suitable backend based on the current environment, such as
+		 * opening an X11 window if an X11 server is running. */
+		backend = wlr_backend_autocreate(display, &session);
+		assert(backend);
+		startup_mark("backend_create");
+
+		/* Autocreates a renderer, either Pixman, GLES2 or Vulkan for us. The
+		 * user can also specify a renderer using the WLR_RENDERER env var. */
+		renderer = wlr_renderer_autocreate(backend);
+	}
 
-	/* Autocreates a renderer, either Pixman, GLES2 or Vulkan for us. The user
-	 * can also specify a renderer using the WLR_RENDERER env var.
-	 * The renderer is responsible for defining the various pixel formats it
+	/* The renderer is responsible for defining the various pixel formats it
 	 * supports for shared memory, this configures that for clients. */
-	renderer = wlr_renderer_autocreate(backend);
 	assert(renderer);
 	wlr_renderer_init_wl_display(renderer, display);
 
@@ -362,6 +501,7 @@ Server::Server() : listeners(*this) {
 	 * screen */
 	allocator = wlr_allocator_autocreate(backend, renderer);
 	assert(allocator);
+	startup_mark("renderer");
 
 	/* This creates some hands-off wlroots interfaces. The compositor is
 	 * necessary for clients to allocate surfaces, the subcompositor allows to
@@ -394,6 +534,7 @@ Server::Server() : listeners(*this) {
 	wl_signal_add(&output_power_manager->events.set_mode, &listeners.output_power_manager_set_mode);
 
 	seat = new Seat(*this);
+	startup_mark("core_globals");
 
 	/* Configure a listener to be notified when new outputs are available on the
 	 * backend. */
@@ -412,8 +553,15 @@ Server::Server() : listeners(*this) {
 		scene_layers[idx] = wlr_scene_tree_create(&scene->tree);
 		wlr_scene_node_raise_to_top(&scene_layers[idx]->node);
 	}
+	for (uint32_t idx = 0; idx < MAGPIE_WORKSPACE_COUNT; idx++) {
+		workspaces.push_back(new Workspace(*this, *scene_layers[MAGPIE_SCENE_LAYER_NORMAL], idx));
+	}
+	active_workspace = workspaces.front();
+	active_workspace->set_active(true);
+	transactions = new TransactionManager(*this);
 
 	scene_layout = wlr_scene_attach_output_layout(scene, output_layout);
+	startup_mark("scene");
 
 	auto* presentation = wlr_presentation_create(display, backend);
 	assert(presentation);
@@ -430,14 +578,37 @@ Server::Server() : listeners(*this) {
 	xdg_activation = wlr_xdg_activation_v1_create(display);
 	listeners.activation_request_activation.notify = request_activation_notify;
 	wl_signal_add(&xdg_activation->events.request_activate, &listeners.activation_request_activation);
+	listeners.activation_new_token.notify = activation_new_token_notify;
+	wl_signal_add(&xdg_activation->events.new_token, &listeners.activation_new_token);
 
-	wlr_data_control_manager_v1_create(display);
 	foreign_toplevel_manager = wlr_foreign_toplevel_manager_v1_create(display);
 
-	xwayland = new XWayland(*this);
-
 	wlr_viewporter_create(display);
 	wlr_single_pixel_buffer_manager_v1_create(display);
+	startup_mark("shell_globals");
+
+	/* Everything else waits until the first frame is on screen, or for the
+	 * fallback timer if no output shows up. */
+	deferred_init_timer = wl_event_loop_add_timer(wl_display_get_event_loop(display), deferred_init_timeout_notify, this);
+	wl_event_source_timer_update(deferred_init_timer, DEFERRED_INIT_TIMEOUT_MS);
+}
+
+void Server::schedule_deferred_init() {
+	if (deferred_init_scheduled) {
+		return;
+	}
+
+	deferred_init_scheduled = true;
+	wl_event_source_remove(deferred_init_timer);
+	deferred_init_timer = nullptr;
+	wl_event_loop_add_idle(wl_display_get_event_loop(display), deferred_globals_idle, this);
+}
+
+/* Globals that no client needs to draw its first frame. Clients already
+ * connected see them appear through the registry like any hotplugged global. */
+void Server::init_deferred_globals() {
+	MAGPIE_TRACE_SCOPE("init_deferred_globals");
+	wlr_data_control_manager_v1_create(display);
 	wlr_screencopy_manager_v1_create(display);
 	wlr_export_dmabuf_manager_v1_create(display);
 	wlr_gamma_control_manager_v1_create(display);
@@ -453,5 +624,113 @@ Server::Server() : listeners(*this) {
 	if (drm_manager != nullptr) {
 		listeners.drm_lease_request.notify = drm_lease_notify;
 		wl_signal_add(&drm_manager->events.request, &listeners.drm_lease_request);
+		for (const auto* output : std::as_const(outputs)) {
+			wlr_drm_lease_v1_manager_offer_output(drm_manager, &output->wlr);
+		}
+	}
+
+	startup_mark("deferred_globals");
+}
+
+void Server::init_deferred_xwayland() {
+	MAGPIE_TRACE_SCOPE("init_deferred_xwayland");
+	if (backend_type != MAGPIE_BACKEND_HEADLESS) {
+		xwayland = new XWayland(*this);
+		startup_mark("xwayland");
+	}
+
+	startup_deferred_done();
+	if (on_startup_complete) {
+		on_startup_complete();
+	}
+}
+
+/* Does what wl_display_run does, but waits for events itself, so the
+ * watchdog can tell an iteration that is busy from one that is asleep. */
+void Server::run() {
+	wl_event_loop* loop = wl_display_get_event_loop(display);
+	pollfd loop_fd = {wl_event_loop_get_fd(loop), POLLIN, 0};
+
+	running = true;
+	while (running) {
+		wl_event_loop_dispatch_idle(loop);
+		wl_display_flush_clients(display);
+
+		watchdog->idle();
+		if (poll(&loop_fd, 1, -1) < 0 && errno != EINTR) {
+			wlr_log_errno(WLR_ERROR, "Failed to wait for events");
+			break;
+		}
+		watchdog->busy();
+
+		wl_event_loop_dispatch(loop, 0);
+	}
+	watchdog->idle();
+}
+
+void Server::terminate() {
+	running = false;
+	wl_display_terminate(display);
+}
+
+void Server::set_global_filter(const wl_display_global_filter_func_t filter, void* data) {
+	global_filter = filter;
+	global_filter_data = data;
+	wl_display_set_global_filter(display, filter, data);
+}
+
+/* For tests, time stops following CLOCK_MONOTONIC and outputs only get the
+ * frames advance_clock hands out, so frame pacing no longer depends on how
+ * fast the machine is. */
+void Server::use_virtual_clock(const uint64_t now_ns) {
+	clock_set_virtual(now_ns);
+	for (auto* output : std::as_const(outputs)) {
+		output->next_frame_ns = 0;
 	}
 }
+
+void Server::use_real_clock() {
+	clock_set_real();
+	/* The backends stopped sending frames once they went unanswered */
+	for (auto* output : std::as_const(outputs)) {
+		wlr_output_schedule_frame(&output->wlr);
+	}
+}
+
+/* Moves virtual time forward, handing each enabled output the frames that
+ * fall due on the way in order, with the clock at each frame's time. An
+ * output's first frame is one interval after it was first seen here. Returns
+ * the number of frames handed out. */
+uint64_t Server::advance_clock(const uint64_t ns) {
+	const uint64_t end_ns = clock_now_ns() + ns;
+	uint64_t frames = 0;
+
+	while (true) {
+		const uint64_t now_ns = clock_now_ns();
+		Output* next = nullptr;
+		for (auto* output : std::as_const(outputs)) {
+			if (!output->wlr.enabled) {
+				continue;
+			}
+			if (output->next_frame_ns < now_ns) {
+				output->next_frame_ns = now_ns + output->frame_interval_ns();
+			}
+			if (next == nullptr || output->next_frame_ns < next->next_frame_ns) {
+				next = output;
+			}
+		}
+		if (next == nullptr || next->next_frame_ns > end_ns) {
+			break;
+		}
+
+		clock_advance_to(next->next_frame_ns);
+		next->next_frame_ns += next->frame_interval_ns();
+		next->frame_from_clock = true;
+		wlr_output_send_frame(&next->wlr);
+		next->frame_from_clock = false;
+		frames++;
+	}
+
+	clock_advance_to(end_ns);
+	return frames;
+}
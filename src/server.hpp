@@ -6,6 +6,7 @@
 #include <functional>
 #include <list>
 #include <set>
+#include <vector>
 
 #include "wlr-wrap-start.hpp"
 #include <wlr/backend/session.h>
@@ -31,6 +32,13 @@ typedef enum {
 	MAGPIE_SCENE_LAYER_LOCK
 } magpie_scene_layer_t;
 
+enum ServerBackend {
+	/* Whatever fits the environment: DRM, nested Wayland or X11 */
+	MAGPIE_BACKEND_AUTO,
+	/* No session, no inputs and pixman rendering, for benchmarks */
+	MAGPIE_BACKEND_HEADLESS,
+};
+
 class Server {
   public:
 	struct Listeners {
@@ -38,6 +46,7 @@ class Server {
 		wl_listener xdg_shell_new_xdg_surface = {};
 		wl_listener layer_shell_new_layer_surface = {};
 		wl_listener activation_request_activation = {};
+		wl_listener activation_new_token = {};
 		wl_listener backend_new_output = {};
 		wl_listener drm_lease_request = {};
 		wl_listener output_layout_change = {};
@@ -48,20 +57,38 @@ class Server {
 
   private:
 	Listeners listeners;
+	wl_event_source* deferred_init_timer = nullptr;
+	bool deferred_init_scheduled = false;
+	bool running = false;
+
+	void show_workspace(Workspace& workspace);
 
   public:
+	const ServerBackend backend_type;
 	wl_display* display;
-	wlr_session* session;
+	WorkerPool* workers;
+	Telemetry* telemetry;
+	IpcServer* ipc;
+	Launcher* launcher;
+	ConfigManager* config;
+	InputRecorder* input_recorder;
+	ProtocolCapture* protocol_capture;
+	FlightRecorder* flight_recorder;
+	Watchdog* watchdog;
+	wlr_session* session = nullptr;
 	wlr_backend* backend;
 	wlr_renderer* renderer;
 	wlr_allocator* allocator;
 	wlr_compositor* compositor;
 
-	XWayland* xwayland;
+	XWayland* xwayland = nullptr;
 
 	wlr_scene* scene;
 	wlr_scene_output_layout* scene_layout;
 	wlr_scene_tree* scene_layers[MAGPIE_SCENE_LAYER_LOCK + 1] = {};
+	std::vector<Workspace*> workspaces;
+	Workspace* active_workspace;
+	TransactionManager* transactions;
 
 	wlr_xdg_shell* xdg_shell;
 
@@ -74,6 +101,7 @@ class Server {
 	Seat* seat;
 
 	std::list<View*> views;
+	uint64_t next_view_id = 1;
 	View* focused_view = nullptr;
 	View* grabbed_view = nullptr;
 	double grab_x = 0.0, grab_y = 0.0;
@@ -86,15 +114,37 @@ class Server {
 	std::set<Output*> outputs;
 	uint8_t num_pending_output_layout_changes = 0;
 
-	wlr_idle_notifier_v1* idle_notifier;
-	wlr_idle_inhibit_manager_v1* idle_inhibit_manager;
+	wlr_idle_notifier_v1* idle_notifier = nullptr;
+	wlr_idle_inhibit_manager_v1* idle_inhibit_manager = nullptr;
+
+	wlr_drm_lease_v1_manager* drm_manager = nullptr;
 
-	wlr_drm_lease_v1_manager* drm_manager;
+	/* The display's global filter, which libwayland has no getter for. It is
+	 * only set through set_global_filter, so a new one can chain to it. */
+	wl_display_global_filter_func_t global_filter = nullptr;
+	void* global_filter_data = nullptr;
 
-	Server();
+	/* Called once the deferred globals and XWayland have been set up */
+	std::function<void()> on_startup_complete;
+
+	explicit Server(ServerBackend backend_type = MAGPIE_BACKEND_AUTO);
+
+	void run();
+	void terminate();
+
+	void set_global_filter(wl_display_global_filter_func_t filter, void* data);
+	void schedule_deferred_init();
+	void init_deferred_globals();
+	void init_deferred_xwayland();
 
 	Surface* surface_at(double lx, double ly, wlr_surface** wlr, double* sx, double* sy) const;
 	void focus_view(View* view, wlr_surface* surface = nullptr);
+	void refocus();
+	void set_active_workspace(Workspace& workspace);
+
+	void use_virtual_clock(uint64_t now_ns);
+	void use_real_clock();
+	uint64_t advance_clock(uint64_t ns);
 };
 
 #endif
@@ -0,0 +1,178 @@
+#include "stack.hpp"
+
+#include "ipc.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_scene.h>
+#include <wlr/xwayland.h>
+#include "wlr-wrap-end.hpp"
+
+/* Guards against clients that manage to build a cycle of transient parents. */
+static constexpr int MAX_TRANSIENT_DEPTH = 32;
+
+static const View& group_root(const View& view) {
+	const View* root = &view;
+	for (int depth = 0; depth < MAX_TRANSIENT_DEPTH; depth++) {
+		const View* parent = root->get_transient_parent();
+		if (parent == nullptr) {
+			break;
+		}
+		root = parent;
+	}
+
+	return *root;
+}
+
+/* Returns how many transient parents separate view from ancestor, or -1 if
+ * ancestor is not in the parent chain of view. */
+static int transient_depth(const View& view, const View& ancestor) {
+	const View* current = &view;
+	for (int depth = 0; depth < MAX_TRANSIENT_DEPTH && current != nullptr; depth++) {
+		if (current == &ancestor) {
+			return depth;
+		}
+		current = current->get_transient_parent();
+	}
+
+	return -1;
+}
+
+static void stack_restack_idle(void* data) {
+	auto& stack = *static_cast<Stack*>(data);
+
+	stack.flush_restack();
+}
+
+Stack::Stack(Server& server, wlr_scene_tree& parent) noexcept : server(server) {
+	tree = wlr_scene_tree_create(&parent);
+	for (int idx = 0; idx <= VIEW_BAND_ABOVE; idx++) {
+		band_trees[idx] = wlr_scene_tree_create(tree);
+		wlr_scene_node_raise_to_top(&band_trees[idx]->node);
+	}
+}
+
+Stack::~Stack() noexcept {
+	if (restack_idle != nullptr) {
+		wl_event_source_remove(restack_idle);
+	}
+}
+
+bool Stack::contains(const View& view) const {
+	return std::find(order.begin(), order.end(), &view) != order.end();
+}
+
+void Stack::add(View& view) {
+	if (!contains(view)) {
+		order.push_back(&view);
+	}
+
+	raise(view);
+}
+
+void Stack::remove(View& view) {
+	order.remove(&view);
+
+	/* The X11 windows around this one now have a different sibling, so the
+	 * cached siblings can no longer be trusted. */
+	restack_all = true;
+}
+
+/* Moves the transient group of view to the top of its band, with view and
+ * its own transients at the top of the group. */
+void Stack::raise(View& view) {
+	MAGPIE_TRACE_SCOPE("stack_raise");
+	if (!contains(view)) {
+		return;
+	}
+
+	const View& root = group_root(view);
+	const ViewBand band = root.band;
+
+	std::vector<View*> group;
+	std::vector<View*> raised;
+	for (auto it = order.begin(); it != order.end();) {
+		View* member = *it;
+		if (&group_root(*member) != &root) {
+			++it;
+			continue;
+		}
+
+		if (transient_depth(*member, view) >= 0) {
+			raised.push_back(member);
+		} else {
+			group.push_back(member);
+		}
+		it = order.erase(it);
+	}
+
+	/* Transients always stay above their parent, whatever order they were in. */
+	std::stable_sort(raised.begin(), raised.end(), [&view](const View* a, const View* b) {
+		return transient_depth(*a, view) < transient_depth(*b, view);
+	});
+	group.insert(group.end(), raised.begin(), raised.end());
+
+	const auto position = std::find_if(order.begin(), order.end(), [band](const View* other) {
+		return group_root(*other).band > band;
+	});
+	order.insert(position, group.begin(), group.end());
+
+	for (const View* member : std::as_const(group)) {
+		wlr_scene_node_reparent(member->scene_node, band_trees[band]);
+		wlr_scene_node_raise_to_top(member->scene_node);
+	}
+
+	schedule_restack();
+}
+
+void Stack::set_band(View& view, const ViewBand band) {
+	if (view.band == band) {
+		return;
+	}
+
+	view.band = band;
+	raise(view);
+	server.ipc->view_event(IPC_EVENT_VIEW_CHANGED, view);
+}
+
+void Stack::schedule_restack() {
+	if (restack_idle == nullptr) {
+		restack_idle = wl_event_loop_add_idle(wl_display_get_event_loop(server.display), stack_restack_idle, this);
+	}
+}
+
+void Stack::schedule_full_restack() {
+	restack_all = true;
+	schedule_restack();
+}
+
+/* Walks the stack once from the bottom, restacking only the X11 windows
+ * whose sibling below has changed since the last pass. */
+void Stack::flush_restack() {
+	MAGPIE_TRACE_SCOPE("stack_flush_restack");
+	restack_idle = nullptr;
+
+	wlr_xwayland_surface* below = nullptr;
+	for (View* view : std::as_const(order)) {
+		auto* xwayland_view = dynamic_cast<XWaylandView*>(view);
+		if (xwayland_view == nullptr) {
+			continue;
+		}
+
+		if (restack_all || xwayland_view->stacked_above != below) {
+			wlr_xwayland_surface* surface = &xwayland_view->xwayland_surface;
+			wlr_xwayland_surface_restack(surface, below, below == nullptr ? XCB_STACK_MODE_BELOW : XCB_STACK_MODE_ABOVE);
+			xwayland_view->stacked_above = below;
+		}
+
+		below = &xwayland_view->xwayland_surface;
+	}
+
+	restack_all = false;
+}
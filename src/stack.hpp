@@ -0,0 +1,43 @@
+#ifndef MAGPIE_STACK_HPP
+#define MAGPIE_STACK_HPP
+
+#include "types.hpp"
+
+#include <list>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_scene.h>
+#include "wlr-wrap-end.hpp"
+
+/* The stacking order of views, from bottom to top. Views are sorted into
+ * keep-below, normal and keep-above bands, chosen through keybindings, IPC or
+ * the initial _NET_WM_STATE of X11 windows, and transient views (dialogs) are
+ * always kept above their parent, so that raising any member of a transient
+ * group moves the whole group at once. X11 windows are restacked to match
+ * once per event loop iteration rather than once per change. */
+class Stack {
+	wl_event_source* restack_idle = nullptr;
+	bool restack_all = false;
+
+	[[nodiscard]] bool contains(const View& view) const;
+	void schedule_restack();
+
+  public:
+	Server& server;
+	wlr_scene_tree* tree;
+	wlr_scene_tree* band_trees[VIEW_BAND_ABOVE + 1] = {};
+	std::list<View*> order;
+
+	Stack(Server& server, wlr_scene_tree& parent) noexcept;
+	~Stack() noexcept;
+
+	void add(View& view);
+	void remove(View& view);
+	void raise(View& view);
+	void set_band(View& view, ViewBand band);
+	void schedule_full_restack();
+	void flush_restack();
+};
+
+#endif
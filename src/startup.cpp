@@ -0,0 +1,85 @@
+#include "startup.hpp"
+
+#include "clock.hpp"
+#include "json.hpp"
+#include "trace.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+struct StartupPhase {
+	std::string name;
+	uint64_t end_ns;
+};
+
+static std::vector<StartupPhase> phases;
+static uint64_t start_ns = 0;
+static bool frame_presented = false;
+static bool deferred_done = false;
+static bool summary_logged = false;
+
+static void log_summary() {
+	if (summary_logged || !frame_presented || !deferred_done) {
+		return;
+	}
+	summary_logged = true;
+
+	std::string summary;
+	uint64_t previous_ns = start_ns;
+	for (const auto& phase : phases) {
+		summary += " " + phase.name + "=" + std::to_string((phase.end_ns - previous_ns) / 1000) + "us";
+		previous_ns = phase.end_ns;
+	}
+
+	wlr_log(WLR_INFO, "Startup took %.1fms:%s", static_cast<double>(previous_ns - start_ns) / 1e6, summary.c_str());
+}
+
+void startup_mark(const char* phase) {
+	const uint64_t now = monotonic_ns();
+	if (start_ns == 0) {
+		start_ns = now;
+	}
+
+	MAGPIE_TRACE_INSTANT("startup", phase);
+	phases.push_back({phase, now});
+}
+
+void startup_frame_presented(const char* output_name) {
+	if (frame_presented) {
+		return;
+	}
+
+	startup_mark((std::string("first_frame_presented:") + output_name).c_str());
+	frame_presented = true;
+	log_summary();
+}
+
+void startup_deferred_done() {
+	startup_mark("deferred_done");
+	deferred_done = true;
+	log_summary();
+}
+
+bool startup_frame_pending() {
+	return !frame_presented;
+}
+
+/* Durations are in microseconds, end times are relative to the start of main. */
+void startup_write_json(JsonWriter& json) {
+	json.begin_array();
+	uint64_t previous_ns = start_ns;
+	for (const auto& phase : phases) {
+		json.begin_object();
+		json.key("phase").value(phase.name);
+		json.key("duration_us").value((phase.end_ns - previous_ns) / 1000);
+		json.key("end_us").value((phase.end_ns - start_ns) / 1000);
+		json.end_object();
+		previous_ns = phase.end_ns;
+	}
+	json.end_array();
+}
@@ -0,0 +1,16 @@
+#ifndef MAGPIE_STARTUP_HPP
+#define MAGPIE_STARTUP_HPP
+
+#include "json.hpp"
+
+/* Records when each startup phase finished, relative to the start of main, up
+ * to the first frame presented on any output. A summary is logged once that
+ * frame was presented and the deferred setup has run, whichever comes last.
+ * Only called from the main thread. */
+void startup_mark(const char* phase);
+void startup_frame_presented(const char* output_name);
+void startup_deferred_done();
+[[nodiscard]] bool startup_frame_pending();
+void startup_write_json(JsonWriter& json);
+
+#endif
@@ -4,6 +4,8 @@
 #include "popup.hpp"
 #include "server.hpp"
 #include "surface.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 #include "types.hpp"
 
 #include "wlr-wrap-start.hpp"
@@ -48,6 +50,7 @@ LayerSubsurface::~LayerSubsurface() noexcept {
 
 /* Called when the surface is mapped, or ready to display on-screen. */
 static void wlr_layer_surface_v1_map_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("layer_map");
 	Layer& layer = magpie_container_of(listener, layer, map);
 	(void) data;
 
@@ -72,12 +75,15 @@ static void wlr_layer_surface_v1_destroy_notify(wl_listener* listener, void* dat
 }
 
 static void wlr_layer_surface_v1_commit_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("layer_commit");
 	Layer& layer = magpie_container_of(listener, layer, commit);
 	(void) data;
 
 	const Server& server = layer.output.server;
 	const wlr_layer_surface_v1& surface = layer.layer_surface;
 
+	server.telemetry->surface_commit();
+
 	const uint32_t committed = surface.current.committed;
 	if (committed & WLR_LAYER_SURFACE_V1_STATE_LAYER) {
 		const magpie_scene_layer_t chosen_layer = magpie_layer_from_wlr_layer(surface.current.layer);
@@ -1,6 +1,7 @@
 #ifndef MAGPIE_LAYER_HPP
 #define MAGPIE_LAYER_HPP
 
+#include "live_objects.hpp"
 #include "surface.hpp"
 #include "types.hpp"
 #include <set>
@@ -24,6 +25,7 @@ class Layer final : public Surface {
 
   private:
 	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_LAYER> live;
 
   public:
 	Server& server;
@@ -55,6 +57,7 @@ class LayerSubsurface {
 
   private:
 	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_LAYER_SUBSURFACE> live;
 
   public:
 	Layer& parent;
@@ -1,6 +1,7 @@
 #include "popup.hpp"
 
 #include "surface.hpp"
+#include "trace.hpp"
 #include "types.hpp"
 
 static void popup_map_notify(wl_listener* listener, void* data) {
@@ -21,6 +22,7 @@ static void popup_destroy_notify(wl_listener* listener, void* data) {
 }
 
 static void popup_commit_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("popup_commit");
 	(void) listener;
 	(void) data;
 }
@@ -2,6 +2,7 @@
 #define MAGPIE_POPUP_HPP
 
 #include "surface.hpp"
+#include "live_objects.hpp"
 #include "types.hpp"
 
 #include "wlr-wrap-start.hpp"
@@ -22,6 +23,7 @@ class Popup final : public Surface {
 
   private:
 	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_POPUP> live;
 
   public:
 	Server& server;
@@ -2,9 +2,15 @@
 
 #include "foreign_toplevel.hpp"
 #include "input/seat.hpp"
+#include "ipc.hpp"
 #include "output.hpp"
 #include "server.hpp"
 #include "types.hpp"
+#include "workspace.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
 
 #include "wlr-wrap-start.hpp"
 #include <wlr/types/wlr_compositor.h>
@@ -103,8 +109,12 @@ void View::set_position(const int new_x, const int new_y) {
 	}
 	current.x = new_x;
 	current.y = std::max(new_y, 0);
-	wlr_scene_node_set_position(scene_node, current.x, current.y);
+	/* Minimized X11 views have no scene node until they map again */
+	if (scene_node != nullptr) {
+		wlr_scene_node_set_position(scene_node, current.x, current.y);
+	}
 	impl_set_position(new_x, new_y);
+	get_server().ipc->view_event(IPC_EVENT_VIEW_CHANGED, *this);
 }
 
 void View::set_size(const int new_width, const int new_height) {
@@ -115,6 +125,7 @@ void View::set_size(const int new_width, const int new_height) {
 	current.width = new_width;
 	current.height = new_height;
 	impl_set_size(new_width, new_height);
+	get_server().ipc->view_event(IPC_EVENT_VIEW_CHANGED, *this);
 }
 
 void View::set_activated(const bool activated) {
@@ -160,6 +171,7 @@ void View::set_placement(const ViewPlacement new_placement, const bool force) {
 		if (toplevel_handle.has_value()) {
 			toplevel_handle->set_placement(new_placement);
 		}
+		server.ipc->view_event(IPC_EVENT_VIEW_CHANGED, *this);
 	}
 }
 
@@ -209,15 +221,50 @@ void View::set_minimized(const bool minimized) {
 	}
 	impl_set_minimized(minimized);
 	this->is_minimized = minimized;
+	get_server().ipc->view_event(IPC_EVENT_VIEW_CHANGED, *this);
 
 	if (minimized) {
 		unmap();
 		set_activated(false);
-	} else {
+	} else if (const wlr_surface* surface = get_wlr_surface(); surface != nullptr && surface->mapped) {
+		/* Otherwise it is shown once its client maps it again */
 		map();
 	}
 }
 
+/* Moves the view and its stacking order to another workspace, handing focus
+ * over if it was focused and is leaving the active workspace. */
+void View::set_workspace(Workspace& new_workspace) {
+	if (workspace == &new_workspace) {
+		return;
+	}
+
+	Server& server = get_server();
+
+	if (workspace != nullptr) {
+		workspace->stack.remove(*this);
+	}
+	workspace = &new_workspace;
+	if (scene_node != nullptr) {
+		new_workspace.stack.add(*this);
+	}
+	server.ipc->view_event(IPC_EVENT_VIEW_CHANGED, *this);
+
+	/* Transients follow their parent. Moving them can change focus, which
+	 * reorders server.views, so collect them first. */
+	std::vector<View*> transients;
+	std::copy_if(server.views.begin(), server.views.end(), std::back_inserter(transients), [this](const View* view) {
+		return view->get_transient_parent() == this;
+	});
+	for (auto* view : transients) {
+		view->set_workspace(new_workspace);
+	}
+
+	if (this == server.focused_view && workspace != server.active_workspace) {
+		server.refocus();
+	}
+}
+
 void View::toggle_maximize() {
 	if (curr_placement != VIEW_PLACEMENT_FULLSCREEN) {
 		set_placement(curr_placement != VIEW_PLACEMENT_MAXIMIZED ? VIEW_PLACEMENT_MAXIMIZED : VIEW_PLACEMENT_STACKING);
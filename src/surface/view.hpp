@@ -3,6 +3,8 @@
 
 #include "foreign_toplevel.hpp"
 #include "input/cursor.hpp"
+#include "launcher.hpp"
+#include "live_objects.hpp"
 #include "surface.hpp"
 #include "types.hpp"
 
@@ -15,35 +17,48 @@
 #include "wlr-wrap-end.hpp"
 
 struct View : Surface {
+	/* Stable handle for IPC clients, never reused within a session */
+	uint64_t id = 0;
 	ViewPlacement prev_placement = VIEW_PLACEMENT_STACKING;
 	ViewPlacement curr_placement = VIEW_PLACEMENT_STACKING;
 	bool is_minimized = false;
+	ViewBand band = VIEW_BAND_NORMAL;
+	Workspace* workspace = nullptr;
 	wlr_box current;
 	wlr_box pending;
 	wlr_box previous;
 	std::optional<ForeignToplevelHandle> toplevel_handle = {};
+	LaunchTimes launch = {};
 
 	~View() noexcept override = default;
 
 	[[nodiscard]] virtual wlr_box get_geometry() const = 0;
+	[[nodiscard]] virtual View* get_transient_parent() const = 0;
+	[[nodiscard]] virtual const char* get_title() const = 0;
+	[[nodiscard]] virtual const char* get_app_id() const = 0;
 	virtual void map() = 0;
 	virtual void unmap() = 0;
 	virtual void close() = 0;
+	/* Sends the client a configure for new layout geometry without touching
+	 * the scene. Returns the serial to wait for, or 0 if nothing was sent. */
+	virtual uint32_t send_configure(const wlr_box& geometry) = 0;
+	[[nodiscard]] virtual bool has_committed(uint32_t serial, const wlr_box& geometry) const = 0;
 
 	[[nodiscard]] constexpr bool is_view() const override {
 		return true;
 	}
+	[[nodiscard]] std::optional<const Output*> find_output_for_maximize() const;
 	void begin_interactive(CursorMode mode, uint32_t edges);
 	void set_position(int new_x, int new_y);
 	void set_size(int new_width, int new_height);
 	void set_activated(bool activated);
 	void set_placement(ViewPlacement new_placement, bool force = false);
 	void set_minimized(bool minimized);
+	void set_workspace(Workspace& new_workspace);
 	void toggle_maximize();
 	void toggle_fullscreen();
 
   private:
-	[[nodiscard]] std::optional<const Output*> find_output_for_maximize() const;
 	void stack();
 	bool maximize();
 	bool fullscreen();
@@ -78,6 +93,8 @@ class XdgView final : public View {
 
   private:
 	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_XDG_VIEW> live;
+	bool pending_initial_configure = true;
 	bool pending_map = true;
 
   public:
@@ -90,9 +107,15 @@ class XdgView final : public View {
 	[[nodiscard]] constexpr wlr_surface* get_wlr_surface() const override;
 	[[nodiscard]] constexpr Server& get_server() const override;
 	[[nodiscard]] wlr_box get_geometry() const override;
+	[[nodiscard]] View* get_transient_parent() const override;
+	[[nodiscard]] const char* get_title() const override;
+	[[nodiscard]] const char* get_app_id() const override;
+	void commit();
 	void map() override;
 	void unmap() override;
 	void close() override;
+	uint32_t send_configure(const wlr_box& geometry) override;
+	[[nodiscard]] bool has_committed(uint32_t serial, const wlr_box& geometry) const override;
 
   protected:
 	void impl_set_position(int new_x, int new_y) override;
@@ -101,6 +124,9 @@ class XdgView final : public View {
 	void impl_set_fullscreen(bool fullscreen) override;
 	void impl_set_maximized(bool maximized) override;
 	void impl_set_minimized(bool minimized) override;
+
+  private:
+	void prepare_initial_configure();
 };
 
 class XWaylandView final : public View {
@@ -125,10 +151,15 @@ class XWaylandView final : public View {
 
   private:
 	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_XWAYLAND_VIEW> live;
+	wl_event_source* configure_idle = nullptr;
+	/* Whether the pending configure answers a ConfigureRequest */
+	bool configure_requested = false;
 
   public:
 	Server& server;
 	wlr_xwayland_surface& xwayland_surface;
+	std::optional<wlr_xwayland_surface*> stacked_above = {};
 
 	XWaylandView(Server& server, wlr_xwayland_surface& surface) noexcept;
 	~XWaylandView() noexcept override;
@@ -136,9 +167,17 @@ class XWaylandView final : public View {
 	[[nodiscard]] constexpr wlr_surface* get_wlr_surface() const override;
 	[[nodiscard]] constexpr Server& get_server() const override;
 	[[nodiscard]] constexpr wlr_box get_geometry() const override;
+	[[nodiscard]] View* get_transient_parent() const override;
+	[[nodiscard]] const char* get_title() const override;
+	[[nodiscard]] const char* get_app_id() const override;
 	void map() override;
 	void unmap() override;
 	void close() override;
+	uint32_t send_configure(const wlr_box& geometry) override;
+	[[nodiscard]] bool has_committed(uint32_t serial, const wlr_box& geometry) const override;
+	[[nodiscard]] bool configure_pending() const;
+	void schedule_configure(bool requested = false);
+	void flush_configure();
 
   protected:
 	void impl_set_position(int new_x, int new_y) override;
@@ -1,10 +1,17 @@
 #include "types.hpp"
 #include "view.hpp"
 
+#include "clock.hpp"
 #include "foreign_toplevel.hpp"
+#include "ipc.hpp"
+#include "launcher.hpp"
 #include "output.hpp"
 #include "server.hpp"
 #include "surface.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+#include "transaction.hpp"
+#include "workspace.hpp"
 #include "input/seat.hpp"
 
 #include "wlr-wrap-start.hpp"
@@ -13,6 +20,7 @@
 
 /* Called when the surface is mapped, or ready to display on-screen. */
 static void xdg_toplevel_map_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xdg_map");
 	XdgView& view = magpie_container_of(listener, view, map);
 	(void) data;
 
@@ -21,18 +29,32 @@ static void xdg_toplevel_map_notify(wl_listener* listener, void* data) {
 
 /* Called when the surface is unmapped, and should no longer be shown. */
 static void xdg_toplevel_unmap_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xdg_unmap");
 	XdgView& view = magpie_container_of(listener, view, unmap);
 	(void) data;
 
 	view.unmap();
 }
 
+/* Called when the client commits new surface state. */
+static void xdg_toplevel_commit_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xdg_commit");
+	XdgView& view = magpie_container_of(listener, view, commit);
+	(void) data;
+
+	view.commit();
+}
+
 /* Called when the surface is destroyed and should never be shown again. */
 static void xdg_toplevel_destroy_notify(wl_listener* listener, void* data) {
 	XdgView& view = magpie_container_of(listener, view, destroy);
 	(void) data;
 
 	view.server.views.remove(&view);
+	view.server.telemetry->update_views();
+	view.server.ipc->view_event(IPC_EVENT_VIEW_DESTROYED, view);
+	view.workspace->stack.remove(view);
+	view.server.transactions->view_destroyed(view);
 	delete &view;
 }
 
@@ -66,6 +88,7 @@ static void xdg_toplevel_request_resize_notify(wl_listener* listener, void* data
  * typically because the user clicked on the maximize button on
  * client-side decorations. */
 static void xdg_toplevel_request_maximize_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xdg_request_maximize");
 	XdgView& view = magpie_container_of(listener, view, request_maximize);
 	(void) data;
 
@@ -74,6 +97,7 @@ static void xdg_toplevel_request_maximize_notify(wl_listener* listener, void* da
 }
 
 static void xdg_toplevel_request_fullscreen_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xdg_request_fullscreen");
 	XdgView& view = magpie_container_of(listener, view, request_fullscreen);
 	(void) data;
 
@@ -94,6 +118,7 @@ static void xdg_toplevel_set_title_notify(wl_listener* listener, void* data) {
 	(void) data;
 
 	view.toplevel_handle->set_title(view.xdg_toplevel.title);
+	view.server.ipc->view_event(IPC_EVENT_VIEW_CHANGED, view);
 }
 
 static void xdg_toplevel_set_app_id_notify(wl_listener* listener, void* data) {
@@ -101,18 +126,23 @@ static void xdg_toplevel_set_app_id_notify(wl_listener* listener, void* data) {
 	(void) data;
 
 	view.toplevel_handle->set_app_id(view.xdg_toplevel.app_id);
+	view.server.ipc->view_event(IPC_EVENT_VIEW_CHANGED, view);
 }
 
 static void xdg_toplevel_set_parent_notify(wl_listener* listener, void* data) {
 	XdgView& view = magpie_container_of(listener, view, set_parent);
 	(void) data;
 
-	if (view.xdg_toplevel.parent != nullptr) {
-		const auto* m_view = dynamic_cast<View*>(static_cast<Surface*>(view.xdg_toplevel.parent->base->data));
-		if (m_view != nullptr) {
-			view.toplevel_handle->set_parent(m_view->toplevel_handle);
-			return;
-		}
+	/* Keep the view stacked with its new transient group */
+	const auto* m_view = view.get_transient_parent();
+	if (m_view != nullptr && m_view->workspace != nullptr) {
+		view.set_workspace(*m_view->workspace);
+	}
+	view.workspace->stack.raise(view);
+
+	if (m_view != nullptr) {
+		view.toplevel_handle->set_parent(m_view->toplevel_handle);
+		return;
 	}
 
 	view.toplevel_handle->set_parent({});
@@ -120,7 +150,13 @@ static void xdg_toplevel_set_parent_notify(wl_listener* listener, void* data) {
 
 XdgView::XdgView(Server& server, wlr_xdg_toplevel& toplevel) noexcept
 	: listeners(*this), server(server), xdg_toplevel(toplevel) {
-	auto* scene_tree = wlr_scene_xdg_surface_create(&server.scene->tree, toplevel.base);
+	id = server.next_view_id++;
+
+	/* Dialogs open on the workspace of their parent */
+	const auto* parent_view = get_transient_parent();
+	workspace = parent_view != nullptr && parent_view->workspace != nullptr ? parent_view->workspace : server.active_workspace;
+
+	auto* scene_tree = wlr_scene_xdg_surface_create(workspace->stack.band_trees[VIEW_BAND_NORMAL], toplevel.base);
 	scene_node = &scene_tree->node;
 
 	wlr_xdg_toplevel_set_wm_capabilities(&toplevel, WLR_XDG_TOPLEVEL_WM_CAPABILITIES_MAXIMIZE |
@@ -135,11 +171,9 @@ XdgView::XdgView(Server& server, wlr_xdg_toplevel& toplevel) noexcept
 	toplevel_handle->set_title(xdg_toplevel.title);
 	toplevel_handle->set_app_id(xdg_toplevel.app_id);
 
-	if (xdg_toplevel.parent != nullptr) {
-		auto* m_view = dynamic_cast<View*>(static_cast<Surface*>(xdg_toplevel.parent->base->data));
-		if (m_view != nullptr) {
-			toplevel_handle->set_parent(m_view->toplevel_handle.value());
-		}
+	const auto* m_view = get_transient_parent();
+	if (m_view != nullptr) {
+		toplevel_handle->set_parent(m_view->toplevel_handle.value());
 	}
 
 	listeners.map.notify = xdg_toplevel_map_notify;
@@ -148,6 +182,8 @@ XdgView::XdgView(Server& server, wlr_xdg_toplevel& toplevel) noexcept
 	wl_signal_add(&toplevel.base->surface->events.unmap, &listeners.unmap);
 	listeners.destroy.notify = xdg_toplevel_destroy_notify;
 	wl_signal_add(&toplevel.base->events.destroy, &listeners.destroy);
+	listeners.commit.notify = xdg_toplevel_commit_notify;
+	wl_signal_add(&toplevel.base->surface->events.commit, &listeners.commit);
 	listeners.request_move.notify = xdg_toplevel_request_move_notify;
 	wl_signal_add(&xdg_toplevel.events.request_move, &listeners.request_move);
 	listeners.request_resize.notify = xdg_toplevel_request_resize_notify;
@@ -165,17 +201,24 @@ XdgView::XdgView(Server& server, wlr_xdg_toplevel& toplevel) noexcept
 	listeners.set_parent.notify = xdg_toplevel_set_parent_notify;
 	wl_signal_add(&xdg_toplevel.events.set_parent, &listeners.set_parent);
 
+	pid_t pid = 0;
+	wl_client_get_credentials(wl_resource_get_client(toplevel.resource), &pid, nullptr, nullptr);
+	server.launcher->view_created(*this, pid);
+
 	server.views.push_back(this);
+	workspace->stack.add(*this);
 }
 
 XdgView::~XdgView() noexcept {
 	wl_list_remove(&listeners.map.link);
 	wl_list_remove(&listeners.unmap.link);
 	wl_list_remove(&listeners.destroy.link);
+	wl_list_remove(&listeners.commit.link);
 	wl_list_remove(&listeners.request_move.link);
 	wl_list_remove(&listeners.request_resize.link);
 	wl_list_remove(&listeners.request_maximize.link);
 	wl_list_remove(&listeners.request_minimize.link);
+	wl_list_remove(&listeners.request_fullscreen.link);
 	wl_list_remove(&listeners.set_title.link);
 	wl_list_remove(&listeners.set_app_id.link);
 	wl_list_remove(&listeners.set_parent.link);
@@ -195,17 +238,82 @@ wlr_box XdgView::get_geometry() const {
 	return box;
 }
 
+View* XdgView::get_transient_parent() const {
+	if (xdg_toplevel.parent == nullptr) {
+		return nullptr;
+	}
+
+	return dynamic_cast<View*>(static_cast<Surface*>(xdg_toplevel.parent->base->surface->data));
+}
+
+const char* XdgView::get_title() const {
+	return xdg_toplevel.title;
+}
+
+const char* XdgView::get_app_id() const {
+	return xdg_toplevel.app_id;
+}
+
+void XdgView::commit() {
+	/* The initial commit, which carries no buffer yet */
+	if (launch.first_commit_ns == 0) {
+		launch.first_commit_ns = clock_now_ns();
+	}
+	if (pending_initial_configure) {
+		pending_initial_configure = false;
+		prepare_initial_configure();
+	}
+
+	server.transactions->view_committed(*this);
+	server.telemetry->surface_commit();
+}
+
+/* The initial commit comes before the first configure is sent, so deciding
+ * the output, size and placement here means the first buffer the client
+ * renders already has its final size. */
+void XdgView::prepare_initial_configure() {
+	current = {0, 0, 0, 0};
+	previous = {0, 0, 0, 0};
+
+	const auto output = find_output_for_maximize();
+	if (!output.has_value()) {
+		return;
+	}
+
+	const wlr_box usable_area = output.value()->usable_area_in_layout_coords();
+	if (wl_resource_get_version(xdg_toplevel.resource) >= XDG_TOPLEVEL_CONFIGURE_BOUNDS_SINCE_VERSION) {
+		wlr_xdg_toplevel_set_bounds(&xdg_toplevel, usable_area.width, usable_area.height);
+	}
+
+	if (xdg_toplevel.requested.fullscreen || xdg_toplevel.requested.maximized) {
+		/* Its own size is not known yet, so a view that starts out maximized
+		 * or fullscreen is restored to half the usable area, centered */
+		current = {usable_area.x + usable_area.width / 4, usable_area.y + usable_area.height / 4, usable_area.width / 2,
+			usable_area.height / 2};
+		previous = current;
+	}
+	if (xdg_toplevel.requested.fullscreen) {
+		set_placement(VIEW_PLACEMENT_FULLSCREEN, true);
+	} else if (xdg_toplevel.requested.maximized) {
+		set_placement(VIEW_PLACEMENT_MAXIMIZED, true);
+	}
+}
+
 void XdgView::map() {
 	if (pending_map) {
-		previous = {0, 0, 0, 0};
-		wlr_xdg_surface_get_geometry(xdg_toplevel.base, &current);
-
-		if (!server.outputs.empty()) {
-			const auto output = static_cast<Output*>(wlr_output_layout_get_center_output(server.output_layout)->data);
-			const auto usable_area = output->usable_area_in_layout_coords();
-			const auto center_x = usable_area.x + usable_area.width / 2;
-			const auto center_y = usable_area.y + usable_area.height / 2;
-			set_position(center_x - current.width / 2, center_y - current.height / 2);
+		/* Maximized and fullscreen views were already placed before the
+		 * first configure, only stacking views still need centering. */
+		if (curr_placement == VIEW_PLACEMENT_STACKING) {
+			previous = {0, 0, 0, 0};
+			wlr_xdg_surface_get_geometry(xdg_toplevel.base, &current);
+
+			const auto output = find_output_for_maximize();
+			if (output.has_value()) {
+				const auto usable_area = output.value()->usable_area_in_layout_coords();
+				const auto center_x = usable_area.x + usable_area.width / 2;
+				const auto center_y = usable_area.y + usable_area.height / 2;
+				set_position(center_x - current.width / 2, center_y - current.height / 2);
+			}
 		}
 
 		pending_map = false;
@@ -221,11 +329,23 @@ void XdgView::map() {
 	}
 
 	server.focus_view(this);
+	server.telemetry->update_views();
+	server.ipc->view_event(IPC_EVENT_VIEW_MAPPED, *this);
+	server.launcher->view_mapped(*this);
 }
 
 void XdgView::unmap() {
 	wlr_scene_node_set_enabled(scene_node, false);
 
+	/* Unless it is being minimized, the client attached a null buffer and
+	 * starts over with another initial commit, like a new toplevel */
+	if (!is_minimized) {
+		pending_initial_configure = true;
+		pending_map = true;
+		prev_placement = VIEW_PLACEMENT_STACKING;
+		curr_placement = VIEW_PLACEMENT_STACKING;
+	}
+
 	/* Reset the cursor mode if the grabbed view was unmapped. */
 	if (this == server.grabbed_view) {
 		server.seat->cursor.reset_mode();
@@ -233,13 +353,33 @@ void XdgView::unmap() {
 
 	if (this == server.focused_view) {
 		server.focused_view = nullptr;
+		server.ipc->event(IPC_EVENT_FOCUS_CHANGED);
 	}
+
+	server.telemetry->update_views();
+	server.ipc->view_event(IPC_EVENT_VIEW_UNMAPPED, *this);
+	server.launcher->view_unmapped(*this);
 }
 
 void XdgView::close() {
 	wlr_xdg_toplevel_send_close(&xdg_toplevel);
 }
 
+uint32_t XdgView::send_configure(const wlr_box& geometry) {
+	if (geometry.width == current.width && geometry.height == current.height) {
+		return 0;
+	}
+
+	return wlr_xdg_toplevel_set_size(&xdg_toplevel, geometry.width, geometry.height);
+}
+
+bool XdgView::has_committed(const uint32_t serial, const wlr_box& geometry) const {
+	(void) geometry;
+
+	/* Serials wrap around, so compare them the same way the protocol does */
+	return serial == 0 || static_cast<int32_t>(xdg_toplevel.base->current.configure_serial - serial) >= 0;
+}
+
 void XdgView::impl_set_position(const int new_x, const int new_y) {
 	(void) new_x;
 	(void) new_y;
@@ -2,10 +2,18 @@
 
 #include "foreign_toplevel.hpp"
 #include "input/seat.hpp"
+#include "ipc.hpp"
+#include "launcher.hpp"
 #include "server.hpp"
 #include "surface.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+#include "transaction.hpp"
 #include "types.hpp"
+#include "workspace.hpp"
+#include "xwayland.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 #include <wayland-server-core.h>
 
@@ -15,6 +23,7 @@
 
 /* Called when the surface is mapped, or ready to display on-screen. */
 static void xwayland_surface_map_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xwayland_map");
 	XWaylandView& view = magpie_container_of(listener, view, map);
 	(void) data;
 
@@ -23,47 +32,71 @@ static void xwayland_surface_map_notify(wl_listener* listener, void* data) {
 
 /* Called when the surface is unmapped, and should no longer be shown. */
 static void xwayland_surface_unmap_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xwayland_unmap");
 	XWaylandView& view = magpie_container_of(listener, view, unmap);
 	(void) data;
 
 	view.unmap();
 }
 
+/* Called when the client commits new surface state. */
+static void xwayland_surface_commit_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xwayland_commit");
+	XWaylandView& view = magpie_container_of(listener, view, commit);
+	(void) data;
+
+	view.server.transactions->view_committed(view);
+	view.server.telemetry->surface_commit();
+}
+
 /* Called when the surface is destroyed and should never be shown again. */
 static void xwayland_surface_destroy_notify(wl_listener* listener, void* data) {
 	XWaylandView& view = magpie_container_of(listener, view, destroy);
 	(void) data;
 
 	view.server.views.remove(&view);
+	view.server.transactions->view_destroyed(view);
+	view.server.ipc->view_event(IPC_EVENT_VIEW_DESTROYED, view);
 	delete &view;
 }
 
+/* Configure requests are not answered immediately. Clients such as Java and
+ * Wine send bursts of them while laying out, so we only record the latest
+ * geometry here and answer once per event loop iteration. */
 static void xwayland_surface_request_configure_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xwayland_request_configure");
 	XWaylandView& view = magpie_container_of(listener, view, request_configure);
-
-	wlr_xwayland_surface& surface = view.xwayland_surface;
 	const auto* event = static_cast<wlr_xwayland_surface_configure_event*>(data);
 
-	wlr_xwayland_surface_configure(&surface, event->x, event->y, event->width, event->height);
 	view.current = {event->x, event->y, event->width, event->height};
-
-	if (surface.surface->mapped) {
-		wlr_scene_node_set_position(view.scene_node, event->x, event->y);
-	}
+	view.schedule_configure(true);
 }
 
 static void xwayland_surface_set_geometry_notify(wl_listener* listener, void* data) {
+	MAGPIE_TRACE_SCOPE("xwayland_set_geometry");
 	XWaylandView& view = magpie_container_of(listener, view, set_geometry);
 	(void) data;
 
 	const wlr_xwayland_surface& surface = view.xwayland_surface;
 
+	if (view.configure_pending()) {
+		/* Our own configure is about to overwrite this geometry anyway. */
+		return;
+	}
+
 	view.current = {surface.x, surface.y, surface.width, surface.height};
-	if (surface.surface->mapped) {
+	if (surface.surface != nullptr && surface.surface->mapped) {
 		wlr_scene_node_set_position(view.scene_node, view.current.x, view.current.y);
+		view.server.ipc->view_event(IPC_EVENT_VIEW_CHANGED, view);
 	}
 }
 
+static void xwayland_surface_configure_idle(void* data) {
+	auto& view = *static_cast<XWaylandView*>(data);
+
+	view.flush_configure();
+}
+
 /* This event is raised when a client would like to begin an interactive
  * move, typically because the user clicked on their client-side
  * decorations. Note that a more sophisticated compositor should check the
@@ -111,6 +144,7 @@ static void xwayland_surface_set_title_notify(wl_listener* listener, void* data)
 	if (view.toplevel_handle.has_value()) {
 		view.toplevel_handle->set_title(view.xwayland_surface.title);
 	}
+	view.server.ipc->view_event(IPC_EVENT_VIEW_CHANGED, view);
 }
 
 static void xwayland_surface_set_class_notify(wl_listener* listener, void* data) {
@@ -120,21 +154,27 @@ static void xwayland_surface_set_class_notify(wl_listener* listener, void* data)
 	if (view.toplevel_handle.has_value()) {
 		view.toplevel_handle->set_app_id(view.xwayland_surface._class);
 	}
+	view.server.ipc->view_event(IPC_EVENT_VIEW_CHANGED, view);
 }
 
 static void xwayland_surface_set_parent_notify(wl_listener* listener, void* data) {
 	XWaylandView& view = magpie_container_of(listener, view, set_parent);
 	(void) data;
 
-	if (view.xwayland_surface.parent != nullptr) {
-		auto* m_view = dynamic_cast<View*>(static_cast<Surface*>(view.xwayland_surface.parent->data));
-		if (m_view != nullptr && view.scene_node != nullptr) {
-			wlr_scene_node_reparent(view.scene_node, m_view->scene_node->parent);
-			if (view.toplevel_handle.has_value() && m_view->toplevel_handle.has_value()) {
-				view.toplevel_handle->set_parent(m_view->toplevel_handle.value());
-			}
-			return;
+	/* Keep the view stacked with its new transient group */
+	const auto* m_view = view.get_transient_parent();
+	if (m_view != nullptr && m_view->workspace != nullptr) {
+		view.set_workspace(*m_view->workspace);
+	}
+	if (view.workspace != nullptr) {
+		view.workspace->stack.raise(view);
+	}
+
+	if (m_view != nullptr) {
+		if (view.toplevel_handle.has_value() && m_view->toplevel_handle.has_value()) {
+			view.toplevel_handle->set_parent(m_view->toplevel_handle.value());
 		}
+		return;
 	}
 
 	if (view.toplevel_handle.has_value()) {
@@ -145,6 +185,9 @@ static void xwayland_surface_set_parent_notify(wl_listener* listener, void* data
 XWaylandView::XWaylandView(Server& server, wlr_xwayland_surface& surface) noexcept
 	: listeners(*this), server(server), xwayland_surface(surface) {
 	this->xwayland_surface = surface;
+	id = server.next_view_id++;
+	/* Often 0, _NET_WM_PID is read later */
+	server.launcher->view_created(*this, surface.pid);
 
 	/* Listen to the various events it can emit */
 	listeners.map.notify = xwayland_surface_map_notify;
@@ -174,12 +217,17 @@ XWaylandView::XWaylandView(Server& server, wlr_xwayland_surface& surface) noexce
 }
 
 XWaylandView::~XWaylandView() noexcept {
+	if (configure_idle != nullptr) {
+		wl_event_source_remove(configure_idle);
+	}
 	wl_list_remove(&listeners.map.link);
 	wl_list_remove(&listeners.unmap.link);
 	wl_list_remove(&listeners.destroy.link);
 	wl_list_remove(&listeners.request_configure.link);
 	wl_list_remove(&listeners.request_move.link);
 	wl_list_remove(&listeners.request_resize.link);
+	wl_list_remove(&listeners.request_maximize.link);
+	wl_list_remove(&listeners.request_fullscreen.link);
 	wl_list_remove(&listeners.set_geometry.link);
 	wl_list_remove(&listeners.set_title.link);
 	wl_list_remove(&listeners.set_class.link);
@@ -198,25 +246,69 @@ constexpr wlr_box XWaylandView::get_geometry() const {
 	return {xwayland_surface.x, xwayland_surface.y, xwayland_surface.width, xwayland_surface.height};
 }
 
+View* XWaylandView::get_transient_parent() const {
+	if (xwayland_surface.parent == nullptr) {
+		return nullptr;
+	}
+
+	return dynamic_cast<View*>(static_cast<Surface*>(xwayland_surface.parent->data));
+}
+
+const char* XWaylandView::get_title() const {
+	return xwayland_surface.title;
+}
+
+const char* XWaylandView::get_app_id() const {
+	return xwayland_surface._class;
+}
+
 void XWaylandView::map() {
+	/* Already mapped, by its client while it was minimized */
+	if (scene_node != nullptr) {
+		return;
+	}
+
 	xwayland_surface.data = this;
 	xwayland_surface.surface->data = this;
 
+	listeners.commit.notify = xwayland_surface_commit_notify;
+	wl_signal_add(&xwayland_surface.surface->events.commit, &listeners.commit);
+
 	toplevel_handle.emplace(*this);
 	toplevel_handle->set_title(xwayland_surface.title);
 	toplevel_handle->set_app_id(xwayland_surface._class);
 
-	wlr_scene_tree* scene_tree = wlr_scene_subsurface_tree_create(&server.scene->tree, xwayland_surface.surface);
+	/* Dialogs open on the workspace of their parent, and minimized views come
+	 * back on the workspace they were minimized from. */
+	const auto* parent_view = get_transient_parent();
+	if (parent_view != nullptr && parent_view->workspace != nullptr) {
+		workspace = parent_view->workspace;
+	} else if (workspace == nullptr) {
+		workspace = server.active_workspace;
+	}
+
+	wlr_scene_tree* scene_tree =
+		wlr_scene_subsurface_tree_create(workspace->stack.band_trees[VIEW_BAND_NORMAL], xwayland_surface.surface);
 	scene_node = &scene_tree->node;
 	scene_node->data = this;
 
-	if (xwayland_surface.parent != nullptr) {
-		const auto* m_view = dynamic_cast<View*>(static_cast<Surface*>(xwayland_surface.parent->data));
-		if (m_view != nullptr) {
-			wlr_scene_node_reparent(scene_node, m_view->scene_node->parent);
-			toplevel_handle->set_parent(m_view->toplevel_handle);
+	/* Notifications float above regular windows, and a window may have asked
+	 * for a band before it was mapped. A band chosen since keeps across
+	 * minimizing, which unmaps the window. */
+	for (size_t i = 0; i < xwayland_surface.window_type_len; i++) {
+		if (xwayland_surface.window_type[i] == server.xwayland->atoms[NET_WM_WINDOW_TYPE_NOTIFICATION]) {
+			band = VIEW_BAND_ABOVE;
 		}
 	}
+	if (band == VIEW_BAND_NORMAL) {
+		band = server.xwayland->read_band(xwayland_surface.window_id);
+	}
+	workspace->stack.add(*this);
+
+	const auto* m_view = get_transient_parent();
+	if (m_view != nullptr) {
+		toplevel_handle->set_parent(m_view->toplevel_handle);
+	}
 
 	wlr_scene_node_set_enabled(scene_node, true);
 	if (xwayland_surface.fullscreen) {
@@ -227,11 +319,27 @@ void XWaylandView::map() {
 		set_placement(VIEW_PLACEMENT_STACKING);
 	}
 
+	server.views.remove(this);
 	server.views.insert(server.views.begin(), this);
 	server.focus_view(this);
+	server.telemetry->update_views();
+	server.ipc->view_event(IPC_EVENT_VIEW_MAPPED, *this);
+	server.launcher->view_mapped(*this);
+	/* X11 clients pass their activation token as the startup notification
+	 * id, there is no activation request to tie them to it */
+	if (xwayland_surface.startup_id != nullptr) {
+		server.launcher->token_activated(xwayland_surface.startup_id, *this);
+	}
 }
 
+/* Minimizing unmaps the view too, but keeps it in the views so IPC and
+ * keybindings can still find it and bring it back. */
 void XWaylandView::unmap() {
+	/* Already unmapped by minimizing */
+	if (scene_node == nullptr) {
+		return;
+	}
+
 	scene_node->data = nullptr;
 	Cursor& cursor = server.seat->cursor;
 
@@ -242,14 +350,25 @@ void XWaylandView::unmap() {
 
 	if (this == server.focused_view) {
 		server.focused_view = nullptr;
+		server.ipc->event(IPC_EVENT_FOCUS_CHANGED);
 	}
 
 	if (server.seat->wlr->keyboard_state.focused_surface == xwayland_surface.surface) {
 		server.seat->wlr->keyboard_state.focused_surface = nullptr;
 	}
 
+	wl_list_remove(&listeners.commit.link);
+
+	workspace->stack.remove(*this);
+	stacked_above.reset();
 	wlr_scene_node_destroy(scene_node);
-	server.views.remove(this);
+	scene_node = nullptr;
+	if (!is_minimized) {
+		server.views.remove(this);
+	}
+	server.telemetry->update_views();
+	server.ipc->view_event(IPC_EVENT_VIEW_UNMAPPED, *this);
+	server.launcher->view_unmapped(*this);
 
 	toplevel_handle.reset();
 }
@@ -270,19 +389,83 @@ static constexpr int16_t trunc(const int32_t int32) {
 	return static_cast<int16_t>(int32);
 }
 
+bool XWaylandView::configure_pending() const {
+	return configure_idle != nullptr;
+}
+
+void XWaylandView::schedule_configure(const bool requested) {
+	configure_requested = configure_requested || requested;
+	if (configure_idle == nullptr) {
+		configure_idle =
+			wl_event_loop_add_idle(wl_display_get_event_loop(server.display), xwayland_surface_configure_idle, this);
+	}
+}
+
+/* Sends a single configure carrying the final geometry of everything requested
+ * since the last flush, skipping it if the X11 window already has it. A
+ * ConfigureRequest is always answered though, ICCCM 4.1.5 wants a synthetic
+ * ConfigureNotify even when nothing changed and some toolkits wait for it. */
+void XWaylandView::flush_configure() {
+	MAGPIE_TRACE_SCOPE("xwayland_flush_configure");
+	configure_idle = nullptr;
+	const bool requested = configure_requested;
+	configure_requested = false;
+
+	const int16_t x = trunc(current.x);
+	const int16_t y = trunc(current.y);
+	const auto width = static_cast<uint16_t>(std::max(current.width, 0));
+	const auto height = static_cast<uint16_t>(std::max(current.height, 0));
+
+	if (requested || x != xwayland_surface.x || y != xwayland_surface.y || width != xwayland_surface.width ||
+		height != xwayland_surface.height) {
+		wlr_xwayland_surface_configure(&xwayland_surface, x, y, width, height);
+	}
+
+	if (scene_node != nullptr && xwayland_surface.surface != nullptr && xwayland_surface.surface->mapped) {
+		wlr_scene_node_set_position(scene_node, current.x, current.y);
+	}
+}
+
+/* X11 configures carry the position as well, so the window is moved right away
+ * and only the scene waits for the rest of the transaction. */
+uint32_t XWaylandView::send_configure(const wlr_box& geometry) {
+	if (configure_idle != nullptr) {
+		wl_event_source_remove(configure_idle);
+		configure_idle = nullptr;
+		configure_requested = false;
+	}
+
+	const auto width = static_cast<uint16_t>(std::max(geometry.width, 0));
+	const auto height = static_cast<uint16_t>(std::max(geometry.height, 0));
+	wlr_xwayland_surface_configure(&xwayland_surface, trunc(geometry.x), trunc(geometry.y), width, height);
+
+	return 0;
+}
+
+bool XWaylandView::has_committed(const uint32_t serial, const wlr_box& geometry) const {
+	(void) serial;
+
+	const wlr_surface* surface = xwayland_surface.surface;
+	return surface == nullptr || !surface->mapped ||
+		   (surface->current.width == geometry.width && surface->current.height == geometry.height);
+}
+
 void XWaylandView::impl_set_position(const int new_x, const int new_y) {
-	wlr_xwayland_surface_configure(&xwayland_surface, trunc(new_x), trunc(new_y), current.width, current.height);
+	(void) new_x;
+	(void) new_y;
+
+	schedule_configure();
 }
 
 void XWaylandView::impl_set_size(const int new_width, const int new_height) {
-	wlr_xwayland_surface_configure(&xwayland_surface, trunc(current.x), trunc(current.y), new_width, new_height);
+	(void) new_width;
+	(void) new_height;
+
+	schedule_configure();
 }
 
 void XWaylandView::impl_set_activated(const bool activated) {
 	wlr_xwayland_surface_activate(&xwayland_surface, activated);
-	if (activated) {
-		wlr_xwayland_surface_restack(&xwayland_surface, nullptr, XCB_STACK_MODE_ABOVE);
-	}
 }
 
 void XWaylandView::impl_set_fullscreen(const bool fullscreen) {
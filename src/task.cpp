@@ -0,0 +1,143 @@
+#include "task.hpp"
+
+#include "types.hpp"
+
+static void signal_awaiter_signal_notify(wl_listener* listener, void* data) {
+	SignalAwaiter& awaiter = magpie_container_of(listener, awaiter, signal);
+
+	awaiter.finish(true, data);
+}
+
+static void signal_awaiter_cancel_notify(wl_listener* listener, void* data) {
+	SignalAwaiter& awaiter = magpie_container_of(listener, awaiter, cancel);
+	(void) data;
+
+	awaiter.finish(false, nullptr);
+}
+
+static int signal_awaiter_timeout_notify(void* data) {
+	auto& awaiter = *static_cast<SignalAwaiter*>(data);
+
+	awaiter.finish(false, nullptr);
+	return 0;
+}
+
+SignalAwaiter::SignalAwaiter(wl_signal& signal, wl_signal* cancel, wl_event_loop* loop, const int timeout_ms) noexcept
+	: listeners(*this), signal(signal), cancel(cancel), loop(loop), timeout_ms(timeout_ms) {
+	wl_list_init(&listeners.signal.link);
+	wl_list_init(&listeners.cancel.link);
+}
+
+SignalAwaiter::~SignalAwaiter() noexcept {
+	wl_list_remove(&listeners.signal.link);
+	wl_list_remove(&listeners.cancel.link);
+	if (timer != nullptr) {
+		wl_event_source_remove(timer);
+	}
+}
+
+void SignalAwaiter::await_suspend(const std::coroutine_handle<> awaiting) noexcept {
+	handle = awaiting;
+
+	listeners.signal.notify = signal_awaiter_signal_notify;
+	wl_signal_add(&signal, &listeners.signal);
+	if (cancel != nullptr) {
+		listeners.cancel.notify = signal_awaiter_cancel_notify;
+		wl_signal_add(cancel, &listeners.cancel);
+	}
+	if (loop != nullptr && timeout_ms > 0) {
+		timer = wl_event_loop_add_timer(loop, signal_awaiter_timeout_notify, this);
+		wl_event_source_timer_update(timer, timeout_ms);
+	}
+}
+
+/* Detaches from everything before resuming, the coroutine may well wait on
+ * the same signal again right away. */
+void SignalAwaiter::finish(const bool fired, void* data) {
+	wl_list_remove(&listeners.signal.link);
+	wl_list_init(&listeners.signal.link);
+	wl_list_remove(&listeners.cancel.link);
+	wl_list_init(&listeners.cancel.link);
+	if (timer != nullptr) {
+		wl_event_source_remove(timer);
+		timer = nullptr;
+	}
+
+	result = {fired, data};
+	handle.resume();
+}
+
+static int timer_awaiter_notify(void* data) {
+	auto& awaiter = *static_cast<TimerAwaiter*>(data);
+
+	awaiter.finish();
+	return 0;
+}
+
+TimerAwaiter::TimerAwaiter(wl_event_loop& loop, const int timeout_ms) noexcept : loop(loop), timeout_ms(timeout_ms) {}
+
+TimerAwaiter::~TimerAwaiter() noexcept {
+	if (source != nullptr) {
+		wl_event_source_remove(source);
+	}
+}
+
+void TimerAwaiter::await_suspend(const std::coroutine_handle<> awaiting) noexcept {
+	handle = awaiting;
+	source = wl_event_loop_add_timer(&loop, timer_awaiter_notify, this);
+	wl_event_source_timer_update(source, timeout_ms);
+}
+
+void TimerAwaiter::finish() {
+	wl_event_source_remove(source);
+	source = nullptr;
+	handle.resume();
+}
+
+static int fd_awaiter_notify(int fd, uint32_t mask, void* data) {
+	auto& awaiter = *static_cast<FdAwaiter*>(data);
+	(void) fd;
+
+	awaiter.finish(mask);
+	return 0;
+}
+
+static int fd_awaiter_timeout_notify(void* data) {
+	auto& awaiter = *static_cast<FdAwaiter*>(data);
+
+	awaiter.finish(0);
+	return 0;
+}
+
+FdAwaiter::FdAwaiter(wl_event_loop& loop, const int fd, const uint32_t mask, const int timeout_ms) noexcept
+	: loop(loop), fd(fd), mask(mask), timeout_ms(timeout_ms) {}
+
+FdAwaiter::~FdAwaiter() noexcept {
+	if (source != nullptr) {
+		wl_event_source_remove(source);
+	}
+	if (timer != nullptr) {
+		wl_event_source_remove(timer);
+	}
+}
+
+void FdAwaiter::await_suspend(const std::coroutine_handle<> awaiting) noexcept {
+	handle = awaiting;
+	source = wl_event_loop_add_fd(&loop, fd, mask, fd_awaiter_notify, this);
+	if (timeout_ms > 0) {
+		timer = wl_event_loop_add_timer(&loop, fd_awaiter_timeout_notify, this);
+		wl_event_source_timer_update(timer, timeout_ms);
+	}
+}
+
+void FdAwaiter::finish(const uint32_t new_mask) {
+	wl_event_source_remove(source);
+	source = nullptr;
+	if (timer != nullptr) {
+		wl_event_source_remove(timer);
+		timer = nullptr;
+	}
+
+	ready_mask = new_mask;
+	handle.resume();
+}
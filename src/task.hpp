@@ -0,0 +1,169 @@
+#ifndef MAGPIE_TASK_HPP
+#define MAGPIE_TASK_HPP
+
+#include "live_objects.hpp"
+#include "types.hpp"
+#include "worker_pool.hpp"
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <utility>
+
+#include <wayland-server-core.h>
+
+/* A fire-and-forget coroutine driven by the Wayland event loop. It runs
+ * synchronously until its first co_await and is then resumed from event loop
+ * callbacks, always on the main thread. The awaiters below embed their
+ * listeners and event sources in the coroutine frame, so waiting allocates
+ * nothing beyond what libwayland does for an event source.
+ *
+ * A suspended task is only resumed by the thing it waits on, so anything that
+ * can be destroyed while waited on should be awaited together with its destroy
+ * signal (see SignalAwaiter), or with a timeout. */
+class Task {
+  public:
+	struct promise_type {
+		Task get_return_object() noexcept {
+			return {};
+		}
+		std::suspend_never initial_suspend() noexcept {
+			return {};
+		}
+		std::suspend_never final_suspend() noexcept {
+			return {};
+		}
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept {
+			std::terminate();
+		}
+	};
+};
+
+struct SignalResult {
+	/* False if the wait was cancelled or timed out */
+	bool fired;
+	void* data;
+};
+
+/* Waits for one emission of a wl_signal. Optionally gives up when a cancel
+ * signal (usually the emitter's destroy signal) fires first, or after a
+ * timeout in milliseconds. */
+class SignalAwaiter {
+  public:
+	struct Listeners {
+		std::reference_wrapper<SignalAwaiter> parent;
+		wl_listener signal = {};
+		wl_listener cancel = {};
+		explicit Listeners(SignalAwaiter& parent) noexcept : parent(parent) {}
+	};
+
+  private:
+	Listeners listeners;
+	[[no_unique_address]] LiveObject<LIVE_OBJECT_SIGNAL_AWAITER> live;
+	wl_signal& signal;
+	wl_signal* cancel;
+	wl_event_loop* loop;
+	int timeout_ms;
+	wl_event_source* timer = nullptr;
+	std::coroutine_handle<> handle = {};
+	SignalResult result = {false, nullptr};
+
+  public:
+	explicit SignalAwaiter(
+		wl_signal& signal, wl_signal* cancel = nullptr, wl_event_loop* loop = nullptr, int timeout_ms = 0) noexcept;
+	SignalAwaiter(const SignalAwaiter&) = delete;
+	SignalAwaiter& operator=(const SignalAwaiter&) = delete;
+	~SignalAwaiter() noexcept;
+
+	[[nodiscard]] bool await_ready() const noexcept {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> awaiting) noexcept;
+	[[nodiscard]] SignalResult await_resume() const noexcept {
+		return result;
+	}
+	void finish(bool fired, void* data);
+};
+
+/* Sleeps for a number of milliseconds. */
+class TimerAwaiter {
+	wl_event_loop& loop;
+	int timeout_ms;
+	wl_event_source* source = nullptr;
+	std::coroutine_handle<> handle = {};
+
+  public:
+	TimerAwaiter(wl_event_loop& loop, int timeout_ms) noexcept;
+	TimerAwaiter(const TimerAwaiter&) = delete;
+	TimerAwaiter& operator=(const TimerAwaiter&) = delete;
+	~TimerAwaiter() noexcept;
+
+	[[nodiscard]] bool await_ready() const noexcept {
+		return timeout_ms <= 0;
+	}
+	void await_suspend(std::coroutine_handle<> awaiting) noexcept;
+	void await_resume() const noexcept {}
+	void finish();
+};
+
+/* Waits until a file descriptor is ready. Resumes with the ready mask, or 0
+ * if the optional timeout expired first. */
+class FdAwaiter {
+	wl_event_loop& loop;
+	int fd;
+	uint32_t mask;
+	int timeout_ms;
+	wl_event_source* source = nullptr;
+	wl_event_source* timer = nullptr;
+	std::coroutine_handle<> handle = {};
+	uint32_t ready_mask = 0;
+
+  public:
+	FdAwaiter(wl_event_loop& loop, int fd, uint32_t mask, int timeout_ms = 0) noexcept;
+	FdAwaiter(const FdAwaiter&) = delete;
+	FdAwaiter& operator=(const FdAwaiter&) = delete;
+	~FdAwaiter() noexcept;
+
+	[[nodiscard]] bool await_ready() const noexcept {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> awaiting) noexcept;
+	[[nodiscard]] uint32_t await_resume() const noexcept {
+		return ready_mask;
+	}
+	void finish(uint32_t new_mask);
+};
+
+/* Runs work on the worker pool and resumes with its result on the main
+ * thread. The same rules as for WorkerPool::submit apply to work. */
+template <typename Result>
+class WorkerAwaiter {
+	WorkerPool& pool;
+	std::function<Result()> work;
+	std::optional<Result> result = {};
+
+  public:
+	WorkerAwaiter(WorkerPool& pool, std::function<Result()> work) noexcept : pool(pool), work(std::move(work)) {}
+	WorkerAwaiter(const WorkerAwaiter&) = delete;
+	WorkerAwaiter& operator=(const WorkerAwaiter&) = delete;
+
+	[[nodiscard]] bool await_ready() const noexcept {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> awaiting) {
+		pool.submit(
+			[this] {
+				result.emplace(work());
+			},
+			[awaiting] {
+				awaiting.resume();
+			});
+	}
+	Result await_resume() {
+		return std::move(result.value());
+	}
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "telemetry.hpp"
+
+#include "clock.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+#include "types.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+static void copy_name(char* dest, const size_t size, const char* name) {
+	std::memset(dest, 0, size);
+	if (name != nullptr) {
+		std::strncpy(dest, name, size - 1);
+	}
+}
+
+Telemetry::Telemetry(Server& server) noexcept : server(server) {
+	const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+	if (runtime_dir != nullptr) {
+		path = std::string(runtime_dir) + "/magpie-telemetry." + std::to_string(getpid());
+		fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	}
+
+	/* Without a runtime dir nobody can find the page, but the hot paths still
+	 * need somewhere to write. */
+	if (fd < 0) {
+		path.clear();
+		fd = memfd_create("magpie-telemetry", MFD_CLOEXEC);
+	}
+
+	if (fd < 0 || ftruncate(fd, sizeof(TelemetryPage)) < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to create the telemetry page");
+	} else {
+		void* mapping = mmap(nullptr, sizeof(TelemetryPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (mapping != MAP_FAILED) {
+			page = static_cast<TelemetryPage*>(mapping);
+		} else {
+			wlr_log_errno(WLR_ERROR, "Failed to map the telemetry page");
+		}
+	}
+
+	if (page == nullptr) {
+		page = static_cast<TelemetryPage*>(calloc(1, sizeof(TelemetryPage)));
+	}
+
+	page->magic = MAGPIE_TELEMETRY_MAGIC;
+	page->version = MAGPIE_TELEMETRY_VERSION;
+	page->size = sizeof(TelemetryPage);
+	page->pid = static_cast<uint32_t>(getpid());
+	page->start_ns = clock_now_ns();
+	page->update_ns = page->start_ns;
+}
+
+Telemetry::~Telemetry() noexcept {
+	if (fd >= 0) {
+		munmap(page, sizeof(TelemetryPage));
+		close(fd);
+	} else {
+		free(page);
+	}
+
+	if (!path.empty()) {
+		unlink(path.c_str());
+	}
+}
+
+void Telemetry::begin_update() {
+	std::atomic_ref sequence(page->sequence);
+	sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Telemetry::end_update() {
+	page->update_ns = clock_now_ns();
+	std::atomic_ref sequence(page->sequence);
+	sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Telemetry::set_wayland_display(const char* name) {
+	begin_update();
+	copy_name(page->wayland_display, sizeof(page->wayland_display), name);
+	end_update();
+}
+
+/* Returns the slot the output reports to, or -1 if all are taken. */
+int32_t Telemetry::add_output(const char* name) {
+	for (size_t slot = 0; slot < MAGPIE_TELEMETRY_MAX_OUTPUTS; slot++) {
+		TelemetryOutput& output = page->output[slot];
+		if (output.enabled != 0) {
+			continue;
+		}
+
+		begin_update();
+		std::memset(&output, 0, sizeof(output));
+		copy_name(output.name, sizeof(output.name), name);
+		output.enabled = 1;
+		page->outputs++;
+		end_update();
+		return static_cast<int32_t>(slot);
+	}
+
+	return -1;
+}
+
+void Telemetry::remove_output(const int32_t slot) {
+	if (slot < 0 || static_cast<size_t>(slot) >= MAGPIE_TELEMETRY_MAX_OUTPUTS) {
+		return;
+	}
+
+	begin_update();
+	page->output[slot].enabled = 0;
+	page->outputs--;
+	end_update();
+}
+
+/* Called once per output frame, which makes it a good place to also refresh
+ * the client count. */
+void Telemetry::output_frame(const int32_t slot, const int32_t refresh_mhz) {
+	if (slot < 0 || static_cast<size_t>(slot) >= MAGPIE_TELEMETRY_MAX_OUTPUTS) {
+		return;
+	}
+
+	const uint64_t now = clock_now_ns();
+
+	begin_update();
+	TelemetryOutput& output = page->output[slot];
+	if (output.last_frame_ns != 0) {
+		output.last_frame_interval_ns = now - output.last_frame_ns;
+	}
+	output.last_frame_ns = now;
+	output.frames++;
+	output.refresh_mhz = refresh_mhz > 0 ? refresh_mhz : 0;
+	page->clients = wl_list_length(wl_display_get_client_list(server.display));
+	end_update();
+}
+
+void Telemetry::pointer_event() {
+	begin_update();
+	page->pointer_events++;
+	end_update();
+}
+
+void Telemetry::keyboard_event() {
+	begin_update();
+	page->keyboard_events++;
+	end_update();
+}
+
+void Telemetry::surface_commit() {
+	begin_update();
+	page->surface_commits++;
+	end_update();
+}
+
+void Telemetry::update_views() {
+	uint32_t mapped = 0;
+	for (const auto* view : server.views) {
+		if (view->scene_node != nullptr && view->scene_node->enabled && !view->is_minimized) {
+			mapped++;
+		}
+	}
+
+	begin_update();
+	page->views = server.views.size();
+	page->mapped_views = mapped;
+	end_update();
+}
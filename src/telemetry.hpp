@@ -0,0 +1,81 @@
+#ifndef MAGPIE_TELEMETRY_HPP
+#define MAGPIE_TELEMETRY_HPP
+
+#include "types.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+static constexpr uint32_t MAGPIE_TELEMETRY_MAGIC = 0x5450474d; /* "MGPT" */
+static constexpr uint32_t MAGPIE_TELEMETRY_VERSION = 1;
+static constexpr size_t MAGPIE_TELEMETRY_MAX_OUTPUTS = 8;
+
+/* The layout below is read by other processes. Only ever append fields, and
+ * bump the version when changing the meaning of an existing one. All
+ * timestamps are clock_now_ns nanoseconds, all counters only grow, so
+ * readers derive rates from two snapshots. */
+struct TelemetryOutput {
+	char name[32];
+	uint32_t enabled;
+	uint32_t refresh_mhz;
+	uint64_t frames;
+	uint64_t last_frame_ns;
+	uint64_t last_frame_interval_ns;
+};
+
+struct TelemetryPage {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t pid;
+	/* Odd while an update is in progress. Readers copy the page and retry if
+	 * the sequence was odd or changed in the meantime. */
+	uint64_t sequence;
+	uint64_t start_ns;
+	uint64_t update_ns;
+	char wayland_display[32];
+
+	uint64_t pointer_events;
+	uint64_t keyboard_events;
+	uint64_t surface_commits;
+	uint32_t views;
+	uint32_t mapped_views;
+	uint32_t clients;
+	uint32_t outputs;
+	TelemetryOutput output[MAGPIE_TELEMETRY_MAX_OUTPUTS];
+};
+
+static_assert(std::is_standard_layout_v<TelemetryPage> && std::is_trivially_copyable_v<TelemetryPage>);
+static_assert(offsetof(TelemetryPage, sequence) == 16);
+
+/* Publishes live counters in a shared memory file, $XDG_RUNTIME_DIR/
+ * magpie-telemetry.<pid>, so monitoring agents can sample them at any rate
+ * without talking to the compositor. Updates are plain stores guarded by a
+ * seqlock, cheap enough for the frame and input paths. */
+class Telemetry {
+	TelemetryPage* page = nullptr;
+	int fd = -1;
+	std::string path;
+
+	void begin_update();
+	void end_update();
+
+  public:
+	Server& server;
+
+	explicit Telemetry(Server& server) noexcept;
+	~Telemetry() noexcept;
+
+	void set_wayland_display(const char* name);
+	int32_t add_output(const char* name);
+	void remove_output(int32_t slot);
+	void output_frame(int32_t slot, int32_t refresh_mhz);
+	void pointer_event();
+	void keyboard_event();
+	void surface_commit();
+	void update_views();
+};
+
+#endif
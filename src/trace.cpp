@@ -0,0 +1,143 @@
+#include "trace.hpp"
+
+#include "alloc_guard.hpp"
+#include "clock.hpp"
+#include "json.hpp"
+#include "recording.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+std::atomic<bool> trace_recording = false;
+constinit thread_local const char* trace_current_scope = nullptr;
+
+struct TraceEvent {
+	const char* name;
+	char phase;
+	uint64_t start_ns;
+	uint64_t duration_ns;
+	std::string detail;
+};
+
+/* The owning thread appends, the main thread takes the events when recording
+ * stops, so the lock is practically never contended. */
+struct TraceBuffer {
+	std::mutex mutex;
+	pid_t tid;
+	std::vector<TraceEvent> events;
+};
+
+static std::mutex buffers_mutex;
+static std::vector<std::shared_ptr<TraceBuffer>> buffers;
+
+static TraceBuffer& thread_buffer() {
+	thread_local std::shared_ptr<TraceBuffer> buffer = [] {
+		auto new_buffer = std::make_shared<TraceBuffer>();
+		new_buffer->tid = static_cast<pid_t>(syscall(SYS_gettid));
+		const std::lock_guard lock(buffers_mutex);
+		buffers.push_back(new_buffer);
+		return new_buffer;
+	}();
+
+	return *buffer;
+}
+
+/* Spans measure real time, even while the compositor runs on virtual time */
+uint64_t trace_now_ns() {
+	return monotonic_ns();
+}
+
+void trace_complete(const char* name, const uint64_t start_ns, const uint64_t end_ns) {
+	MAGPIE_ALLOC_ALLOWED();
+	TraceBuffer& buffer = thread_buffer();
+	const std::lock_guard lock(buffer.mutex);
+	buffer.events.push_back({name, 'X', start_ns, end_ns - start_ns, {}});
+}
+
+void trace_instant(const char* name, const char* detail) {
+	if (!trace_recording.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	MAGPIE_ALLOC_ALLOWED();
+
+	TraceBuffer& buffer = thread_buffer();
+	const std::lock_guard lock(buffer.mutex);
+	buffer.events.push_back({name, 'i', trace_now_ns(), 0, detail});
+}
+
+static void write_trace(const std::string& path, std::vector<std::pair<pid_t, std::vector<TraceEvent>>> threads) {
+	const pid_t pid = getpid();
+
+	JsonWriter json;
+	json.begin_object().key("displayTimeUnit").value("ms").key("traceEvents").begin_array();
+	for (const auto& [tid, events] : threads) {
+		for (const auto& event : events) {
+			json.begin_object();
+			json.key("name").value(event.name);
+			json.key("ph").value(std::string_view(&event.phase, 1));
+			json.key("ts").value(static_cast<double>(event.start_ns) / 1000.0);
+			if (event.phase == 'X') {
+				json.key("dur").value(static_cast<double>(event.duration_ns) / 1000.0);
+			} else {
+				json.key("s").value("t");
+			}
+			json.key("pid").value(pid);
+			json.key("tid").value(tid);
+			if (!event.detail.empty()) {
+				json.key("args").begin_object().key("detail").value(event.detail).end_object();
+			}
+			json.end_object();
+		}
+	}
+	json.end_array().end_object();
+
+	FILE* file = std::fopen(path.c_str(), "we");
+	if (file == nullptr) {
+		wlr_log_errno(WLR_ERROR, "Failed to open trace file %s", path.c_str());
+		return;
+	}
+	bool ok = std::fwrite(json.str().data(), 1, json.str().size(), file) == json.str().size();
+	ok = std::fclose(file) == 0 && ok;
+
+	if (!ok) {
+		wlr_log(WLR_ERROR, "Failed to write trace file %s", path.c_str());
+		return;
+	}
+	wlr_log(WLR_INFO, "Wrote trace to %s", path.c_str());
+}
+
+/* Starts or stops recording, returns whether recording is now on. The file is
+ * written on a separate thread so stopping doesn't cost a frame. */
+bool trace_toggle() {
+	if (!trace_recording.exchange(true)) {
+		wlr_log(WLR_INFO, "Trace recording started");
+		return true;
+	}
+	trace_recording.store(false);
+
+	std::vector<std::pair<pid_t, std::vector<TraceEvent>>> threads;
+	{
+		const std::lock_guard lock(buffers_mutex);
+		for (const auto& buffer : buffers) {
+			const std::lock_guard buffer_lock(buffer->mutex);
+			threads.emplace_back(buffer->tid, std::exchange(buffer->events, {}));
+		}
+	}
+
+	const std::string path = default_recording_path("trace", "json");
+
+	std::thread(write_trace, path, std::move(threads)).detach();
+	return false;
+}
@@ -0,0 +1,66 @@
+#ifndef MAGPIE_TRACE_HPP
+#define MAGPIE_TRACE_HPP
+
+/* Trace spans for finding where a frame went. Built only with the tracing
+ * meson option, otherwise every macro below expands to nothing.
+ *
+ * Recording is toggled at runtime (SIGUSR2). While recording, spans are kept
+ * in memory per thread; when recording stops they are written out as Chrome
+ * trace-event JSON to $XDG_RUNTIME_DIR/magpie-trace-<pid>-<n>.json, which
+ * loads in chrome://tracing and in Perfetto. Span names must be string
+ * literals.
+ *
+ * The innermost scope of each thread is kept as well, which the watchdog
+ * puts in its stall reports. */
+
+#ifdef MAGPIE_TRACING
+
+#include <atomic>
+#include <cstdint>
+
+#define MAGPIE_TRACE_CONCAT_INNER(a, b) a##b
+#define MAGPIE_TRACE_CONCAT(a, b) MAGPIE_TRACE_CONCAT_INNER(a, b)
+
+#define MAGPIE_TRACE_SCOPE(name) const TraceScope MAGPIE_TRACE_CONCAT(magpie_trace_scope_, __LINE__)(name)
+#define MAGPIE_TRACE_INSTANT(name, detail) trace_instant(name, detail)
+
+extern std::atomic<bool> trace_recording;
+/* Read from a signal handler on the same thread, so a plain pointer will do */
+extern constinit thread_local const char* trace_current_scope;
+
+uint64_t trace_now_ns();
+void trace_complete(const char* name, uint64_t start_ns, uint64_t end_ns);
+void trace_instant(const char* name, const char* detail);
+bool trace_toggle();
+
+class TraceScope {
+	const char* name;
+	const char* previous;
+	uint64_t start_ns = 0;
+
+  public:
+	explicit TraceScope(const char* name) noexcept : name(name), previous(trace_current_scope) {
+		trace_current_scope = name;
+		if (trace_recording.load(std::memory_order_relaxed)) {
+			start_ns = trace_now_ns();
+		}
+	}
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+	~TraceScope() noexcept {
+		if (start_ns != 0) {
+			trace_complete(name, start_ns, trace_now_ns());
+		}
+		trace_current_scope = previous;
+	}
+};
+
+#else
+
+#define MAGPIE_TRACE_SCOPE(name) ((void) 0)
+#define MAGPIE_TRACE_INSTANT(name, detail) ((void) 0)
+
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+#include "transaction.hpp"
+
+#include "ipc.hpp"
+#include "server.hpp"
+#include "surface/view.hpp"
+#include "trace.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_scene.h>
+#include "wlr-wrap-end.hpp"
+
+/* How long to wait for slow clients before applying the transaction anyway. */
+static constexpr int TRANSACTION_TIMEOUT_MS = 150;
+
+static int transaction_timeout_notify(void* data) {
+	auto& manager = *static_cast<TransactionManager*>(data);
+
+	manager.apply();
+	return 0;
+}
+
+TransactionManager::TransactionManager(Server& server) noexcept : server(server) {
+	timeout = wl_event_loop_add_timer(wl_display_get_event_loop(server.display), transaction_timeout_notify, this);
+}
+
+TransactionManager::~TransactionManager() noexcept {
+	wl_event_source_remove(timeout);
+}
+
+/* Stages new layout geometry for a view, to be sent with the next commit. */
+void TransactionManager::add(View& view, const wlr_box& geometry) {
+	const auto it = std::find_if(staged.begin(), staged.end(), [&view](const Entry& entry) {
+		return entry.view == &view;
+	});
+
+	if (it != staged.end()) {
+		it->geometry = geometry;
+	} else {
+		staged.push_back({&view, geometry, 0, false});
+	}
+}
+
+void TransactionManager::commit() {
+	MAGPIE_TRACE_SCOPE("transaction_commit");
+	if (staged.empty()) {
+		return;
+	}
+
+	/* A newer layout supersedes whatever is still in flight */
+	if (!in_flight.empty()) {
+		apply();
+	}
+
+	in_flight = std::move(staged);
+	staged.clear();
+
+	for (auto& entry : in_flight) {
+		entry.serial = entry.view->send_configure(entry.geometry);
+		entry.ready = entry.view->has_committed(entry.serial, entry.geometry);
+	}
+
+	wl_event_source_timer_update(timeout, TRANSACTION_TIMEOUT_MS);
+	check_ready();
+}
+
+/* Applies the new positions of every view in the transaction at once. */
+void TransactionManager::apply() {
+	MAGPIE_TRACE_SCOPE("transaction_apply");
+	wl_event_source_timer_update(timeout, 0);
+
+	const std::vector<Entry> entries = std::move(in_flight);
+	in_flight.clear();
+
+	for (const auto& entry : entries) {
+		View& view = *entry.view;
+		view.current = entry.geometry;
+		if (view.scene_node != nullptr) {
+			wlr_scene_node_set_position(view.scene_node, view.current.x, view.current.y);
+		}
+		server.ipc->view_event(IPC_EVENT_VIEW_CHANGED, view);
+	}
+}
+
+void TransactionManager::check_ready() {
+	if (in_flight.empty()) {
+		return;
+	}
+
+	const bool all_ready = std::all_of(in_flight.begin(), in_flight.end(), [](const Entry& entry) {
+		return entry.ready;
+	});
+
+	if (all_ready) {
+		apply();
+	}
+}
+
+void TransactionManager::view_committed(const View& view) {
+	for (auto& entry : in_flight) {
+		if (entry.view == &view && !entry.ready) {
+			entry.ready = view.has_committed(entry.serial, entry.geometry);
+		}
+	}
+
+	check_ready();
+}
+
+void TransactionManager::view_destroyed(const View& view) {
+	const auto is_view = [&view](const Entry& entry) {
+		return entry.view == &view;
+	};
+
+	std::erase_if(staged, is_view);
+	if (std::erase_if(in_flight, is_view) > 0) {
+		check_ready();
+	}
+}
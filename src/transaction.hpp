@@ -0,0 +1,43 @@
+#ifndef MAGPIE_TRANSACTION_HPP
+#define MAGPIE_TRANSACTION_HPP
+
+#include "types.hpp"
+
+#include <vector>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/box.h>
+#include "wlr-wrap-end.hpp"
+
+/* Moves and resizes several views as one atomic step. Configures for every
+ * staged view are sent together, and the new positions are only applied to
+ * the scene once every client has committed a buffer for its new size (or the
+ * transaction timed out), so all affected windows change in the same frame. */
+class TransactionManager {
+	struct Entry {
+		View* view;
+		wlr_box geometry;
+		uint32_t serial;
+		bool ready;
+	};
+
+	std::vector<Entry> staged;
+	std::vector<Entry> in_flight;
+	wl_event_source* timeout;
+
+	void check_ready();
+
+  public:
+	Server& server;
+
+	explicit TransactionManager(Server& server) noexcept;
+	~TransactionManager() noexcept;
+
+	void add(View& view, const wlr_box& geometry);
+	void commit();
+	void apply();
+	void view_committed(const View& view);
+	void view_destroyed(const View& view);
+};
+
+#endif
@@ -4,11 +4,27 @@
 class Server;
 class XWayland;
 class Output;
+class Stack;
+class TransactionManager;
+class Workspace;
+class WorkerPool;
+class Telemetry;
+class IpcServer;
+class IpcClient;
+class Launcher;
+class ConfigManager;
+class ProtocolCapture;
+class Watchdog;
+class ClientCapture;
+class FlightRecorder;
+struct Config;
+struct OutputConfig;
 
 class Seat;
 class Keyboard;
 class Cursor;
 class PointerConstraint;
+class InputRecorder;
 
 struct Surface;
 struct View;
@@ -26,6 +42,12 @@ enum ViewPlacement {
 	VIEW_PLACEMENT_FULLSCREEN,
 };
 
+enum ViewBand {
+	VIEW_BAND_BELOW,
+	VIEW_BAND_NORMAL,
+	VIEW_BAND_ABOVE,
+};
+
 #define magpie_container_of(ptr, sample, member)                                                                               \
 	(__extension__({                                                                                                           \
 		std::remove_reference<decltype(sample)>::type::Listeners* container = wl_container_of(ptr, container, member);         \
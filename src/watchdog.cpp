@@ -0,0 +1,266 @@
+#include "watchdog.hpp"
+
+#include "flight_recorder.hpp"
+#include "json.hpp"
+#include "server.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+static constexpr int WATCHDOG_STACK_DEPTH = 64;
+static constexpr uint64_t WATCHDOG_MIN_POLL_NS = 10000000;
+/* How long the main thread gets to answer the signal */
+static constexpr uint64_t WATCHDOG_SNAPSHOT_TIMEOUT_NS = 50000000;
+static constexpr off_t WATCHDOG_LOG_MAX_SIZE = 256 * 1024;
+
+/* Filled in by the main thread from the signal handler. There is only one
+ * main thread, so a single snapshot will do. */
+struct WatchdogSnapshot {
+	void* stack[WATCHDOG_STACK_DEPTH];
+	int depth;
+	/* Only known in tracing builds */
+	const char* scope;
+};
+
+static WatchdogSnapshot watchdog_snapshot;
+static std::atomic<bool> watchdog_snapshot_ready = false;
+
+static void watchdog_signal_handler(const int signal) {
+	(void) signal;
+	const int saved_errno = errno;
+
+	watchdog_snapshot.depth = backtrace(watchdog_snapshot.stack, WATCHDOG_STACK_DEPTH);
+#ifdef MAGPIE_TRACING
+	watchdog_snapshot.scope = trace_current_scope;
+#else
+	watchdog_snapshot.scope = nullptr;
+#endif
+	watchdog_snapshot_ready.store(true, std::memory_order_release);
+
+	errno = saved_errno;
+}
+
+/* module+0xoffset, followed by the symbol when it is exported */
+static std::string describe_address(void* address) {
+	Dl_info info = {};
+	if (dladdr(address, &info) == 0 || info.dli_fname == nullptr) {
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%p", address);
+		return buffer;
+	}
+
+	const char* slash = std::strrchr(info.dli_fname, '/');
+	const auto offset = reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(info.dli_fbase);
+	char buffer[64];
+	std::snprintf(buffer, sizeof(buffer), "+0x%zx", static_cast<size_t>(offset));
+	std::string description = std::string(slash != nullptr ? slash + 1 : info.dli_fname) + buffer;
+
+	if (info.dli_sname != nullptr) {
+		int status = 0;
+		char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+		const auto symbol_offset = reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(info.dli_saddr);
+		std::snprintf(buffer, sizeof(buffer), "+0x%zx", static_cast<size_t>(symbol_offset));
+		description += std::string(" ") + (status == 0 ? demangled : info.dli_sname) + buffer;
+		std::free(demangled);
+	}
+	return description;
+}
+
+Watchdog::Watchdog(Server& server, const uint32_t threshold_ms) noexcept
+	: main_thread(pthread_self()), threshold_ns(static_cast<uint64_t>(threshold_ms) * 1000000), server(server) {
+	const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+	if (runtime_dir != nullptr) {
+		path = std::string(runtime_dir) + "/magpie-watchdog-" + std::to_string(getpid()) + ".log";
+	}
+
+	/* The first call loads libgcc, which must not happen in the handler */
+	void* preload[1];
+	(void) backtrace(preload, 1);
+
+	struct sigaction action = {};
+	action.sa_handler = watchdog_signal_handler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGRTMIN, &action, nullptr) < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to install the watchdog signal handler");
+	}
+
+	thread = std::thread(&Watchdog::watch, this);
+}
+
+Watchdog::~Watchdog() noexcept {
+	{
+		const std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	cond.notify_all();
+	thread.join();
+
+	signal(SIGRTMIN, SIG_DFL);
+}
+
+void Watchdog::set_threshold(const uint32_t threshold_ms) {
+	threshold_ns.store(static_cast<uint64_t>(threshold_ms) * 1000000, std::memory_order_relaxed);
+	cond.notify_all();
+	wlr_log(WLR_INFO, threshold_ms != 0 ? "Watchdog threshold set to %u ms" : "Watchdog turned off", threshold_ms);
+}
+
+void Watchdog::add_output(const int32_t slot, const char* name) {
+	if (slot < 0 || static_cast<size_t>(slot) >= MAGPIE_TELEMETRY_MAX_OUTPUTS) {
+		return;
+	}
+
+	WatchdogOutput& output = outputs[slot];
+	std::memset(output.name, 0, sizeof(output.name));
+	std::strncpy(output.name, name, sizeof(output.name) - 1);
+	output.frames.store(0, std::memory_order_relaxed);
+	output.active.store(true, std::memory_order_release);
+}
+
+void Watchdog::remove_output(const int32_t slot) {
+	if (slot < 0 || static_cast<size_t>(slot) >= MAGPIE_TELEMETRY_MAX_OUTPUTS) {
+		return;
+	}
+
+	outputs[slot].active.store(false, std::memory_order_release);
+}
+
+void Watchdog::output_frame(const int32_t slot) {
+	if (slot < 0 || static_cast<size_t>(slot) >= MAGPIE_TELEMETRY_MAX_OUTPUTS) {
+		return;
+	}
+
+	WatchdogOutput& output = outputs[slot];
+	const uint64_t frames = output.frames.load(std::memory_order_relaxed);
+	output.frame_ns[frames % MAGPIE_WATCHDOG_FRAMES].store(monotonic_ns(), std::memory_order_relaxed);
+	output.frames.store(frames + 1, std::memory_order_release);
+}
+
+/* Checks a few times per threshold, so a stall is caught at most a quarter
+ * of the threshold late */
+void Watchdog::watch() {
+	std::unique_lock lock(mutex);
+	while (!stopping) {
+		const uint64_t threshold = threshold_ns.load(std::memory_order_relaxed);
+		const uint64_t poll_ns = threshold == 0 ? 1000000000 : std::max(threshold / 4, WATCHDOG_MIN_POLL_NS);
+		cond.wait_for(lock, std::chrono::nanoseconds(poll_ns));
+		if (stopping || threshold_ns.load(std::memory_order_relaxed) == 0) {
+			continue;
+		}
+
+		const uint64_t since = busy_since_ns.load(std::memory_order_relaxed);
+		const uint64_t now = monotonic_ns();
+		if (since == 0 || since == reported_since_ns.load(std::memory_order_relaxed) ||
+			now - since < threshold_ns.load(std::memory_order_relaxed)) {
+			continue;
+		}
+
+		reported_since_ns.store(since, std::memory_order_relaxed);
+		lock.unlock();
+		report(since, now);
+		lock.lock();
+	}
+}
+
+void Watchdog::report(const uint64_t since_ns, const uint64_t now_ns) {
+	watchdog_snapshot_ready.store(false, std::memory_order_relaxed);
+	pthread_kill(main_thread, SIGRTMIN);
+	const uint64_t deadline = monotonic_ns() + WATCHDOG_SNAPSHOT_TIMEOUT_NS;
+	while (!watchdog_snapshot_ready.load(std::memory_order_acquire) && monotonic_ns() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	const bool have_stack = watchdog_snapshot_ready.load(std::memory_order_acquire);
+	/* A stack taken after the loop moved on shows something else */
+	const bool still_busy = busy_since_ns.load(std::memory_order_relaxed) == since_ns;
+
+	JsonWriter json;
+	json.begin_object();
+	json.key("time").value(static_cast<uint64_t>(std::time(nullptr)));
+	json.key("stall_ms").value((now_ns - since_ns) / 1000000);
+	json.key("threshold_ms").value(threshold_ns.load(std::memory_order_relaxed) / 1000000);
+	if (!have_stack) {
+		json.key("stack").null();
+	} else if (!still_busy) {
+		json.key("recovered").value(true);
+	} else {
+		json.key("flight_recording").value(server.flight_recorder->dump());
+		json.key("scope").value(watchdog_snapshot.scope);
+		json.key("stack").begin_array();
+		for (int i = 0; i < watchdog_snapshot.depth; i++) {
+			json.value(describe_address(watchdog_snapshot.stack[i]));
+		}
+		json.end_array();
+	}
+
+	/* How long ago each of the last frames was, newest first */
+	json.key("outputs").begin_array();
+	for (const auto& output : outputs) {
+		if (!output.active.load(std::memory_order_acquire)) {
+			continue;
+		}
+
+		const uint64_t frames = output.frames.load(std::memory_order_acquire);
+		json.begin_object();
+		json.key("name").value(std::string_view(output.name, strnlen(output.name, sizeof(output.name))));
+		json.key("frames").value(frames);
+		json.key("frame_ms_ago").begin_array();
+		for (uint64_t i = 0; i < std::min<uint64_t>(frames, MAGPIE_WATCHDOG_FRAMES); i++) {
+			const uint64_t frame_ns = output.frame_ns[(frames - 1 - i) % MAGPIE_WATCHDOG_FRAMES].load(
+				std::memory_order_relaxed);
+			json.value(static_cast<double>(now_ns - std::min(frame_ns, now_ns)) / 1000000);
+		}
+		json.end_array();
+		json.end_object();
+	}
+	json.end_array();
+	json.end_object();
+
+	wlr_log(WLR_ERROR, "Main loop stalled for %lu ms in %s", static_cast<unsigned long>((now_ns - since_ns) / 1000000),
+		have_stack && still_busy && watchdog_snapshot.scope != nullptr ? watchdog_snapshot.scope : "an unknown scope");
+	write_report(json.str());
+}
+
+/* Appends a line, moving the file to .log.1 first once it grew too large */
+void Watchdog::write_report(const std::string& line) {
+	if (path.empty()) {
+		return;
+	}
+
+	struct stat info = {};
+	if (stat(path.c_str(), &info) == 0 && info.st_size > WATCHDOG_LOG_MAX_SIZE) {
+		(void) rename(path.c_str(), (path + ".1").c_str());
+	}
+
+	const int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to open %s", path.c_str());
+		return;
+	}
+
+	const std::string data = line + "\n";
+	if (write(fd, data.data(), data.size()) < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to write %s", path.c_str());
+	}
+	close(fd);
+}
+
+void Watchdog::stall_ended(const uint64_t since_ns) {
+	wlr_log(WLR_ERROR, "Main loop recovered after %lu ms", static_cast<unsigned long>((monotonic_ns() - since_ns) / 1000000));
+}
@@ -0,0 +1,84 @@
+#ifndef MAGPIE_WATCHDOG_HPP
+#define MAGPIE_WATCHDOG_HPP
+
+#include "clock.hpp"
+#include "telemetry.hpp"
+#include "types.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <thread>
+
+static constexpr size_t MAGPIE_WATCHDOG_FRAMES = 32;
+
+/* The last frames of one output, written by the main thread and read by the
+ * watchdog while the main thread is stuck */
+struct WatchdogOutput {
+	std::atomic<bool> active = false;
+	/* Only written while inactive */
+	char name[32] = {};
+	std::atomic<uint64_t> frames = 0;
+	std::atomic<uint64_t> frame_ns[MAGPIE_WATCHDOG_FRAMES] = {};
+};
+
+/* Watches for event loop iterations that run too long. Server::run marks the
+ * loop busy when it wakes up and idle before it sleeps again, two stores per
+ * iteration, and a thread checks on it a few times per threshold.
+ *
+ * Once an iteration passes the threshold, the main thread is interrupted to
+ * take its own backtrace, along with the innermost MAGPIE_TRACE_SCOPE it is
+ * in when built with tracing, and a JSON line with both and the recent
+ * frames of every output is appended to
+ * $XDG_RUNTIME_DIR/magpie-watchdog-<pid>.log, which is rotated to .log.1 as
+ * it grows, along with a dump of the flight recorder. Stack
+ * entries are module+offset, which addr2line resolves when the symbol is not
+ * exported. Each stall is reported once. */
+class Watchdog {
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool stopping = false;
+
+	pthread_t main_thread;
+	std::atomic<uint64_t> busy_since_ns = 0;
+	std::atomic<uint64_t> reported_since_ns = 0;
+	std::atomic<uint64_t> threshold_ns;
+	std::string path;
+
+	WatchdogOutput outputs[MAGPIE_TELEMETRY_MAX_OUTPUTS];
+
+	void watch();
+	void report(uint64_t since_ns, uint64_t now_ns);
+	void write_report(const std::string& line);
+	void stall_ended(uint64_t since_ns);
+
+  public:
+	Server& server;
+
+	Watchdog(Server& server, uint32_t threshold_ms) noexcept;
+	~Watchdog() noexcept;
+
+	/* 0 turns it off */
+	void set_threshold(uint32_t threshold_ms);
+
+	void busy() {
+		busy_since_ns.store(monotonic_ns(), std::memory_order_relaxed);
+	}
+	void idle() {
+		const uint64_t since = busy_since_ns.exchange(0, std::memory_order_relaxed);
+		if (since != 0 && since == reported_since_ns.load(std::memory_order_relaxed)) {
+			stall_ended(since);
+		}
+	}
+
+	/* Slots are the telemetry's */
+	void add_output(int32_t slot, const char* name);
+	void remove_output(int32_t slot);
+	void output_frame(int32_t slot);
+};
+
+#endif
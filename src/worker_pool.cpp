@@ -0,0 +1,121 @@
+#include "worker_pool.hpp"
+
+#include "server.hpp"
+#include "types.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/util/log.h>
+#include "wlr-wrap-end.hpp"
+
+static int worker_pool_event_notify(int fd, uint32_t mask, void* data) {
+	auto& pool = *static_cast<WorkerPool*>(data);
+	(void) mask;
+
+	uint64_t count = 0;
+	if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+		wlr_log_errno(WLR_ERROR, "Failed to read worker pool eventfd");
+	}
+
+	pool.dispatch_completed();
+	return 0;
+}
+
+WorkerPool::WorkerPool(Server& server, const uint32_t thread_count) noexcept : server(server) {
+	event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (event_fd < 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to create worker pool eventfd, running work inline");
+		return;
+	}
+
+	event_source = wl_event_loop_add_fd(
+		wl_display_get_event_loop(server.display), event_fd, WL_EVENT_READABLE, worker_pool_event_notify, this);
+
+	for (uint32_t i = 0; i < thread_count; i++) {
+		threads.emplace_back(&WorkerPool::worker_main, this);
+	}
+}
+
+WorkerPool::~WorkerPool() noexcept {
+	{
+		const std::lock_guard lock(queue_mutex);
+		stopping = true;
+	}
+	queue_cond.notify_all();
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	if (event_source != nullptr) {
+		wl_event_source_remove(event_source);
+	}
+	if (event_fd >= 0) {
+		close(event_fd);
+	}
+}
+
+void WorkerPool::worker_main() {
+	while (true) {
+		Job job;
+		{
+			std::unique_lock lock(queue_mutex);
+			queue_cond.wait(lock, [this] {
+				return stopping || !queue.empty();
+			});
+			if (stopping) {
+				return;
+			}
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		job.work();
+
+		if (job.done) {
+			{
+				const std::lock_guard lock(completed_mutex);
+				completed.push_back(std::move(job.done));
+			}
+
+			const uint64_t one = 1;
+			if (write(event_fd, &one, sizeof(one)) < 0) {
+				/* Nothing sensible to do off the main thread, the completion
+				 * still runs with the next one that gets through. */
+			}
+		}
+	}
+}
+
+void WorkerPool::submit(std::function<void()> work, std::function<void()> done) {
+	if (threads.empty()) {
+		work();
+		if (done) {
+			done();
+		}
+		return;
+	}
+
+	{
+		const std::lock_guard lock(queue_mutex);
+		queue.push_back({std::move(work), std::move(done)});
+	}
+	queue_cond.notify_one();
+}
+
+/* Runs the completion functions of finished jobs, on the main thread. */
+void WorkerPool::dispatch_completed() {
+	std::vector<std::function<void()>> batch;
+	{
+		const std::lock_guard lock(completed_mutex);
+		batch.swap(completed);
+	}
+
+	for (auto& done : batch) {
+		done();
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef MAGPIE_WORKER_POOL_HPP
+#define MAGPIE_WORKER_POOL_HPP
+
+#include "types.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <wayland-server-core.h>
+
+/* Runs blocking setup work (file IO, keymap compilation, X11 round trips) off
+ * the main thread, and hands the results back through the event loop.
+ *
+ * The rule: work functions run on a worker thread and must not touch any
+ * wlroots or Wayland object, nor any compositor state. Everything they need
+ * is captured by value, and everything they produce is returned. Completion
+ * functions run on the main thread from the event loop, and are the only
+ * place where the result may be applied. */
+class WorkerPool {
+	struct Job {
+		std::function<void()> work;
+		std::function<void()> done;
+	};
+
+	std::mutex queue_mutex;
+	std::condition_variable queue_cond;
+	std::deque<Job> queue;
+	bool stopping = false;
+
+	std::mutex completed_mutex;
+	std::vector<std::function<void()>> completed;
+
+	std::vector<std::thread> threads;
+	int event_fd;
+	wl_event_source* event_source = nullptr;
+
+	void worker_main();
+
+  public:
+	Server& server;
+
+	WorkerPool(Server& server, uint32_t thread_count) noexcept;
+	~WorkerPool() noexcept;
+
+	void submit(std::function<void()> work, std::function<void()> done = {});
+	void dispatch_completed();
+
+	/* Runs work on a worker and passes its return value to done on the main
+	 * thread. */
+	template <typename Result, typename Work, typename Done>
+	void submit(Work work, Done done) {
+		auto result = std::make_shared<std::optional<Result>>();
+		submit(
+			[result, work = std::move(work)]() mutable {
+				result->emplace(work());
+			},
+			[result, done = std::move(done)]() mutable {
+				done(std::move(result->value()));
+			});
+	}
+};
+
+#endif
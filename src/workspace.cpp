@@ -0,0 +1,37 @@
+#include "workspace.hpp"
+
+#include "server.hpp"
+#include "surface/view.hpp"
+#include "types.hpp"
+
+#include <utility>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_scene.h>
+#include "wlr-wrap-end.hpp"
+
+Workspace::Workspace(Server& server, wlr_scene_tree& parent, const uint32_t index) noexcept
+	: server(server), index(index), stack(server, parent) {
+	wlr_scene_node_set_enabled(&stack.tree->node, false);
+}
+
+void Workspace::set_active(const bool active) {
+	wlr_scene_node_set_enabled(&stack.tree->node, active);
+
+	if (active) {
+		/* The X11 stack only mirrors one workspace at a time */
+		stack.schedule_full_restack();
+	}
+}
+
+/* Returns the topmost view that can take focus, if any. */
+View* Workspace::top_view() const {
+	for (auto it = stack.order.rbegin(); it != stack.order.rend(); ++it) {
+		View* view = *it;
+		if (!view->is_minimized && view->scene_node != nullptr && view->scene_node->enabled) {
+			return view;
+		}
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,31 @@
+#ifndef MAGPIE_WORKSPACE_HPP
+#define MAGPIE_WORKSPACE_HPP
+
+#include "stack.hpp"
+#include "types.hpp"
+
+#include <cstdint>
+
+#include "wlr-wrap-start.hpp"
+#include <wlr/types/wlr_scene.h>
+#include "wlr-wrap-end.hpp"
+
+static constexpr uint32_t MAGPIE_WORKSPACE_COUNT = 4;
+
+/* A virtual desktop. Each workspace keeps its views in its own stack, whose
+ * scene tree is the only thing toggled when switching, so switching costs the
+ * same no matter how many views there are. Views on a disabled tree are not
+ * rendered and get no frame callbacks. */
+class Workspace {
+  public:
+	Server& server;
+	uint32_t index;
+	Stack stack;
+
+	Workspace(Server& server, wlr_scene_tree& parent, uint32_t index) noexcept;
+
+	void set_active(bool active);
+	[[nodiscard]] View* top_view() const;
+};
+
+#endif
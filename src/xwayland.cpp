@@ -4,11 +4,26 @@
 #include "server.hpp"
 #include "types.hpp"
 #include "surface/view.hpp"
+#include "task.hpp"
+#include "worker_pool.hpp"
+#include "workspace.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <utility>
 
 #include "wlr-wrap-start.hpp"
 #include <wlr/util/log.h>
 #include "wlr-wrap-end.hpp"
 
+/* The actions of a _NET_WM_STATE client message */
+static constexpr uint32_t NET_WM_STATE_ACTION_ADD = 1;
+static constexpr uint32_t NET_WM_STATE_ACTION_TOGGLE = 2;
+
 static const char* atom_map[ATOM_LAST] = {
 	"_NET_WM_WINDOW_TYPE_NORMAL",
 	"_NET_WM_WINDOW_TYPE_DIALOG",
@@ -20,19 +35,28 @@ static const char* atom_map[ATOM_LAST] = {
 	"_NET_WM_WINDOW_TYPE_POPUP_MENU",
 	"_NET_WM_WINDOW_TYPE_TOOLTIP",
 	"_NET_WM_WINDOW_TYPE_NOTIFICATION",
+	"_NET_WM_STATE",
 	"_NET_WM_STATE_MODAL",
+	"_NET_WM_STATE_ABOVE",
+	"_NET_WM_STATE_BELOW",
 };
 
-static void ready_notify(wl_listener* listener, void* data) {
-	XWayland& xwayland = magpie_container_of(listener, xwayland, ready);
-	(void) data;
+/* Result of connecting and resolving the atoms on a worker, since connecting
+ * to the X server and waiting on the replies blocks. */
+struct AtomLookup {
+	xcb_connection_t* connection = nullptr;
+	xcb_atom_t atoms[ATOM_LAST] = {};
+	std::string error;
+};
 
-	wlr_xwayland_set_seat(xwayland.wlr, xwayland.server.seat->wlr);
+static AtomLookup lookup_atoms(const std::string& display_name) {
+	AtomLookup lookup;
 
-	xcb_connection_t* xcb_conn = xcb_connect(nullptr, nullptr);
+	xcb_connection_t* xcb_conn = xcb_connect(display_name.c_str(), nullptr);
 	if (const int err = xcb_connection_has_error(xcb_conn)) {
-		wlr_log(WLR_ERROR, "XCB connect failed: %d", err);
-		return;
+		lookup.error = "XCB connect failed: " + std::to_string(err);
+		xcb_disconnect(xcb_conn);
+		return lookup;
 	}
 
 	xcb_intern_atom_cookie_t cookies[ATOM_LAST];
@@ -43,18 +67,69 @@ static void ready_notify(wl_listener* listener, void* data) {
 		xcb_generic_error_t* error = nullptr;
 		xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply(xcb_conn, cookies[i], &error);
 		if (reply != nullptr && error == nullptr) {
-			xwayland.atoms[i] = reply->atom;
+			lookup.atoms[i] = reply->atom;
 		}
 		free(reply);
 
 		if (error != nullptr) {
-			wlr_log(WLR_ERROR, "could not resolve atom %s: X11 error code %d", atom_map[i], error->error_code);
+			lookup.error = std::string("could not resolve atom ") + atom_map[i] +
+						   ": X11 error code " + std::to_string(error->error_code);
 			free(error);
 			break;
 		}
 	}
+	if (!lookup.error.empty()) {
+		xcb_disconnect(xcb_conn);
+		return lookup;
+	}
+
+	/* _NET_WM_STATE changes of mapped windows are client messages to the
+	 * root window, which the xwm gets first but anyone can listen to */
+	const xcb_screen_t* screen = xcb_setup_roots_iterator(xcb_get_setup(xcb_conn)).data;
+	const uint32_t event_mask = XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY;
+	xcb_change_window_attributes(xcb_conn, screen->root, XCB_CW_EVENT_MASK, &event_mask);
+	xcb_flush(xcb_conn);
+
+	lookup.connection = xcb_conn;
+	return lookup;
+}
 
-	xcb_disconnect(xcb_conn);
+/* Runs for the lifetime of the compositor. The X server is started lazily and
+ * restarted if it goes away, and the connection is made again each time it
+ * becomes ready. */
+static Task xwayland_ready_loop(XWayland& xwayland) {
+	while (true) {
+		co_await SignalAwaiter(xwayland.wlr->events.ready);
+
+		wlr_xwayland_set_seat(xwayland.wlr, xwayland.server.seat->wlr);
+
+		const std::string display_name = xwayland.wlr->display_name;
+		const AtomLookup lookup = co_await WorkerAwaiter<AtomLookup>(*xwayland.server.workers, [display_name] {
+			return lookup_atoms(display_name);
+		});
+
+		if (!lookup.error.empty()) {
+			wlr_log(WLR_ERROR, "%s", lookup.error.c_str());
+		}
+		std::copy(std::begin(lookup.atoms), std::end(lookup.atoms), std::begin(xwayland.atoms));
+		xwayland.set_connection(lookup.connection);
+	}
+}
+
+static int xwayland_xcb_notify(const int fd, const uint32_t mask, void* data) {
+	(void) fd;
+	auto& xwayland = *static_cast<XWayland*>(data);
+
+	if ((mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) != 0) {
+		xwayland.set_connection(nullptr);
+		return 0;
+	}
+	xwayland.handle_events();
+	return 0;
+}
+
+static void xwayland_xcb_idle(void* data) {
+	static_cast<XWayland*>(data)->handle_queued_events();
 }
 
 static void new_surface_notify(wl_listener* listener, void* data) {
@@ -67,10 +142,133 @@ static void new_surface_notify(wl_listener* listener, void* data) {
 XWayland::XWayland(Server& server) noexcept : listeners(*this), server(server) {
 	wlr = wlr_xwayland_create(server.display, server.compositor, true);
 
-	listeners.ready.notify = ready_notify;
-	wl_signal_add(&wlr->events.ready, &listeners.ready);
 	listeners.new_surface.notify = new_surface_notify;
 	wl_signal_add(&wlr->events.new_surface, &listeners.new_surface);
 
 	setenv("DISPLAY", wlr->display_name, true);
+
+	xwayland_ready_loop(*this);
+}
+
+void XWayland::set_connection(xcb_connection_t* connection) {
+	if (xcb_idle != nullptr) {
+		wl_event_source_remove(xcb_idle);
+		xcb_idle = nullptr;
+	}
+	if (xcb_source != nullptr) {
+		wl_event_source_remove(xcb_source);
+		xcb_source = nullptr;
+	}
+	if (xcb_conn != nullptr) {
+		xcb_disconnect(xcb_conn);
+	}
+
+	xcb_conn = connection;
+	if (xcb_conn != nullptr) {
+		xcb_source = wl_event_loop_add_fd(wl_display_get_event_loop(server.display), xcb_get_file_descriptor(xcb_conn),
+			WL_EVENT_READABLE, xwayland_xcb_notify, this);
+	}
+}
+
+/* Only client messages are of interest, the rest of what selecting on the
+ * root window brings is dropped */
+void XWayland::handle_events() {
+	if (xcb_conn == nullptr) {
+		return;
+	}
+
+	while (xcb_generic_event_t* event = xcb_poll_for_event(xcb_conn)) {
+		if ((event->response_type & ~0x80) == XCB_CLIENT_MESSAGE) {
+			window_state_changed(*reinterpret_cast<const xcb_client_message_event_t*>(event));
+		}
+		free(event);
+	}
+	if (xcb_connection_has_error(xcb_conn) != 0) {
+		wlr_log(WLR_ERROR, "Lost our connection to the X server");
+		set_connection(nullptr);
+	}
+}
+
+/* The idle source is gone once it has run */
+void XWayland::handle_queued_events() {
+	xcb_idle = nullptr;
+	handle_events();
+}
+
+/* _NET_WM_STATE requests from the EWMH: an action to remove, add or toggle,
+ * then up to two states */
+void XWayland::window_state_changed(const xcb_client_message_event_t& event) {
+	if (event.type != atoms[NET_WM_STATE] || event.format != 32) {
+		return;
+	}
+
+	XWaylandView* view = nullptr;
+	for (View* candidate : std::as_const(server.views)) {
+		auto* xwayland_view = dynamic_cast<XWaylandView*>(candidate);
+		if (xwayland_view != nullptr && xwayland_view->xwayland_surface.window_id == event.window) {
+			view = xwayland_view;
+			break;
+		}
+	}
+	if (view == nullptr) {
+		return;
+	}
+
+	const uint32_t action = event.data.data32[0];
+	ViewBand band = view->band;
+	for (const uint32_t state : {event.data.data32[1], event.data.data32[2]}) {
+		ViewBand requested;
+		if (state != 0 && state == atoms[NET_WM_STATE_ABOVE]) {
+			requested = VIEW_BAND_ABOVE;
+		} else if (state != 0 && state == atoms[NET_WM_STATE_BELOW]) {
+			requested = VIEW_BAND_BELOW;
+		} else {
+			continue;
+		}
+
+		const bool set = action == NET_WM_STATE_ACTION_ADD || (action == NET_WM_STATE_ACTION_TOGGLE && band != requested);
+		if (set) {
+			band = requested;
+		} else if (band == requested) {
+			band = VIEW_BAND_NORMAL;
+		}
+	}
+
+	if (view->scene_node != nullptr && view->workspace != nullptr) {
+		view->workspace->stack.set_band(*view, band);
+	} else {
+		view->band = band;
+	}
+}
+
+/* wlroots does not track _NET_WM_STATE_ABOVE and _BELOW. The property is read
+ * the way the xwm reads the properties it does track, waiting on the reply,
+ * so the band is known before the window is first stacked. */
+ViewBand XWayland::read_band(const xcb_window_t window) {
+	if (xcb_conn == nullptr || atoms[NET_WM_STATE] == 0) {
+		return VIEW_BAND_NORMAL;
+	}
+
+	ViewBand band = VIEW_BAND_NORMAL;
+	const xcb_get_property_cookie_t cookie = xcb_get_property(xcb_conn, 0, window, atoms[NET_WM_STATE], XCB_ATOM_ATOM, 0, 32);
+	xcb_get_property_reply_t* reply = xcb_get_property_reply(xcb_conn, cookie, nullptr);
+	if (reply != nullptr && reply->type == XCB_ATOM_ATOM && reply->format == 32) {
+		const auto* states = static_cast<const xcb_atom_t*>(xcb_get_property_value(reply));
+		const int count = xcb_get_property_value_length(reply) / static_cast<int>(sizeof(xcb_atom_t));
+		for (int i = 0; i < count; i++) {
+			if (states[i] == atoms[NET_WM_STATE_ABOVE]) {
+				band = VIEW_BAND_ABOVE;
+			} else if (states[i] == atoms[NET_WM_STATE_BELOW]) {
+				band = VIEW_BAND_BELOW;
+			}
+		}
+	}
+	free(reply);
+
+	/* Waiting on the reply may have queued events without the fd becoming
+	 * readable again */
+	if (xcb_idle == nullptr) {
+		xcb_idle = wl_event_loop_add_idle(wl_display_get_event_loop(server.display), xwayland_xcb_idle, this);
+	}
+	return band;
 }
@@ -4,6 +4,7 @@
 #include "types.hpp"
 
 #include <functional>
+#include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
 #include "wlr-wrap-start.hpp"
@@ -21,7 +22,10 @@ enum atom_name {
 	NET_WM_WINDOW_TYPE_POPUP_MENU,
 	NET_WM_WINDOW_TYPE_TOOLTIP,
 	NET_WM_WINDOW_TYPE_NOTIFICATION,
+	NET_WM_STATE,
 	NET_WM_STATE_MODAL,
+	NET_WM_STATE_ABOVE,
+	NET_WM_STATE_BELOW,
 	ATOM_LAST,
 };
 
@@ -29,13 +33,18 @@ class XWayland {
   public:
 	struct Listeners {
 		std::reference_wrapper<XWayland> parent;
-		wl_listener ready = {};
 		wl_listener new_surface = {};
 		explicit Listeners(XWayland& parent) noexcept : parent(parent) {}
 	};
 
   private:
 	Listeners listeners;
+	/* Our own connection to the X server, for what wlroots does not track */
+	xcb_connection_t* xcb_conn = nullptr;
+	wl_event_source* xcb_source = nullptr;
+	wl_event_source* xcb_idle = nullptr;
+
+	void window_state_changed(const xcb_client_message_event_t& event);
 
   public:
 	Server& server;
@@ -43,6 +52,11 @@ class XWayland {
 	xcb_atom_t atoms[ATOM_LAST] = {};
 
 	explicit XWayland(Server& server) noexcept;
+
+	void set_connection(xcb_connection_t* connection);
+	void handle_events();
+	void handle_queued_events();
+	[[nodiscard]] ViewBand read_band(xcb_window_t window);
 };
 
 #endif
@@ -0,0 +1,143 @@
+#include "flight_recorder.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/* Prints a dump of the flight recorder, one message per line in the style of
+ * WAYLAND_DEBUG: requests as they are, events after an arrow. Times are
+ * relative to the dump. */
+
+static bool read_file(const char* path, std::vector<char>& contents) {
+	FILE* file = std::fopen(path, "rb");
+	if (file == nullptr) {
+		std::fprintf(stderr, "%s: %s\n", path, std::strerror(errno));
+		return false;
+	}
+
+	char buffer[64 * 1024];
+	size_t read;
+	while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		contents.insert(contents.end(), buffer, buffer + read);
+	}
+	std::fclose(file);
+	return true;
+}
+
+/* Reads the next thing in the dump, false once it ran short */
+struct DumpReader {
+	const std::vector<char>& contents;
+	size_t offset = 0;
+
+	explicit DumpReader(const std::vector<char>& contents) noexcept : contents(contents) {}
+
+	template <typename T>
+	bool read(T& value) {
+		if (contents.size() - offset < sizeof(T)) {
+			return false;
+		}
+		std::memcpy(&value, contents.data() + offset, sizeof(T));
+		offset += sizeof(T);
+		return true;
+	}
+
+	bool read_string(std::string& string) {
+		uint32_t length = 0;
+		if (!read(length) || contents.size() - offset < length) {
+			return false;
+		}
+		string.assign(contents.data() + offset, length);
+		offset += length;
+		return true;
+	}
+};
+
+static void usage(const char* name) {
+	std::fprintf(stderr, "Usage: %s [-p pid] dump\n", name);
+}
+
+int main(const int argc, char** argv) {
+	pid_t only_pid = 0;
+	int c;
+	while ((c = getopt(argc, argv, "p:h")) != -1) {
+		switch (c) {
+			case 'p':
+				only_pid = static_cast<pid_t>(std::strtol(optarg, nullptr, 10));
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (optind + 1 != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char* path = argv[optind];
+	std::vector<char> contents;
+	if (!read_file(path, contents)) {
+		return 1;
+	}
+
+	DumpReader reader(contents);
+	FlightRecordingHeader header = {};
+	if (!reader.read(header) || header.magic != MAGPIE_FLIGHT_RECORDING_MAGIC ||
+		header.version != MAGPIE_FLIGHT_RECORDING_VERSION) {
+		std::fprintf(stderr, "%s is not a flight recorder dump this version can read\n", path);
+		return 1;
+	}
+
+	std::vector<std::string> names(header.names);
+	for (auto& name : names) {
+		if (!reader.read_string(name)) {
+			std::fprintf(stderr, "%s is truncated\n", path);
+			return 1;
+		}
+	}
+	const auto name = [&names](const uint32_t index) {
+		return index < names.size() ? names[index].c_str() : "?";
+	};
+
+	for (uint32_t i = 0; i < header.clients; i++) {
+		FlightRecordingClient client = {};
+		if (!reader.read(client)) {
+			std::fprintf(stderr, "%s is truncated\n", path);
+			return 1;
+		}
+
+		const bool shown = only_pid == 0 || client.pid == only_pid;
+		if (shown) {
+			client.command[sizeof(client.command) - 1] = '\0';
+			std::printf("client %u, pid %d (%s), connected %.3f s before the dump%s, %lu messages", client.id, client.pid,
+				client.command[0] != '\0' ? client.command : "unknown",
+				static_cast<double>(header.dump_ns - client.connect_ns) / 1e9,
+				client.connected != 0 ? "" : " and gone since", static_cast<unsigned long>(client.total));
+			if (client.total > client.messages) {
+				std::printf(", the last %u", client.messages);
+			}
+			std::printf(":\n");
+		}
+
+		for (uint32_t j = 0; j < client.messages; j++) {
+			FlightRecordingMessage message = {};
+			if (!reader.read(message)) {
+				std::fprintf(stderr, "%s is truncated\n", path);
+				return 1;
+			}
+			if (!shown) {
+				continue;
+			}
+
+			const double ago_ms = (static_cast<double>(message.time_ns) - static_cast<double>(header.dump_ns)) / 1e6;
+			std::printf("  %12.3f ms  %s%s@%u.%s\n", ago_ms, message.type == WL_PROTOCOL_LOGGER_EVENT ? "-> " : "",
+				name(message.interface), message.object_id, name(message.message));
+		}
+	}
+
+	return 0;
+}